@@ -9,6 +9,9 @@
 #endif
 
 #include "THAtomic.h"
+#include "THThreadPool.h"
+#include "THProfile.h"
+#include "THAutotune.h"
 #include "THVector.h"
 #include "THLogAdd.h"
 #include "THRandom.h"
@@ -20,5 +23,6 @@
 #include "THFile.h"
 #include "THDiskFile.h"
 #include "THMemoryFile.h"
+#include "THTensorStream.h"
 
 #endif
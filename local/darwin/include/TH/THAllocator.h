@@ -28,4 +28,55 @@ void THMapAllocatorContext_free(THMapAllocatorContext *ctx);
 
 extern THAllocator THMapAllocator;
 
+/* growable mapping allocator
+ * Blocks are shared mappings of filename (created if needed, its size
+ * following the block), or private anonymous mappings if filename is NULL.
+ * realloc grows the file and the mapping in place with mremap where
+ * available, instead of allocating and copying. One block per context; free
+ * unmaps it and frees the context.
+ */
+typedef struct THRemapAllocatorContext_ THRemapAllocatorContext;
+TH_API THRemapAllocatorContext *THRemapAllocatorContext_new(const char *filename);
+TH_API void THRemapAllocatorContext_free(THRemapAllocatorContext *ctx);
+
+extern THAllocator THRemapAllocator;
+
+/* NUMA aware allocator
+ *  TH_NUMA_DEFAULT:    no policy, pages land where they are first touched
+ *  TH_NUMA_LOCAL:      pages land on the node of the thread touching them
+ *  TH_NUMA_INTERLEAVE: pages are spread round-robin over the given nodes
+ *  TH_NUMA_BIND:       pages are restricted to the given nodes
+ * Large blocks are mapped page-aligned so that the policy covers them
+ * entirely; small blocks go through THAlloc. On systems without NUMA
+ * support the policy is ignored.
+ */
+#define TH_NUMA_DEFAULT 0
+#define TH_NUMA_LOCAL 1
+#define TH_NUMA_INTERLEAVE 2
+#define TH_NUMA_BIND 3
+
+typedef struct THNumaAllocatorContext_ THNumaAllocatorContext;
+/* nodes == NULL or nnodes <= 0 selects all nodes */
+TH_API THNumaAllocatorContext *THNumaAllocatorContext_new(int policy, const int *nodes, int nnodes);
+TH_API void THNumaAllocatorContext_free(THNumaAllocatorContext *ctx);
+
+/* a NULL context uses the process-wide policy below */
+extern THAllocator THNumaAllocator;
+
+/* process-wide policy; anything but TH_NUMA_DEFAULT makes
+ * THStorage_(newWithSize) allocate through THNumaAllocator
+ */
+TH_API void THNuma_setPolicy(int policy, const int *nodes, int nnodes);
+TH_API int THNuma_getPolicy(void);
+
+TH_API int THNuma_isAvailable(void);
+TH_API int THNuma_numNodes(void);
+TH_API long THNuma_pageSize(void);
+
+/* node holding each page of [ptr, ptr+size); -1 for pages not yet touched
+ * (or when unknown). Fills at most maxPages entries, returns the number of
+ * pages spanned by the range.
+ */
+TH_API long THNuma_pageNodes(const void *ptr, long size, int *nodes, long maxPages);
+
 #endif
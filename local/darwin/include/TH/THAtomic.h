@@ -81,4 +81,70 @@ TH_API long THAtomicAddLong(long volatile *a, long value);
 */
 TH_API long THAtomicCompareAndSwapLong(long volatile *a, long oldvalue, long newvalue);
 
+
+/******************************************************************************
+ * inline refcounting
+ *  The refcounting functions above, inlined: with the GCC __atomic builtins
+ *  (GCC >= 4.7, clang), else C11 atomics, else a call to the functions
+ *  above. Linux builds always get one of the first two. Increments are
+ *  relaxed and decrements acquire-release, as a reference count needs.
+ *  TH_ATOMIC_INLINE_BACKEND names the backend: "gcc", "c11" or "call".
+ ******************************************************************************/
+
+#if defined(__GNUC__) && defined(__ATOMIC_RELAXED)
+# define TH_ATOMIC_INLINE_GCC
+# define TH_ATOMIC_INLINE_BACKEND "gcc"
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+# include <stdatomic.h>
+# define TH_ATOMIC_INLINE_C11
+# define TH_ATOMIC_INLINE_BACKEND "c11"
+#elif defined(__linux__)
+# error "TH needs the GCC __atomic builtins or C11 atomics on Linux"
+#else
+# define TH_ATOMIC_INLINE_BACKEND "call"
+#endif
+
+/*
+ * return *a
+*/
+static inline int THAtomicGetInline(int volatile *a)
+{
+#if defined(TH_ATOMIC_INLINE_GCC)
+  return __atomic_load_n(a, __ATOMIC_ACQUIRE);
+#elif defined(TH_ATOMIC_INLINE_C11)
+  return atomic_load_explicit((_Atomic int volatile *)a, memory_order_acquire);
+#else
+  return THAtomicGet(a);
+#endif
+}
+
+/*
+ * *a++
+*/
+static inline void THAtomicIncrementRefInline(int volatile *a)
+{
+#if defined(TH_ATOMIC_INLINE_GCC)
+  __atomic_fetch_add(a, 1, __ATOMIC_RELAXED);
+#elif defined(TH_ATOMIC_INLINE_C11)
+  atomic_fetch_add_explicit((_Atomic int volatile *)a, 1, memory_order_relaxed);
+#else
+  THAtomicIncrementRef(a);
+#endif
+}
+
+/*
+ * *a--,
+ * return 1 if *a == 0 after the operation, 0 otherwise
+*/
+static inline int THAtomicDecrementRefInline(int volatile *a)
+{
+#if defined(TH_ATOMIC_INLINE_GCC)
+  return __atomic_sub_fetch(a, 1, __ATOMIC_ACQ_REL) == 0;
+#elif defined(TH_ATOMIC_INLINE_C11)
+  return atomic_fetch_sub_explicit((_Atomic int volatile *)a, 1, memory_order_acq_rel) == 1;
+#else
+  return THAtomicDecrementRef(a);
+#endif
+}
+
 #endif
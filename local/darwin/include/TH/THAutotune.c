@@ -0,0 +1,322 @@
+#include "THAutotune.h"
+#include "THThreadPool.h"
+#include "THProfile.h"
+
+#if defined(_WIN32) || defined(TH_NO_THREADS)
+# define TH_AUTOTUNE_SERIAL
+#else
+# include <pthread.h>
+#endif
+
+typedef struct THAutotuneEntry
+{
+  char key[TH_AUTOTUNE_KEY_SIZE];  /* empty: free slot */
+  int choice;                      /* -1 while on trial */
+  int nCandidates;
+  int next;                        /* next candidate to time */
+  int runs[TH_AUTOTUNE_MAX_CANDIDATES];
+  double best[TH_AUTOTUNE_MAX_CANDIDATES];
+} THAutotuneEntry;
+
+/* open addressing, linear probing; capacity is a power of two */
+static struct
+{
+  THAutotuneEntry *entries;
+  long capacity;
+  long count;
+  int mode;
+  char *path;
+} th_autotune = { NULL, 0, 0, TH_AUTOTUNE_OFF, NULL };
+
+#ifndef TH_AUTOTUNE_SERIAL
+static pthread_mutex_t th_autotune_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t th_autotune_once = PTHREAD_ONCE_INIT;
+# define TH_AUTOTUNE_LOCK() pthread_mutex_lock(&th_autotune_mutex)
+# define TH_AUTOTUNE_UNLOCK() pthread_mutex_unlock(&th_autotune_mutex)
+#else
+static int th_autotune_once = 0;
+# define TH_AUTOTUNE_LOCK()
+# define TH_AUTOTUNE_UNLOCK()
+#endif
+
+static unsigned long THAutotune_hash(const char *key)
+{
+  unsigned long h = 14695981039346656037UL;
+  for(; *key; key++)
+    h = (h ^ (unsigned char)*key) * 1099511628211UL;
+  return h;
+}
+
+/* slot of key, inserted if absent (lock held) */
+static THAutotuneEntry *THAutotune_slot(const char *key, int insert)
+{
+  long i;
+
+  if(th_autotune.capacity == 0 || (insert && 2*(th_autotune.count+1) > th_autotune.capacity))
+  {
+    THAutotuneEntry *old = th_autotune.entries;
+    long oldCapacity = th_autotune.capacity;
+    long capacity = THMax(64, 2*oldCapacity);
+    if(!insert)
+      return NULL;
+    th_autotune.entries = calloc(capacity, sizeof(THAutotuneEntry));
+    if(!th_autotune.entries)
+    {
+      th_autotune.entries = old;
+      return NULL;
+    }
+    th_autotune.capacity = capacity;
+    for(i = 0; i < oldCapacity; i++)
+    {
+      if(old[i].key[0])
+      {
+        long j = THAutotune_hash(old[i].key) & (capacity-1);
+        while(th_autotune.entries[j].key[0])
+          j = (j+1) & (capacity-1);
+        th_autotune.entries[j] = old[i];
+      }
+    }
+    free(old);
+  }
+
+  i = THAutotune_hash(key) & (th_autotune.capacity-1);
+  while(th_autotune.entries[i].key[0])
+  {
+    if(!strcmp(th_autotune.entries[i].key, key))
+      return &th_autotune.entries[i];
+    i = (i+1) & (th_autotune.capacity-1);
+  }
+  if(!insert)
+    return NULL;
+
+  strncpy(th_autotune.entries[i].key, key, TH_AUTOTUNE_KEY_SIZE-1);
+  th_autotune.entries[i].choice = -1;
+  th_autotune.count++;
+  return &th_autotune.entries[i];
+}
+
+/* lines "key choice"; '#' starts a comment line (lock held) */
+static void THAutotune_load(const char *path)
+{
+  char line[TH_AUTOTUNE_KEY_SIZE+32];
+  char key[TH_AUTOTUNE_KEY_SIZE];
+  FILE *f = fopen(path, "r");
+  if(!f)
+    return;
+  while(fgets(line, sizeof(line), f))
+  {
+    int choice;
+    THAutotuneEntry *entry;
+    if(line[0] == '#' || sscanf(line, "%127s %d", key, &choice) != 2 || choice < 0)
+      continue;
+    entry = THAutotune_slot(key, 1);
+    if(entry)
+      entry->choice = choice;
+  }
+  fclose(f);
+}
+
+/* errors are ignored: this may run on a pool worker (lock held) */
+static void THAutotune_save(const char *key, int choice)
+{
+  FILE *f;
+  if(!th_autotune.path)
+    return;
+  f = fopen(th_autotune.path, "a");
+  if(!f)
+    return;
+  fprintf(f, "%s %d\n", key, choice);
+  fclose(f);
+}
+
+static void THAutotune_setPath(const char *path)
+{
+  free(th_autotune.path);
+  th_autotune.path = NULL;
+  if(path && *path)
+  {
+    th_autotune.path = malloc(strlen(path)+1);
+    if(th_autotune.path)
+    {
+      strcpy(th_autotune.path, path);
+      THAutotune_load(path);
+    }
+  }
+}
+
+static void THAutotune_initOnce(void)
+{
+  const char *mode = getenv("TH_AUTOTUNE");
+  if(mode)
+    th_autotune.mode = THMax(TH_AUTOTUNE_OFF, THMin(TH_AUTOTUNE_ON, atoi(mode)));
+  THAutotune_setPath(getenv("TH_AUTOTUNE_CACHE"));
+}
+
+static void THAutotune_init(void)
+{
+#ifndef TH_AUTOTUNE_SERIAL
+  pthread_once(&th_autotune_once, THAutotune_initOnce);
+#else
+  if(!th_autotune_once)
+  {
+    th_autotune_once = 1;
+    THAutotune_initOnce();
+  }
+#endif
+}
+
+void THAutotune_setMode(int mode)
+{
+  THArgCheck(mode >= TH_AUTOTUNE_OFF && mode <= TH_AUTOTUNE_ON, 1, "unknown autotuning mode");
+  THAutotune_init();
+  th_autotune.mode = mode;
+}
+
+int THAutotune_getMode(void)
+{
+  THAutotune_init();
+  return th_autotune.mode;
+}
+
+void THAutotune_setCacheFile(const char *path)
+{
+  THAutotune_init();
+  TH_AUTOTUNE_LOCK();
+  THAutotune_setPath(path);
+  TH_AUTOTUNE_UNLOCK();
+}
+
+void THAutotune_clear(void)
+{
+  THAutotune_init();
+  TH_AUTOTUNE_LOCK();
+  free(th_autotune.entries);
+  th_autotune.entries = NULL;
+  th_autotune.capacity = 0;
+  th_autotune.count = 0;
+  TH_AUTOTUNE_UNLOCK();
+}
+
+int THAutotune_lookup(const char *key)
+{
+  THAutotuneEntry *entry;
+  int choice;
+  THAutotune_init();
+  TH_AUTOTUNE_LOCK();
+  entry = THAutotune_slot(key, 0);
+  choice = (entry ? entry->choice : -1);
+  TH_AUTOTUNE_UNLOCK();
+  return choice;
+}
+
+void THAutotune_record(const char *key, int choice)
+{
+  THAutotuneEntry *entry;
+  THArgCheck(choice >= 0, 2, "invalid choice");
+  THAutotune_init();
+  TH_AUTOTUNE_LOCK();
+  entry = THAutotune_slot(key, 1);
+  if(entry)
+    entry->choice = choice;
+  THAutotune_save(key, choice);
+  TH_AUTOTUNE_UNLOCK();
+}
+
+void THAutotune_makeKey(char *key, const char *op, const char *type,
+                        const long *dims, int nDims, int layout, int bucket)
+{
+  int len, d;
+
+  len = snprintf(key, TH_AUTOTUNE_KEY_SIZE, "%s:%s:", op, type);
+  for(d = 0; d < nDims && len < TH_AUTOTUNE_KEY_SIZE; d++)
+  {
+    long dim = dims[d];
+    if(bucket)
+    {
+      long p = 1;
+      while(p < dim)
+        p <<= 1;
+      dim = p;
+    }
+    len += snprintf(key+len, TH_AUTOTUNE_KEY_SIZE-len, (d == 0 ? "%ld" : "x%ld"), dim);
+  }
+  if(len < TH_AUTOTUNE_KEY_SIZE)
+    snprintf(key+len, TH_AUTOTUNE_KEY_SIZE-len, ":%d:t%d", layout, THThreadPool_getNumThreads());
+}
+
+int THAutotune_begin(THAutotuneTrial *trial, const char *key, int nCandidates, int fallback)
+{
+  THAutotuneEntry *entry;
+  int choice = fallback;
+
+  trial->candidate = -1;
+  THAutotune_init();
+  if(th_autotune.mode == TH_AUTOTUNE_OFF || nCandidates <= 1)
+    return fallback;
+  nCandidates = THMin(nCandidates, TH_AUTOTUNE_MAX_CANDIDATES);
+
+  TH_AUTOTUNE_LOCK();
+  entry = THAutotune_slot(key, th_autotune.mode == TH_AUTOTUNE_ON);
+  if(entry && entry->choice >= 0)
+    choice = (entry->choice < nCandidates ? entry->choice : fallback);
+  else if(entry)
+  {
+    if(entry->nCandidates != nCandidates)
+    {
+      int c;
+      entry->nCandidates = nCandidates;
+      entry->next = 0;
+      for(c = 0; c < nCandidates; c++)
+      {
+        entry->runs[c] = 0;
+        entry->best[c] = 1e300;
+      }
+    }
+    choice = entry->next;
+    entry->next = (entry->next+1) % nCandidates;
+    strncpy(trial->key, key, TH_AUTOTUNE_KEY_SIZE-1);
+    trial->key[TH_AUTOTUNE_KEY_SIZE-1] = '\0';
+    trial->candidate = choice;
+  }
+  TH_AUTOTUNE_UNLOCK();
+
+  if(trial->candidate >= 0)
+    trial->start = THProfile_now();
+  return choice;
+}
+
+void THAutotune_end(THAutotuneTrial *trial)
+{
+  THAutotuneEntry *entry;
+  double elapsed;
+  int c;
+
+  if(trial->candidate < 0)
+    return;
+  elapsed = THProfile_now() - trial->start;
+
+  TH_AUTOTUNE_LOCK();
+  entry = THAutotune_slot(trial->key, 0);
+  /* the key may have been cleared, or decided by another thread */
+  if(entry && entry->choice < 0 && trial->candidate < entry->nCandidates)
+  {
+    int done = 1, winner = 0;
+    entry->runs[trial->candidate]++;
+    if(elapsed < entry->best[trial->candidate])
+      entry->best[trial->candidate] = elapsed;
+    for(c = 0; c < entry->nCandidates; c++)
+    {
+      if(entry->runs[c] < TH_AUTOTUNE_TRIALS)
+        done = 0;
+      if(entry->best[c] < entry->best[winner])
+        winner = c;
+    }
+    if(done)
+    {
+      entry->choice = winner;
+      THAutotune_save(entry->key, winner);
+    }
+  }
+  TH_AUTOTUNE_UNLOCK();
+  trial->candidate = -1;
+}
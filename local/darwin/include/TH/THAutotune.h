@@ -0,0 +1,70 @@
+#ifndef TH_AUTOTUNE_INC
+#define TH_AUTOTUNE_INC
+
+#include "THGeneral.h"
+
+/******************************************************************************
+ * Shape-keyed autotuning of kernel variants
+ *  - ops with several equivalent strategies name each call with a key (op,
+ *    type, shape, layout class and thread count) and ask which strategy to
+ *    run; the answer is the index of the fastest one for that key
+ *  - in TH_AUTOTUNE_ON mode, the first calls on an unknown key cycle through
+ *    the candidates on the real operands, TH_AUTOTUNE_TRIALS timed calls
+ *    each, then the fastest is kept (every candidate computes the same
+ *    result, so the caller does not notice)
+ *  - winners are appended to a cache file, loaded back on startup: later
+ *    runs use them from the first call
+ *  - TH_AUTOTUNE_CACHED only uses known winners; TH_AUTOTUNE_OFF (the
+ *    default) keeps the built-in heuristics
+ ******************************************************************************/
+
+#define TH_AUTOTUNE_OFF 0
+#define TH_AUTOTUNE_CACHED 1
+#define TH_AUTOTUNE_ON 2
+
+#define TH_AUTOTUNE_TRIALS 3
+#define TH_AUTOTUNE_MAX_CANDIDATES 8
+#define TH_AUTOTUNE_KEY_SIZE 128
+
+/*
+ * mode and cache file default to the TH_AUTOTUNE env variable (0, 1 or 2)
+ * and to the TH_AUTOTUNE_CACHE one (a path). Setting a cache file loads it
+ * if it exists, later lines overriding earlier ones; NULL keeps the winners
+ * in memory only.
+*/
+TH_API void THAutotune_setMode(int mode);
+TH_API int THAutotune_getMode(void);
+TH_API void THAutotune_setCacheFile(const char *path);
+
+/* forget all winners and running trials (the cache file is left alone) */
+TH_API void THAutotune_clear(void);
+
+/* winner of key, or -1 if unknown */
+TH_API int THAutotune_lookup(const char *key);
+/* sets the winner of key and appends it to the cache file */
+TH_API void THAutotune_record(const char *key, int choice);
+
+/*
+ * key "op:type:d0xd1x..:layout:tN" in key (TH_AUTOTUNE_KEY_SIZE bytes), N
+ * being the pool thread count. If bucket, each dim is rounded up to a power
+ * of two, so that close shapes share their winner.
+*/
+TH_API void THAutotune_makeKey(char *key, const char *op, const char *type,
+                               const long *dims, int nDims, int layout, int bucket);
+
+typedef struct THAutotuneTrial
+{
+  char key[TH_AUTOTUNE_KEY_SIZE];
+  int candidate;  /* -1 when the call is not timed */
+  double start;
+} THAutotuneTrial;
+
+/*
+ * candidate (in [0, nCandidates)) to run for key: the winner if known, a
+ * candidate on trial in TH_AUTOTUNE_ON mode, fallback otherwise. A call
+ * opened by begin must be closed by end once the candidate has run.
+*/
+TH_API int THAutotune_begin(THAutotuneTrial *trial, const char *key, int nCandidates, int fallback);
+TH_API void THAutotune_end(THAutotuneTrial *trial);
+
+#endif
@@ -0,0 +1,344 @@
+#include "TH.h"
+#include "THBenchmark.h"
+
+#if !defined(_WIN32) && !defined(TH_NO_THREADS)
+# include <pthread.h>
+# define TH_BENCHMARK_PTHREAD
+#endif
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+# include <stdatomic.h>
+# define TH_BENCHMARK_C11
+#endif
+
+typedef struct THBenchmarkContext
+{
+  const char *filter;
+  int repeat;
+  int threads;
+  FILE *output;
+  int failures;   /* accuracy checks above their bound */
+} THBenchmarkContext;
+
+static double th_benchmark_peakGFlops = -1;
+static double th_benchmark_peakGBs = -1;
+
+void THBenchmark_setPeak(double gflops, double gbs)
+{
+  th_benchmark_peakGFlops = gflops;
+  th_benchmark_peakGBs = gbs;
+}
+
+static void THBenchmark_initPeak(void)
+{
+  if(th_benchmark_peakGFlops < 0)
+  {
+    const char *env = getenv("TH_PEAK_GFLOPS");
+    th_benchmark_peakGFlops = (env ? atof(env) : 0);
+  }
+  if(th_benchmark_peakGBs < 0)
+  {
+    const char *env = getenv("TH_PEAK_GBS");
+    th_benchmark_peakGBs = (env ? atof(env) : 0);
+  }
+}
+
+static int THBenchmark_selected(THBenchmarkContext *ctx, const char *op)
+{
+  return !ctx->filter || strstr(op, ctx->filter) != NULL;
+}
+
+/* seconds: best time of one run; flops and bytes: work of one run */
+static void THBenchmark_report(THBenchmarkContext *ctx, const char *op, const char *type,
+                               const char *shape, const char *layout,
+                               double seconds, double flops, double bytes)
+{
+  double gflops = (seconds > 0 ? flops/seconds*1e-9 : 0);
+  double gbs = (seconds > 0 ? bytes/seconds*1e-9 : 0);
+
+  fprintf(ctx->output, "{\"op\": \"%s\", \"type\": \"%s\", \"shape\": \"%s\", \"layout\": \"%s\", \"threads\": %d, "
+          "\"time_us\": %.3f, \"gflops\": %.3f, \"gbs\": %.3f, ",
+          op, type, shape, layout, ctx->threads, seconds*1e6, gflops, gbs);
+  if(th_benchmark_peakGFlops > 0 && flops > 0)
+    fprintf(ctx->output, "\"peak_gflops\": %.4f, ", gflops/th_benchmark_peakGFlops);
+  else
+    fprintf(ctx->output, "\"peak_gflops\": null, ");
+  if(th_benchmark_peakGBs > 0)
+    fprintf(ctx->output, "\"peak_gbs\": %.4f}\n", gbs/th_benchmark_peakGBs);
+  else
+    fprintf(ctx->output, "\"peak_gbs\": null}\n");
+  fflush(ctx->output);
+}
+
+/* accuracy checks: relError of a result against a long double reference,
+   and the bound it must stay under */
+static void THBenchmark_reportError(THBenchmarkContext *ctx, const char *op, const char *type,
+                                    const char *shape, const char *layout,
+                                    double relError, double bound)
+{
+  fprintf(ctx->output, "{\"op\": \"%s\", \"type\": \"%s\", \"shape\": \"%s\", \"layout\": \"%s\", \"threads\": %d, "
+          "\"rel_error\": %.3e, \"bound\": %.3e, \"ok\": %s}\n",
+          op, type, shape, layout, ctx->threads, relError, bound, (relError <= bound ? "true" : "false"));
+  fflush(ctx->output);
+  if(!(relError <= bound))
+    ctx->failures++;
+}
+
+/* runs STMT once to warm up, then ctx->repeat times; SECONDS gets the best time */
+#define TH_BENCHMARK_TIME(ctx, SECONDS, STMT)           \
+  {                                                     \
+    int th_benchmark_r;                                 \
+    double th_benchmark_best = 1e300;                   \
+    STMT;                                               \
+    for(th_benchmark_r = 0; th_benchmark_r < (ctx)->repeat; th_benchmark_r++) \
+    {                                                   \
+      double th_benchmark_t = THProfile_now();          \
+      STMT;                                             \
+      th_benchmark_t = THProfile_now() - th_benchmark_t; \
+      if(th_benchmark_t < th_benchmark_best)            \
+        th_benchmark_best = th_benchmark_t;             \
+    }                                                   \
+    SECONDS = th_benchmark_best*1e-6;                   \
+  }
+
+/* fully connected and LSTM layers, square and skinny products */
+static const long th_benchmark_addmm_shapes[][3] = { /* M, N, K */
+  {64, 4096, 4096},
+  {32, 2048, 512},
+  {512, 512, 512},
+  {1, 4096, 4096},
+  {32, 32, 32}
+};
+
+/* early conv stages of small image nets */
+static const long th_benchmark_conv_shapes[][7] = { /* batch, nIn, H, W, nOut, kH, kW */
+  {16, 3, 32, 32, 16, 5, 5},
+  {16, 16, 14, 14, 32, 5, 5},
+  {8, 64, 28, 28, 64, 3, 3}
+};
+
+/* large (memory bound) and cache resident element-wise updates */
+static const long th_benchmark_vector_sizes[] = { 1L << 24, 1L << 16 };
+
+/* accumulation accuracy: from a partial lane to long sums of positive
+   values, where plain real accumulation drifts the most; none is a multiple
+   of the lane count or of the pairwise leaf size */
+static const long th_benchmark_accumulate_sizes[] = { 7, 1001, 65539, 10000019 };
+
+#include "generic/THBenchmark.c"
+#include "THGenerateFloatTypes.h"
+
+/*
+  Reference count contention: one task per thread, each doing retain/release
+  pairs either on one shared counter or on a counter of its own (a cache line
+  apart), through every atomic backend available, plus tensor retain/free
+  pairs on a shared tensor and on confined ones.
+*/
+#define TH_BENCHMARK_REFCOUNT_PAIRS 1000000
+#define TH_BENCHMARK_CACHE_LINE 64
+
+enum {
+  TH_BENCHMARK_REF_GCC,
+  TH_BENCHMARK_REF_C11,
+  TH_BENCHMARK_REF_CALL,
+  TH_BENCHMARK_REF_PTHREAD,
+  TH_BENCHMARK_REF_CONFINED,
+  TH_BENCHMARK_REF_TENSOR,
+  TH_BENCHMARK_REF_TENSOR_CONFINED,
+  TH_BENCHMARK_REF_COUNT
+};
+
+static const char *th_benchmark_refBackends[TH_BENCHMARK_REF_COUNT] = {
+  "gcc", "c11", "call", "pthread", "confined", "tensor", "tensor_confined"
+};
+
+typedef struct THBenchmarkRefcount
+{
+  int backend;
+  int shared;
+  char *counters;               /* TH_BENCHMARK_CACHE_LINE bytes per task */
+  THFloatTensor **tensors;      /* one per task */
+#ifdef TH_BENCHMARK_PTHREAD
+  pthread_mutex_t mutex;
+#endif
+} THBenchmarkRefcount;
+
+static void THBenchmark_refcountKernel(void *args_, long begin, long end)
+{
+  THBenchmarkRefcount *args = (THBenchmarkRefcount*)args_;
+  long b, i;
+
+  for(b = begin; b < end; b++)
+  {
+    long slot = (args->shared ? 0 : b);
+    int volatile *counter = (int volatile*)(args->counters + slot*TH_BENCHMARK_CACHE_LINE);
+    THFloatTensor *tensor = args->tensors[slot];
+
+    switch(args->backend)
+    {
+#if defined(__GNUC__) && defined(__ATOMIC_RELAXED)
+      case TH_BENCHMARK_REF_GCC:
+        for(i = 0; i < TH_BENCHMARK_REFCOUNT_PAIRS; i++)
+        {
+          __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+          __atomic_sub_fetch(counter, 1, __ATOMIC_ACQ_REL);
+        }
+        break;
+#endif
+#ifdef TH_BENCHMARK_C11
+      case TH_BENCHMARK_REF_C11:
+        for(i = 0; i < TH_BENCHMARK_REFCOUNT_PAIRS; i++)
+        {
+          atomic_fetch_add_explicit((_Atomic int volatile*)counter, 1, memory_order_relaxed);
+          atomic_fetch_sub_explicit((_Atomic int volatile*)counter, 1, memory_order_acq_rel);
+        }
+        break;
+#endif
+      case TH_BENCHMARK_REF_CALL:
+        for(i = 0; i < TH_BENCHMARK_REFCOUNT_PAIRS; i++)
+        {
+          THAtomicIncrementRef(counter);
+          THAtomicDecrementRef(counter);
+        }
+        break;
+#ifdef TH_BENCHMARK_PTHREAD
+      case TH_BENCHMARK_REF_PTHREAD:
+        for(i = 0; i < TH_BENCHMARK_REFCOUNT_PAIRS; i++)
+        {
+          pthread_mutex_lock(&args->mutex);
+          (*counter)++;
+          pthread_mutex_unlock(&args->mutex);
+          pthread_mutex_lock(&args->mutex);
+          (*counter)--;
+          pthread_mutex_unlock(&args->mutex);
+        }
+        break;
+#endif
+      case TH_BENCHMARK_REF_CONFINED:
+        for(i = 0; i < TH_BENCHMARK_REFCOUNT_PAIRS; i++)
+        {
+          (*counter)++;
+          (*counter)--;
+        }
+        break;
+      case TH_BENCHMARK_REF_TENSOR:
+      case TH_BENCHMARK_REF_TENSOR_CONFINED:
+        for(i = 0; i < TH_BENCHMARK_REFCOUNT_PAIRS; i++)
+        {
+          THFloatTensor_retain(tensor);
+          THFloatTensor_free(tensor);
+        }
+        break;
+    }
+  }
+}
+
+static int THBenchmark_refcountAvailable(int backend)
+{
+  switch(backend)
+  {
+#if !(defined(__GNUC__) && defined(__ATOMIC_RELAXED))
+    case TH_BENCHMARK_REF_GCC: return 0;
+#endif
+#ifndef TH_BENCHMARK_C11
+    case TH_BENCHMARK_REF_C11: return 0;
+#endif
+#ifndef TH_BENCHMARK_PTHREAD
+    case TH_BENCHMARK_REF_PTHREAD: return 0;
+#endif
+    default: return 1;
+  }
+}
+
+static void THBenchmark_refcount(THBenchmarkContext *ctx)
+{
+  THBenchmarkRefcount args;
+  int nTasks = ctx->threads;
+  char *counters;
+  char shape[64];
+  long i;
+
+  if(!THBenchmark_selected(ctx, "refcount"))
+    return;
+
+  counters = THAlloc(TH_BENCHMARK_CACHE_LINE*(nTasks+1));
+  args.counters = counters + TH_BENCHMARK_CACHE_LINE - ((size_t)counters % TH_BENCHMARK_CACHE_LINE);
+  memset(args.counters, 0, TH_BENCHMARK_CACHE_LINE*nTasks);
+  args.tensors = THAlloc(sizeof(THFloatTensor*)*nTasks);
+  for(i = 0; i < nTasks; i++)
+    args.tensors[i] = THFloatTensor_new();
+#ifdef TH_BENCHMARK_PTHREAD
+  pthread_mutex_init(&args.mutex, NULL);
+#endif
+  snprintf(shape, sizeof(shape), "%dx%d", nTasks, TH_BENCHMARK_REFCOUNT_PAIRS);
+
+  for(args.backend = 0; args.backend < TH_BENCHMARK_REF_COUNT; args.backend++)
+  {
+    int confined = (args.backend == TH_BENCHMARK_REF_CONFINED || args.backend == TH_BENCHMARK_REF_TENSOR_CONFINED);
+    if(!THBenchmark_refcountAvailable(args.backend))
+      continue;
+    for(args.shared = 1; args.shared >= 0; args.shared--)
+    {
+      double seconds;
+      /* a confined count is never shared */
+      if(confined && args.shared)
+        continue;
+      for(i = 0; i < nTasks; i++)
+      {
+        if(args.backend == TH_BENCHMARK_REF_TENSOR_CONFINED)
+          THFloatTensor_setFlag(args.tensors[i], TH_TENSOR_CONFINED);
+        else
+          THFloatTensor_clearFlag(args.tensors[i], TH_TENSOR_CONFINED);
+      }
+      TH_BENCHMARK_TIME(ctx, seconds,
+                        THParallel_for(0, nTasks, 1, THBenchmark_refcountKernel, &args));
+      /* flops: retain/release operations */
+      THBenchmark_report(ctx, "refcount", th_benchmark_refBackends[args.backend], shape,
+                         (args.shared ? "shared" : "private"), seconds,
+                         2.0*nTasks*TH_BENCHMARK_REFCOUNT_PAIRS, 0);
+    }
+  }
+
+  for(i = 0; i < nTasks; i++)
+  {
+    THFloatTensor_clearFlag(args.tensors[i], TH_TENSOR_CONFINED);
+    THFloatTensor_free(args.tensors[i]);
+  }
+  THFree(args.tensors);
+  THFree(counters);
+#ifdef TH_BENCHMARK_PTHREAD
+  pthread_mutex_destroy(&args.mutex);
+#endif
+}
+
+void THBenchmark_run(const char *filter, int repeat, const int *threads, int nThreads, FILE *output)
+{
+  THBenchmarkContext ctx;
+  int savedThreads = THThreadPool_getRequestedThreads();
+  int currentThreads = THThreadPool_getNumThreads();
+  int t;
+
+  THBenchmark_initPeak();
+  ctx.filter = filter;
+  ctx.repeat = (repeat > 0 ? repeat : 1);
+  ctx.output = (output ? output : stdout);
+  ctx.failures = 0;
+
+  if(!threads || nThreads <= 0)
+  {
+    threads = &currentThreads;
+    nThreads = 1;
+  }
+
+  for(t = 0; t < nThreads; t++)
+  {
+    THThreadPool_setNumThreads(threads[t]);
+    ctx.threads = THThreadPool_getNumThreads();
+    THFloatTensor_benchmark(&ctx);
+    THDoubleTensor_benchmark(&ctx);
+    THBenchmark_refcount(&ctx);
+  }
+
+  THThreadPool_setNumThreads(savedThreads);
+  if(ctx.failures)
+    THError("%d accuracy checks above their bound", ctx.failures);
+}
@@ -0,0 +1,37 @@
+#ifndef TH_BENCHMARK_INC
+#define TH_BENCHMARK_INC
+
+#include "THGeneral.h"
+
+/******************************************************************************
+ * Microbenchmarks of THTensorMath, THTensorConv and THBlas, and of the
+ * reference counting backends under contention ("refcount": gflops is then
+ * billions of retain/release operations per second)
+ *  - float and double, contiguous and strided operands, several thread counts
+ *  - shapes taken from common models (fully connected / LSTM layers, conv
+ *    stages of small image nets, large element-wise updates)
+ *  - one JSON object per line on the output, for run-over-run comparison:
+ *    {"op": .., "type": .., "shape": .., "layout": .., "threads": ..,
+ *     "time_us": .., "gflops": .., "gbs": .., "peak_gflops": .., "peak_gbs": ..}
+ *    peak_* are the fractions of the declared peaks (null when unknown)
+ *  - "accumulate" checks the accuracy of the accumulation policies of sumall
+ *    and dot instead of timing them (THBenchmark_run raises an error at the
+ *    end if any result is above its bound), one line per result:
+ *    {"op": .., "type": .., "shape": .., "layout": <policy>, "threads": ..,
+ *     "rel_error": .., "bound": .., "ok": ..}
+ ******************************************************************************/
+
+/* theoretical machine peaks used to normalize the results; <= 0 if unknown.
+   Default to the TH_PEAK_GFLOPS and TH_PEAK_GBS env variables. */
+TH_API void THBenchmark_setPeak(double gflops, double gbs);
+
+/*
+ * run the cases whose op name contains filter (NULL: all), with each of the
+ * nThreads thread counts (threads == NULL: current pool setting). Each case
+ * is run once to warm up, then repeat times; the best time is reported.
+ * The pool thread setting (a fixed count, or the default) is restored on
+ * exit.
+*/
+TH_API void THBenchmark_run(const char *filter, int repeat, const int *threads, int nThreads, FILE *output);
+
+#endif
@@ -0,0 +1,189 @@
+#include "THBitMask.h"
+#include "THAtomic.h"
+#include "THTensor.h"
+
+/* the bytes (0 or 1 each) of the 4 bits of a nibble, lowest bit first */
+static const unsigned char th_bit_mask_nibble_bytes[16][4] = {
+  {0,0,0,0}, {1,0,0,0}, {0,1,0,0}, {1,1,0,0},
+  {0,0,1,0}, {1,0,1,0}, {0,1,1,0}, {1,1,1,0},
+  {0,0,0,1}, {1,0,0,1}, {0,1,0,1}, {1,1,0,1},
+  {0,0,1,1}, {1,0,1,1}, {0,1,1,1}, {1,1,1,1}
+};
+
+THBitMask *THBitMask_new(void)
+{
+  THBitMask *self = THAlloc(sizeof(THBitMask));
+  self->data = NULL;
+  self->nElement = 0;
+  self->nDimension = 0;
+  self->size = NULL;
+  self->refcount = 1;
+  return self;
+}
+
+THBitMask *THBitMask_newWithSize(int nDimension, const long *size)
+{
+  THBitMask *self = THBitMask_new();
+  THBitMask_resize(self, nDimension, size);
+  return self;
+}
+
+void THBitMask_retain(THBitMask *self)
+{
+  if(self)
+    THAtomicIncrementRef(&self->refcount);
+}
+
+void THBitMask_free(THBitMask *self)
+{
+  if(!self)
+    return;
+  if(THAtomicDecrementRef(&self->refcount))
+  {
+    THFree(self->data);
+    THFree(self->size);
+    THFree(self);
+  }
+}
+
+void THBitMask_resize(THBitMask *self, int nDimension, const long *size)
+{
+  long nElement = (nDimension > 0 ? 1 : 0);
+  int d;
+
+  for(d = 0; d < nDimension; d++)
+  {
+    THArgCheck(size[d] >= 0, 3, "invalid size");
+    nElement *= size[d];
+  }
+
+  if(self->nDimension != nDimension)
+  {
+    self->size = THRealloc(self->size, sizeof(long)*nDimension);
+    self->nDimension = nDimension;
+  }
+  for(d = 0; d < nDimension; d++)
+    self->size[d] = size[d];
+
+  if(THBitMask_nWords(nElement) != THBitMask_nWords(self->nElement))
+    self->data = THRealloc(self->data, sizeof(uint64_t)*THBitMask_nWords(nElement));
+  self->nElement = nElement;
+
+  /* keep the tail of the last word clear */
+  if(nElement % TH_BIT_MASK_WORD_BITS)
+    self->data[nElement / TH_BIT_MASK_WORD_BITS] &= ((uint64_t)1 << (nElement % TH_BIT_MASK_WORD_BITS)) - 1;
+}
+
+long THBitMask_nElement(const THBitMask *self)
+{
+  return self->nElement;
+}
+
+uint64_t *THBitMask_data(const THBitMask *self)
+{
+  return self->data;
+}
+
+int THBitMask_get(const THBitMask *self, long index)
+{
+  THArgCheck(index >= 0 && index < self->nElement, 2, "out of range");
+  return (int)((self->data[index / TH_BIT_MASK_WORD_BITS] >> (index % TH_BIT_MASK_WORD_BITS)) & 1);
+}
+
+void THBitMask_set(THBitMask *self, long index, int value)
+{
+  uint64_t bit;
+  THArgCheck(index >= 0 && index < self->nElement, 2, "out of range");
+  bit = (uint64_t)1 << (index % TH_BIT_MASK_WORD_BITS);
+  if(value)
+    self->data[index / TH_BIT_MASK_WORD_BITS] |= bit;
+  else
+    self->data[index / TH_BIT_MASK_WORD_BITS] &= ~bit;
+}
+
+void THBitMask_zero(THBitMask *self)
+{
+  if(self->nElement > 0)
+    memset(self->data, 0, sizeof(uint64_t)*THBitMask_nWords(self->nElement));
+}
+
+long THBitMask_count(const THBitMask *self)
+{
+  long nWords = THBitMask_nWords(self->nElement);
+  long count = 0, w;
+  for(w = 0; w < nWords; w++)
+    count += THBitMask_popcount(self->data[w]);
+  return count;
+}
+
+int THBitMask_all(const THBitMask *self)
+{
+  long nFull = self->nElement / TH_BIT_MASK_WORD_BITS;
+  long tail = self->nElement % TH_BIT_MASK_WORD_BITS;
+  long w;
+  THArgCheck(self->nDimension > 0, 1, "empty mask");
+  for(w = 0; w < nFull; w++)
+  {
+    if(~self->data[w])
+      return 0;
+  }
+  return !tail || self->data[nFull] == ((uint64_t)1 << tail) - 1;
+}
+
+int THBitMask_any(const THBitMask *self)
+{
+  long nWords = THBitMask_nWords(self->nElement);
+  long w;
+  THArgCheck(self->nDimension > 0, 1, "empty mask");
+  for(w = 0; w < nWords; w++)
+  {
+    if(self->data[w])
+      return 1;
+  }
+  return 0;
+}
+
+void THBitMask_copyByteTensor(THBitMask *self, THByteTensor *src)
+{
+  long i = 0;
+  THBitMask_resize(self, src->nDimension, src->size);
+  THBitMask_zero(self);
+  TH_TENSOR_APPLY(unsigned char, src,
+                  if(*src_data)
+                    self->data[i / TH_BIT_MASK_WORD_BITS] |= (uint64_t)1 << (i % TH_BIT_MASK_WORD_BITS);
+                  i++;);
+}
+
+void THBitMask_toByteTensor(const THBitMask *self, THByteTensor *dst)
+{
+  THLongStorage *size = THLongStorage_newWithSize(self->nDimension);
+  if(self->nDimension > 0)
+    memcpy(THLongStorage_data(size), self->size, sizeof(long)*self->nDimension);
+  THByteTensor_resize(dst, size, NULL);
+  THLongStorage_free(size);
+
+  if(THByteTensor_isContiguous(dst))
+  {
+    unsigned char *data = THByteTensor_data(dst);
+    long i;
+    for(i = 0; i < self->nElement; i += TH_BIT_MASK_WORD_BITS)
+      THBitMask_expandWord(data + i, self->data[i / TH_BIT_MASK_WORD_BITS],
+                           THMin(TH_BIT_MASK_WORD_BITS, self->nElement - i));
+  }
+  else
+  {
+    long i = 0;
+    TH_TENSOR_APPLY(unsigned char, dst,
+                    *dst_data = (self->data[i / TH_BIT_MASK_WORD_BITS] >> (i % TH_BIT_MASK_WORD_BITS)) & 1;
+                    i++;);
+  }
+}
+
+void THBitMask_expandWord(unsigned char *dst, uint64_t word, long n)
+{
+  long i;
+  for(i = 0; i + 4 <= n; i += 4, word >>= 4)
+    memcpy(dst + i, th_bit_mask_nibble_bytes[word & 15], 4);
+  for(; i < n; i++, word >>= 1)
+    dst[i] = word & 1;
+}
@@ -0,0 +1,77 @@
+#ifndef TH_BIT_MASK_INC
+#define TH_BIT_MASK_INC
+
+#include "THGeneral.h"
+#include <stdint.h>
+
+/******************************************************************************
+ * Bit-packed masks, as produced by the *Mask comparisons of THTensorMath
+ *  - one bit per element, in the row-major order of the compared tensors
+ *  - 64 elements per word; the bits past nElement in the last word are 0
+ *  - consumed directly by maskedFillBits, maskedSelectBits and
+ *    THBitMask_all/any, at 1/8th of the memory traffic of a THByteTensor mask
+ ******************************************************************************/
+
+#define TH_BIT_MASK_WORD_BITS 64
+
+typedef struct THBitMask
+{
+    uint64_t *data;
+    long nElement;
+    int nDimension;
+    long *size;
+    int refcount;
+} THBitMask;
+
+#define THBitMask_nWords(n) (((n) + TH_BIT_MASK_WORD_BITS - 1) / TH_BIT_MASK_WORD_BITS)
+
+#if defined(__GNUC__)
+# define THBitMask_ctz(word) __builtin_ctzll(word)
+# define THBitMask_popcount(word) __builtin_popcountll(word)
+#else
+static inline int THBitMask_ctz(uint64_t word)
+{
+  int n = 0;
+  while(!(word & 1))
+  {
+    word >>= 1;
+    n++;
+  }
+  return n;
+}
+static inline int THBitMask_popcount(uint64_t word)
+{
+  int n = 0;
+  for(; word; word &= word - 1)
+    n++;
+  return n;
+}
+#endif
+
+TH_API THBitMask *THBitMask_new(void);
+TH_API THBitMask *THBitMask_newWithSize(int nDimension, const long *size);
+TH_API void THBitMask_retain(THBitMask *self);
+TH_API void THBitMask_free(THBitMask *self);
+
+/* the content is undefined after a resize that changes the number of elements */
+TH_API void THBitMask_resize(THBitMask *self, int nDimension, const long *size);
+TH_API long THBitMask_nElement(const THBitMask *self);
+TH_API uint64_t *THBitMask_data(const THBitMask *self);
+
+TH_API int THBitMask_get(const THBitMask *self, long index);
+TH_API void THBitMask_set(THBitMask *self, long index, int value);
+TH_API void THBitMask_zero(THBitMask *self);
+
+TH_API long THBitMask_count(const THBitMask *self);
+TH_API int THBitMask_all(const THBitMask *self);
+TH_API int THBitMask_any(const THBitMask *self);
+
+/* conversions from/to the 0/1 THByteTensor masks (same element order) */
+struct THByteTensor;
+TH_API void THBitMask_copyByteTensor(THBitMask *self, struct THByteTensor *src);
+TH_API void THBitMask_toByteTensor(const THBitMask *self, struct THByteTensor *dst);
+
+/* dst[i] = bit i of word, i < n (n <= 64) */
+TH_API void THBitMask_expandWord(unsigned char *dst, uint64_t word, long n);
+
+#endif
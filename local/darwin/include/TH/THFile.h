@@ -81,4 +81,22 @@ TH_API size_t THFile_position(THFile *self);
 TH_API void THFile_close(THFile *self);
 TH_API void THFile_free(THFile *self);
 
+/*
+ * streaming reads: the next n elements (n < 0: up to the end of the file)
+ * are read by read, chunkSize elements at a time, alternately into
+ * buffers[0] and buffers[1] (chunkSize elements each). A background thread
+ * reads one buffer while chunk(ctx, buffer, count) processes the other, on
+ * the calling thread, in file order. chunk must not raise an error, which
+ * would leave the reader running: it returns nonzero to stop the stream
+ * instead, and the caller raises once THFile_stream has returned (the
+ * reader joined, the file restored).
+ * Returns the number of elements read, -1 if chunk stopped the stream,
+ * raising an error if fewer than n >= 0 were available.
+*/
+typedef size_t (*THFileReadFunction)(THFile *self, void *data, size_t n);
+typedef int (*THFileChunkFunction)(void *ctx, int buffer, long n);
+
+TH_API long THFile_stream(THFile *self, long n, long chunkSize, void *buffers[2],
+                          THFileReadFunction read, THFileChunkFunction chunk, void *ctx);
+
 #endif
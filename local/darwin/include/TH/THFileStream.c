@@ -0,0 +1,149 @@
+#include "THFile.h"
+#include "THFilePrivate.h"
+
+#if !defined(_WIN32) && !defined(TH_NO_THREADS)
+# include <pthread.h>
+# define TH_FILE_STREAM_PTHREAD
+#endif
+
+typedef struct THFileStream
+{
+  THFile *file;
+  THFileReadFunction read;
+  void **buffers;
+  long n;
+  long chunkSize;
+  long count[2];   /* elements in each buffer, -1 while it waits to be filled */
+  int stop;        /* set when chunk stops the stream */
+#ifdef TH_FILE_STREAM_PTHREAD
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+#endif
+} THFileStream;
+
+/* elements expected in the next chunk, total having been read so far; a
+   chunk shorter than that is the last one */
+static long THFileStream_want(THFileStream *stream, long total)
+{
+  if(stream->n < 0)
+    return stream->chunkSize;
+  return THMin(stream->chunkSize, stream->n - total);
+}
+
+#ifdef TH_FILE_STREAM_PTHREAD
+static void *THFileStream_reader(void *stream_)
+{
+  THFileStream *stream = (THFileStream*)stream_;
+  long total = 0, want, got;
+  int b = 0, stop;
+
+  while((want = THFileStream_want(stream, total)) > 0)
+  {
+    pthread_mutex_lock(&stream->mutex);
+    while(stream->count[b] != -1 && !stream->stop)
+      pthread_cond_wait(&stream->cond, &stream->mutex);
+    stop = stream->stop;
+    pthread_mutex_unlock(&stream->mutex);
+    if(stop)
+      break;
+
+    got = (long)stream->read(stream->file, stream->buffers[b], want);
+    total += got;
+
+    pthread_mutex_lock(&stream->mutex);
+    stream->count[b] = got;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+
+    if(got < want)
+      break;
+    b ^= 1;
+  }
+  return NULL;
+}
+#endif
+
+long THFile_stream(THFile *self, long n, long chunkSize, void *buffers[2],
+                   THFileReadFunction read, THFileChunkFunction chunk, void *ctx)
+{
+  THFileStream stream;
+  int wasQuiet, hadError;
+  long total = 0, want, got;
+  int b = 0, stop = 0;
+
+  THArgCheck(THFile_isOpened(self), 1, "attempt to use a closed file");
+  THArgCheck(self->isReadable, 1, "attempt to read in a write-only file");
+  THArgCheck(chunkSize > 0, 3, "chunk size must be positive");
+
+  stream.file = self;
+  stream.read = read;
+  stream.buffers = buffers;
+  stream.n = n;
+  stream.chunkSize = chunkSize;
+  stream.count[0] = stream.count[1] = -1;
+  stream.stop = 0;
+
+  /* short reads are reported through the count, not as errors raised on
+     the reader thread */
+  wasQuiet = self->isQuiet;
+  hadError = self->hasError;
+  self->isQuiet = 1;
+
+#ifdef TH_FILE_STREAM_PTHREAD
+  if(n < 0 || n > chunkSize)
+  {
+    pthread_t reader;
+    pthread_mutex_init(&stream.mutex, NULL);
+    pthread_cond_init(&stream.cond, NULL);
+    if(pthread_create(&reader, NULL, THFileStream_reader, &stream) == 0)
+    {
+      while((want = THFileStream_want(&stream, total)) > 0)
+      {
+        pthread_mutex_lock(&stream.mutex);
+        while(stream.count[b] == -1)
+          pthread_cond_wait(&stream.cond, &stream.mutex);
+        got = stream.count[b];
+        pthread_mutex_unlock(&stream.mutex);
+
+        stop = (got > 0 && chunk(ctx, b, got));
+        total += got;
+
+        pthread_mutex_lock(&stream.mutex);
+        stream.count[b] = -1;
+        stream.stop = stop;
+        pthread_cond_broadcast(&stream.cond);
+        pthread_mutex_unlock(&stream.mutex);
+
+        if(stop || got < want)
+          break;
+        b ^= 1;
+      }
+      pthread_join(reader, NULL);
+      /* everything has been read: skip the serial loop */
+      stream.n = total;
+    }
+    pthread_cond_destroy(&stream.cond);
+    pthread_mutex_destroy(&stream.mutex);
+  }
+#endif
+
+  /* single chunk, no threads, or the reader could not be started */
+  while(!stop && (want = THFileStream_want(&stream, total)) > 0)
+  {
+    got = (long)read(self, buffers[b], want);
+    stop = (got > 0 && chunk(ctx, b, got));
+    total += got;
+    if(got < want)
+      break;
+    b ^= 1;
+  }
+
+  self->isQuiet = wasQuiet;
+  if(!hadError)
+    self->hasError = 0;
+  if(stop)
+    return -1;
+  if(n >= 0 && total < n)
+    THError("read error: read %ld elements instead of %ld", total, n);
+  return total;
+}
@@ -10,4 +10,23 @@ TH_API THFile *THMemoryFile_new(const char *mode);
 TH_API THCharStorage *THMemoryFile_storage(THFile *self);
 TH_API void THMemoryFile_longSize(THFile *self, int size);
 
+/* a memory file ('w' or 'rw') whose buffer is a shared mapping of filename
+   (truncated), or an anonymous mapping if filename is NULL: the buffer
+   grows with mremap rather than realloc + copy. The file holds the content
+   followed by zero padding. */
+TH_API THFile *THMemoryFile_newWithMapping(const char *filename, const char *mode);
+
+/* binary files: read n elements as a storage pointing into the file buffer
+   (no copy), which keeps the buffer alive. Valid as long as the file is not
+   written to (growing the buffer may move it). Falls back to a copying read
+   when the data is misaligned for the type or when less than n elements are
+   left. Long views assume the native long size. */
+TH_API THByteStorage *THMemoryFile_readByteView(THFile *self, long n);
+TH_API THCharStorage *THMemoryFile_readCharView(THFile *self, long n);
+TH_API THShortStorage *THMemoryFile_readShortView(THFile *self, long n);
+TH_API THIntStorage *THMemoryFile_readIntView(THFile *self, long n);
+TH_API THLongStorage *THMemoryFile_readLongView(THFile *self, long n);
+TH_API THFloatStorage *THMemoryFile_readFloatView(THFile *self, long n);
+TH_API THDoubleStorage *THMemoryFile_readDoubleView(THFile *self, long n);
+
 #endif
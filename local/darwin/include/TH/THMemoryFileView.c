@@ -0,0 +1,77 @@
+#include "THMemoryFile.h"
+#include "THFilePrivate.h"
+
+/* views hold a reference on the buffer of the file, through their context */
+static void *THMemoryFileView_alloc(void *ctx, long size)
+{
+  (void)ctx; (void)size;
+  THError("memory file views can not be allocated");
+  return NULL;
+}
+
+static void THMemoryFileView_free(void *ctx, void *data)
+{
+  (void)data;
+  THCharStorage_free((THCharStorage*)ctx);
+}
+
+static THAllocator THMemoryFileViewAllocator = {
+  &THMemoryFileView_alloc,
+  NULL,
+  &THMemoryFileView_free
+};
+
+THFile *THMemoryFile_newWithMapping(const char *filename, const char *mode)
+{
+  THRemapAllocatorContext *ctx;
+  THCharStorage *storage;
+  THFile *file;
+
+  THArgCheck(mode && strchr(mode, 'w'), 2, "file mode should be 'w' or 'rw'");
+  ctx = THRemapAllocatorContext_new(filename);
+  storage = THCharStorage_newWithAllocator(1, &THRemapAllocator, ctx);
+  storage->data[0] = '\0';
+  file = THMemoryFile_newWithStorage(storage, mode);
+  THCharStorage_free(storage);
+  return file;
+}
+
+#define IMPLEMENT_THMEMORYFILE_VIEW(TYPEC, TYPE)                                          \
+  TH##TYPEC##Storage *THMemoryFile_read##TYPEC##View(THFile *self, long n)                \
+  {                                                                                       \
+    THCharStorage *buffer;                                                                \
+    TH##TYPEC##Storage *view;                                                             \
+    size_t position, size;                                                                \
+                                                                                          \
+    THArgCheck(self->isReadable, 1, "attempt to read in a write-only file");              \
+    THArgCheck(self->isBinary, 1, "storage views need a binary file");                    \
+    THArgCheck(n >= 0, 2, "invalid number of elements");                                  \
+                                                                                          \
+    buffer = THMemoryFile_storage(self);                                                  \
+    position = THFile_position(self);                                                     \
+    THFile_seekEnd(self);                                                                 \
+    size = THFile_position(self);                                                         \
+    THFile_seek(self, position);                                                          \
+                                                                                          \
+    if(position + n*sizeof(TYPE) > size || ((size_t)(buffer->data + position) % sizeof(TYPE))) \
+    {                                                                                     \
+      view = TH##TYPEC##Storage_newWithSize(n);                                           \
+      THFile_read##TYPEC##Raw(self, view->data, n);                                       \
+      return view;                                                                        \
+    }                                                                                     \
+                                                                                          \
+    THCharStorage_retain(buffer);                                                         \
+    view = TH##TYPEC##Storage_newWithDataAndAllocator((TYPE*)(buffer->data + position), n, \
+                                                      &THMemoryFileViewAllocator, buffer); \
+    TH##TYPEC##Storage_clearFlag(view, TH_STORAGE_RESIZABLE);                             \
+    THFile_seek(self, position + n*sizeof(TYPE));                                         \
+    return view;                                                                          \
+  }
+
+IMPLEMENT_THMEMORYFILE_VIEW(Byte, unsigned char)
+IMPLEMENT_THMEMORYFILE_VIEW(Char, char)
+IMPLEMENT_THMEMORYFILE_VIEW(Short, short)
+IMPLEMENT_THMEMORYFILE_VIEW(Int, int)
+IMPLEMENT_THMEMORYFILE_VIEW(Long, long)
+IMPLEMENT_THMEMORYFILE_VIEW(Float, float)
+IMPLEMENT_THMEMORYFILE_VIEW(Double, double)
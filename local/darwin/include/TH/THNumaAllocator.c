@@ -0,0 +1,294 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "THAllocator.h"
+
+#if defined(__linux__)
+# define TH_NUMA_LINUX
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# include <dirent.h>
+# include <errno.h>
+#elif !defined(_WIN32)
+# include <unistd.h>
+#endif
+
+/* blocks smaller than this are not worth a mapping of their own */
+#define TH_NUMA_MIN_MAPPED_SIZE 65536
+#define TH_NUMA_MAX_NODES 1024
+#define TH_NUMA_MASK_LONGS (TH_NUMA_MAX_NODES/(8*sizeof(unsigned long)))
+
+/* kernel mempolicy modes (numaif.h, which we do not want to depend on) */
+#define TH_MPOL_PREFERRED 1
+#define TH_MPOL_BIND 2
+#define TH_MPOL_INTERLEAVE 3
+
+struct THNumaAllocatorContext_ {
+  int policy;
+  unsigned long mask[TH_NUMA_MASK_LONGS];
+};
+
+/* sits right in front of every block handed out */
+typedef struct THNumaHeader
+{
+  long size;    /* bytes requested */
+  long mapped;  /* bytes mapped (header page included), 0 if from THAlloc */
+} THNumaHeader;
+
+#define TH_NUMA_HEADER_SIZE 16
+
+static THNumaAllocatorContext th_numa_policy = { TH_NUMA_DEFAULT, {0} };
+
+long THNuma_pageSize(void)
+{
+#if defined(_WIN32)
+  return 4096;
+#else
+  static long pageSize = 0;
+  if(pageSize == 0)
+    pageSize = sysconf(_SC_PAGESIZE);
+  return pageSize;
+#endif
+}
+
+int THNuma_numNodes(void)
+{
+#ifdef TH_NUMA_LINUX
+  static int nNodes = 0;
+  if(nNodes == 0)
+  {
+    DIR *dir = opendir("/sys/devices/system/node");
+    int maxNode = 0;
+    if(dir)
+    {
+      struct dirent *entry;
+      while((entry = readdir(dir)))
+      {
+        int node;
+        if(sscanf(entry->d_name, "node%d", &node) == 1 && node+1 > maxNode)
+          maxNode = node+1;
+      }
+      closedir(dir);
+    }
+    nNodes = (maxNode > 0 ? THMin(maxNode, TH_NUMA_MAX_NODES) : 1);
+  }
+  return nNodes;
+#else
+  return 1;
+#endif
+}
+
+int THNuma_isAvailable(void)
+{
+#ifdef TH_NUMA_LINUX
+  return THNuma_numNodes() > 1;
+#else
+  return 0;
+#endif
+}
+
+static void THNuma_setMask(THNumaAllocatorContext *ctx, const int *nodes, int nnodes)
+{
+  int i;
+  memset(ctx->mask, 0, sizeof(ctx->mask));
+  if(!nodes || nnodes <= 0)
+  {
+    for(i = 0; i < THNuma_numNodes(); i++)
+      ctx->mask[i/(8*sizeof(unsigned long))] |= 1UL << (i % (8*sizeof(unsigned long)));
+    return;
+  }
+  for(i = 0; i < nnodes; i++)
+  {
+    THArgCheck(nodes[i] >= 0 && nodes[i] < THNuma_numNodes(), 2, "invalid NUMA node %d", nodes[i]);
+    ctx->mask[nodes[i]/(8*sizeof(unsigned long))] |= 1UL << (nodes[i] % (8*sizeof(unsigned long)));
+  }
+}
+
+THNumaAllocatorContext *THNumaAllocatorContext_new(int policy, const int *nodes, int nnodes)
+{
+  THNumaAllocatorContext *ctx;
+  THArgCheck(policy >= TH_NUMA_DEFAULT && policy <= TH_NUMA_BIND, 1, "unknown NUMA policy");
+  ctx = THAlloc(sizeof(THNumaAllocatorContext));
+  ctx->policy = policy;
+  THNuma_setMask(ctx, nodes, nnodes);
+  return ctx;
+}
+
+void THNumaAllocatorContext_free(THNumaAllocatorContext *ctx)
+{
+  THFree(ctx);
+}
+
+void THNuma_setPolicy(int policy, const int *nodes, int nnodes)
+{
+  THArgCheck(policy >= TH_NUMA_DEFAULT && policy <= TH_NUMA_BIND, 1, "unknown NUMA policy");
+  THNuma_setMask(&th_numa_policy, nodes, nnodes);
+  th_numa_policy.policy = policy;
+}
+
+int THNuma_getPolicy(void)
+{
+  return th_numa_policy.policy;
+}
+
+#ifdef TH_NUMA_LINUX
+static void THNuma_bind(THNumaAllocatorContext *ctx, void *ptr, long size)
+{
+  int mode;
+  const unsigned long *mask = ctx->mask;
+
+  switch(ctx->policy)
+  {
+    case TH_NUMA_LOCAL:
+      mode = TH_MPOL_PREFERRED; /* with an empty mask: node of the faulting thread */
+      mask = NULL;
+      break;
+    case TH_NUMA_INTERLEAVE:
+      mode = TH_MPOL_INTERLEAVE;
+      break;
+    case TH_NUMA_BIND:
+      mode = TH_MPOL_BIND;
+      break;
+    default:
+      return;
+  }
+
+  /* failure (no NUMA in the kernel, ...) leaves the default policy: not an error */
+  syscall(SYS_mbind, ptr, (unsigned long)size, mode, mask,
+          (unsigned long)(mask ? TH_NUMA_MAX_NODES+1 : 0), 0U);
+}
+#endif
+
+static void *THNumaAllocator_alloc(void *ctx_, long size)
+{
+  THNumaAllocatorContext *ctx = (ctx_ ? (THNumaAllocatorContext*)ctx_ : &th_numa_policy);
+  THNumaHeader *header;
+  char *ptr;
+
+  if(size < 0)
+    THError("$ Torch: invalid memory size -- maybe an overflow?");
+
+#ifdef TH_NUMA_LINUX
+  if(ctx->policy != TH_NUMA_DEFAULT && size >= TH_NUMA_MIN_MAPPED_SIZE)
+  {
+    long pageSize = THNuma_pageSize();
+    long mapped = pageSize + ((size + pageSize - 1)/pageSize)*pageSize;
+    char *base = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(base == MAP_FAILED)
+      THError("$ Torch: not enough memory: you tried to allocate %ldGB. Buy new RAM!", size/1073741824);
+
+    /* the header page is left alone: only the data pages follow the policy */
+    THNuma_bind(ctx, base + pageSize, mapped - pageSize);
+    ptr = base + pageSize;
+    header = (THNumaHeader*)(ptr - TH_NUMA_HEADER_SIZE);
+    header->size = size;
+    header->mapped = mapped;
+    THHeapUpdate(mapped);
+    return ptr;
+  }
+#else
+  (void)ctx;
+#endif
+
+  ptr = THAlloc(size + TH_NUMA_HEADER_SIZE);
+  header = (THNumaHeader*)ptr;
+  header->size = size;
+  header->mapped = 0;
+  return ptr + TH_NUMA_HEADER_SIZE;
+}
+
+static void THNumaAllocator_free(void *ctx, void *ptr)
+{
+  THNumaHeader *header;
+  (void)ctx;
+
+  if(!ptr)
+    return;
+
+  header = (THNumaHeader*)((char*)ptr - TH_NUMA_HEADER_SIZE);
+#ifdef TH_NUMA_LINUX
+  if(header->mapped)
+  {
+    long mapped = header->mapped;
+    if(munmap((char*)ptr - THNuma_pageSize(), mapped))
+      THError("could not unmap memory");
+    THHeapUpdate(-mapped);
+    return;
+  }
+#endif
+  THFree(header);
+}
+
+static void *THNumaAllocator_realloc(void *ctx, void *ptr, long size)
+{
+  THNumaHeader *header;
+  void *newptr;
+
+  if(!ptr)
+    return THNumaAllocator_alloc(ctx, size);
+
+  header = (THNumaHeader*)((char*)ptr - TH_NUMA_HEADER_SIZE);
+  if(!header->mapped && size < TH_NUMA_MIN_MAPPED_SIZE)
+  {
+    header = THRealloc(header, size + TH_NUMA_HEADER_SIZE);
+    header->size = size;
+    return (char*)header + TH_NUMA_HEADER_SIZE;
+  }
+
+  /* a fresh block gets the policy applied to all of its pages */
+  newptr = THNumaAllocator_alloc(ctx, size);
+  memcpy(newptr, ptr, THMin(size, header->size));
+  THNumaAllocator_free(ctx, ptr);
+  return newptr;
+}
+
+THAllocator THNumaAllocator = {
+  &THNumaAllocator_alloc,
+  &THNumaAllocator_realloc,
+  &THNumaAllocator_free
+};
+
+long THNuma_pageNodes(const void *ptr, long size, int *nodes, long maxPages)
+{
+  long pageSize = THNuma_pageSize();
+  unsigned long first, last;
+  long nPages, i;
+
+  if(!ptr || size <= 0)
+    return 0;
+
+  first = (unsigned long)ptr / pageSize;
+  last = ((unsigned long)ptr + size - 1) / pageSize;
+  nPages = (long)(last - first + 1);
+  maxPages = THMin(maxPages, nPages);
+
+  for(i = 0; i < maxPages; i++)
+    nodes[i] = -1;
+
+#ifdef TH_NUMA_LINUX
+  {
+    /* move_pages() with no target nodes only reports where the pages are */
+    enum { BATCH = 1024 };
+    void *pages[BATCH];
+    int status[BATCH];
+    long done = 0;
+
+    while(done < maxPages)
+    {
+      long n = THMin((long)BATCH, maxPages - done);
+      for(i = 0; i < n; i++)
+        pages[i] = (void*)((first + done + i) * pageSize);
+      if(syscall(SYS_move_pages, 0, (unsigned long)n, pages, NULL, status, 0) != 0)
+        break;
+      for(i = 0; i < n; i++)
+        nodes[done+i] = (status[i] >= 0 ? status[i] : -1);
+      done += n;
+    }
+  }
+#endif
+
+  return nPages;
+}
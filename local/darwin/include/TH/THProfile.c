@@ -0,0 +1,285 @@
+#include "THProfile.h"
+
+#if defined(_WIN32)
+# include <windows.h>
+#elif defined(__APPLE__)
+# include <mach/mach_time.h>
+#else
+# include <time.h>
+#endif
+
+#if defined(_MSC_VER)
+# define TH_TLS __declspec(thread)
+#else
+# define TH_TLS __thread
+#endif
+
+/* per thread: distinct ops (all types) and traced events kept */
+#define TH_PROFILE_STAT_SLOTS 4096
+#define TH_PROFILE_TRACE_EVENTS 65536
+
+typedef struct THProfileStat
+{
+  const char *name;
+  long calls;
+  double total;
+  double min;
+  double max;
+  long bytes;
+} THProfileStat;
+
+typedef struct THProfileEvent
+{
+  const char *name;
+  double start;
+  double duration;
+  long bytes;
+  int nDimension;
+  long size[TH_PROFILE_MAX_DIMS];
+} THProfileEvent;
+
+/* written by its owner thread only; read when dumping */
+typedef struct THProfileBuffer
+{
+  int threadId;
+  THProfileStat *stats;
+  THProfileEvent *events;
+  long nEvents; /* events recorded, the last TH_PROFILE_TRACE_EVENTS are kept */
+  struct THProfileBuffer *next;
+} THProfileBuffer;
+
+static int th_profile_enabled = 1;
+static int th_profile_tracing = 0;
+static THProfileBuffer *volatile th_profile_buffers = NULL;
+static int th_profile_nThreads = 0;
+static TH_TLS THProfileBuffer *th_profile_buffer = NULL;
+
+void THProfile_setEnabled(int enabled)
+{
+  th_profile_enabled = enabled;
+}
+
+int THProfile_isEnabled(void)
+{
+  return th_profile_enabled;
+}
+
+void THProfile_setTracing(int tracing)
+{
+  th_profile_tracing = tracing;
+}
+
+int THProfile_isTracing(void)
+{
+  return th_profile_tracing;
+}
+
+double THProfile_now(void)
+{
+#if defined(_WIN32)
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&freq);
+  return (double)count.QuadPart * 1e6 / (double)freq.QuadPart;
+#elif defined(__APPLE__)
+  static mach_timebase_info_data_t timebase;
+  if(timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return (double)mach_absolute_time() * timebase.numer / timebase.denom * 1e-3;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+#endif
+}
+
+static THProfileBuffer *THProfile_threadBuffer(void)
+{
+  THProfileBuffer *buffer = th_profile_buffer;
+  if(buffer)
+    return buffer;
+
+  buffer = THAlloc(sizeof(THProfileBuffer));
+  buffer->stats = THAlloc(sizeof(THProfileStat)*TH_PROFILE_STAT_SLOTS);
+  memset(buffer->stats, 0, sizeof(THProfileStat)*TH_PROFILE_STAT_SLOTS);
+  buffer->events = NULL;
+  buffer->nEvents = 0;
+
+  /* buffers are never freed: a dump can always walk the list */
+#if defined(__GNUC__)
+  buffer->threadId = __sync_fetch_and_add(&th_profile_nThreads, 1);
+  do
+  {
+    buffer->next = th_profile_buffers;
+  } while(!__sync_bool_compare_and_swap(&th_profile_buffers, buffer->next, buffer));
+#else
+  buffer->threadId = th_profile_nThreads++;
+  buffer->next = th_profile_buffers;
+  th_profile_buffers = buffer;
+#endif
+
+  th_profile_buffer = buffer;
+  return buffer;
+}
+
+void THProfile_record(const char *name, double start, double end, long bytes,
+                      int nDimension, const long *size)
+{
+  THProfileBuffer *buffer = THProfile_threadBuffer();
+  double duration = end - start;
+  unsigned long slot = ((unsigned long)name >> 3) % TH_PROFILE_STAT_SLOTS;
+  long probe;
+
+  /* open addressing on the (static) name pointer */
+  for(probe = 0; probe < TH_PROFILE_STAT_SLOTS; probe++)
+  {
+    THProfileStat *stat = &buffer->stats[slot];
+    if(stat->name == name || stat->name == NULL)
+    {
+      if(stat->name == NULL)
+      {
+        stat->name = name;
+        stat->min = duration;
+        stat->max = duration;
+      }
+      stat->calls++;
+      stat->total += duration;
+      stat->bytes += bytes;
+      if(duration < stat->min)
+        stat->min = duration;
+      if(duration > stat->max)
+        stat->max = duration;
+      break;
+    }
+    slot = (slot + 1) % TH_PROFILE_STAT_SLOTS;
+  }
+
+  if(th_profile_tracing)
+  {
+    THProfileEvent *event;
+    int d;
+
+    if(!buffer->events)
+      buffer->events = THAlloc(sizeof(THProfileEvent)*TH_PROFILE_TRACE_EVENTS);
+
+    event = &buffer->events[buffer->nEvents % TH_PROFILE_TRACE_EVENTS];
+    event->name = name;
+    event->start = start;
+    event->duration = duration;
+    event->bytes = bytes;
+    event->nDimension = THMin(nDimension, TH_PROFILE_MAX_DIMS);
+    for(d = 0; d < event->nDimension; d++)
+      event->size[d] = size[d];
+    buffer->nEvents++;
+  }
+}
+
+void THProfile_reset(void)
+{
+  THProfileBuffer *buffer;
+  for(buffer = th_profile_buffers; buffer; buffer = buffer->next)
+  {
+    memset(buffer->stats, 0, sizeof(THProfileStat)*TH_PROFILE_STAT_SLOTS);
+    buffer->nEvents = 0;
+  }
+}
+
+static int THProfile_compareName(const void *a, const void *b)
+{
+  return strcmp(((const THProfileStat*)a)->name, ((const THProfileStat*)b)->name);
+}
+
+static int THProfile_compareTotal(const void *a, const void *b)
+{
+  double ta = ((const THProfileStat*)a)->total;
+  double tb = ((const THProfileStat*)b)->total;
+  return (ta < tb) - (ta > tb);
+}
+
+int THProfile_dumpJSON(const char *filename)
+{
+  THProfileBuffer *buffer;
+  THProfileStat *all;
+  long nAll = 0, nMerged = 0, i;
+  FILE *f;
+
+  for(buffer = th_profile_buffers; buffer; buffer = buffer->next)
+    nAll += TH_PROFILE_STAT_SLOTS;
+  all = THAlloc(sizeof(THProfileStat)*THMax(nAll, 1));
+
+  nAll = 0;
+  for(buffer = th_profile_buffers; buffer; buffer = buffer->next)
+  {
+    for(i = 0; i < TH_PROFILE_STAT_SLOTS; i++)
+    {
+      if(buffer->stats[i].name)
+        all[nAll++] = buffer->stats[i];
+    }
+  }
+
+  /* the same op seen by several threads is folded into one entry */
+  qsort(all, nAll, sizeof(THProfileStat), THProfile_compareName);
+  for(i = 0; i < nAll; i++)
+  {
+    if(nMerged > 0 && !strcmp(all[nMerged-1].name, all[i].name))
+    {
+      THProfileStat *stat = &all[nMerged-1];
+      stat->calls += all[i].calls;
+      stat->total += all[i].total;
+      stat->bytes += all[i].bytes;
+      stat->min = THMin(stat->min, all[i].min);
+      stat->max = THMax(stat->max, all[i].max);
+    }
+    else
+      all[nMerged++] = all[i];
+  }
+  qsort(all, nMerged, sizeof(THProfileStat), THProfile_compareTotal);
+
+  f = fopen(filename, "w");
+  if(!f)
+  {
+    THFree(all);
+    return -1;
+  }
+  fprintf(f, "{\"ops\": [");
+  for(i = 0; i < nMerged; i++)
+  {
+    fprintf(f, "%s\n  {\"name\": \"%s\", \"calls\": %ld, \"total_us\": %.3f, \"min_us\": %.3f, \"max_us\": %.3f, \"bytes\": %ld}",
+            (i > 0 ? "," : ""), all[i].name, all[i].calls, all[i].total, all[i].min, all[i].max, all[i].bytes);
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  THFree(all);
+  return 0;
+}
+
+int THProfile_dumpChromeTrace(const char *filename)
+{
+  THProfileBuffer *buffer;
+  int first = 1;
+  FILE *f = fopen(filename, "w");
+
+  if(!f)
+    return -1;
+
+  fprintf(f, "{\"traceEvents\": [");
+  for(buffer = th_profile_buffers; buffer; buffer = buffer->next)
+  {
+    long begin = THMax(0L, buffer->nEvents - TH_PROFILE_TRACE_EVENTS);
+    long e;
+    for(e = begin; e < buffer->nEvents; e++)
+    {
+      THProfileEvent *event = &buffer->events[e % TH_PROFILE_TRACE_EVENTS];
+      int d;
+      fprintf(f, "%s\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"bytes\": %ld, \"shape\": [",
+              (first ? "" : ","), event->name, buffer->threadId, event->start, event->duration, event->bytes);
+      for(d = 0; d < event->nDimension; d++)
+        fprintf(f, "%s%ld", (d > 0 ? ", " : ""), event->size[d]);
+      fprintf(f, "]}}");
+      first = 0;
+    }
+  }
+  fprintf(f, "\n], \"displayTimeUnit\": \"ms\"}\n");
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef TH_PROFILE_INC
+#define TH_PROFILE_INC
+
+#include "THGeneral.h"
+
+/******************************************************************************
+ * Per-op instrumentation of the THTensor math, conv and lapack entry points
+ *  - compiled in with -DTH_PROFILE (gcc/clang only), compiled out otherwise
+ *  - each thread records into its own buffers: no lock on the hot path
+ *  - per-op counters (calls, time, bytes) are always kept while enabled;
+ *    individual events are only kept when tracing is on
+ *  - times are inclusive: an op calling another op is charged for both
+ ******************************************************************************/
+
+#if defined(TH_PROFILE) && !defined(__GNUC__)
+# undef TH_PROFILE /* needs __attribute__((cleanup)) */
+#endif
+
+#define TH_PROFILE_MAX_DIMS 4
+
+/* runtime switches; profiling starts enabled, tracing disabled */
+TH_API void THProfile_setEnabled(int enabled);
+TH_API int THProfile_isEnabled(void);
+TH_API void THProfile_setTracing(int tracing);
+TH_API int THProfile_isTracing(void);
+
+/* monotonic clock, in microseconds */
+TH_API double THProfile_now(void);
+
+/* account one call of op name, started at start and ended at end, which
+   touched bytes bytes; size holds the shape of its main tensor */
+TH_API void THProfile_record(const char *name, double start, double end, long bytes,
+                             int nDimension, const long *size);
+
+/* forget everything recorded so far (not thread safe w.r.t. running ops) */
+TH_API void THProfile_reset(void);
+
+/*
+ * per-op summary as JSON:
+ * {"ops": [{"name": .., "calls": .., "total_us": .., "min_us": .., "max_us": .., "bytes": ..}, ..]}
+ * Returns 0 on success. Should be called while no op is running.
+*/
+TH_API int THProfile_dumpJSON(const char *filename);
+
+/* traced events in the Chrome trace event format (chrome://tracing) */
+TH_API int THProfile_dumpChromeTrace(const char *filename);
+
+/* to be placed first in an instrumented function, t1..t3 being its main
+   tensor arguments (or NULL) */
+#ifdef TH_PROFILE
+#define TH_PROFILE_TENSOR_OP(t1, t2, t3)                                \
+  THTensor_(ProfileScope) th_profile_scope                              \
+    __attribute__((cleanup(THTensor_(profileEnd)), unused)) =           \
+    THTensor_(profileBegin)(__func__, t1, t2, t3)
+#else
+#define TH_PROFILE_TENSOR_OP(t1, t2, t3)
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "THAllocator.h"
+
+#if !defined(_WIN32)
+# define TH_REMAP_MMAP
+# include <sys/mman.h>
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <errno.h>
+# if defined(__linux__) && defined(MREMAP_MAYMOVE)
+#  define TH_REMAP_MREMAP
+# endif
+# if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
+#endif
+
+struct THRemapAllocatorContext_ {
+  char *filename;  /* NULL for an anonymous mapping */
+  int fd;
+  long size;       /* bytes currently mapped */
+};
+
+THRemapAllocatorContext *THRemapAllocatorContext_new(const char *filename)
+{
+  THRemapAllocatorContext *ctx = THAlloc(sizeof(THRemapAllocatorContext));
+  ctx->filename = NULL;
+  ctx->fd = -1;
+  ctx->size = 0;
+
+  if(filename)
+  {
+#ifdef TH_REMAP_MMAP
+    ctx->fd = open(filename, O_RDWR | O_CREAT, (mode_t)0600);
+    if(ctx->fd == -1)
+    {
+      THFree(ctx);
+      THError("unable to open file <%s> in read-write mode", filename);
+    }
+    ctx->filename = THAlloc(strlen(filename)+1);
+    strcpy(ctx->filename, filename);
+#else
+    THFree(ctx);
+    THError("file mappings are not supported on this platform");
+#endif
+  }
+  return ctx;
+}
+
+void THRemapAllocatorContext_free(THRemapAllocatorContext *ctx)
+{
+#ifdef TH_REMAP_MMAP
+  if(ctx->fd != -1)
+    close(ctx->fd);
+#endif
+  THFree(ctx->filename);
+  THFree(ctx);
+}
+
+#ifdef TH_REMAP_MMAP
+static void THRemapAllocator_truncate(THRemapAllocatorContext *ctx, long size)
+{
+  if(ctx->fd != -1 && ftruncate(ctx->fd, size) == -1)
+    THError("unable to resize file <%s> to %ld bytes (errno %d)", ctx->filename, size, errno);
+}
+
+static void *THRemapAllocator_map(THRemapAllocatorContext *ctx, long size)
+{
+  void *data;
+  if(ctx->fd != -1)
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->fd, 0);
+  else
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(data == MAP_FAILED)
+    THError("$ Torch: unable to map %ld bytes (errno %d)", size, errno);
+  return data;
+}
+#endif
+
+static void *THRemapAllocator_alloc(void *ctx_, long size)
+{
+  THRemapAllocatorContext *ctx = ctx_;
+  THArgCheck(ctx != NULL, 1, "a THRemapAllocatorContext is required");
+  THArgCheck(ctx->size == 0, 1, "the context already holds a block");
+  if(size <= 0)
+    return NULL;
+#ifdef TH_REMAP_MMAP
+  THRemapAllocator_truncate(ctx, size);
+  ctx->size = size;
+  return THRemapAllocator_map(ctx, size);
+#else
+  ctx->size = size;
+  return THAlloc(size);
+#endif
+}
+
+static void THRemapAllocator_unmap(THRemapAllocatorContext *ctx, void *data)
+{
+  if(!data)
+    return;
+#ifdef TH_REMAP_MMAP
+  if(munmap(data, ctx->size))
+    THError("could not unmap the shared memory file");
+#else
+  THFree(data);
+#endif
+  ctx->size = 0;
+}
+
+static void *THRemapAllocator_realloc(void *ctx_, void *ptr, long size)
+{
+  THRemapAllocatorContext *ctx = ctx_;
+  void *newptr;
+
+  if(!ptr)
+    return THRemapAllocator_alloc(ctx, size);
+  if(size <= 0)
+  {
+    THRemapAllocator_unmap(ctx, ptr);
+    THRemapAllocator_truncate(ctx, 0);
+    return NULL;
+  }
+  if(size == ctx->size)
+    return ptr;
+
+#if defined(TH_REMAP_MREMAP)
+  /* shrink the mapping before the file, grow the file before the mapping */
+  if(size > ctx->size)
+    THRemapAllocator_truncate(ctx, size);
+  newptr = mremap(ptr, ctx->size, size, MREMAP_MAYMOVE);
+  if(newptr == MAP_FAILED)
+    THError("$ Torch: unable to remap %ld bytes (errno %d)", size, errno);
+  if(size < ctx->size)
+    THRemapAllocator_truncate(ctx, size);
+#elif defined(TH_REMAP_MMAP)
+  if(ctx->fd != -1)
+  {
+    /* the content lives in the file: mapping it again copies nothing */
+    if(munmap(ptr, ctx->size))
+      THError("could not unmap the shared memory file");
+    THRemapAllocator_truncate(ctx, size);
+    newptr = THRemapAllocator_map(ctx, size);
+  }
+  else
+  {
+    newptr = THRemapAllocator_map(ctx, size);
+    memcpy(newptr, ptr, THMin(size, ctx->size));
+    if(munmap(ptr, ctx->size))
+      THError("could not unmap the shared memory file");
+  }
+#else
+  newptr = THRealloc(ptr, size);
+#endif
+  ctx->size = size;
+  return newptr;
+}
+
+static void THRemapAllocator_free(void *ctx_, void *data)
+{
+  THRemapAllocatorContext *ctx = ctx_;
+  THRemapAllocator_unmap(ctx, data);
+  THRemapAllocatorContext_free(ctx);
+}
+
+THAllocator THRemapAllocator = {
+  &THRemapAllocator_alloc,
+  &THRemapAllocator_realloc,
+  &THRemapAllocator_free
+};
@@ -3,9 +3,13 @@
 
 #include "THStorage.h"
 #include "THTensorApply.h"
+#include "THProfile.h"
+#include "THBitMask.h"
+#include "THAutotune.h"
 
 #define THTensor          TH_CONCAT_3(TH,Real,Tensor)
 #define THTensor_(NAME)   TH_CONCAT_4(TH,Real,Tensor_,NAME)
+#define THTensorView      TH_CONCAT_3(TH,Real,TensorView)
 
 #define TH_DESC_BUFF_LEN 64
 typedef struct {
@@ -16,6 +20,11 @@ typedef struct {
 #include "generic/THTensor.h"
 #include "THGenerateAllTypes.h"
 
+#ifdef TH_PROFILE
+#include "generic/THTensorProfile.h"
+#include "THGenerateAllTypes.h"
+#endif
+
 #include "generic/THTensorCopy.h"
 #include "THGenerateAllTypes.h"
 
@@ -0,0 +1,4 @@
+#include "THTensorStream.h"
+
+#include "generic/THTensorStream.c"
+#include "THGenerateAllTypes.h"
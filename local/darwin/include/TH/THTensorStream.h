@@ -0,0 +1,23 @@
+#ifndef TH_TENSOR_STREAM_INC
+#define TH_TENSOR_STREAM_INC
+
+#include "THTensor.h"
+#include "THFile.h"
+
+/******************************************************************************
+ * Out-of-core reductions over elements stored in a THFile
+ *  - the next n elements of the file (n < 0: up to its end) are read in
+ *    chunks of chunkSize elements (<= 0: TH_STREAM_DEFAULT_CHUNK), each
+ *    chunk being read on a background thread while the previous one is
+ *    reduced by the in-memory kernels, then the partial results combined
+ *  - memory use is two chunks, whatever the size of the file; nothing is
+ *    mapped, so the data only has to be readable by THFile_read*Raw
+ *  - the file is left positioned after the elements read
+ ******************************************************************************/
+
+#define TH_STREAM_DEFAULT_CHUNK (1L << 20)
+
+#include "generic/THTensorStream.h"
+#include "THGenerateAllTypes.h"
+
+#endif
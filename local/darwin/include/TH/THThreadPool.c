@@ -0,0 +1,432 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "THThreadPool.h"
+
+#if defined(_WIN32) || defined(TH_NO_THREADS)
+# define TH_POOL_SERIAL
+#else
+# include <pthread.h>
+# include <unistd.h>
+# ifdef __linux__
+#  include <sched.h>
+# endif
+#endif
+
+#if defined(_MSC_VER)
+# define TH_TLS __declspec(thread)
+#else
+# define TH_TLS __thread
+#endif
+
+/* upper bound on the number of partial results of THParallel_reduce */
+#define TH_PARALLEL_MAX_CHUNKS 256
+
+static TH_TLS int th_pool_threadNum = 0;
+static TH_TLS int th_pool_inParallel = 0;
+
+static long th_pool_grain = TH_PARALLEL_DEFAULT_GRAIN;
+static int th_pool_requestedThreads = 0;
+
+#ifndef TH_POOL_SERIAL
+
+/* one range per thread; the owner pops from the front, thieves split the back */
+typedef struct THPoolSlot
+{
+    pthread_mutex_t mutex;
+    long begin;
+    long end;
+    char pad[64];
+} THPoolSlot;
+
+typedef struct THPool
+{
+    int nThreads; /* caller included */
+    pthread_t *threads;
+    THPoolSlot *slots;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeup;
+    pthread_cond_t done;
+    unsigned long generation;
+    int active;
+    int stop;
+
+    THParallelFunction fn;
+    void *ctx;
+    long grain;
+} THPool;
+
+static THPool th_pool;
+static int th_pool_started = 0;
+static int *th_pool_cpus = NULL;
+static int th_pool_ncpus = 0;
+
+/* a single job runs at a time; concurrent callers execute inline */
+static pthread_mutex_t th_pool_jobMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int THPool_defaultNumThreads(void)
+{
+  const char *env = getenv("TH_NUM_THREADS");
+  long n = 0;
+  if(env)
+    n = strtol(env, NULL, 10);
+  if(n <= 0)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0 ? (int)n : 1);
+}
+
+static void THPool_applyAffinity(int self)
+{
+#ifdef __linux__
+  if(th_pool_ncpus > 0)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(th_pool_cpus[self % th_pool_ncpus], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+#else
+  (void)self;
+#endif
+}
+
+static int THPool_popChunk(THPoolSlot *slot, long grain, long *begin, long *end)
+{
+  int found = 0;
+  pthread_mutex_lock(&slot->mutex);
+  if(slot->begin < slot->end)
+  {
+    *begin = slot->begin;
+    *end = (slot->end - slot->begin > grain ? slot->begin + grain : slot->end);
+    slot->begin = *end;
+    found = 1;
+  }
+  pthread_mutex_unlock(&slot->mutex);
+  return found;
+}
+
+/* move the back half of another thread's range into our (empty) slot */
+static int THPool_steal(int self, long grain)
+{
+  int k;
+  for(k = 1; k < th_pool.nThreads; k++)
+  {
+    THPoolSlot *victim = &th_pool.slots[(self+k) % th_pool.nThreads];
+    long remaining, begin, end;
+
+    pthread_mutex_lock(&victim->mutex);
+    remaining = victim->end - victim->begin;
+    if(remaining <= 0)
+    {
+      pthread_mutex_unlock(&victim->mutex);
+      continue;
+    }
+    end = victim->end;
+    begin = (remaining >= 2*grain ? end - remaining/2 : victim->begin);
+    victim->end = begin;
+    pthread_mutex_unlock(&victim->mutex);
+
+    pthread_mutex_lock(&th_pool.slots[self].mutex);
+    th_pool.slots[self].begin = begin;
+    th_pool.slots[self].end = end;
+    pthread_mutex_unlock(&th_pool.slots[self].mutex);
+    return 1;
+  }
+  return 0;
+}
+
+static void THPool_work(int self)
+{
+  long begin, end;
+  do
+  {
+    while(THPool_popChunk(&th_pool.slots[self], th_pool.grain, &begin, &end))
+      th_pool.fn(th_pool.ctx, begin, end);
+  } while(THPool_steal(self, th_pool.grain));
+}
+
+static void *THPool_main(void *arg)
+{
+  int self = (int)(long)arg;
+  unsigned long seen;
+
+  th_pool_threadNum = self;
+  th_pool_inParallel = 1;
+  THPool_applyAffinity(self);
+
+  /* generation is 0 when the pool starts; a worker scheduled late must still
+     pick up a job published before it first got the mutex */
+  seen = 0;
+  pthread_mutex_lock(&th_pool.mutex);
+  for(;;)
+  {
+    while(!th_pool.stop && th_pool.generation == seen)
+      pthread_cond_wait(&th_pool.wakeup, &th_pool.mutex);
+    if(th_pool.stop)
+      break;
+    seen = th_pool.generation;
+    pthread_mutex_unlock(&th_pool.mutex);
+
+    THPool_work(self);
+
+    pthread_mutex_lock(&th_pool.mutex);
+    if(--th_pool.active == 0)
+      pthread_cond_signal(&th_pool.done);
+  }
+  pthread_mutex_unlock(&th_pool.mutex);
+  return NULL;
+}
+
+/* must be called with th_pool_jobMutex held */
+static void THPool_start(void)
+{
+  int i, n;
+
+  if(th_pool_started)
+    return;
+
+  n = (th_pool_requestedThreads > 0 ? th_pool_requestedThreads : THPool_defaultNumThreads());
+  th_pool.threads = THAlloc(sizeof(pthread_t)*n);
+  th_pool.slots = THAlloc(sizeof(THPoolSlot)*n);
+  for(i = 0; i < n; i++)
+  {
+    pthread_mutex_init(&th_pool.slots[i].mutex, NULL);
+    th_pool.slots[i].begin = 0;
+    th_pool.slots[i].end = 0;
+  }
+  pthread_mutex_init(&th_pool.mutex, NULL);
+  pthread_cond_init(&th_pool.wakeup, NULL);
+  pthread_cond_init(&th_pool.done, NULL);
+  th_pool.generation = 0;
+  th_pool.active = 0;
+  th_pool.stop = 0;
+
+  th_pool.nThreads = 1;
+  for(i = 1; i < n; i++)
+  {
+    if(pthread_create(&th_pool.threads[i], NULL, THPool_main, (void*)(long)i) != 0)
+      break;
+    th_pool.nThreads++;
+  }
+  th_pool_started = 1;
+}
+
+/* must be called with th_pool_jobMutex held */
+static void THPool_stop(void)
+{
+  int i;
+
+  if(!th_pool_started)
+    return;
+
+  pthread_mutex_lock(&th_pool.mutex);
+  th_pool.stop = 1;
+  pthread_cond_broadcast(&th_pool.wakeup);
+  pthread_mutex_unlock(&th_pool.mutex);
+
+  for(i = 1; i < th_pool.nThreads; i++)
+    pthread_join(th_pool.threads[i], NULL);
+
+  for(i = 0; i < th_pool.nThreads; i++)
+    pthread_mutex_destroy(&th_pool.slots[i].mutex);
+  pthread_mutex_destroy(&th_pool.mutex);
+  pthread_cond_destroy(&th_pool.wakeup);
+  pthread_cond_destroy(&th_pool.done);
+  THFree(th_pool.threads);
+  THFree(th_pool.slots);
+  th_pool_started = 0;
+}
+
+#endif
+
+void THThreadPool_setNumThreads(int n)
+{
+#ifndef TH_POOL_SERIAL
+  pthread_mutex_lock(&th_pool_jobMutex);
+  THPool_stop();
+  th_pool_requestedThreads = (n > 0 ? n : 0);
+  pthread_mutex_unlock(&th_pool_jobMutex);
+#else
+  th_pool_requestedThreads = (n > 0 ? n : 0);
+#endif
+}
+
+int THThreadPool_getNumThreads(void)
+{
+#ifndef TH_POOL_SERIAL
+  if(th_pool_requestedThreads > 0)
+    return th_pool_requestedThreads;
+  return THPool_defaultNumThreads();
+#else
+  return 1;
+#endif
+}
+
+int THThreadPool_getRequestedThreads(void)
+{
+  return th_pool_requestedThreads;
+}
+
+void THThreadPool_setGrainSize(long grain)
+{
+  th_pool_grain = (grain > 0 ? grain : TH_PARALLEL_DEFAULT_GRAIN);
+}
+
+long THThreadPool_getGrainSize(void)
+{
+  return th_pool_grain;
+}
+
+void THThreadPool_setAffinity(const int *cpus, int ncpus)
+{
+#ifndef TH_POOL_SERIAL
+  pthread_mutex_lock(&th_pool_jobMutex);
+  THPool_stop();
+  THFree(th_pool_cpus);
+  th_pool_cpus = NULL;
+  th_pool_ncpus = 0;
+  if(cpus && ncpus > 0)
+  {
+    th_pool_cpus = THAlloc(sizeof(int)*ncpus);
+    memcpy(th_pool_cpus, cpus, sizeof(int)*ncpus);
+    th_pool_ncpus = ncpus;
+  }
+  pthread_mutex_unlock(&th_pool_jobMutex);
+#else
+  (void)cpus;
+  (void)ncpus;
+#endif
+}
+
+int THThreadPool_inParallelRegion(void)
+{
+  return th_pool_inParallel;
+}
+
+int THThreadPool_getThreadNum(void)
+{
+  return th_pool_threadNum;
+}
+
+void THThreadPool_shutdown(void)
+{
+#ifndef TH_POOL_SERIAL
+  pthread_mutex_lock(&th_pool_jobMutex);
+  THPool_stop();
+  pthread_mutex_unlock(&th_pool_jobMutex);
+#endif
+}
+
+void THParallel_for(long begin, long end, long grain, THParallelFunction f, void *ctx)
+{
+  long n = end - begin;
+
+  if(n <= 0)
+    return;
+  if(grain <= 0)
+    grain = th_pool_grain;
+
+#ifndef TH_POOL_SERIAL
+  if(n > grain && !th_pool_inParallel && THThreadPool_getNumThreads() > 1 &&
+     pthread_mutex_trylock(&th_pool_jobMutex) == 0)
+  {
+    long nParts;
+    int i;
+
+    THPool_start();
+    nParts = THMin((long)th_pool.nThreads, n/grain);
+    for(i = 0; i < th_pool.nThreads; i++)
+    {
+      th_pool.slots[i].begin = (i < nParts ? begin + (n*i)/nParts : end);
+      th_pool.slots[i].end = (i < nParts ? begin + (n*(i+1))/nParts : end);
+    }
+    th_pool.fn = f;
+    th_pool.ctx = ctx;
+    th_pool.grain = grain;
+
+    pthread_mutex_lock(&th_pool.mutex);
+    th_pool.generation++;
+    th_pool.active = th_pool.nThreads-1;
+    pthread_cond_broadcast(&th_pool.wakeup);
+    pthread_mutex_unlock(&th_pool.mutex);
+
+    th_pool_inParallel = 1;
+    THPool_work(0);
+    th_pool_inParallel = 0;
+
+    pthread_mutex_lock(&th_pool.mutex);
+    while(th_pool.active > 0)
+      pthread_cond_wait(&th_pool.done, &th_pool.mutex);
+    pthread_mutex_unlock(&th_pool.mutex);
+
+    pthread_mutex_unlock(&th_pool_jobMutex);
+    return;
+  }
+#endif
+
+  f(ctx, begin, end);
+}
+
+typedef struct THParallelReduceJob
+{
+    THParallelReduceFunction fn;
+    void *ctx;
+    char *partials;
+    size_t partialSize;
+    long begin;
+    long end;
+    long chunkSize;
+} THParallelReduceJob;
+
+static void THParallel_reduceChunks(void *job_, long firstChunk, long lastChunk)
+{
+  THParallelReduceJob *job = (THParallelReduceJob*)job_;
+  long c;
+  for(c = firstChunk; c < lastChunk; c++)
+  {
+    long b = job->begin + c*job->chunkSize;
+    long e = THMin(b + job->chunkSize, job->end);
+    job->fn(job->ctx, b, e, job->partials + c*job->partialSize);
+  }
+}
+
+void THParallel_reduce(long begin, long end, long grain,
+                       THParallelReduceFunction f, THParallelCombineFunction combine,
+                       void *ctx, void *result, size_t resultSize)
+{
+  THParallelReduceJob job;
+  long n = end - begin;
+  long nChunks, c;
+
+  if(n <= 0)
+    return;
+  if(grain <= 0)
+    grain = th_pool_grain;
+
+  /* the chunking only depends on n and grain: same answer for any thread count */
+  nChunks = THMin((n + grain - 1)/grain, (long)TH_PARALLEL_MAX_CHUNKS);
+  if(nChunks <= 1)
+  {
+    f(ctx, begin, end, result);
+    return;
+  }
+
+  job.fn = f;
+  job.ctx = ctx;
+  job.partialSize = resultSize;
+  job.begin = begin;
+  job.end = end;
+  job.chunkSize = (n + nChunks - 1)/nChunks;
+  nChunks = (n + job.chunkSize - 1)/job.chunkSize;
+  job.partials = THAlloc(resultSize*nChunks);
+  for(c = 0; c < nChunks; c++)
+    memcpy(job.partials + c*resultSize, result, resultSize);
+
+  THParallel_for(0, nChunks, 1, THParallel_reduceChunks, &job);
+
+  for(c = 0; c < nChunks; c++)
+    combine(ctx, result, job.partials + c*resultSize);
+  THFree(job.partials);
+}
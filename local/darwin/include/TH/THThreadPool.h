@@ -0,0 +1,78 @@
+#ifndef TH_THREAD_POOL_INC
+#define TH_THREAD_POOL_INC
+
+#include "THGeneral.h"
+
+/******************************************************************************
+ * Persistent thread pool for TH kernels
+ *  - workers are created lazily on the first parallel call and kept alive
+ *  - ranges are split per worker and rebalanced by work stealing
+ *  - calls made from inside a parallel region run inline (no oversubscription)
+ *  - on platforms without pthreads everything runs on the calling thread
+ ******************************************************************************/
+
+/* default grain: ranges with fewer elements than this run serially */
+#define TH_PARALLEL_DEFAULT_GRAIN 100000
+
+/* process [begin, end) */
+typedef void (*THParallelFunction)(void *ctx, long begin, long end);
+
+/* accumulate [begin, end) into partial */
+typedef void (*THParallelReduceFunction)(void *ctx, long begin, long end, void *partial);
+
+/* result <- result (op) partial */
+typedef void (*THParallelCombineFunction)(void *ctx, void *result, const void *partial);
+
+/*
+ * number of threads used by the pool, the calling thread included.
+ * n <= 0 restores the default (TH_NUM_THREADS env variable, or the number of
+ * online cpus). Must not be called while a parallel region is running.
+*/
+TH_API void THThreadPool_setNumThreads(int n);
+TH_API int THThreadPool_getNumThreads(void);
+/* the count last given to setNumThreads, 0 while on the default: passing it
+   back to setNumThreads restores the current setting */
+TH_API int THThreadPool_getRequestedThreads(void);
+
+/*
+ * minimum number of elements handed to a worker when a kernel passes
+ * grain <= 0 to THParallel_for/THParallel_reduce
+*/
+TH_API void THThreadPool_setGrainSize(long grain);
+TH_API long THThreadPool_getGrainSize(void);
+
+/*
+ * pin worker i (1..n-1) to cpus[i % ncpus]; cpus[0] is left to the calling
+ * thread, which TH never pins. cpus == NULL or ncpus <= 0 removes the pinning.
+ * Linux only, ignored elsewhere.
+*/
+TH_API void THThreadPool_setAffinity(const int *cpus, int ncpus);
+
+/* 1 if called from a pool worker or from a thread running a parallel region */
+TH_API int THThreadPool_inParallelRegion(void);
+
+/* index of the current thread in the pool: 0 for the caller, 1..n-1 for workers */
+TH_API int THThreadPool_getThreadNum(void);
+
+/* join all workers; the pool is re-created on the next parallel call */
+TH_API void THThreadPool_shutdown(void);
+
+/*
+ * f(ctx, b, e) is called on disjoint sub-ranges covering [begin, end).
+ * Sub-ranges hold grain elements (grain <= 0: pool grain size), the tail of a
+ * range being possibly shorter; ranges of at most grain elements run inline.
+ * f must not raise a THError.
+*/
+TH_API void THParallel_for(long begin, long end, long grain, THParallelFunction f, void *ctx);
+
+/*
+ * [begin, end) is split in a fixed number of chunks (independent of the
+ * scheduling, so results are reproducible); each chunk is accumulated by f
+ * into a copy of *result (which must hold the identity element), and the
+ * partials are then folded into result with combine, in chunk order.
+*/
+TH_API void THParallel_reduce(long begin, long end, long grain,
+                              THParallelReduceFunction f, THParallelCombineFunction combine,
+                              void *ctx, void *result, size_t resultSize);
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef TH_GENERIC_FILE
+#define TH_GENERIC_FILE "generic/THBenchmark.c"
+#else
+
+#if defined(TH_REAL_IS_FLOAT)
+#define TH_BENCHMARK_TYPE "float"
+#define TH_BENCHMARK_REAL_EPS FLT_EPSILON
+#define TH_BENCHMARK_ACCREAL_EPS DBL_EPSILON
+#else
+#define TH_BENCHMARK_TYPE "double"
+#define TH_BENCHMARK_REAL_EPS DBL_EPSILON
+#define TH_BENCHMARK_ACCREAL_EPS DBL_EPSILON
+#endif
+
+/* deterministic, well conditioned values */
+static void THTensor_(benchmarkInit)(THTensor *t)
+{
+  long i = 0;
+  TH_TENSOR_APPLY(real, t, *t_data = (real)((i++ % 97) + 1) / 97;);
+}
+
+/* n elements, every other element of a 2n storage */
+static THTensor *THTensor_(benchmarkStrided1d)(long n)
+{
+  THStorage *storage = THStorage_(newWithSize)(2*n);
+  THTensor *t = THTensor_(newWithStorage1d)(storage, 0, n, 2);
+  THStorage_(free)(storage);
+  THTensor_(benchmarkInit)(t);
+  return t;
+}
+
+static THTensor *THTensor_(benchmarkVector)(long n, int strided)
+{
+  THTensor *t;
+  if(strided)
+    return THTensor_(benchmarkStrided1d)(n);
+  t = THTensor_(newWithSize1d)(n);
+  THTensor_(benchmarkInit)(t);
+  return t;
+}
+
+/* rows x cols; transposed: view on a contiguous cols x rows tensor */
+static THTensor *THTensor_(benchmarkMatrix)(long rows, long cols, int transposed)
+{
+  THTensor *t;
+  if(transposed)
+  {
+    THTensor *tt = THTensor_(newWithSize2d)(cols, rows);
+    THTensor_(benchmarkInit)(tt);
+    t = THTensor_(newTranspose)(tt, 0, 1);
+    THTensor_(free)(tt);
+    return t;
+  }
+  t = THTensor_(newWithSize2d)(rows, cols);
+  THTensor_(benchmarkInit)(t);
+  return t;
+}
+
+static void THTensor_(benchmarkAddmm)(THBenchmarkContext *ctx)
+{
+  size_t s;
+  int layout;
+
+  if(!THBenchmark_selected(ctx, "addmm"))
+    return;
+
+  for(s = 0; s < sizeof(th_benchmark_addmm_shapes)/sizeof(th_benchmark_addmm_shapes[0]); s++)
+  {
+    long M = th_benchmark_addmm_shapes[s][0];
+    long N = th_benchmark_addmm_shapes[s][1];
+    long K = th_benchmark_addmm_shapes[s][2];
+    char shape[64];
+    snprintf(shape, sizeof(shape), "%ldx%ldx%ld", M, N, K);
+
+    for(layout = 0; layout < 2; layout++)
+    {
+      THTensor *m1 = THTensor_(benchmarkMatrix)(M, K, layout);
+      THTensor *m2 = THTensor_(benchmarkMatrix)(K, N, layout);
+      THTensor *r = THTensor_(newWithSize2d)(M, N);
+      double seconds;
+
+      THTensor_(zero)(r);
+      TH_BENCHMARK_TIME(ctx, seconds, THTensor_(addmm)(r, 0, r, 1, m1, m2));
+      THBenchmark_report(ctx, "addmm", TH_BENCHMARK_TYPE, shape, (layout ? "transposed" : "contiguous"),
+                         seconds, 2.0*M*N*K, (double)(M*K + K*N + M*N)*sizeof(real));
+
+      THTensor_(free)(m1);
+      THTensor_(free)(m2);
+      THTensor_(free)(r);
+    }
+  }
+}
+
+static void THTensor_(benchmarkConv2Dmm)(THBenchmarkContext *ctx)
+{
+  size_t s;
+
+  if(!THBenchmark_selected(ctx, "conv2Dmm"))
+    return;
+
+  for(s = 0; s < sizeof(th_benchmark_conv_shapes)/sizeof(th_benchmark_conv_shapes[0]); s++)
+  {
+    const long *c = th_benchmark_conv_shapes[s];
+    long oH = c[2] - c[5] + 1, oW = c[3] - c[6] + 1;
+    THTensor *input = THTensor_(newWithSize4d)(c[0], c[1], c[2], c[3]);
+    THTensor *kernel = THTensor_(newWithSize4d)(c[4], c[1], c[5], c[6]);
+    THTensor *output = THTensor_(new)();
+    char shape[96];
+    double seconds;
+
+    snprintf(shape, sizeof(shape), "%ldx%ldx%ldx%ld*%ldx%ldx%ld", c[0], c[1], c[2], c[3], c[4], c[5], c[6]);
+    THTensor_(benchmarkInit)(input);
+    THTensor_(benchmarkInit)(kernel);
+
+    TH_BENCHMARK_TIME(ctx, seconds, THTensor_(conv2Dmm)(output, 0, 1, input, kernel, 1, 1, "V", "X"));
+    THBenchmark_report(ctx, "conv2Dmm", TH_BENCHMARK_TYPE, shape, "contiguous", seconds,
+                       2.0*c[0]*c[4]*c[1]*oH*oW*c[5]*c[6],
+                       (double)(THTensor_(nElement)(input) + THTensor_(nElement)(kernel) + THTensor_(nElement)(output))*sizeof(real));
+
+    THTensor_(free)(input);
+    THTensor_(free)(kernel);
+    THTensor_(free)(output);
+  }
+}
+
+static void THTensor_(benchmarkSort)(THBenchmarkContext *ctx)
+{
+  static const long sizes[][2] = { {1, 1L << 20}, {1024, 1024} }; /* rows, cols: sorted along cols */
+  size_t s;
+
+  for(s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+  {
+    THTensor *t = THTensor_(newWithSize2d)(sizes[s][0], sizes[s][1]);
+    THTensor *rt = THTensor_(new)();
+    THLongTensor *ri = THLongTensor_new();
+    double n = (double)sizes[s][0]*sizes[s][1];
+    double seconds;
+    char shape[64];
+
+    snprintf(shape, sizeof(shape), "%ldx%ld", sizes[s][0], sizes[s][1]);
+    THTensor_(benchmarkInit)(t);
+
+    if(THBenchmark_selected(ctx, "sort"))
+    {
+      TH_BENCHMARK_TIME(ctx, seconds, THTensor_(sort)(rt, ri, t, 1, 0));
+      THBenchmark_report(ctx, "sort", TH_BENCHMARK_TYPE, shape, "contiguous", seconds,
+                         0, n*(2*sizeof(real) + sizeof(long)));
+    }
+    if(THBenchmark_selected(ctx, "topk"))
+    {
+      TH_BENCHMARK_TIME(ctx, seconds, THTensor_(topk)(rt, ri, t, 10, 1, 1, 1));
+      THBenchmark_report(ctx, "topk", TH_BENCHMARK_TYPE, shape, "contiguous", seconds,
+                         0, n*sizeof(real));
+    }
+
+    THTensor_(free)(t);
+    THTensor_(free)(rt);
+    THLongTensor_free(ri);
+  }
+}
+
+/* the THVector kernels, reached through the tensor functions using them */
+static void THTensor_(benchmarkVectorOps)(THBenchmarkContext *ctx)
+{
+  size_t s;
+  int strided;
+
+  for(s = 0; s < sizeof(th_benchmark_vector_sizes)/sizeof(th_benchmark_vector_sizes[0]); s++)
+  {
+    long n = th_benchmark_vector_sizes[s];
+    char shape[32];
+    snprintf(shape, sizeof(shape), "%ld", n);
+
+    for(strided = 0; strided < 2; strided++)
+    {
+      const char *layout = (strided ? "strided" : "contiguous");
+      THTensor *x = THTensor_(benchmarkVector)(n, strided);
+      THTensor *y = THTensor_(benchmarkVector)(n, strided);
+      THTensor *r = THTensor_(benchmarkVector)(n, strided);
+      double seconds;
+      accreal sum = 0;
+
+      if(THBenchmark_selected(ctx, "fill"))
+      {
+        TH_BENCHMARK_TIME(ctx, seconds, THTensor_(fill)(r, 1));
+        THBenchmark_report(ctx, "fill", TH_BENCHMARK_TYPE, shape, layout, seconds, 0, (double)n*sizeof(real));
+      }
+      if(THBenchmark_selected(ctx, "add"))
+      {
+        TH_BENCHMARK_TIME(ctx, seconds, THTensor_(add)(r, x, 1));
+        THBenchmark_report(ctx, "add", TH_BENCHMARK_TYPE, shape, layout, seconds, n, 2.0*n*sizeof(real));
+      }
+      if(THBenchmark_selected(ctx, "cmul"))
+      {
+        TH_BENCHMARK_TIME(ctx, seconds, THTensor_(cmul)(r, x, y));
+        THBenchmark_report(ctx, "cmul", TH_BENCHMARK_TYPE, shape, layout, seconds, n, 3.0*n*sizeof(real));
+      }
+      if(THBenchmark_selected(ctx, "cadd"))
+      {
+        TH_BENCHMARK_TIME(ctx, seconds, THTensor_(cadd)(r, x, 2, y));
+        THBenchmark_report(ctx, "cadd", TH_BENCHMARK_TYPE, shape, layout, seconds, 2.0*n, 3.0*n*sizeof(real));
+      }
+      if(THBenchmark_selected(ctx, "sumall"))
+      {
+        TH_BENCHMARK_TIME(ctx, seconds, sum += THTensor_(sumall)(x));
+        THBenchmark_report(ctx, "sumall", TH_BENCHMARK_TYPE, shape, layout, seconds, n, (double)n*sizeof(real));
+      }
+      (void)sum;
+
+      THTensor_(free)(x);
+      THTensor_(free)(y);
+      THTensor_(free)(r);
+    }
+  }
+}
+
+/* layout 0: contiguous, 1: every other element, 2: transposed 3 x n/3 */
+static THTensor *THTensor_(benchmarkAccumulateOperand)(long n, int layout)
+{
+  if(layout == 2)
+    return THTensor_(benchmarkMatrix)(3, n/3, 1);
+  return THTensor_(benchmarkVector)(n, layout == 1);
+}
+
+/*
+  Accuracy of sumall and dot under each accumulation policy, against a
+  compensated long double reference (a plain long double sum drifts by
+  1e-14 on the largest size). The data is positive, so the relative error
+  bounds of the summation methods apply: a few units of roundoff of real
+  for KAHAN; for PAIRWISE, the 32 sequential additions of a lane in a leaf,
+  the folding of the lanes and log2(n) pairwise levels; n units of roundoff
+  of accreal for ACCREAL. The sizes are not multiples of the lane count nor
+  of the leaf size, and the strided and transposed layouts go through the
+  innermost run paths. Results above their bound count as failures.
+*/
+static void THTensor_(benchmarkAccumulate)(THBenchmarkContext *ctx)
+{
+  static const char *policies[] = { "accreal", "pairwise", "kahan" };
+  static const char *layouts[] = { "contiguous", "strided", "transposed" };
+  size_t s;
+  int layout;
+
+  if(!THBenchmark_selected(ctx, "accumulate"))
+    return;
+
+  for(s = 0; s < sizeof(th_benchmark_accumulate_sizes)/sizeof(th_benchmark_accumulate_sizes[0]); s++)
+  {
+    for(layout = 0; layout < 3; layout++)
+    {
+      THTensor *x = THTensor_(benchmarkAccumulateOperand)(th_benchmark_accumulate_sizes[s], layout);
+      THTensor *y = THTensor_(benchmarkAccumulateOperand)(th_benchmark_accumulate_sizes[s], layout);
+      long n = THTensor_(nElement)(x);
+      long double refSum = 0, refDot = 0, compSum = 0, compDot = 0;
+      char shape[32], name[48];
+      int policy;
+
+      if(n == 0)
+      {
+        THTensor_(free)(x);
+        THTensor_(free)(y);
+        continue;
+      }
+      TH_TENSOR_APPLY2(real, x, real, y,
+                       long double v = *x_data - compSum;
+                       long double t = refSum + v;
+                       compSum = (t - refSum) - v;
+                       refSum = t;
+                       v = (long double)*x_data * *y_data - compDot;
+                       t = refDot + v;
+                       compDot = (t - refDot) - v;
+                       refDot = t;);
+      snprintf(shape, sizeof(shape), "%ld", n);
+
+      for(policy = TH_ACCUMULATE_ACCREAL; policy <= TH_ACCUMULATE_KAHAN; policy++)
+      {
+        double eps = TH_BENCHMARK_REAL_EPS;
+        double bound = 4*eps;
+        accreal sum = THTensor_(sumallWith)(x, policy);
+        accreal dot = THTensor_(dotWith)(x, y, policy);
+        if(policy == TH_ACCUMULATE_PAIRWISE)
+          bound = eps*(48 + log2((double)n));
+        else if(policy == TH_ACCUMULATE_ACCREAL)
+          bound = THMax(n, 4)*TH_BENCHMARK_ACCREAL_EPS;
+        snprintf(name, sizeof(name), "%s/%s", layouts[layout], policies[policy]);
+        THBenchmark_reportError(ctx, "accumulate.sumall", TH_BENCHMARK_TYPE, shape, name,
+                                fabs((double)((sum - refSum)/refSum)), bound);
+        THBenchmark_reportError(ctx, "accumulate.dot", TH_BENCHMARK_TYPE, shape, name,
+                                fabs((double)((dot - refDot)/refDot)), bound);
+      }
+
+      THTensor_(free)(x);
+      THTensor_(free)(y);
+    }
+  }
+}
+
+static void THTensor_(benchmarkBlas)(THBenchmarkContext *ctx)
+{
+  long n = 1L << 22, m = 4096;
+  int inc;
+
+  for(inc = 1; inc <= 2; inc++)
+  {
+    const char *layout = (inc == 1 ? "contiguous" : "strided");
+    THTensor *x = THTensor_(benchmarkVector)(n, inc == 2);
+    THTensor *y = THTensor_(benchmarkVector)(n, inc == 2);
+    real *xp = THTensor_(data)(x);
+    real *yp = THTensor_(data)(y);
+    double seconds;
+    real dot = 0;
+    char shape[32];
+
+    snprintf(shape, sizeof(shape), "%ld", n);
+    if(THBenchmark_selected(ctx, "blas.dot"))
+    {
+      TH_BENCHMARK_TIME(ctx, seconds, dot += THBlas_(dot)(n, xp, inc, yp, inc));
+      THBenchmark_report(ctx, "blas.dot", TH_BENCHMARK_TYPE, shape, layout, seconds, 2.0*n, 2.0*n*sizeof(real));
+    }
+    if(THBenchmark_selected(ctx, "blas.axpy"))
+    {
+      TH_BENCHMARK_TIME(ctx, seconds, THBlas_(axpy)(n, 1e-3, xp, inc, yp, inc));
+      THBenchmark_report(ctx, "blas.axpy", TH_BENCHMARK_TYPE, shape, layout, seconds, 2.0*n, 3.0*n*sizeof(real));
+    }
+    (void)dot;
+
+    if(THBenchmark_selected(ctx, "blas.gemv"))
+    {
+      /* m x m matrix; strided: leading dimension twice the row length */
+      THTensor *a = THTensor_(newWithSize1d)(m*m*inc);
+      THTensor *v = THTensor_(benchmarkVector)(m, inc == 2);
+      THTensor *w = THTensor_(benchmarkVector)(m, inc == 2);
+      THTensor_(benchmarkInit)(a);
+      snprintf(shape, sizeof(shape), "%ldx%ld", m, m);
+      TH_BENCHMARK_TIME(ctx, seconds, THBlas_(gemv)('n', m, m, 1, THTensor_(data)(a), m*inc,
+                                                     THTensor_(data)(v), inc, 0, THTensor_(data)(w), inc));
+      THBenchmark_report(ctx, "blas.gemv", TH_BENCHMARK_TYPE, shape, layout, seconds,
+                         2.0*m*m, (double)(m*m + 2*m)*sizeof(real));
+      THTensor_(free)(a);
+      THTensor_(free)(v);
+      THTensor_(free)(w);
+    }
+
+    THTensor_(free)(x);
+    THTensor_(free)(y);
+  }
+}
+
+static void THTensor_(benchmark)(THBenchmarkContext *ctx)
+{
+  THTensor_(benchmarkAddmm)(ctx);
+  THTensor_(benchmarkConv2Dmm)(ctx);
+  THTensor_(benchmarkSort)(ctx);
+  THTensor_(benchmarkVectorOps)(ctx);
+  THTensor_(benchmarkBlas)(ctx);
+  THTensor_(benchmarkAccumulate)(ctx);
+}
+
+#undef TH_BENCHMARK_TYPE
+#undef TH_BENCHMARK_REAL_EPS
+#undef TH_BENCHMARK_ACCREAL_EPS
+
+#endif
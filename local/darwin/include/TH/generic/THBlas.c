@@ -24,9 +24,63 @@ TH_EXTERNC void dger_(int *m, int *n, double *alpha, double *x, int *incx, doubl
 TH_EXTERNC void sger_(int *m, int *n, float *alpha, float *x, int *incx, float *y, int *incy, float *a, int *lda);
 TH_EXTERNC void dgemm_(char *transa, char *transb, int *m, int *n, int *k, double *alpha, double *a, int *lda, double *b, int *ldb, double *beta, double *c, int *ldc);
 TH_EXTERNC void sgemm_(char *transa, char *transb, int *m, int *n, int *k, float *alpha, float *a, int *lda, float *b, int *ldb, float *beta, float *c, int *ldc);
+TH_EXTERNC void dtrmm_(char *side, char *uplo, char *transa, char *diag, int *m, int *n, double *alpha, double *a, int *lda, double *b, int *ldb);
+TH_EXTERNC void strmm_(char *side, char *uplo, char *transa, char *diag, int *m, int *n, float *alpha, float *a, int *lda, float *b, int *ldb);
+TH_EXTERNC void dsyrk_(char *uplo, char *trans, int *n, int *k, double *alpha, double *a, int *lda, double *beta, double *c, int *ldc);
+TH_EXTERNC void ssyrk_(char *uplo, char *trans, int *n, int *k, float *alpha, float *a, int *lda, float *beta, float *c, int *ldc);
     
  
 
+/*
+  Fallback kernels (no BLAS, or sizes beyond the int BLAS interface).
+  Reductions keep TH_BLAS_LANES independent partial sums, one per lane of a
+  unit stride block: the lanes do not depend on each other, so the compiler
+  can hold them in vector registers (contracting the multiply-adds into
+  FMAs where the target has them) instead of serializing every addition on
+  a single accumulator.
+*/
+#ifndef TH_BLAS_LANES
+#define TH_BLAS_LANES 8
+#endif
+
+static real THBlas_(dotContiguous)(long n, const real *x, const real *y)
+{
+  real acc[TH_BLAS_LANES];
+  real sum = 0;
+  long i, l;
+
+  for(l = 0; l < TH_BLAS_LANES; l++)
+    acc[l] = 0;
+  for(i = 0; i + TH_BLAS_LANES <= n; i += TH_BLAS_LANES)
+    for(l = 0; l < TH_BLAS_LANES; l++)
+      acc[l] += x[i+l]*y[i+l];
+  for(l = 0; l < TH_BLAS_LANES; l++)
+    sum += acc[l];
+  for(; i < n; i++)
+    sum += x[i]*y[i];
+  return sum;
+}
+
+/* y += a*x, unit strides; each block of lanes is loaded before being
+   stored, which lets the compiler treat it as one vector operation */
+static void THBlas_(axpyContiguous)(long n, real a, const real *x, real *y)
+{
+  real xl[TH_BLAS_LANES], yl[TH_BLAS_LANES];
+  long i, l;
+  for(i = 0; i + TH_BLAS_LANES <= n; i += TH_BLAS_LANES)
+  {
+    for(l = 0; l < TH_BLAS_LANES; l++)
+    {
+      xl[l] = x[i+l];
+      yl[l] = y[i+l];
+    }
+    for(l = 0; l < TH_BLAS_LANES; l++)
+      y[i+l] = yl[l] + a*xl[l];
+  }
+  for(; i < n; i++)
+    y[i] += a*x[i];
+}
+
 void THBlas_(swap)(long n, real *x, long incx, real *y, long incy)
 {
   if(n == 1)
@@ -142,8 +196,13 @@ void THBlas_(axpy)(long n, real a, real *x, long incx, real *y, long incy)
 #endif
   {
     long i;
-    for(i = 0; i < n; i++)
-      y[i*incy] += a*x[i*incx];
+    if(incx == 1 && incy == 1)
+      THBlas_(axpyContiguous)(n, a, x, y);
+    else
+    {
+      for(i = 0; i < n; i++)
+        y[i*incy] += a*x[i*incx];
+    }
   }
 }
 
@@ -172,12 +231,161 @@ real THBlas_(dot)(long n, real *x, long incx, real *y, long incy)
   {
     long i;
     real sum = 0;
+    if(incx == 1 && incy == 1)
+      return THBlas_(dotContiguous)(n, x, y);
     for(i = 0; i < n; i++)
-    sum += x[i*incx]*y[i*incy];
+      sum += x[i*incx]*y[i*incy];
     return sum;
   }
 }
 
+typedef struct THBlas_(GemvArgs)
+{
+  long m;
+  long n;
+  real alpha;
+  real *a;
+  long lda;
+  real *x;
+  long incx;
+  real beta;
+  real *y;
+  long incy;
+} THBlas_(GemvArgs);
+
+/*
+  y[i] = beta*y[i] + alpha*dot(column i, x) for the columns [begin, end),
+  four at a time so that each load of x feeds four columns
+*/
+static void THBlas_(gemvTransKernel)(void *args_, long begin, long end)
+{
+  THBlas_(GemvArgs) *args = (THBlas_(GemvArgs)*)args_;
+  long m = args->m, lda = args->lda, incx = args->incx, incy = args->incy;
+  real alpha = args->alpha, beta = args->beta;
+  real *x = args->x, *y = args->y;
+  long i = begin, j, l;
+
+  for(; i + 4 <= end; i += 4)
+  {
+    const real *c0 = args->a + lda*i, *c1 = c0 + lda, *c2 = c1 + lda, *c3 = c2 + lda;
+    real s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    j = 0;
+    if(incx == 1)
+    {
+      real a0[4] = {0, 0, 0, 0}, a1[4] = {0, 0, 0, 0}, a2[4] = {0, 0, 0, 0}, a3[4] = {0, 0, 0, 0};
+      for(; j + 4 <= m; j += 4)
+      {
+        for(l = 0; l < 4; l++)
+        {
+          real xj = x[j+l];
+          a0[l] += c0[j+l]*xj;
+          a1[l] += c1[j+l]*xj;
+          a2[l] += c2[j+l]*xj;
+          a3[l] += c3[j+l]*xj;
+        }
+      }
+      for(l = 0; l < 4; l++)
+      {
+        s0 += a0[l];
+        s1 += a1[l];
+        s2 += a2[l];
+        s3 += a3[l];
+      }
+    }
+    for(; j < m; j++)
+    {
+      real xj = x[j*incx];
+      s0 += c0[j]*xj;
+      s1 += c1[j]*xj;
+      s2 += c2[j]*xj;
+      s3 += c3[j]*xj;
+    }
+    y[i*incy] = beta*y[i*incy] + alpha*s0;
+    y[(i+1)*incy] = beta*y[(i+1)*incy] + alpha*s1;
+    y[(i+2)*incy] = beta*y[(i+2)*incy] + alpha*s2;
+    y[(i+3)*incy] = beta*y[(i+3)*incy] + alpha*s3;
+  }
+  for(; i < end; i++)
+  {
+    real sum = THBlas_(dot)(m, x, incx, args->a + lda*i, 1);
+    y[i*incy] = beta*y[i*incy] + alpha*sum;
+  }
+}
+
+/*
+  y[begin:end] = beta*y[begin:end] + alpha*a[begin:end,:]*x, walking the
+  columns four at a time so that each element of y is loaded and stored
+  once per four columns (the additions stay in column order)
+*/
+static void THBlas_(gemvKernel)(void *args_, long begin, long end)
+{
+  THBlas_(GemvArgs) *args = (THBlas_(GemvArgs)*)args_;
+  long n = args->n, lda = args->lda, incx = args->incx, incy = args->incy;
+  real alpha = args->alpha, beta = args->beta;
+  real *x = args->x, *y = args->y;
+  long i, j = 0;
+
+  if(beta != 1)
+  {
+    for(i = begin; i < end; i++)
+      y[i*incy] *= beta;
+  }
+
+  for(; j + 4 <= n; j += 4)
+  {
+    const real *c0 = args->a + lda*j, *c1 = c0 + lda, *c2 = c1 + lda, *c3 = c2 + lda;
+    real z0 = alpha*x[j*incx], z1 = alpha*x[(j+1)*incx], z2 = alpha*x[(j+2)*incx], z3 = alpha*x[(j+3)*incx];
+    if(incy == 1)
+    {
+      real yl[TH_BLAS_LANES];
+      long l;
+      for(i = begin; i + TH_BLAS_LANES <= end; i += TH_BLAS_LANES)
+      {
+        for(l = 0; l < TH_BLAS_LANES; l++)
+          yl[l] = y[i+l];
+        for(l = 0; l < TH_BLAS_LANES; l++)
+          yl[l] += z0*c0[i+l];
+        for(l = 0; l < TH_BLAS_LANES; l++)
+          yl[l] += z1*c1[i+l];
+        for(l = 0; l < TH_BLAS_LANES; l++)
+          yl[l] += z2*c2[i+l];
+        for(l = 0; l < TH_BLAS_LANES; l++)
+          yl[l] += z3*c3[i+l];
+        for(l = 0; l < TH_BLAS_LANES; l++)
+          y[i+l] = yl[l];
+      }
+      for(; i < end; i++)
+      {
+        real yi = y[i];
+        yi += z0*c0[i];
+        yi += z1*c1[i];
+        yi += z2*c2[i];
+        yi += z3*c3[i];
+        y[i] = yi;
+      }
+    }
+    else
+    {
+      for(i = begin; i < end; i++)
+      {
+        real yi = y[i*incy];
+        yi += z0*c0[i];
+        yi += z1*c1[i];
+        yi += z2*c2[i];
+        yi += z3*c3[i];
+        y[i*incy] = yi;
+      }
+    }
+  }
+  for(; j < n; j++)
+  {
+    const real *column_ = args->a + lda*j;
+    real z = alpha*x[j*incx];
+    for(i = begin; i < end; i++)
+      y[i*incy] += z*column_[i];
+  }
+}
+
 void THBlas_(gemv)(char trans, long m, long n, real alpha, real *a, long lda, real *x, long incx, real beta, real *y, long incy)
 {
   if(n == 1)
@@ -204,31 +412,59 @@ void THBlas_(gemv)(char trans, long m, long n, real alpha, real *a, long lda, re
   }
 #endif
   {
-    long i, j;
+    /* threads take disjoint parts of y: columns of a when transposed,
+       row blocks (of all the columns) otherwise */
+    THBlas_(GemvArgs) args;
+    args.m = m;
+    args.n = n;
+    args.alpha = alpha;
+    args.a = a;
+    args.lda = lda;
+    args.x = x;
+    args.incx = incx;
+    args.beta = beta;
+    args.y = y;
+    args.incy = incy;
 
     if( (trans == 'T') || (trans == 't') )
-    {
-      for(i = 0; i < n; i++)
-      {
-        real sum = 0;
-        real *row_ = a+lda*i;
-        for(j = 0; j < m; j++)
-          sum += x[j*incx]*row_[j];
-        y[i*incy] = beta*y[i*incy] + alpha*sum;
-      }
-    }
+      THParallel_for(0, n, THMax(4, THThreadPool_getGrainSize()/THMax(m, 1)),
+                     THBlas_(gemvTransKernel), &args);
+    else
+      THParallel_for(0, m, THMax(64, THThreadPool_getGrainSize()/THMax(n, 1)),
+                     THBlas_(gemvKernel), &args);
+  }
+}
+
+typedef struct THBlas_(GerArgs)
+{
+  long m;
+  real alpha;
+  real *x;
+  long incx;
+  real *y;
+  long incy;
+  real *a;
+  long lda;
+} THBlas_(GerArgs);
+
+/* columns [begin, end) of a += alpha*x*y' */
+static void THBlas_(gerKernel)(void *args_, long begin, long end)
+{
+  THBlas_(GerArgs) *args = (THBlas_(GerArgs)*)args_;
+  long m = args->m, incx = args->incx;
+  real *x = args->x;
+  long i, j;
+
+  for(j = begin; j < end; j++)
+  {
+    real *column_ = args->a + j*args->lda;
+    real z = args->alpha*args->y[j*args->incy];
+    if(incx == 1)
+      THBlas_(axpyContiguous)(m, z, x, column_);
     else
     {
-      if(beta != 1)
-        THBlas_(scal)(m, beta, y, incy);
-      
-      for(j = 0; j < n; j++)
-      {
-        real *column_ = a+lda*j;
-        real z = alpha*x[j*incx];
-        for(i = 0; i < m; i++)
-          y[i*incy] += z*column_[i];
-      }
+      for(i = 0; i < m; i++)
+        column_[i] += z*x[i*incx];
     }
   }
 }
@@ -256,14 +492,16 @@ void THBlas_(ger)(long m, long n, real alpha, real *x, long incx, real *y, long
   }
 #endif
   {
-    long i, j;
-    for(j = 0; j < n; j++)
-    {
-      real *column_ = a+j*lda;
-      real z = alpha*y[j*incy];
-      for(i = 0; i < m; i++)
-        column_[i] += z*x[i*incx] ;
-    }
+    THBlas_(GerArgs) args;
+    args.m = m;
+    args.alpha = alpha;
+    args.x = x;
+    args.incx = incx;
+    args.y = y;
+    args.incy = incy;
+    args.a = a;
+    args.lda = lda;
+    THParallel_for(0, n, THMax(1, THThreadPool_getGrainSize()/THMax(m, 1)), THBlas_(gerKernel), &args);
   }
 }
 
@@ -388,4 +626,264 @@ void THBlas_(gemm)(char transa, char transb, long m, long n, long k, real alpha,
   }
 }
 
+typedef struct THBlas_(TrmmArgs)
+{
+  int upper;
+  int trans;
+  int unit;
+  long m;
+  long n;
+  real alpha;
+  real *a;
+  long lda;
+  real *b;
+  long ldb;
+} THBlas_(TrmmArgs);
+
+/* columns [begin, end) of b := alpha*op(a)*b, one triangular product per
+   column. Without transpose the columns of a are walked with axpys, with a
+   transpose they become dots; either way only the stored triangle is read. */
+static void THBlas_(trmmLeftKernel)(void *args_, long begin, long end)
+{
+  THBlas_(TrmmArgs) *args = (THBlas_(TrmmArgs)*)args_;
+  long m = args->m, lda = args->lda;
+  real *a = args->a;
+  real alpha = args->alpha;
+  long i, j;
+
+  for(j = begin; j < end; j++)
+  {
+    real *x = args->b + j*args->ldb;
+    if(!args->trans && args->upper)
+    {
+      for(i = 0; i < m; i++)
+      {
+        real z = alpha*x[i];
+        THBlas_(axpyContiguous)(i, z, a + i*lda, x);
+        x[i] = (args->unit ? z : z*a[i+i*lda]);
+      }
+    }
+    else if(!args->trans)
+    {
+      for(i = m-1; i >= 0; i--)
+      {
+        real z = alpha*x[i];
+        x[i] = (args->unit ? z : z*a[i+i*lda]);
+        THBlas_(axpyContiguous)(m-i-1, z, a + i+1 + i*lda, x + i+1);
+      }
+    }
+    else if(args->upper)
+    {
+      for(i = m-1; i >= 0; i--)
+      {
+        real z = (args->unit ? x[i] : x[i]*a[i+i*lda]);
+        z += THBlas_(dotContiguous)(i, a + i*lda, x);
+        x[i] = alpha*z;
+      }
+    }
+    else
+    {
+      for(i = 0; i < m; i++)
+      {
+        real z = (args->unit ? x[i] : x[i]*a[i+i*lda]);
+        z += THBlas_(dotContiguous)(m-i-1, a + i+1 + i*lda, x + i+1);
+        x[i] = alpha*z;
+      }
+    }
+  }
+}
+
+/* rows [begin, end) of b := alpha*b*op(a). Column j of the result only
+   mixes the columns l on the nonzero side of op(a), so walking j away from
+   them lets every column be updated in place. */
+static void THBlas_(trmmRightKernel)(void *args_, long begin, long end)
+{
+  THBlas_(TrmmArgs) *args = (THBlas_(TrmmArgs)*)args_;
+  long n = args->n, lda = args->lda, ldb = args->ldb;
+  real *a = args->a;
+  real *b = args->b + begin;
+  real alpha = args->alpha;
+  long len = end-begin;
+  int tupper = (args->upper != args->trans);
+  long i, j, l;
+
+  for(j = (tupper ? n-1 : 0); (tupper ? j >= 0 : j < n); j += (tupper ? -1 : 1))
+  {
+    real *y = b + j*ldb;
+    real z = (args->unit ? alpha : alpha*a[j+j*lda]);
+    for(i = 0; i < len; i++)
+      y[i] *= z;
+    for(l = (tupper ? 0 : j+1); l < (tupper ? j : n); l++)
+    {
+      real coef = (args->trans ? a[j+l*lda] : a[l+j*lda]);
+      if(coef != 0)
+        THBlas_(axpyContiguous)(len, alpha*coef, b + l*ldb, y);
+    }
+  }
+}
+
+void THBlas_(trmm)(char side, char uplo, char transa, char diag, long m, long n, real alpha, real *a, long lda, real *b, long ldb)
+{
+  int left = ((side == 'l') || (side == 'L'));
+  long na = (left ? m : n);
+
+  if(n == 1)
+    ldb = m;
+  if(na == 1)
+    lda = 1;
+
+#if defined(USE_BLAS) && (defined(TH_REAL_IS_DOUBLE) || defined(TH_REAL_IS_FLOAT))
+  if( (m <= INT_MAX) && (n <= INT_MAX) && (lda <= INT_MAX) && (ldb <= INT_MAX) )
+  {
+    int i_m = (int)m;
+    int i_n = (int)n;
+    int i_lda = (int)lda;
+    int i_ldb = (int)ldb;
+
+#if defined(TH_REAL_IS_DOUBLE)
+    dtrmm_(&side, &uplo, &transa, &diag, &i_m, &i_n, &alpha, a, &i_lda, b, &i_ldb);
+#else
+    strmm_(&side, &uplo, &transa, &diag, &i_m, &i_n, &alpha, a, &i_lda, b, &i_ldb);
+#endif
+    return;
+  }
+#endif
+  {
+    THBlas_(TrmmArgs) args;
+    long j;
+
+    if(alpha == 0)
+    {
+      for(j = 0; j < n; j++)
+        memset(b + j*ldb, 0, m*sizeof(real));
+      return;
+    }
+
+    args.upper = ((uplo == 'u') || (uplo == 'U'));
+    args.trans = ((transa == 't') || (transa == 'T') || (transa == 'c') || (transa == 'C'));
+    args.unit = ((diag == 'u') || (diag == 'U'));
+    args.m = m;
+    args.n = n;
+    args.alpha = alpha;
+    args.a = a;
+    args.lda = lda;
+    args.b = b;
+    args.ldb = ldb;
+
+    /* about half of op(a) is touched per column (left) or row (right) */
+    if(left)
+      THParallel_for(0, n, THMax(1, THThreadPool_getGrainSize()/THMax(m*m/2, 1)),
+                     THBlas_(trmmLeftKernel), &args);
+    else
+      THParallel_for(0, m, THMax(64, THThreadPool_getGrainSize()/THMax(n*n/2, 1)),
+                     THBlas_(trmmRightKernel), &args);
+  }
+}
+
+typedef struct THBlas_(SyrkArgs)
+{
+  int upper;
+  int trans;
+  long n;
+  long k;
+  real alpha;
+  real *a;
+  long lda;
+  real beta;
+  real *c;
+  long ldc;
+} THBlas_(SyrkArgs);
+
+/* columns [begin, end) of the stored triangle of c := alpha*op(a)*op(a)' + beta*c */
+static void THBlas_(syrkKernel)(void *args_, long begin, long end)
+{
+  THBlas_(SyrkArgs) *args = (THBlas_(SyrkArgs)*)args_;
+  long n = args->n, k = args->k, lda = args->lda;
+  real *a = args->a;
+  real alpha = args->alpha, beta = args->beta;
+  long i, j, l;
+
+  for(j = begin; j < end; j++)
+  {
+    long i0 = (args->upper ? 0 : j);
+    long i1 = (args->upper ? j+1 : n);
+    real *c_ = args->c + j*args->ldc;
+
+    /* beta == 0 must not read c, which may hold garbage */
+    if(beta == 0)
+      memset(c_ + i0, 0, (i1-i0)*sizeof(real));
+    else if(beta != 1)
+    {
+      for(i = i0; i < i1; i++)
+        c_[i] *= beta;
+    }
+
+    if(args->trans)
+    {
+      real *aj = a + j*lda;
+      for(i = i0; i < i1; i++)
+        c_[i] += alpha*THBlas_(dotContiguous)(k, a + i*lda, aj);
+    }
+    else
+    {
+      for(l = 0; l < k; l++)
+      {
+        real z = alpha*a[j+l*lda];
+        if(z != 0)
+          THBlas_(axpyContiguous)(i1-i0, z, a + i0 + l*lda, c_ + i0);
+      }
+    }
+  }
+}
+
+void THBlas_(syrk)(char uplo, char trans, long n, long k, real alpha, real *a, long lda, real beta, real *c, long ldc)
+{
+  int trans_ = ((trans == 't') || (trans == 'T') || (trans == 'c') || (trans == 'C'));
+
+  if(n == 1)
+    ldc = 1;
+  if(trans_)
+  {
+    if(n == 1)
+      lda = k;
+  }
+  else
+  {
+    if(k == 1)
+      lda = n;
+  }
+
+#if defined(USE_BLAS) && (defined(TH_REAL_IS_DOUBLE) || defined(TH_REAL_IS_FLOAT))
+  if( (n <= INT_MAX) && (k <= INT_MAX) && (lda <= INT_MAX) && (ldc <= INT_MAX) )
+  {
+    int i_n = (int)n;
+    int i_k = (int)k;
+    int i_lda = (int)lda;
+    int i_ldc = (int)ldc;
+
+#if defined(TH_REAL_IS_DOUBLE)
+    dsyrk_(&uplo, &trans, &i_n, &i_k, &alpha, a, &i_lda, &beta, c, &i_ldc);
+#else
+    ssyrk_(&uplo, &trans, &i_n, &i_k, &alpha, a, &i_lda, &beta, c, &i_ldc);
+#endif
+    return;
+  }
+#endif
+  {
+    THBlas_(SyrkArgs) args;
+    args.upper = ((uplo == 'u') || (uplo == 'U'));
+    args.trans = trans_;
+    args.n = n;
+    args.k = k;
+    args.alpha = alpha;
+    args.a = a;
+    args.lda = lda;
+    args.beta = beta;
+    args.c = c;
+    args.ldc = ldc;
+    THParallel_for(0, n, THMax(1, THThreadPool_getGrainSize()/THMax(n*k/2, 1)),
+                   THBlas_(syrkKernel), &args);
+  }
+}
+
 #endif
@@ -16,4 +16,12 @@ TH_API void THBlas_(ger)(long m, long n, real alpha, real *x, long incx, real *y
 /* Level 3 */
 TH_API void THBlas_(gemm)(char transa, char transb, long m, long n, long k, real alpha, real *a, long lda, real *b, long ldb, real beta, real *c, long ldc);
 
+/* b := alpha*op(a)*b (side 'l') or alpha*b*op(a) (side 'r'), a triangular
+   ('u'pper or 'l'ower, 'u'nit diagonal or 'n'ot); the other half of a is
+   never read */
+TH_API void THBlas_(trmm)(char side, char uplo, char transa, char diag, long m, long n, real alpha, real *a, long lda, real *b, long ldb);
+/* c := alpha*a*a' + beta*c (trans 'n', a is n x k) or alpha*a'*a + beta*c
+   (trans 't', a is k x n); only the uplo triangle of c is computed */
+TH_API void THBlas_(syrk)(char uplo, char trans, long n, long k, real alpha, real *a, long lda, real beta, real *c, long ldc);
+
 #endif
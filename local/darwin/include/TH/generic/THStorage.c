@@ -24,6 +24,8 @@ THStorage* THStorage_(new)(void)
 
 THStorage* THStorage_(newWithSize)(long size)
 {
+  if(THNuma_getPolicy() != TH_NUMA_DEFAULT)
+    return THStorage_(newWithAllocator)(size, &THNumaAllocator, NULL);
   return THStorage_(newWithAllocator)(size, &THDefaultAllocator, NULL);
 }
 
@@ -104,7 +106,12 @@ void THStorage_(clearFlag)(THStorage *storage, const char flag)
 void THStorage_(retain)(THStorage *storage)
 {
   if(storage && (storage->flag & TH_STORAGE_REFCOUNTED))
-    THAtomicIncrementRef(&storage->refcount);
+  {
+    if(storage->flag & TH_STORAGE_CONFINED)
+      storage->refcount++;
+    else
+      THAtomicIncrementRefInline(&storage->refcount);
+  }
 }
 
 void THStorage_(free)(THStorage *storage)
@@ -112,9 +119,14 @@ void THStorage_(free)(THStorage *storage)
   if(!storage)
     return;
 
-  if((storage->flag & TH_STORAGE_REFCOUNTED) && (THAtomicGet(&storage->refcount) > 0))
+  if(storage->flag & TH_STORAGE_REFCOUNTED)
   {
-    if(THAtomicDecrementRef(&storage->refcount))
+    int last;
+    if(storage->flag & TH_STORAGE_CONFINED)
+      last = (storage->refcount > 0 && --storage->refcount == 0);
+    else
+      last = (THAtomicGetInline(&storage->refcount) > 0 && THAtomicDecrementRefInline(&storage->refcount));
+    if(last)
     {
       if(storage->flag & TH_STORAGE_FREEMEM) {
         storage->allocator->free(storage->allocatorContext, storage->data);
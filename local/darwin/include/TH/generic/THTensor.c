@@ -225,6 +225,38 @@ THTensor *THTensor_(newUnfold)(THTensor *tensor, int dimension_, long size_, lon
   return self;
 }
 
+/*
+  Views of consecutive slices of splitSize along dimension (the last one
+  may be smaller); no data is copied. Returns a THAlloc'ed array of
+  *numOutputs new tensors, each to be freed, then the array with THFree.
+*/
+THTensor **THTensor_(split)(THTensor *tensor, long splitSize, int dimension, int *numOutputs)
+{
+  THTensor **outputs;
+  long dimSize, offset;
+  int i, n;
+
+  THArgCheck(dimension >= 0 && dimension < tensor->nDimension, 3, "out of range");
+  THArgCheck(splitSize > 0, 2, "split size must be positive");
+
+  dimSize = tensor->size[dimension];
+  n = (int)((dimSize + splitSize - 1) / splitSize);
+  outputs = THAlloc(sizeof(THTensor*)*THMax(n, 1));
+  for(i = 0, offset = 0; i < n; i++, offset += splitSize)
+    outputs[i] = THTensor_(newNarrow)(tensor, dimension, offset, THMin(splitSize, dimSize - offset));
+  *numOutputs = n;
+  return outputs;
+}
+
+/* split in at most nChunks views of equal size (but the last) along dimension */
+THTensor **THTensor_(chunk)(THTensor *tensor, int nChunks, int dimension, int *numOutputs)
+{
+  THArgCheck(nChunks > 0, 2, "number of chunks must be positive");
+  THArgCheck(dimension >= 0 && dimension < tensor->nDimension, 3, "out of range");
+  return THTensor_(split)(tensor, THMax(1, (tensor->size[dimension] + nChunks - 1) / nChunks),
+                          dimension, numOutputs);
+}
+
 /* Resize */
 void THTensor_(resize)(THTensor *self, THLongStorage *size, THLongStorage *stride)
 {
@@ -415,9 +447,22 @@ void THTensor_(unfold)(THTensor *self, THTensor *src, int dimension, long size,
   THArgCheck((dimension >= 0) && (dimension < src->nDimension), 2, "out of range");
   THArgCheck(size <= src->size[dimension], 3, "out of range");
   THArgCheck(step > 0, 4, "invalid step");
+  THArgCheck(!(self->flag & TH_TENSOR_VIEW) || src->nDimension < TH_TENSOR_VIEW_MAX_DIMS, 1,
+             "tensor views are limited to %d dimensions", TH_TENSOR_VIEW_MAX_DIMS);
 
   THTensor_(set)(self, src);
 
+  if(self->flag & TH_TENSOR_VIEW)
+  {
+    /* in place: the inline arrays have room for the new dimension */
+    self->size[self->nDimension] = size;
+    self->stride[self->nDimension] = self->stride[dimension];
+    self->size[dimension] = (self->size[dimension] - size) / step + 1;
+    self->stride[dimension] *= step;
+    self->nDimension++;
+    return;
+  }
+
   newSize = THAlloc(sizeof(long)*(self->nDimension+1));
   newStride = THAlloc(sizeof(long)*(self->nDimension+1));
 
@@ -445,6 +490,57 @@ void THTensor_(unfold)(THTensor *self, THTensor *src, int dimension, long size,
   self->nDimension++;
 }
 
+/**** non-owning views ****/
+
+THTensor *THTensor_(viewOf)(THTensorView *view, THTensor *src)
+{
+  THTensor *self = &view->tensor;
+
+  THArgCheck(src->nDimension <= TH_TENSOR_VIEW_MAX_DIMS, 2, "tensor views are limited to %d dimensions",
+             TH_TENSOR_VIEW_MAX_DIMS);
+  if(src != self && src->nDimension > 0)
+  {
+    memcpy(view->size, src->size, sizeof(long)*src->nDimension);
+    memcpy(view->stride, src->stride, sizeof(long)*src->nDimension);
+  }
+  self->size = view->size;
+  self->stride = view->stride;
+  self->nDimension = src->nDimension;
+  self->storage = src->storage;
+  self->storageOffset = src->storageOffset;
+  self->refcount = 1;
+  self->flag = TH_TENSOR_VIEW;
+  return self;
+}
+
+THTensor *THTensor_(viewSelect)(THTensorView *view, THTensor *src, int dimension_, long sliceIndex_)
+{
+  THTensor *self = THTensor_(viewOf)(view, src);
+  THTensor_(select)(self, NULL, dimension_, sliceIndex_);
+  return self;
+}
+
+THTensor *THTensor_(viewNarrow)(THTensorView *view, THTensor *src, int dimension_, long firstIndex_, long size_)
+{
+  THTensor *self = THTensor_(viewOf)(view, src);
+  THTensor_(narrow)(self, NULL, dimension_, firstIndex_, size_);
+  return self;
+}
+
+THTensor *THTensor_(viewTranspose)(THTensorView *view, THTensor *src, int dimension1_, int dimension2_)
+{
+  THTensor *self = THTensor_(viewOf)(view, src);
+  THTensor_(transpose)(self, NULL, dimension1_, dimension2_);
+  return self;
+}
+
+THTensor *THTensor_(viewUnfold)(THTensorView *view, THTensor *src, int dimension_, long size_, long step_)
+{
+  THTensor *self = THTensor_(viewOf)(view, src);
+  THTensor_(unfold)(self, NULL, dimension_, size_, step_);
+  return self;
+}
+
 /* we have to handle the case where the result is a number */
 void THTensor_(squeeze)(THTensor *self, THTensor *src)
 {
@@ -578,10 +674,43 @@ long THTensor_(nElement)(const THTensor *self)
   }
 }
 
+long THTensor_(numaPlacement)(const THTensor *self, long *pagesPerNode, int nNodes)
+{
+  long nElement = THTensor_(nElement)(self);
+  long span = 1, nPages, i;
+  int *nodes;
+  int d;
+
+  for(d = 0; d < nNodes; d++)
+    pagesPerNode[d] = 0;
+  if(nElement == 0 || !self->storage)
+    return 0;
+
+  for(d = 0; d < self->nDimension; d++)
+    span += (self->size[d]-1)*self->stride[d];
+  span *= sizeof(real);
+
+  nPages = THNuma_pageNodes(self->storage->data + self->storageOffset, span, NULL, 0);
+  nodes = THAlloc(sizeof(int)*nPages);
+  THNuma_pageNodes(self->storage->data + self->storageOffset, span, nodes, nPages);
+  for(i = 0; i < nPages; i++)
+  {
+    if(nodes[i] >= 0 && nodes[i] < nNodes)
+      pagesPerNode[nodes[i]]++;
+  }
+  THFree(nodes);
+  return nPages;
+}
+
 void THTensor_(retain)(THTensor *self)
 {
   if(self->flag & TH_TENSOR_REFCOUNTED)
-    THAtomicIncrementRef(&self->refcount);
+  {
+    if(self->flag & TH_TENSOR_CONFINED)
+      self->refcount++;
+    else
+      THAtomicIncrementRefInline(&self->refcount);
+  }
 }
 
 void THTensor_(free)(THTensor *self)
@@ -591,7 +720,12 @@ void THTensor_(free)(THTensor *self)
 
   if(self->flag & TH_TENSOR_REFCOUNTED)
   {
-    if(THAtomicDecrementRef(&self->refcount))
+    int last;
+    if(self->flag & TH_TENSOR_CONFINED)
+      last = (--self->refcount == 0);
+    else
+      last = THAtomicDecrementRefInline(&self->refcount);
+    if(last)
     {
       THFree(self->size);
       THFree(self->stride);
@@ -626,7 +760,12 @@ static void THTensor_(rawInit)(THTensor *self)
 static void THTensor_(rawSet)(THTensor *self, THStorage *storage, long storageOffset, int nDimension, long *size, long *stride)
 {
   /* storage */
-  if(self->storage != storage)
+  if(self->storage != storage && (self->flag & TH_TENSOR_VIEW))
+  {
+    /* views do not own their storage */
+    self->storage = storage;
+  }
+  else if(self->storage != storage)
   {
     if(self->storage)
       THStorage_(free)(self->storage);
@@ -683,8 +822,14 @@ static void THTensor_(rawResize)(THTensor *self, int nDimension, long *size, lon
   {
     if(nDimension != self->nDimension)
     {
-      self->size = THRealloc(self->size, sizeof(long)*nDimension);
-      self->stride = THRealloc(self->stride, sizeof(long)*nDimension);
+      if(self->flag & TH_TENSOR_VIEW)
+        THArgCheck(nDimension <= TH_TENSOR_VIEW_MAX_DIMS, 1, "tensor views are limited to %d dimensions",
+                   TH_TENSOR_VIEW_MAX_DIMS);
+      else
+      {
+        self->size = THRealloc(self->size, sizeof(long)*nDimension);
+        self->stride = THRealloc(self->stride, sizeof(long)*nDimension);
+      }
       self->nDimension = nDimension;
     }
 
@@ -707,7 +852,11 @@ static void THTensor_(rawResize)(THTensor *self, int nDimension, long *size, lon
     if(totalSize+self->storageOffset > 0)
     {
       if(!self->storage)
+      {
+        if(self->flag & TH_TENSOR_VIEW)
+          THError("a tensor view can not allocate a storage");
         self->storage = THStorage_(new)();
+      }
       if(totalSize+self->storageOffset > self->storage->size)
         THStorage_(resize)(self->storage, totalSize+self->storageOffset);
     }
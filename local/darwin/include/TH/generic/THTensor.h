@@ -6,6 +6,15 @@
 
 #define TH_TENSOR_REFCOUNTED 1
 
+/*
+  The tensor is only reachable from one thread: retain and free count its
+  references with plain increments instead of atomics. Set it with setFlag
+  from that thread, and clear it before handing the tensor to another one
+  (through a mutex, a queue or a thread creation, which publish the count).
+  The storage has its own TH_STORAGE_CONFINED flag.
+*/
+#define TH_TENSOR_CONFINED 4
+
 typedef struct THTensor
 {
     long *size;
@@ -20,6 +29,26 @@ typedef struct THTensor
 
 } THTensor;
 
+/*
+  Non-owning view: a THTensor followed by inline size and stride arrays, to
+  be declared on the stack. The view* functions below make its tensor
+  describe (part of) another tensor without allocating anything nor
+  touching reference counts; the result can be passed to any function
+  taking a THTensor, as input or as output, as long as it does not need to
+  allocate a storage or go beyond TH_TENSOR_VIEW_MAX_DIMS dimensions.
+  The view does not retain the storage: it must not outlive the viewed
+  tensor. THTensor_(free) and THTensor_(retain) do nothing on it.
+*/
+#define TH_TENSOR_VIEW 2
+#define TH_TENSOR_VIEW_MAX_DIMS 16
+
+typedef struct THTensorView
+{
+    THTensor tensor;
+    long size[TH_TENSOR_VIEW_MAX_DIMS];
+    long stride[TH_TENSOR_VIEW_MAX_DIMS];
+} THTensorView;
+
 
 /**** access methods ****/
 TH_API THStorage* THTensor_(storage)(const THTensor *self);
@@ -68,6 +97,15 @@ TH_API THTensor *THTensor_(newSelect)(THTensor *tensor, int dimension_, long sli
 TH_API THTensor *THTensor_(newNarrow)(THTensor *tensor, int dimension_, long firstIndex_, long size_);
 TH_API THTensor *THTensor_(newTranspose)(THTensor *tensor, int dimension1_, int dimension2_);
 TH_API THTensor *THTensor_(newUnfold)(THTensor *tensor, int dimension_, long size_, long step_);
+TH_API THTensor **THTensor_(split)(THTensor *tensor, long splitSize, int dimension, int *numOutputs);
+TH_API THTensor **THTensor_(chunk)(THTensor *tensor, int nChunks, int dimension, int *numOutputs);
+
+/* non-owning views; src may be the view itself, to chain them */
+TH_API THTensor *THTensor_(viewOf)(THTensorView *view, THTensor *src);
+TH_API THTensor *THTensor_(viewSelect)(THTensorView *view, THTensor *src, int dimension_, long sliceIndex_);
+TH_API THTensor *THTensor_(viewNarrow)(THTensorView *view, THTensor *src, int dimension_, long firstIndex_, long size_);
+TH_API THTensor *THTensor_(viewTranspose)(THTensorView *view, THTensor *src, int dimension1_, int dimension2_);
+TH_API THTensor *THTensor_(viewUnfold)(THTensorView *view, THTensor *src, int dimension_, long size_, long step_);
   
 TH_API void THTensor_(resize)(THTensor *tensor, THLongStorage *size, THLongStorage *stride);
 TH_API void THTensor_(resizeAs)(THTensor *tensor, THTensor *src);
@@ -108,6 +146,10 @@ TH_API int THTensor_(isSetTo)(const THTensor *self, const THTensor *src);
 TH_API int THTensor_(isSize)(const THTensor *self, const THLongStorage *dims);
 TH_API long THTensor_(nElement)(const THTensor *self);
 
+/* pages of the tensor found on each NUMA node (pages not yet touched are not
+   counted); returns the number of pages spanned by the tensor */
+TH_API long THTensor_(numaPlacement)(const THTensor *self, long *pagesPerNode, int nNodes);
+
 TH_API void THTensor_(retain)(THTensor *self);
 TH_API void THTensor_(free)(THTensor *self);
 TH_API void THTensor_(freeCopyTo)(THTensor *self, THTensor *dst);
@@ -12,6 +12,7 @@ void THTensor_(validXCorr2Dptr)(real *r_,
                                        real *k_, long kr, long kc,
                                        long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long or = (ir - kr) / sr + 1;
   long oc = (ic - kc) / sc + 1;
 
@@ -65,6 +66,7 @@ void THTensor_(validConv2Dptr)(real *r_,
                                       real *k_, long kr, long kc,
                                       long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long or = (ir - kr) / sr + 1;
   long oc = (ic - kc) / sc + 1;
 
@@ -118,6 +120,7 @@ void THTensor_(fullConv2Dptr)(real *r_,
                                      real *k_, long kr, long kc,
                                      long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long oc = (ic - 1) * sc + kc;
 
   long xx, yy, kx, ky;
@@ -170,6 +173,7 @@ void THTensor_(fullXCorr2Dptr)(real *r_,
                                       real *k_, long kr, long kc,
                                       long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long oc = (ic - 1) * sc + kc;
 
   long xx, yy, kx, ky;
@@ -225,6 +229,7 @@ void THTensor_(validXCorr2DRevptr)(real *r_,
                                           real *k_, long kr, long kc,
                                           long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long or = ir - (kr - 1) * sr;
   long oc = ic - (kc - 1) * sc;
 
@@ -273,6 +278,7 @@ void THTensor_(validXCorr3Dptr)(real *r_,
                                        real *k_, long kt, long kr, long kc,
                                        long st, long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long ot = (it - kt) / st + 1;
   long or = (ir - kr) / sr + 1;
   long oc = (ic - kc) / sc + 1;
@@ -318,6 +324,7 @@ void THTensor_(validConv3Dptr)(real *r_,
                                       real *k_, long kt, long kr, long kc,
                                       long st, long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long ot = (it - kt) / st + 1;
   long or = (ir - kr) / sr + 1;
   long oc = (ic - kc) / sc + 1;
@@ -364,6 +371,7 @@ void THTensor_(fullConv3Dptr)(real *r_,
                                      real *k_, long kt, long kr, long kc,
                                      long st, long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long or = (ir - 1) * sr + kr;
   long oc = (ic - 1) * sc + kc;
 
@@ -412,6 +420,7 @@ void THTensor_(fullXCorr3Dptr)(real *r_,
                                       real *k_, long kt, long kr, long kc,
                                       long st, long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long or = (ir - 1) * sr + kr;
   long oc = (ic - 1) * sc + kc;
 
@@ -457,6 +466,7 @@ void THTensor_(validXCorr3DRevptr)(real *r_,
                                           real *k_, long kt, long kr, long kc,
                                           long st, long sr, long sc)
 {
+  TH_PROFILE_TENSOR_OP(NULL, NULL, NULL);
   long ot = it - (kt - 1) * st;
   long or = ir - (kr - 1) * sr;
   long oc = ic - (kc - 1) * sc;
@@ -476,8 +486,7 @@ void THTensor_(validXCorr3DRevptr)(real *r_,
         {
           for(ky = 0; ky < or; ky++)
           {
-            for(kx = 0; kx < oc; kx++)
-              po_[kx] += z * pi_[kx];
+            THVector_(add)(po_, pi_, z, oc);
             pi_ += ic;
             po_ += oc;
           }
@@ -572,6 +581,181 @@ long THTensor_(convsize)(long x, long k, long s, const char* vf)
 }
 
 
+/* state shared by the workers of the conv2D* functions below */
+typedef struct THTensor_(Conv2DArgs)
+{
+  real *input_data;
+  real *weight_data;
+  real *output_data;
+  real alpha;
+  real beta;
+  long nbatch, nInputPlane, nInputRows, nInputCols;
+  long nKernelPlane, nKernelRows, nKernelCols;
+  long nOutputPlane, nOutputRows, nOutputCols;
+  long istride0, istride1, kstride0, kstride1;
+  long srow, scol;
+  const char *vf;
+  const char *xc;
+} THTensor_(Conv2DArgs);
+
+/* output planes [begin, end): zeroed if beta == 0, scaled by beta otherwise */
+static void THTensor_(conv2DScalePlanes)(void *args_, long begin, long end)
+{
+  THTensor_(Conv2DArgs) *args = (THTensor_(Conv2DArgs)*)args_;
+  long planeSize = args->nOutputRows*args->nOutputCols;
+  real *ptr_output = args->output_data + begin*planeSize;
+  long l, n = (end-begin)*planeSize;
+  if (args->beta == 0)
+    for (l = 0; l < n; l++)
+      ptr_output[l] = 0.0;
+  else
+    for (l = 0; l < n; l++)
+      ptr_output[l] *= args->beta;
+}
+
+static void THTensor_(conv2DInitOutput)(THTensor_(Conv2DArgs) *args, long nelem, long nPlanes, long nelemNew)
+{
+  long planeSize = args->nOutputRows*args->nOutputCols;
+  if (nelem == 0 || nelem != nelemNew)
+    args->beta = 0;
+  if (args->beta != 1)
+    THParallel_for(0, nPlanes, THMax(1, THThreadPool_getGrainSize()/THMax(planeSize, 1)),
+                   THTensor_(conv2DScalePlanes), args);
+}
+
+static void THTensor_(conv2DRevgerWorker)(void *args_, long begin, long end)
+{
+  THTensor_(Conv2DArgs) *a = (THTensor_(Conv2DArgs)*)args_;
+  long k, i;
+  for(k = begin; k < end; k++)
+  {
+    /* get kernel */
+    real *ptr_weight = a->weight_data+k*a->kstride0;
+
+    for(i = 0; i < a->nInputPlane; i++)
+    {
+      /* get output */
+      real *ptr_output = a->output_data + k*a->nInputPlane*a->nOutputCols*a->nOutputRows + i*a->nOutputCols*a->nOutputRows;
+      /* get input */
+      real *ptr_input = a->input_data+i*a->istride0;
+
+      /* do image, kernel convolution */
+      THTensor_(validXCorr2DRevptr)(ptr_output,
+                                    a->alpha,
+                                    ptr_input,  a->nInputRows,  a->nInputCols,
+                                    ptr_weight, a->nKernelRows, a->nKernelCols,
+                                    a->srow, a->scol);
+    }
+  }
+}
+
+static void THTensor_(conv2DRevgermWorker)(void *args_, long begin, long end)
+{
+  THTensor_(Conv2DArgs) *a = (THTensor_(Conv2DArgs)*)args_;
+  long k, i, p;
+  for(k = begin; k < end; k++)
+  {
+    for(i = 0; i < a->nInputPlane; i++)
+    {
+      for(p = 0; p < a->nbatch; p++)
+      {
+        /* get kernel */
+        real *ptr_weight = a->weight_data + p*a->kstride0 + k*a->kstride1;
+        /* get output */
+        real *ptr_output = a->output_data + k*a->nInputPlane*a->nOutputCols*a->nOutputRows + i*a->nOutputCols*a->nOutputRows;
+        /* get input */
+        real *ptr_input = a->input_data + p*a->istride0 + i*a->istride1;
+
+        /* do image, kernel convolution */
+        THTensor_(validXCorr2DRevptr)(ptr_output,
+                                      a->alpha,
+                                      ptr_input,  a->nInputRows,  a->nInputCols,
+                                      ptr_weight, a->nKernelRows, a->nKernelCols,
+                                      a->srow, a->scol);
+      }
+    }
+  }
+}
+
+static void THTensor_(conv2DgerWorker)(void *args_, long begin, long end)
+{
+  THTensor_(Conv2DArgs) *a = (THTensor_(Conv2DArgs)*)args_;
+  long k, i;
+  for(k = begin; k < end; k++)
+  {
+    /* get kernel */
+    real *ptr_weight = a->weight_data+k*a->kstride0;
+
+    for(i = 0; i < a->nInputPlane; i++)
+    {
+      /* get output */
+      real *ptr_output = a->output_data + k*a->nInputPlane*a->nOutputCols*a->nOutputRows + i*a->nOutputCols*a->nOutputRows;
+      /* get input */
+      real *ptr_input = a->input_data+i*a->istride0;
+
+      /* do image, kernel convolution */
+      THTensor_(conv2d)(ptr_output,
+                        a->alpha,
+                        ptr_input,  a->nInputRows,  a->nInputCols,
+                        ptr_weight, a->nKernelRows, a->nKernelCols,
+                        a->srow, a->scol, a->vf, a->xc);
+    }
+  }
+}
+
+static void THTensor_(conv2DmvWorker)(void *args_, long begin, long end)
+{
+  THTensor_(Conv2DArgs) *a = (THTensor_(Conv2DArgs)*)args_;
+  long k, i;
+  for(k = begin; k < end; k++)
+  {
+    /* get output */
+    real *ptr_output = a->output_data + k*a->nOutputCols*a->nOutputRows;
+    for(i = 0; i < a->nInputPlane; i++)
+    {
+      /* get kernel */
+      real *ptr_weight = a->weight_data + k*a->kstride0 + i*a->kstride1;
+      /* get input */
+      real *ptr_input = a->input_data + i*a->istride0;
+
+      /* do image, kernel convolution */
+      THTensor_(conv2d)(ptr_output,
+                        a->alpha,
+                        ptr_input,  a->nInputRows,  a->nInputCols,
+                        ptr_weight, a->nKernelRows, a->nKernelCols,
+                        a->srow, a->scol, a->vf, a->xc);
+    }
+  }
+}
+
+static void THTensor_(conv2DmmWorker)(void *args_, long begin, long end)
+{
+  THTensor_(Conv2DArgs) *a = (THTensor_(Conv2DArgs)*)args_;
+  long p, k, i;
+  for(p = begin; p < end; p++)
+  {
+    for(k = 0; k < a->nOutputPlane; k++)
+    {
+      /* get output */
+      real *ptr_output = a->output_data + p*a->nOutputPlane*a->nOutputCols*a->nOutputRows + k*a->nOutputCols*a->nOutputRows;
+      for(i = 0; i < a->nInputPlane; i++)
+      {
+        /* get kernel */
+        real *ptr_weight = a->weight_data + k*a->kstride0 + i*a->kstride1;
+        /* get input */
+        real *ptr_input = a->input_data + p*a->nInputPlane*a->nInputRows*a->nInputCols + i*a->nInputRows*a->nInputCols;
+
+        /* do image, kernel convolution */
+        THTensor_(conv2d)(ptr_output,
+                          a->alpha,
+                          ptr_input,  a->nInputRows,  a->nInputCols,
+                          ptr_weight, a->nKernelRows, a->nKernelCols,
+                          a->srow, a->scol, a->vf, a->xc);
+      }
+    }
+  }
+}
+
 /*
   3D input, 3D kernel, 4D output
   like rank1 update
@@ -581,6 +765,7 @@ long THTensor_(convsize)(long x, long k, long s, const char* vf)
 */
 void THTensor_(conv2DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nInputPlane, nInputRows, nInputCols;
   long nKernelPlane, nKernelRows, nKernelCols;
   long nOutputPlane, nOutputRows, nOutputCols;
@@ -591,7 +776,7 @@ void THTensor_(conv2DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_,
   real *weight_data;
   real *output_data;
   long nelem;
-  long k;
+  THTensor_(Conv2DArgs) args;
 
   THArgCheck(t_->nDimension == 3 , 3, "input: 3D Tensor expected");
   THArgCheck(k_->nDimension == 3 , 4, "kernel: 3D Tensor expected");
@@ -624,56 +809,27 @@ void THTensor_(conv2DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_,
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
-  if (nelem == 0 || beta == 0 || nelem != THTensor_(nElement)(r_))
-  {
-    /*THTensor_(zero)(r_);*/
-
-#pragma omp parallel for private(k)
-    for (k = 0; k < r_->size[0]*r_->size[1]; k++)
-    {
-      real* ptr_output = output_data + k*nOutputCols*nOutputRows;
-      long l;
-      for (l = 0; l < nOutputRows*nOutputCols; l++)
-        ptr_output[l] = 0.0;
-    }
-  }
-  else if (beta != 1)
-  {
-    /*THTensor_(mul)(r_, beta);*/
-#pragma omp parallel for private(k)
-    for (k = 0; k < r_->size[0]*r_->size[1]; k++)
-    {
-      real* ptr_output = output_data + k*nOutputCols*nOutputRows;
-      long l;
-      for (l = 0; l < nOutputRows*nOutputCols; l++)
-        ptr_output[l] *= beta;
-    }
-  }
-
-#pragma omp parallel for private(k)
-  for(k = 0; k < nKernelPlane; k++)
-  {
-    long i;
-    /* get kernel */
-    real *ptr_weight = weight_data+k*kstride0;
-
-    for(i = 0; i < nInputPlane; i++)
-    {
-      /* get output */
-      real *ptr_output = output_data + k*nInputPlane*nOutputCols*nOutputRows + i*nOutputCols*nOutputRows;
-      /* get input */
-      real *ptr_input = input_data+i*istride0;
+  memset(&args, 0, sizeof(args));
+  args.input_data = input_data;
+  args.weight_data = weight_data;
+  args.output_data = output_data;
+  args.alpha = alpha;
+  args.beta = beta;
+  args.nInputPlane = nInputPlane;
+  args.nInputRows = nInputRows;
+  args.nInputCols = nInputCols;
+  args.nKernelRows = nKernelRows;
+  args.nKernelCols = nKernelCols;
+  args.nOutputRows = nOutputRows;
+  args.nOutputCols = nOutputCols;
+  args.srow = srow;
+  args.scol = scol;
+  args.istride0 = istride0;
+  args.kstride0 = kstride0;
+  THTensor_(conv2DInitOutput)(&args, nelem, r_->size[0]*r_->size[1], THTensor_(nElement)(r_));
+
+  THParallel_for(0, nKernelPlane, 1, THTensor_(conv2DRevgerWorker), &args);
 
-      /* do image, kernel convolution */
-      THTensor_(validXCorr2DRevptr)(ptr_output,
-                                    alpha,
-                                    ptr_input,  nInputRows,  nInputCols,
-                                    ptr_weight, nKernelRows, nKernelCols,
-                                    srow, scol);
-      /* Next output plane */
-      /* output_data += nOutputCols*nOutputRows; */
-    }
-  }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
 }
@@ -688,6 +844,7 @@ void THTensor_(conv2DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_,
 */
 void THTensor_(conv2DRevgerm)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nbatch, nInputPlane, nInputRows, nInputCols;
   long nKernelPlane, nKernelRows, nKernelCols;
   long nOutputRows, nOutputCols;
@@ -698,7 +855,7 @@ void THTensor_(conv2DRevgerm)(THTensor *r_, real beta, real alpha, THTensor *t_,
   real *weight_data;
   real *output_data;
   long nelem;
-  long k;
+  THTensor_(Conv2DArgs) args;
 
   THArgCheck(t_->nDimension == 4 , 3, "input: 4D Tensor expected");
   THArgCheck(k_->nDimension == 4 , 4, "kernel: 4D Tensor expected");
@@ -734,59 +891,30 @@ void THTensor_(conv2DRevgerm)(THTensor *r_, real beta, real alpha, THTensor *t_,
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
-  if (nelem == 0 || beta == 0 || nelem != THTensor_(nElement)(r_))
-  {
-    /*THTensor_(zero)(r_);*/
-
-#pragma omp parallel for private(k)
-    for (k = 0; k < r_->size[0]*r_->size[1]; k++)
-    {
-      real* ptr_output = output_data + k*nOutputCols*nOutputRows;
-      long l;
-      for (l = 0; l < nOutputRows*nOutputCols; l++)
-        ptr_output[l] = 0.0;
-    }
-  }
-  else if (beta != 1)
-  {
-    /*THTensor_(mul)(r_, beta);*/
-#pragma omp parallel for private(k)
-    for (k = 0; k < r_->size[0]*r_->size[1]; k++)
-    {
-      real* ptr_output = output_data + k*nOutputCols*nOutputRows;
-      long l;
-      for (l = 0; l < nOutputRows*nOutputCols; l++)
-        ptr_output[l] *= beta;
-    }
-  }
+  memset(&args, 0, sizeof(args));
+  args.input_data = input_data;
+  args.weight_data = weight_data;
+  args.output_data = output_data;
+  args.alpha = alpha;
+  args.beta = beta;
+  args.nInputPlane = nInputPlane;
+  args.nInputRows = nInputRows;
+  args.nInputCols = nInputCols;
+  args.nKernelRows = nKernelRows;
+  args.nKernelCols = nKernelCols;
+  args.nOutputRows = nOutputRows;
+  args.nOutputCols = nOutputCols;
+  args.srow = srow;
+  args.scol = scol;
+  args.nbatch = nbatch;
+  args.istride0 = istride0;
+  args.istride1 = istride1;
+  args.kstride0 = kstride0;
+  args.kstride1 = kstride1;
+  THTensor_(conv2DInitOutput)(&args, nelem, r_->size[0]*r_->size[1], THTensor_(nElement)(r_));
+
+  THParallel_for(0, nKernelPlane, 1, THTensor_(conv2DRevgermWorker), &args);
 
-#pragma omp parallel for private(k)
-  for(k = 0; k < nKernelPlane; k++)
-  {
-    long i;
-    for(i = 0; i < nInputPlane; i++)
-    {
-      long p;
-      for(p = 0; p < nbatch; p++)
-      {
-        /* get kernel */
-        real *ptr_weight = weight_data + p*kstride0 + k*kstride1;
-        /* get output */
-        real *ptr_output = output_data + k*nInputPlane*nOutputCols*nOutputRows + i*nOutputCols*nOutputRows;
-        /* get input */
-        real *ptr_input = input_data + p*istride0 + i*istride1;
-  
-        /* do image, kernel convolution */
-        THTensor_(validXCorr2DRevptr)(ptr_output,
-                                      alpha,
-                                      ptr_input,  nInputRows,  nInputCols,
-                                      ptr_weight, nKernelRows, nKernelCols,
-                                      srow, scol);
-        /* Next output plane */
-        /* output_data += nOutputCols*nOutputRows; */
-      }
-    }
-  }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
 }
@@ -799,6 +927,7 @@ void THTensor_(conv2DRevgerm)(THTensor *r_, real beta, real alpha, THTensor *t_,
 */
 void THTensor_(conv2Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol, const char *vf, const char *xc)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nInputPlane, nInputRows, nInputCols;
   long nKernelPlane, nKernelRows, nKernelCols;
   long nOutputPlane, nOutputRows, nOutputCols;
@@ -810,7 +939,7 @@ void THTensor_(conv2Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   real *weight_data;
   real *output_data;
   long nelem;
-  long k;
+  THTensor_(Conv2DArgs) args;
 
   THArgCheck(t_->nDimension == 3 , 3, "input: 3D Tensor expected");
   THArgCheck(k_->nDimension == 3 , 4, "kernel: 3D Tensor expected");
@@ -850,76 +979,29 @@ void THTensor_(conv2Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
-  if (nelem == 0 || beta == 0 || nelem != THTensor_(nElement)(r_))
-  {
-    /*THTensor_(zero)(r_);*/
-#pragma omp parallel for private(k)
-    for (k = 0; k < r_->size[0]*r_->size[1]; k++)
-    {
-      real* ptr_output = output_data + k*nOutputCols*nOutputRows;
-      long l;
-      for (l = 0; l < nOutputRows*nOutputCols; l++)
-        ptr_output[l] = 0.0;
-    }
-  }
-  else if (beta != 1)
-  {
-    /*THTensor_(mul)(r_, beta);*/
-#pragma omp parallel for private(k)
-    for (k = 0; k < r_->size[0]*r_->size[1]; k++)
-    {
-      real* ptr_output = output_data + k*nOutputCols*nOutputRows;
-      long l;
-      for (l = 0; l < nOutputRows*nOutputCols; l++)
-        ptr_output[l] *= beta;
-    }
-  }
-
-#pragma omp parallel for private(k)
-  for(k = 0; k < nKernelPlane; k++)
-  {
-    long i;
-    /* get kernel */
-    real *ptr_weight = weight_data+k*kstride0;
-
-    for(i = 0; i < nInputPlane; i++)
-    {
-      /* get output */
-      real *ptr_output = output_data + k*nInputPlane*nOutputCols*nOutputRows + i*nOutputCols*nOutputRows;
-      /* get input */
-      real *ptr_input = input_data+i*istride0;
+  memset(&args, 0, sizeof(args));
+  args.input_data = input_data;
+  args.weight_data = weight_data;
+  args.output_data = output_data;
+  args.alpha = alpha;
+  args.beta = beta;
+  args.nInputPlane = nInputPlane;
+  args.nInputRows = nInputRows;
+  args.nInputCols = nInputCols;
+  args.nKernelRows = nKernelRows;
+  args.nKernelCols = nKernelCols;
+  args.nOutputRows = nOutputRows;
+  args.nOutputCols = nOutputCols;
+  args.srow = srow;
+  args.scol = scol;
+  args.istride0 = istride0;
+  args.kstride0 = kstride0;
+  args.vf = vf;
+  args.xc = xc;
+  THTensor_(conv2DInitOutput)(&args, nelem, r_->size[0]*r_->size[1], THTensor_(nElement)(r_));
+
+  THParallel_for(0, nKernelPlane, 1, THTensor_(conv2DgerWorker), &args);
 
-      /* do image, kernel convolution */
-      if (*vf == 'F')
-        if (*xc == 'X')
-          THTensor_(fullXCorr2Dptr)(ptr_output,
-                                    alpha,
-                                    ptr_input,  nInputRows,  nInputCols,
-                                    ptr_weight, nKernelRows, nKernelCols,
-                                    srow, scol);
-        else
-          THTensor_(fullConv2Dptr)(ptr_output,
-                                   alpha,
-                                   ptr_input,  nInputRows,  nInputCols,
-                                   ptr_weight, nKernelRows, nKernelCols,
-                                   srow, scol);
-      else
-        if (*xc == 'X')
-          THTensor_(validXCorr2Dptr)(ptr_output,
-                                     alpha,
-                                     ptr_input,  nInputRows,  nInputCols,
-                                     ptr_weight, nKernelRows, nKernelCols,
-                                     srow, scol);
-        else
-          THTensor_(validConv2Dptr)(ptr_output,
-                                    alpha,
-                                    ptr_input,  nInputRows,  nInputCols,
-                                    ptr_weight, nKernelRows, nKernelCols,
-                                    srow, scol);
-      /* Next output plane */
-      /* output_data += nOutputCols*nOutputRows; */
-    }
-  }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
 }
@@ -932,6 +1014,7 @@ void THTensor_(conv2Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
 */
 void THTensor_(conv2Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol, const char *vf, const char *xc)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nInputPlane, nInputRows, nInputCols;
   long nKernelRows, nKernelCols;
   long nOutputPlane, nOutputRows, nOutputCols;
@@ -942,7 +1025,7 @@ void THTensor_(conv2Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
   real *weight_data;
   real *output_data;
   long nelem;
-  long k;
+  THTensor_(Conv2DArgs) args;
 
   THArgCheck(t_->nDimension == 3 , 3, "input: 3D Tensor expected");
   THArgCheck(k_->nDimension == 4 , 4, "kernel: 4D Tensor expected");
@@ -988,75 +1071,31 @@ void THTensor_(conv2Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
-  if (nelem == 0 || beta == 0 || nelem != THTensor_(nElement)(r_))
-  {
-    /*THTensor_(zero)(r_);*/
-#pragma omp parallel for private(k)
-    for (k = 0; k < r_->size[0]; k++)
-    {
-      real* ptr_output = output_data + k*nOutputCols*nOutputRows;
-      long l;
-      for (l = 0; l < nOutputRows*nOutputCols; l++)
-        ptr_output[l] = 0.0;
-    }
-  }
-  else if (beta != 1)
-  {
-    /*THTensor_(mul)(r_, beta);*/
-#pragma omp parallel for private(k)
-    for (k = 0; k < r_->size[0]; k++)
-    {
-      real* ptr_output = output_data + k*nOutputCols*nOutputRows;
-      long l;
-      for (l = 0; l < nOutputRows*nOutputCols; l++)
-        ptr_output[l] *= beta;
-    }
-  }
-
-#pragma omp parallel for private(k)
-  for(k = 0; k < nOutputPlane; k++)
-  {
-    long i;
-    /* get output */
-    real *ptr_output = output_data + k*nOutputCols*nOutputRows;
-    for(i = 0; i < nInputPlane; i++)
-    {
-      /* get kernel */
-      real *ptr_weight = weight_data + k*kstride0 + i*kstride1;
-      /* get input */
-      real *ptr_input = input_data + i*istride0;
+  memset(&args, 0, sizeof(args));
+  args.input_data = input_data;
+  args.weight_data = weight_data;
+  args.output_data = output_data;
+  args.alpha = alpha;
+  args.beta = beta;
+  args.nInputPlane = nInputPlane;
+  args.nInputRows = nInputRows;
+  args.nInputCols = nInputCols;
+  args.nKernelRows = nKernelRows;
+  args.nKernelCols = nKernelCols;
+  args.nOutputRows = nOutputRows;
+  args.nOutputCols = nOutputCols;
+  args.srow = srow;
+  args.scol = scol;
+  args.nOutputPlane = nOutputPlane;
+  args.istride0 = istride0;
+  args.kstride0 = kstride0;
+  args.kstride1 = kstride1;
+  args.vf = vf;
+  args.xc = xc;
+  THTensor_(conv2DInitOutput)(&args, nelem, r_->size[0], THTensor_(nElement)(r_));
+
+  THParallel_for(0, nOutputPlane, 1, THTensor_(conv2DmvWorker), &args);
 
-      /* do image, kernel convolution */
-      if (*vf == 'F')
-        if (*xc == 'X')
-          THTensor_(fullXCorr2Dptr)(ptr_output,
-                                    alpha,
-                                    ptr_input,  nInputRows,  nInputCols,
-                                    ptr_weight, nKernelRows, nKernelCols,
-                                    srow, scol);
-        else
-          THTensor_(fullConv2Dptr)(ptr_output,
-                                   alpha,
-                                   ptr_input,  nInputRows,  nInputCols,
-                                   ptr_weight, nKernelRows, nKernelCols,
-                                   srow, scol);
-      else
-        if (*xc == 'X')
-          THTensor_(validXCorr2Dptr)(ptr_output,
-                                     alpha,
-                                     ptr_input,  nInputRows,  nInputCols,
-                                     ptr_weight, nKernelRows, nKernelCols,
-                                     srow, scol);
-        else
-          THTensor_(validConv2Dptr)(ptr_output,
-                                    alpha,
-                                    ptr_input,  nInputRows,  nInputCols,
-                                    ptr_weight, nKernelRows, nKernelCols,
-                                    srow, scol);
-    }
-    /* Next output plane */
-    /* output_data += nOutputCols*nOutputRows;*/
-  }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
 }
@@ -1069,6 +1108,7 @@ void THTensor_(conv2Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
 */
 void THTensor_(conv2Dmm)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol, const char *vf, const char *xc)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nInputPlane, nInputRows, nInputCols;
   long nKernelRows, nKernelCols;
   long nOutputPlane, nOutputRows, nOutputCols;
@@ -1080,7 +1120,7 @@ void THTensor_(conv2Dmm)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
   real *input_data;
   real *weight_data;
   real *output_data;
-  long p;
+  THTensor_(Conv2DArgs) args;
 
   THArgCheck(t_->nDimension == 4 , 3, "input: 4D Tensor expected");
   THArgCheck(k_->nDimension == 4 , 4, "kernel: 4D Tensor expected");
@@ -1126,87 +1166,30 @@ void THTensor_(conv2Dmm)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
-  if (nelem == 0 || beta == 0 || nelem != THTensor_(nElement)(r_))
-  {
-    /*THTensor_(zero)(r_);*/
-#pragma omp parallel for private(p)
-    for (p=0; p < r_->size[0]; p++)
-    {
-      long k;
-      for (k = 0; k < r_->size[1]; k++)
-      {
-        real* ptr_output = output_data + p*nOutputPlane*nOutputRows*nOutputCols + k*nOutputCols*nOutputRows;
-        long l;
-        for (l = 0; l < nOutputRows*nOutputCols; l++)
-          ptr_output[l] = 0.0;
-      }
-    }
-  }
-  else if (beta != 1)
-  {
-    /*THTensor_(mul)(r_, beta);*/
-#pragma omp parallel for private(p)
-    for(p=0; p < r_->size[0]; p++)
-    {
-      long k;
-      for (k = 0; k < r_->size[1]; k++)
-      {
-        real* ptr_output = output_data + p*nOutputPlane*nOutputRows*nOutputCols + k*nOutputCols*nOutputRows;
-        long l;
-        for (l = 0; l < nOutputRows*nOutputCols; l++)
-          ptr_output[l] *= beta;
-      }
-    }
-  }
+  memset(&args, 0, sizeof(args));
+  args.input_data = input_data;
+  args.weight_data = weight_data;
+  args.output_data = output_data;
+  args.alpha = alpha;
+  args.beta = beta;
+  args.nInputPlane = nInputPlane;
+  args.nInputRows = nInputRows;
+  args.nInputCols = nInputCols;
+  args.nKernelRows = nKernelRows;
+  args.nKernelCols = nKernelCols;
+  args.nOutputRows = nOutputRows;
+  args.nOutputCols = nOutputCols;
+  args.srow = srow;
+  args.scol = scol;
+  args.nOutputPlane = nOutputPlane;
+  args.kstride0 = kstride0;
+  args.kstride1 = kstride1;
+  args.vf = vf;
+  args.xc = xc;
+  THTensor_(conv2DInitOutput)(&args, nelem, r_->size[0]*r_->size[1], THTensor_(nElement)(r_));
+
+  THParallel_for(0, nbatch, 1, THTensor_(conv2DmmWorker), &args);
 
-#pragma omp parallel for private(p)
-  for(p=0; p < nbatch; p++)
-  {
-    long k;
-    for(k = 0; k < nOutputPlane; k++)
-    {
-      long i;
-      /* get output */
-      real *ptr_output = output_data + p*nOutputPlane*nOutputCols*nOutputRows + k*nOutputCols*nOutputRows;
-      for(i = 0; i < nInputPlane; i++)
-      {
-        /* get kernel */
-        real *ptr_weight = weight_data + k*kstride0 + i*kstride1;
-        /* get input */
-        real *ptr_input = input_data + p*nInputPlane*nInputRows*nInputCols + i*nInputRows*nInputCols;
-  
-        /* do image, kernel convolution */
-        if (*vf == 'F')
-          if (*xc == 'X')
-            THTensor_(fullXCorr2Dptr)(ptr_output,
-                                      alpha,
-                                      ptr_input,  nInputRows,  nInputCols,
-                                      ptr_weight, nKernelRows, nKernelCols,
-                                      srow, scol);
-          else
-            THTensor_(fullConv2Dptr)(ptr_output,
-                                     alpha,
-                                     ptr_input,  nInputRows,  nInputCols,
-                                     ptr_weight, nKernelRows, nKernelCols,
-                                     srow, scol);
-        else
-          if (*xc == 'X')
-            THTensor_(validXCorr2Dptr)(ptr_output,
-                                       alpha,
-                                       ptr_input,  nInputRows,  nInputCols,
-                                       ptr_weight, nKernelRows, nKernelCols,
-                                       srow, scol);
-          else
-            THTensor_(validConv2Dptr)(ptr_output,
-                                      alpha,
-                                      ptr_input,  nInputRows,  nInputCols,
-                                      ptr_weight, nKernelRows, nKernelCols,
-                                      srow, scol);
-      }
-      /* Next output plane */
-      /* output_data += nOutputCols*nOutputRows;*/
-    }
-  }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
 }
@@ -1219,6 +1202,7 @@ void THTensor_(conv2Dmm)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
 */
 void THTensor_(conv2Dmul)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol, const char *vf, const char *xc)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   THTensor *input;
   THTensor* kernel;
   long nInputRows;
@@ -1278,6 +1262,7 @@ void THTensor_(conv2Dmul)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
 */
 void THTensor_(conv2Dcmul)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol, const char *vf, const char *xc)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nInputPlane, nInputRows, nInputCols;
   long nKernelRows, nKernelCols;
   long nOutputPlane, nOutputRows, nOutputCols;
@@ -1434,6 +1419,352 @@ void THTensor_(conv2Dmap)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   THTensor_(free)(kernel);
 }
 
+/* output slices per block of the direct engine: about this many outputs */
+#define TH_CONV3D_BLOCK_ELEMENTS 16384
+/* size cap of the vol2col buffer of the GEMM engine, in elements */
+#define TH_CONV3D_COLUMNS_ELEMENTS (1L << 22)
+
+static int THTensor_(conv3DEngineChoice) = TH_CONV3D_ENGINE_AUTO;
+
+void THTensor_(conv3DSetEngine)(int engine)
+{
+  THArgCheck(engine >= TH_CONV3D_ENGINE_AUTO && engine <= TH_CONV3D_ENGINE_GEMM, 1, "unknown conv3D engine");
+  THTensor_(conv3DEngineChoice) = engine;
+}
+
+int THTensor_(conv3DGetEngine)(void)
+{
+  return THTensor_(conv3DEngineChoice);
+}
+
+/*
+  engine used for nOut output volumes of volumeSize elements, each summing
+  nIn*kvol kernel taps. vol2col copies the input once per tap, to be reused
+  by all the output volumes through a GEMM: worth it with several outputs
+  and a kernel that is not tiny. In auto mode the autotuner (THAutotune.h)
+  may override that guess; the call must then be closed with
+  THAutotune_end(trial) once the engine has run. Full convolutions always use
+  the direct loops.
+*/
+static int THTensor_(conv3DSelectEngine)(THAutotuneTrial *trial, const char *vf,
+                                         long nOut, long nIn, long kvol, long volumeSize)
+{
+  int engine;
+  trial->candidate = -1;
+  if(*vf != 'V')
+    return TH_CONV3D_ENGINE_DIRECT;
+  if(THTensor_(conv3DEngineChoice) != TH_CONV3D_ENGINE_AUTO)
+    return THTensor_(conv3DEngineChoice);
+  engine = (nOut >= 4 && nIn*kvol >= 16) ? TH_CONV3D_ENGINE_GEMM : TH_CONV3D_ENGINE_DIRECT;
+  if(THAutotune_getMode() != TH_AUTOTUNE_OFF)
+  {
+    char key[TH_AUTOTUNE_KEY_SIZE];
+    long shape[4];
+    shape[0] = nOut;
+    shape[1] = nIn;
+    shape[2] = kvol;
+    shape[3] = volumeSize;
+    THAutotune_makeKey(key, "conv3D", TH_CONCAT_STRING_2(Real,Tensor), shape, 4, 0, 0);
+    /* candidates 0 and 1 are the direct and GEMM engines */
+    engine = TH_CONV3D_ENGINE_DIRECT +
+      THAutotune_begin(trial, key, 2, engine - TH_CONV3D_ENGINE_DIRECT);
+  }
+  return engine;
+}
+
+/*
+  valid 3D cross-correlation (convolution if flip) of one volume with one
+  kernel, accumulated into r_. Output slices are processed in blocks small
+  enough to stay in cache while every kernel tap is added to them, one
+  output row at a time (THVector_(add) when sc == 1).
+*/
+static void THTensor_(validConv3DBlocked)(real *r_,
+                                          real alpha,
+                                          real *t_, long it, long ir, long ic,
+                                          real *k_, long kt, long kr, long kc,
+                                          long st, long sr, long sc, int flip)
+{
+  long ot = (it - kt) / st + 1;
+  long or = (ir - kr) / sr + 1;
+  long oc = (ic - kc) / sc + 1;
+  long block = THMax(1, TH_CONV3D_BLOCK_ELEMENTS/(or*oc));
+  long z0, z, yy, xx, kz, ky, kx;
+
+  for(z0 = 0; z0 < ot; z0 += block)
+  {
+    long z1 = THMin(ot, z0 + block);
+    for(kz = 0; kz < kt; kz++)
+    {
+      for(ky = 0; ky < kr; ky++)
+      {
+        for(kx = 0; kx < kc; kx++)
+        {
+          long tap = (flip ? ((kt-1-kz)*kr + (kr-1-ky))*kc + (kc-1-kx) : (kz*kr + ky)*kc + kx);
+          real w = alpha*k_[tap];
+          for(z = z0; z < z1; z++)
+          {
+            real *po_ = r_ + z*or*oc;
+            real *pi_ = t_ + ((z*st + kz)*ir + ky)*ic + kx;
+            for(yy = 0; yy < or; yy++)
+            {
+              if(sc == 1)
+              {
+                THVector_(add)(po_, pi_, w, oc);
+              }
+              else
+              {
+                for(xx = 0; xx < oc; xx++)
+                  po_[xx] += w*pi_[xx*sc];
+              }
+              po_ += oc;
+              pi_ += sr*ic;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/* r_ += alpha * (t_ * k_) for one volume and one kernel, direct engine */
+static void THTensor_(conv3DDirect)(real *r_,
+                                    real alpha,
+                                    real *t_, long it, long ir, long ic,
+                                    real *k_, long kt, long kr, long kc,
+                                    long st, long sr, long sc,
+                                    const char *vf, const char *xc)
+{
+  if(*vf == 'V')
+    THTensor_(validConv3DBlocked)(r_, alpha, t_, it, ir, ic, k_, kt, kr, kc, st, sr, sc, *xc == 'C');
+  else
+    THTensor_(conv3d)(r_, alpha, t_, it, ir, ic, k_, kt, kr, kc, st, sr, sc, vf, xc);
+}
+
+typedef struct THTensor_(Vol2ColArgs)
+{
+  real *columns;
+  real *input;
+  long istride;
+  long ir, ic, kt, kr, kc;
+  long st, sr, sc;
+  long or, oc;
+  long z0, z1;
+} THTensor_(Vol2ColArgs);
+
+/* rows (plane, kz, ky, kx) of the columns: the input values seen by that tap
+   for each output position of slices [z0, z1) */
+static void THTensor_(vol2colKernel)(void *args_, long begin, long end)
+{
+  THTensor_(Vol2ColArgs) *a = (THTensor_(Vol2ColArgs)*)args_;
+  long kvol = a->kt*a->kr*a->kc;
+  long n = (a->z1 - a->z0)*a->or*a->oc;
+  long row, z, yy, xx;
+
+  for(row = begin; row < end; row++)
+  {
+    long plane = row / kvol, tap = row % kvol;
+    long kz = tap / (a->kr*a->kc), ky = (tap / a->kc) % a->kr, kx = tap % a->kc;
+    real *dst = a->columns + row*n;
+    for(z = a->z0; z < a->z1; z++)
+    {
+      for(yy = 0; yy < a->or; yy++)
+      {
+        real *src = a->input + plane*a->istride + ((z*a->st + kz)*a->ir + yy*a->sr + ky)*a->ic + kx;
+        if(a->sc == 1)
+          memcpy(dst, src, a->oc*sizeof(real));
+        else
+          for(xx = 0; xx < a->oc; xx++)
+            dst[xx] = src[xx*a->sc];
+        dst += a->oc;
+      }
+    }
+  }
+}
+
+typedef struct THTensor_(Conv3DGemmArgs)
+{
+  real *columns;
+  long n, k;
+  real alpha;
+  real *weight;
+  long wstride;
+  real *output;
+  long ostride;
+} THTensor_(Conv3DGemmArgs);
+
+/* output volumes [begin, end) of the current block of slices */
+static void THTensor_(conv3DGemmKernel)(void *args_, long begin, long end)
+{
+  THTensor_(Conv3DGemmArgs) *a = (THTensor_(Conv3DGemmArgs)*)args_;
+  THBlas_(gemm)('n', 'n', a->n, end-begin, a->k, a->alpha, a->columns, a->n,
+                a->weight + begin*a->wstride, a->wstride, 1, a->output + begin*a->ostride, a->ostride);
+}
+
+/*
+  GEMM engine, valid mode: output volume p (at output + p*ostride) gets
+  alpha * sum over input planes i of weight[p][i] (*) input[i], where
+  weight[p] (at weight + p*wstride) holds the nPlane kernels of p one after
+  the other, already flipped for a convolution. The output is done in blocks
+  of slices whose columns fit in TH_CONV3D_COLUMNS_ELEMENTS; vol2col is split
+  over the taps and the GEMM over the output volumes.
+*/
+static void THTensor_(conv3DGemm)(real *output, long ostride, long nOut, real alpha,
+                                  real *input, long istride, long nPlane, long it, long ir, long ic,
+                                  real *weight, long wstride, long kt, long kr, long kc,
+                                  long st, long sr, long sc)
+{
+  THTensor_(Vol2ColArgs) cols;
+  THTensor_(Conv3DGemmArgs) gemm;
+  long ot = (it - kt) / st + 1;
+  long k = nPlane*kt*kr*kc;
+  long sliceSize, block;
+
+  cols.input = input;
+  cols.istride = istride;
+  cols.ir = ir; cols.ic = ic;
+  cols.kt = kt; cols.kr = kr; cols.kc = kc;
+  cols.st = st; cols.sr = sr; cols.sc = sc;
+  cols.or = (ir - kr) / sr + 1;
+  cols.oc = (ic - kc) / sc + 1;
+  sliceSize = cols.or*cols.oc;
+  block = THMax(1, THMin(ot, TH_CONV3D_COLUMNS_ELEMENTS/(k*sliceSize)));
+  cols.columns = THAlloc(sizeof(real)*k*block*sliceSize);
+
+  gemm.columns = cols.columns;
+  gemm.k = k;
+  gemm.alpha = alpha;
+  gemm.weight = weight;
+  gemm.wstride = wstride;
+  gemm.ostride = ostride;
+
+  for(cols.z0 = 0; cols.z0 < ot; cols.z0 += block)
+  {
+    cols.z1 = THMin(ot, cols.z0 + block);
+    gemm.n = (cols.z1 - cols.z0)*sliceSize;
+    gemm.output = output + cols.z0*sliceSize;
+    THParallel_for(0, k, THMax(1, THThreadPool_getGrainSize()/gemm.n), THTensor_(vol2colKernel), &cols);
+    THParallel_for(0, nOut, THMax(1, THThreadPool_getGrainSize()/(gemm.n*k)), THTensor_(conv3DGemmKernel), &gemm);
+  }
+  THFree(cols.columns);
+}
+
+/* nKernel kernels of kvol elements each, as a contiguous matrix; reversed
+   (i.e. flipped in all 3 dimensions) for a convolution */
+static THTensor *THTensor_(conv3DGemmWeight)(THTensor *kernel, long nKernel, long kvol, const char *xc)
+{
+  THTensor *weight;
+  if(*xc != 'C')
+    return THTensor_(newContiguous)(kernel);
+
+  weight = THTensor_(newWithSize1d)(nKernel*kvol);
+  {
+    THTensor *src = THTensor_(newContiguous)(kernel);
+    real *s = THTensor_(data)(src);
+    real *w = THTensor_(data)(weight);
+    long j, l;
+    for(j = 0; j < nKernel; j++)
+      for(l = 0; l < kvol; l++)
+        w[j*kvol + l] = s[j*kvol + kvol-1-l];
+    THTensor_(free)(src);
+  }
+  return weight;
+}
+
+/* state shared by the workers of the conv3D* functions below */
+typedef struct THTensor_(Conv3DArgs)
+{
+  real *input_data;
+  real *weight_data;
+  real *output_data;
+  real alpha;
+  real beta;
+  long nInputPlane, nInputDepth, nInputRows, nInputCols;
+  long nKernelPlane, nKernelDepth, nKernelRows, nKernelCols;
+  long nOutputPlane, nOutputDepth, nOutputRows, nOutputCols;
+  long istride0, istride1, kstride0, kstride1;
+  long sdepth, srow, scol;
+  const char *vf;
+  const char *xc;
+} THTensor_(Conv3DArgs);
+
+/* output volumes [begin, end): zeroed if beta == 0, scaled by beta otherwise */
+static void THTensor_(conv3DScaleVolumes)(void *args_, long begin, long end)
+{
+  THTensor_(Conv3DArgs) *args = (THTensor_(Conv3DArgs)*)args_;
+  long volumeSize = args->nOutputDepth*args->nOutputRows*args->nOutputCols;
+  real *ptr_output = args->output_data + begin*volumeSize;
+  long l, n = (end-begin)*volumeSize;
+  if (args->beta == 0)
+    for (l = 0; l < n; l++)
+      ptr_output[l] = 0.0;
+  else
+    for (l = 0; l < n; l++)
+      ptr_output[l] *= args->beta;
+}
+
+static void THTensor_(conv3DInitOutput)(THTensor_(Conv3DArgs) *args, long nelem, long nVolumes, long nelemNew)
+{
+  long volumeSize = args->nOutputDepth*args->nOutputRows*args->nOutputCols;
+  if (nelem == 0 || nelem != nelemNew)
+    args->beta = 0;
+  if (args->beta != 1)
+    THParallel_for(0, nVolumes, THMax(1, THThreadPool_getGrainSize()/THMax(volumeSize, 1)),
+                   THTensor_(conv3DScaleVolumes), args);
+}
+
+/* tasks: (kernel k, input plane i) pairs, output volume k*nInputPlane+i */
+static void THTensor_(conv3DRevgerWorker)(void *args_, long begin, long end)
+{
+  THTensor_(Conv3DArgs) *a = (THTensor_(Conv3DArgs)*)args_;
+  long volumeSize = a->nOutputDepth*a->nOutputRows*a->nOutputCols;
+  long task;
+  for(task = begin; task < end; task++)
+  {
+    long k = task / a->nInputPlane, i = task % a->nInputPlane;
+    THTensor_(validXCorr3DRevptr)(a->output_data + task*volumeSize,
+                                  a->alpha,
+                                  a->input_data + i*a->istride0, a->nInputDepth, a->nInputRows, a->nInputCols,
+                                  a->weight_data + k*a->kstride0, a->nKernelDepth, a->nKernelRows, a->nKernelCols,
+                                  a->sdepth, a->srow, a->scol);
+  }
+}
+
+/* tasks: (kernel k, input plane i) pairs, output volume k*nInputPlane+i */
+static void THTensor_(conv3DgerWorker)(void *args_, long begin, long end)
+{
+  THTensor_(Conv3DArgs) *a = (THTensor_(Conv3DArgs)*)args_;
+  long volumeSize = a->nOutputDepth*a->nOutputRows*a->nOutputCols;
+  long task;
+  for(task = begin; task < end; task++)
+  {
+    long k = task / a->nInputPlane, i = task % a->nInputPlane;
+    THTensor_(conv3DDirect)(a->output_data + task*volumeSize,
+                            a->alpha,
+                            a->input_data + i*a->istride0, a->nInputDepth, a->nInputRows, a->nInputCols,
+                            a->weight_data + k*a->kstride0, a->nKernelDepth, a->nKernelRows, a->nKernelCols,
+                            a->sdepth, a->srow, a->scol, a->vf, a->xc);
+  }
+}
+
+/* tasks: (batch p, output plane k) pairs, over all the input planes;
+   conv3Dmv is the case of a single batch element */
+static void THTensor_(conv3DmmWorker)(void *args_, long begin, long end)
+{
+  THTensor_(Conv3DArgs) *a = (THTensor_(Conv3DArgs)*)args_;
+  long volumeSize = a->nOutputDepth*a->nOutputRows*a->nOutputCols;
+  long task, i;
+  for(task = begin; task < end; task++)
+  {
+    long p = task / a->nOutputPlane, k = task % a->nOutputPlane;
+    for(i = 0; i < a->nInputPlane; i++)
+      THTensor_(conv3DDirect)(a->output_data + task*volumeSize,
+                              a->alpha,
+                              a->input_data + p*a->istride0 + i*a->istride1, a->nInputDepth, a->nInputRows, a->nInputCols,
+                              a->weight_data + k*a->kstride0 + i*a->kstride1, a->nKernelDepth, a->nKernelRows, a->nKernelCols,
+                              a->sdepth, a->srow, a->scol, a->vf, a->xc);
+  }
+}
+
 /*
   4D input, 4D kernel, 5D output
   like rank1 update
@@ -1444,17 +1775,14 @@ void THTensor_(conv2Dmap)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
 void THTensor_(conv3DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_,
                              long sdepth, long srow, long scol)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nInputPlane, nInputDepth, nInputRows, nInputCols;
   long nKernelPlane, nKernelDepth, nKernelRows, nKernelCols;
-  long nOutputPlane, nOutputDepth, nOutputRows, nOutputCols;
-  long istride0, kstride0;
+  long nOutputDepth, nOutputRows, nOutputCols;
   THTensor *input;
   THTensor *kernel;
-  real *input_data;
-  real *weight_data;
-  real *output_data;
   long nelem;
-  long k, i;
+  THTensor_(Conv3DArgs) args;
 
   THArgCheck(t_->nDimension == 4 , 3, "input: 4D Tensor expected");
   THArgCheck(k_->nDimension == 4 , 4, "kernel: 4D Tensor expected");
@@ -1466,17 +1794,14 @@ void THTensor_(conv3DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_,
   kernel = THTensor_(newContiguous)(k_);
 
   nInputPlane = input->size[0];
-  istride0    = input->stride[0];
   nInputDepth = input->size[1];
   nInputRows  = input->size[2];
   nInputCols  = input->size[3];
 
-  kstride0 = kernel->stride[0];
   nKernelPlane = kernel->size[0];
   nKernelDepth= kernel->size[1];
   nKernelRows = kernel->size[2];
   nKernelCols = kernel->size[3];
-  nOutputPlane = nInputPlane * kernel->size[0];
 
   THArgCheck(nInputDepth >= nKernelDepth && nInputRows >= nKernelRows && nInputCols >= nKernelCols , 2, "conv3DRevger : Input image is smaller than kernel");
 
@@ -1487,37 +1812,31 @@ void THTensor_(conv3DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_,
   nelem = THTensor_(nElement)(r_);
   THTensor_(resize5d)(r_,nKernelPlane, nInputPlane, nOutputDepth, nOutputRows, nOutputCols);
 
-  if (nelem == 0 || beta == 0 || nelem != THTensor_(nElement)(r_))
-  {
-    THTensor_(zero)(r_);
-  }
-  else if (beta != 1)
-    THTensor_(mul)(r_, r_, beta);
-
-  input_data = THTensor_(data)(input);
-  weight_data = THTensor_(data)(kernel);
-  output_data = THTensor_(data)(r_);
+  memset(&args, 0, sizeof(args));
+  args.input_data = THTensor_(data)(input);
+  args.weight_data = THTensor_(data)(kernel);
+  args.output_data = THTensor_(data)(r_);
+  args.alpha = alpha;
+  args.beta = beta;
+  args.nInputPlane = nInputPlane;
+  args.nInputDepth = nInputDepth;
+  args.nInputRows = nInputRows;
+  args.nInputCols = nInputCols;
+  args.nKernelDepth = nKernelDepth;
+  args.nKernelRows = nKernelRows;
+  args.nKernelCols = nKernelCols;
+  args.nOutputDepth = nOutputDepth;
+  args.nOutputRows = nOutputRows;
+  args.nOutputCols = nOutputCols;
+  args.istride0 = input->stride[0];
+  args.kstride0 = kernel->stride[0];
+  args.sdepth = sdepth;
+  args.srow = srow;
+  args.scol = scol;
+  THTensor_(conv3DInitOutput)(&args, nelem, nKernelPlane*nInputPlane, THTensor_(nElement)(r_));
+
+  THParallel_for(0, nKernelPlane*nInputPlane, 1, THTensor_(conv3DRevgerWorker), &args);
 
-  for(k = 0; k < nKernelPlane; k++)
-  {
-    /* get kernel */
-    real *ptr_weight = weight_data+k*kstride0;
-
-    for(i = 0; i < nInputPlane; i++)
-    {
-      /* get input */
-      real *ptr_input = input_data+i*istride0;
-
-      /* do image, kernel convolution */
-      THTensor_(validXCorr3DRevptr)(output_data,
-                                    alpha,
-                                    ptr_input,  nInputDepth, nInputRows,  nInputCols,
-                                    ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
-                                    sdepth, srow, scol);
-      /* Next output plane */
-      output_data += nOutputDepth*nOutputCols*nOutputRows;
-    }
-  }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
 }
@@ -1531,17 +1850,15 @@ void THTensor_(conv3DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_,
 void THTensor_(conv3Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_,
                           long sdepth, long srow, long scol, const char *vf, const char *xc)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nInputPlane, nInputDepth, nInputRows, nInputCols;
   long nKernelPlane, nKernelDepth, nKernelRows, nKernelCols;
-  long nOutputPlane, nOutputDepth, nOutputRows, nOutputCols;
-  long istride0, kstride0;
+  long nOutputDepth, nOutputRows, nOutputCols;
   THTensor *input;
   THTensor *kernel;
-  real *input_data;
-  real *weight_data;
-  real *output_data;
-  long nelem;
-  long k, i;
+  long nelem, kvol;
+  THTensor_(Conv3DArgs) args;
+  THAutotuneTrial trial;
 
   THArgCheck(t_->nDimension == 4 , 3, "input: 4D Tensor expected");
   THArgCheck(k_->nDimension == 4 , 4, "kernel: 4D Tensor expected");
@@ -1555,17 +1872,15 @@ void THTensor_(conv3Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   kernel = THTensor_(newContiguous)(k_);
 
   nInputPlane = input->size[0];
-  istride0    = input->stride[0];
   nInputDepth = input->size[1];
   nInputRows  = input->size[2];
   nInputCols  = input->size[3];
 
-  kstride0     = kernel->stride[0];
   nKernelPlane = kernel->size[0];
   nKernelDepth = kernel->size[1];
   nKernelRows  = kernel->size[2];
   nKernelCols  = kernel->size[3];
-  nOutputPlane = nInputPlane * kernel->size[0];
+  kvol = nKernelDepth*nKernelRows*nKernelCols;
 
   THArgCheck((nInputDepth >= nKernelDepth
               && nInputRows >= nKernelRows
@@ -1579,40 +1894,76 @@ void THTensor_(conv3Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   nelem = THTensor_(nElement)(r_);
   THTensor_(resize5d)(r_,nKernelPlane, nInputPlane, nOutputDepth, nOutputRows, nOutputCols);
 
-  if (nelem == 0 || beta == 0 || nelem != THTensor_(nElement)(r_))
+  memset(&args, 0, sizeof(args));
+  args.input_data = THTensor_(data)(input);
+  args.weight_data = THTensor_(data)(kernel);
+  args.output_data = THTensor_(data)(r_);
+  args.alpha = alpha;
+  args.beta = beta;
+  args.nInputPlane = nInputPlane;
+  args.nInputDepth = nInputDepth;
+  args.nInputRows = nInputRows;
+  args.nInputCols = nInputCols;
+  args.nKernelDepth = nKernelDepth;
+  args.nKernelRows = nKernelRows;
+  args.nKernelCols = nKernelCols;
+  args.nOutputDepth = nOutputDepth;
+  args.nOutputRows = nOutputRows;
+  args.nOutputCols = nOutputCols;
+  args.istride0 = input->stride[0];
+  args.kstride0 = kernel->stride[0];
+  args.sdepth = sdepth;
+  args.srow = srow;
+  args.scol = scol;
+  args.vf = vf;
+  args.xc = xc;
+  THTensor_(conv3DInitOutput)(&args, nelem, nKernelPlane*nInputPlane, THTensor_(nElement)(r_));
+
+  if(THTensor_(conv3DSelectEngine)(&trial, vf, nKernelPlane, 1, kvol,
+                                    nInputPlane*nOutputDepth*nOutputRows*nOutputCols) == TH_CONV3D_ENGINE_GEMM)
   {
-    THTensor_(zero)(r_);
+    /* per input plane: all the kernels against the same columns */
+    long volumeSize = nOutputDepth*nOutputRows*nOutputCols;
+    THTensor *weight = THTensor_(conv3DGemmWeight)(kernel, nKernelPlane, kvol, xc);
+    long i;
+    for(i = 0; i < nInputPlane; i++)
+      THTensor_(conv3DGemm)(args.output_data + i*volumeSize, nInputPlane*volumeSize, nKernelPlane, alpha,
+                            args.input_data + i*args.istride0, 0, 1, nInputDepth, nInputRows, nInputCols,
+                            THTensor_(data)(weight), kvol, nKernelDepth, nKernelRows, nKernelCols,
+                            sdepth, srow, scol);
+    THTensor_(free)(weight);
   }
-  else if (beta != 1)
-    THTensor_(mul)(r_, r_, beta);
+  else
+    THParallel_for(0, nKernelPlane*nInputPlane, 1, THTensor_(conv3DgerWorker), &args);
+  THAutotune_end(&trial);
 
-  input_data = THTensor_(data)(input);
-  weight_data = THTensor_(data)(kernel);
-  output_data = THTensor_(data)(r_);
+  THTensor_(free)(input);
+  THTensor_(free)(kernel);
+}
 
-  for(k = 0; k < nKernelPlane; k++)
+/* output of conv3Dmv/conv3Dmm, over nbatch inputs (istride0 apart) */
+static void THTensor_(conv3DmmRun)(THTensor_(Conv3DArgs) *args, THTensor *kernel, long nbatch)
+{
+  long kvol = args->nKernelDepth*args->nKernelRows*args->nKernelCols;
+  long volumeSize = args->nOutputDepth*args->nOutputRows*args->nOutputCols;
+  THAutotuneTrial trial;
+  if(THTensor_(conv3DSelectEngine)(&trial, args->vf, args->nOutputPlane, args->nInputPlane, kvol,
+                                    nbatch*volumeSize) == TH_CONV3D_ENGINE_GEMM)
   {
-    /* get kernel */
-    real *ptr_weight = weight_data+k*kstride0;
-
-    for(i = 0; i < nInputPlane; i++)
-    {
-      /* get input */
-      real *ptr_input = input_data+i*istride0;
-
-      /* do image, kernel convolution */
-      THTensor_(conv3d)(output_data,
-                        alpha,
-                        ptr_input,  nInputDepth, nInputRows,  nInputCols,
-                        ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
-                        sdepth, srow, scol, vf, xc);
-
-      /* Next output plane */
-      output_data += nOutputDepth*nOutputCols*nOutputRows;
-    }
+    long k = args->nInputPlane*kvol;
+    THTensor *weight = THTensor_(conv3DGemmWeight)(kernel, args->nOutputPlane*args->nInputPlane, kvol, args->xc);
+    long p;
+    for(p = 0; p < nbatch; p++)
+      THTensor_(conv3DGemm)(args->output_data + p*args->nOutputPlane*volumeSize, volumeSize, args->nOutputPlane, args->alpha,
+                            args->input_data + p*args->istride0, args->istride1, args->nInputPlane,
+                            args->nInputDepth, args->nInputRows, args->nInputCols,
+                            THTensor_(data)(weight), k, args->nKernelDepth, args->nKernelRows, args->nKernelCols,
+                            args->sdepth, args->srow, args->scol);
+    THTensor_(free)(weight);
   }
-  THTensor_(free)(input);
-  THTensor_(free)(kernel);
+  else
+    THParallel_for(0, nbatch*args->nOutputPlane, 1, THTensor_(conv3DmmWorker), args);
+  THAutotune_end(&trial);
 }
 
 /*
@@ -1623,17 +1974,14 @@ void THTensor_(conv3Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
 void THTensor_(conv3Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_,
                          long sdepth, long srow, long scol, const char *vf, const char *xc)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nInputPlane, nInputDepth, nInputRows, nInputCols;
   long nKernelDepth, nKernelRows, nKernelCols;
   long nOutputPlane, nOutputDepth, nOutputRows, nOutputCols;
-  long istride0, kstride0, kstride1;
   THTensor *input;
   THTensor *kernel;
-  real *input_data;
-  real *weight_data;
-  real *output_data;
   long nelem;
-  long k, i;
+  THTensor_(Conv3DArgs) args;
 
   THArgCheck(t_->nDimension == 4 , 3, "input: 4D Tensor expected");
   THArgCheck(k_->nDimension == 5 , 4, "kernel: 5D Tensor expected");
@@ -1652,13 +2000,10 @@ void THTensor_(conv3Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
   }
 
   nInputPlane = input->size[0];
-  istride0    = input->stride[0];
   nInputDepth = input->size[1];
   nInputRows  = input->size[2];
   nInputCols  = input->size[3];
 
-  kstride0    = kernel->stride[0];
-  kstride1    = kernel->stride[1];
   nKernelDepth = kernel->size[2];
   nKernelRows = kernel->size[3];
   nKernelCols = kernel->size[4];
@@ -1674,36 +2019,124 @@ void THTensor_(conv3Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
   nelem = THTensor_(nElement)(r_);
   THTensor_(resize4d)(r_, nOutputPlane, nOutputDepth, nOutputRows, nOutputCols);
 
-  if (nelem == 0 || beta == 0 || nelem != THTensor_(nElement)(r_))
-  {
-    THTensor_(zero)(r_);
-  }
-  else if (beta != 1)
-    THTensor_(mul)(r_, r_, beta);
+  memset(&args, 0, sizeof(args));
+  args.input_data = THTensor_(data)(input);
+  args.weight_data = THTensor_(data)(kernel);
+  args.output_data = THTensor_(data)(r_);
+  args.alpha = alpha;
+  args.beta = beta;
+  args.nInputPlane = nInputPlane;
+  args.nInputDepth = nInputDepth;
+  args.nInputRows = nInputRows;
+  args.nInputCols = nInputCols;
+  args.nKernelDepth = nKernelDepth;
+  args.nKernelRows = nKernelRows;
+  args.nKernelCols = nKernelCols;
+  args.nOutputPlane = nOutputPlane;
+  args.nOutputDepth = nOutputDepth;
+  args.nOutputRows = nOutputRows;
+  args.nOutputCols = nOutputCols;
+  args.istride0 = THTensor_(nElement)(input);
+  args.istride1 = input->stride[0];
+  args.kstride0 = kernel->stride[0];
+  args.kstride1 = kernel->stride[1];
+  args.sdepth = sdepth;
+  args.srow = srow;
+  args.scol = scol;
+  args.vf = vf;
+  args.xc = xc;
+  THTensor_(conv3DInitOutput)(&args, nelem, nOutputPlane, THTensor_(nElement)(r_));
+
+  THTensor_(conv3DmmRun)(&args, kernel, 1);
 
-  input_data = THTensor_(data)(input);
-  weight_data = THTensor_(data)(kernel);
-  output_data = THTensor_(data)(r_);
+  THTensor_(free)(input);
+  THTensor_(free)(kernel);
+}
 
-  for(k = 0; k < nOutputPlane; k++)
-  {
-    for(i = 0; i < nInputPlane; i++)
-    {
-      /* get kernel */
-      real *ptr_weight = weight_data + k*kstride0 + i*kstride1;
-      /* get input */
-      real *ptr_input = input_data + i*istride0;
+/*
+  5D input, 5D kernel, 5D output
+  batched conv3Dmv: for each of the nbatch inputs
+  y <- Ax + beta*y
+*/
+void THTensor_(conv3Dmm)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_,
+                         long sdepth, long srow, long scol, const char *vf, const char *xc)
+{
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
+  long nbatch, nInputPlane, nInputDepth, nInputRows, nInputCols;
+  long nKernelDepth, nKernelRows, nKernelCols;
+  long nOutputPlane, nOutputDepth, nOutputRows, nOutputCols;
+  THTensor *input;
+  THTensor *kernel;
+  long nelem;
+  THTensor_(Conv3DArgs) args;
 
-      /* do image, kernel convolution */
-      THTensor_(conv3d)(output_data,
-                        alpha,
-                        ptr_input,  nInputDepth, nInputRows,  nInputCols,
-                        ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
-                        sdepth, srow, scol, vf, xc);
-    }
-    /* Next output plane */
-    output_data += nOutputDepth*nOutputCols*nOutputRows;
+  THArgCheck(t_->nDimension == 5 , 3, "input: 5D Tensor expected");
+  THArgCheck(k_->nDimension == 5 , 4, "kernel: 5D Tensor expected");
+  THArgCheck(sdepth >= 1, 5, "Stride should be a positive integer");
+  THArgCheck(srow >= 1, 6, "Stride should be a positive integer");
+  THArgCheck(scol >= 1, 7, "Stride should be a positive integer");
+  THArgCheck(*vf == 'V' || *vf == 'F', 8, "type of convolution can 'V' or 'F'");
+  THArgCheck(*xc == 'C' || *xc == 'X', 8, "type of convolution can 'X' or 'C'");
+
+  input = THTensor_(newContiguous)(t_);
+  if (!(k_->stride[4] == 1) || !(k_->stride[3] == k_->size[4])) {
+    kernel = THTensor_(newContiguous)(k_);
+  } else {
+    THTensor_(retain)(k_);
+    kernel = k_;
   }
+
+  nbatch = input->size[0];
+  nInputPlane = input->size[1];
+  nInputDepth = input->size[2];
+  nInputRows  = input->size[3];
+  nInputCols  = input->size[4];
+
+  nKernelDepth = kernel->size[2];
+  nKernelRows = kernel->size[3];
+  nKernelCols = kernel->size[4];
+  nOutputPlane = kernel->size[0];
+  THArgCheck(kernel->size[1] == nInputPlane, 2, "invalid number of input planes");
+
+  THArgCheck( (nInputDepth >= nKernelDepth && nInputRows >= nKernelRows && nInputCols >= nKernelCols) || *vf == 'F', 2, "conv3Dmm : Input image is smaller than kernel");
+
+  nOutputDepth = THTensor_(convsize)(nInputDepth, nKernelDepth, sdepth, vf);
+  nOutputRows = THTensor_(convsize)(nInputRows, nKernelRows, srow, vf);
+  nOutputCols = THTensor_(convsize)(nInputCols, nKernelCols, scol, vf);
+
+  nelem = THTensor_(nElement)(r_);
+  THTensor_(resize5d)(r_, nbatch, nOutputPlane, nOutputDepth, nOutputRows, nOutputCols);
+
+  memset(&args, 0, sizeof(args));
+  args.input_data = THTensor_(data)(input);
+  args.weight_data = THTensor_(data)(kernel);
+  args.output_data = THTensor_(data)(r_);
+  args.alpha = alpha;
+  args.beta = beta;
+  args.nInputPlane = nInputPlane;
+  args.nInputDepth = nInputDepth;
+  args.nInputRows = nInputRows;
+  args.nInputCols = nInputCols;
+  args.nKernelDepth = nKernelDepth;
+  args.nKernelRows = nKernelRows;
+  args.nKernelCols = nKernelCols;
+  args.nOutputPlane = nOutputPlane;
+  args.nOutputDepth = nOutputDepth;
+  args.nOutputRows = nOutputRows;
+  args.nOutputCols = nOutputCols;
+  args.istride0 = input->stride[0];
+  args.istride1 = input->stride[1];
+  args.kstride0 = kernel->stride[0];
+  args.kstride1 = kernel->stride[1];
+  args.sdepth = sdepth;
+  args.srow = srow;
+  args.scol = scol;
+  args.vf = vf;
+  args.xc = xc;
+  THTensor_(conv3DInitOutput)(&args, nelem, nbatch*nOutputPlane, THTensor_(nElement)(r_));
+
+  THTensor_(conv3DmmRun)(&args, kernel, nbatch);
+
   THTensor_(free)(input);
   THTensor_(free)(kernel);
 }
@@ -1716,6 +2149,7 @@ void THTensor_(conv3Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
 void THTensor_(conv3Dmul)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_,
                           long sdepth, long srow, long scol, const char *vf, const char *xc)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   THTensor *input;
   THTensor* kernel;
   long nInputDepth;
@@ -1784,6 +2218,7 @@ void THTensor_(conv3Dmul)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
 void THTensor_(conv3Dcmul)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_,
                            long sdepth, long srow, long scol, const char *vf, const char *xc)
 {
+  TH_PROFILE_TENSOR_OP(r_, t_, k_);
   long nInputPlane, nInputDepth, nInputRows, nInputCols;
   long nKernelDepth, nKernelRows, nKernelCols;
   long nOutputPlane, nOutputDepth, nOutputRows, nOutputCols;
@@ -71,9 +71,22 @@ TH_API void THTensor_(validXCorr3DRevptr)(real *r_,
                                        real *k_, long kt, long kr, long kc,
                                        long st, long sr, long sc);
 
+/* engines of conv3Dmv, conv3Dmm and conv3Dger in valid mode: vol2col + GEMM,
+   or direct loops blocked over the output depth. AUTO (default) picks one
+   from the shapes; full convolutions always run the direct loops. */
+#ifndef TH_CONV3D_ENGINE_AUTO
+#define TH_CONV3D_ENGINE_AUTO   0
+#define TH_CONV3D_ENGINE_DIRECT 1
+#define TH_CONV3D_ENGINE_GEMM   2
+#endif
+
+TH_API void THTensor_(conv3DSetEngine)(int engine);
+TH_API int THTensor_(conv3DGetEngine)(void);
+
 TH_API void THTensor_(conv3DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long sdepth, long srow, long scol);
 TH_API void THTensor_(conv3Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long sdepth, long srow, long scol, const char *vf, const char *xc);
 TH_API void THTensor_(conv3Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long sdepth, long srow, long scol, const char *vf, const char *xc);
+TH_API void THTensor_(conv3Dmm)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long sdepth, long srow, long scol, const char *vf, const char *xc);
 TH_API void THTensor_(conv3Dmul)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long sdepth, long srow, long scol, const char *vf, const char *xc);
 TH_API void THTensor_(conv3Dcmul)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long sdepth, long srow, long scol, const char *vf, const char *xc);
 
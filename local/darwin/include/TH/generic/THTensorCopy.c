@@ -2,17 +2,344 @@
 #define TH_GENERIC_FILE "generic/THTensorCopy.c"
 #else
 
+/* edge (in elements) of the tiles the recursive transpose stops at */
+#ifndef TH_COPY_TILE
+#define TH_COPY_TILE 32
+#endif
+
+/* dst(i,j) <- src(i,j) for a rows x cols block; j runs along the axis on
+   which dst is the most contiguous */
+typedef void (*THTensor_(CopyTileFunction))(real *dst, const void *src, long rows, long cols,
+                                             long dRs, long dCs, long sRs, long sCs);
+/* dst[i] <- src[i] for i < n */
+typedef void (*THTensor_(CopyContiguousFunction))(real *dst, const void *src, long n);
+
+typedef struct THTensor_(CopyJob)
+{
+  real *dst;
+  const char *src;
+  int srcElementSize;
+  long cols;
+  long dRs, dCs, sRs, sCs;
+  THTensor_(CopyTileFunction) tile;
+  THTensor_(CopyContiguousFunction) contiguous;
+} THTensor_(CopyJob);
+
+static void THTensor_(copyContiguousKernel)(void *job_, long begin, long end)
+{
+  THTensor_(CopyJob) *job = (THTensor_(CopyJob)*)job_;
+  job->contiguous(job->dst + begin, job->src + begin*job->srcElementSize, end - begin);
+}
+
+static void THTensor_(copyTileKernel)(void *job_, long begin, long end)
+{
+  THTensor_(CopyJob) *job = (THTensor_(CopyJob)*)job_;
+  job->tile(job->dst + begin*job->dRs, job->src + begin*job->sRs*job->srcElementSize,
+            end - begin, job->cols, job->dRs, job->dCs, job->sRs, job->sCs);
+}
+
+/*
+  Copies src (given by its geometry) into tensor when both have the same
+  size and either are both contiguous, or traverse different axes fastest
+  (permuted layouts, e.g. newContiguous of a transpose). In the latter case
+  the two fastest axes are copied by cache-oblivious tiles, in parallel over
+  rows of tiles, and the other axes are looped over.
+  Returns 0 (nothing done) for layouts better left to TH_TENSOR_APPLY2.
+*/
+static int THTensor_(copyEngine)(THTensor *tensor, int nDimension, const long *size, const long *stride,
+                                 const char *srcData, int srcElementSize,
+                                 THTensor_(CopyTileFunction) tile,
+                                 THTensor_(CopyContiguousFunction) contiguous)
+{
+  THTensor_(CopyJob) job;
+  long *counter;
+  long rows, nElement = 1, srcContiguousStride = 1;
+  int srcContiguous = 1;
+  int d, da = -1, sb = -1;
+
+  if(tensor->nDimension != nDimension || nDimension == 0)
+    return 0;
+  for(d = nDimension-1; d >= 0; d--)
+  {
+    if(tensor->size[d] != size[d])
+      return 0;
+    if(size[d] != 1 && stride[d] != srcContiguousStride)
+      srcContiguous = 0;
+    srcContiguousStride *= size[d];
+    nElement *= size[d];
+  }
+  if(nElement == 0)
+    return 1;
+
+  job.dst = THTensor_(data)(tensor);
+  job.src = srcData;
+  job.srcElementSize = srcElementSize;
+  job.tile = tile;
+  job.contiguous = contiguous;
+
+  if(srcContiguous && THTensor_(isContiguous)(tensor))
+  {
+    THParallel_for(0, nElement, 0, THTensor_(copyContiguousKernel), &job);
+    return 1;
+  }
+
+  /* fastest axis of each side; expanded (zero stride) layouts are left to APPLY2 */
+  for(d = 0; d < nDimension; d++)
+  {
+    if(size[d] == 1)
+      continue;
+    if(tensor->stride[d] <= 0 || stride[d] <= 0)
+      return 0;
+    if(da < 0 || tensor->stride[d] < tensor->stride[da])
+      da = d;
+    if(sb < 0 || stride[d] < stride[sb])
+      sb = d;
+  }
+  if(da < 0 || da == sb)
+    return 0;
+
+  rows = size[sb];
+  job.cols = size[da];
+  job.dRs = tensor->stride[sb];
+  job.dCs = tensor->stride[da];
+  job.sRs = stride[sb];
+  job.sCs = stride[da];
+
+  counter = THAlloc(sizeof(long)*nDimension);
+  for(d = 0; d < nDimension; d++)
+    counter[d] = 0;
+
+  for(;;)
+  {
+    long dstOffset = 0, srcOffset = 0;
+    THTensor_(CopyJob) slice = job;
+
+    for(d = 0; d < nDimension; d++)
+    {
+      dstOffset += counter[d]*tensor->stride[d];
+      srcOffset += counter[d]*stride[d];
+    }
+    slice.dst += dstOffset;
+    slice.src += srcOffset*srcElementSize;
+    THParallel_for(0, rows, THMax(TH_COPY_TILE, THThreadPool_getGrainSize()/job.cols),
+                   THTensor_(copyTileKernel), &slice);
+
+    /* next slice along the remaining axes */
+    for(d = nDimension-1; d >= 0; d--)
+    {
+      if(d == da || d == sb)
+        continue;
+      if(++counter[d] < size[d])
+        break;
+      counter[d] = 0;
+    }
+    if(d < 0)
+      break;
+  }
+  THFree(counter);
+  return 1;
+}
+
+/*
+  NAME##Base copies one tile (at most TH_COPY_TILE x TH_COPY_TILE), NAME
+  halves the longest side of the block until it fits in a tile.
+*/
+#define IMPLEMENT_THTensor_COPY_TILE(NAME, TYPE_SRC)                     \
+static void THTensor_(NAME##Base)(real *dst, const TYPE_SRC *src, long rows, long cols, \
+                                  long dRs, long dCs, long sRs, long sCs) \
+{                                                                       \
+  long i, j;                                                            \
+  for(i = 0; i < rows; i++)                                             \
+    for(j = 0; j < cols; j++)                                           \
+      dst[i*dRs + j*dCs] = (real)src[i*sRs + j*sCs];                    \
+}                                                                       \
+                                                                        \
+static void THTensor_(NAME)(real *dst, const void *src_, long rows, long cols, \
+                            long dRs, long dCs, long sRs, long sCs)     \
+{                                                                       \
+  const TYPE_SRC *src = (const TYPE_SRC*)src_;                          \
+  if(rows > TH_COPY_TILE || cols > TH_COPY_TILE)                        \
+  {                                                                     \
+    if(rows >= cols)                                                    \
+    {                                                                   \
+      long half = rows/2;                                               \
+      THTensor_(NAME)(dst, src, half, cols, dRs, dCs, sRs, sCs);        \
+      THTensor_(NAME)(dst + half*dRs, src + half*sRs, rows - half, cols, dRs, dCs, sRs, sCs); \
+    }                                                                   \
+    else                                                                \
+    {                                                                   \
+      long half = cols/2;                                               \
+      THTensor_(NAME)(dst, src, rows, half, dRs, dCs, sRs, sCs);        \
+      THTensor_(NAME)(dst + half*dCs, src + half*sCs, rows, cols - half, dRs, dCs, sRs, sCs); \
+    }                                                                   \
+    return;                                                             \
+  }                                                                     \
+  THTensor_(NAME##Base)(dst, src, rows, cols, dRs, dCs, sRs, sCs);      \
+}
+
+#if defined(USE_SSE2) && (defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE))
+
+#if defined(TH_REAL_IS_FLOAT)
+#define TH_COPY_TRANSPOSE_BLOCK 4
+/* 4x4 block: 4 columns of src are 4 rows of dst */
+#define TH_COPY_TRANSPOSE(dst, src, dRs, sCs)                           \
+{                                                                       \
+  __m128 r0 = _mm_loadu_ps((src));                                      \
+  __m128 r1 = _mm_loadu_ps((src) + (sCs));                              \
+  __m128 r2 = _mm_loadu_ps((src) + 2*(sCs));                            \
+  __m128 r3 = _mm_loadu_ps((src) + 3*(sCs));                            \
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);                                    \
+  _mm_storeu_ps((dst), r0);                                             \
+  _mm_storeu_ps((dst) + (dRs), r1);                                     \
+  _mm_storeu_ps((dst) + 2*(dRs), r2);                                   \
+  _mm_storeu_ps((dst) + 3*(dRs), r3);                                   \
+}
+#else
+#define TH_COPY_TRANSPOSE_BLOCK 2
+#define TH_COPY_TRANSPOSE(dst, src, dRs, sCs)                           \
+{                                                                       \
+  __m128d r0 = _mm_loadu_pd((src));                                     \
+  __m128d r1 = _mm_loadu_pd((src) + (sCs));                             \
+  _mm_storeu_pd((dst), _mm_unpacklo_pd(r0, r1));                        \
+  _mm_storeu_pd((dst) + (dRs), _mm_unpackhi_pd(r0, r1));                \
+}
+#endif
+
+/* same type: when dst rows and src columns are unit stride (a transpose),
+   the tile is moved as blocks transposed in registers */
+static void THTensor_(copyTileBase)(real *dst, const real *src, long rows, long cols,
+                                    long dRs, long dCs, long sRs, long sCs)
+{
+  long i, j, i0, j0 = 0;
+  const long B = TH_COPY_TRANSPOSE_BLOCK;
+
+  if(dCs != 1 || sRs != 1)
+  {
+    for(i = 0; i < rows; i++)
+      for(j = 0; j < cols; j++)
+        dst[i*dRs + j*dCs] = src[i*sRs + j*sCs];
+    return;
+  }
+
+  for(i0 = 0; i0 + B <= rows; i0 += B)
+    for(j0 = 0; j0 + B <= cols; j0 += B)
+      TH_COPY_TRANSPOSE(dst + i0*dRs + j0, src + i0 + j0*sCs, dRs, sCs);
+
+  /* right and bottom borders */
+  for(i = 0; i < rows; i++)
+    for(j = (i < i0 ? j0 : 0); j < cols; j++)
+      dst[i*dRs + j] = src[i + j*sCs];
+}
+
+static void THTensor_(copyTile)(real *dst, const void *src_, long rows, long cols,
+                                long dRs, long dCs, long sRs, long sCs)
+{
+  const real *src = (const real*)src_;
+  if(rows > TH_COPY_TILE || cols > TH_COPY_TILE)
+  {
+    if(rows >= cols)
+    {
+      long half = rows/2;
+      THTensor_(copyTile)(dst, src, half, cols, dRs, dCs, sRs, sCs);
+      THTensor_(copyTile)(dst + half*dRs, src + half*sRs, rows - half, cols, dRs, dCs, sRs, sCs);
+    }
+    else
+    {
+      long half = cols/2;
+      THTensor_(copyTile)(dst, src, rows, half, dRs, dCs, sRs, sCs);
+      THTensor_(copyTile)(dst + half*dCs, src + half*sCs, rows, cols - half, dRs, dCs, sRs, sCs);
+    }
+    return;
+  }
+  THTensor_(copyTileBase)(dst, src, rows, cols, dRs, dCs, sRs, sCs);
+}
+
+#undef TH_COPY_TRANSPOSE
+#undef TH_COPY_TRANSPOSE_BLOCK
+
+#else
+IMPLEMENT_THTensor_COPY_TILE(copyTile, real)
+#endif
+
+static void THTensor_(copyContiguous)(real *dst, const void *src, long n)
+{
+  memcpy(dst, src, n*sizeof(real));
+}
+
 void THTensor_(copy)(THTensor *tensor, THTensor *src)
 {
+  if(tensor == src)
+    return;
+  if(THTensor_(copyEngine)(tensor, src->nDimension, src->size, src->stride,
+                           (const char*)THTensor_(data)(src), sizeof(real),
+                           THTensor_(copyTile), THTensor_(copyContiguous)))
+    return;
   TH_TENSOR_APPLY2(real, tensor, real, src, *tensor_data = (real)(*src_data);)
 }
 
-#define IMPLEMENT_THTensor_COPY(TYPENAMESRC, TYPE_SRC) \
+/* element-wise conversion; plain loop the compiler vectorizes */
+#define IMPLEMENT_THTensor_COPY_CONTIGUOUS(TYPENAMESRC, TYPE_SRC)        \
+static void THTensor_(copyContiguous##TYPENAMESRC)(real *dst, const void *src_, long n) \
+{                                                                       \
+  const TYPE_SRC *src = (const TYPE_SRC*)src_;                          \
+  long i;                                                               \
+  for(i = 0; i < n; i++)                                                \
+    dst[i] = (real)src[i];                                              \
+}
+
+#define IMPLEMENT_THTensor_COPY(TYPENAMESRC, TYPE_SRC)                  \
+IMPLEMENT_THTensor_COPY_TILE(copyTile##TYPENAMESRC, TYPE_SRC) \
 void THTensor_(copy##TYPENAMESRC)(THTensor *tensor, TH##TYPENAMESRC##Tensor *src) \
 { \
+  if(THTensor_(copyEngine)(tensor, src->nDimension, src->size, src->stride, \
+                           (const char*)TH##TYPENAMESRC##Tensor_data(src), sizeof(TYPE_SRC), \
+                           THTensor_(copyTile##TYPENAMESRC), THTensor_(copyContiguous##TYPENAMESRC))) \
+    return; \
   TH_TENSOR_APPLY2(real, tensor, TYPE_SRC, src, *tensor_data = (real)(*src_data);) \
 }
 
+#if defined(USE_SSE2) && defined(TH_REAL_IS_DOUBLE)
+static void THTensor_(copyContiguousFloat)(real *dst, const void *src_, long n)
+{
+  const float *src = (const float*)src_;
+  long i;
+  for(i = 0; i + 4 <= n; i += 4)
+  {
+    __m128 x = _mm_loadu_ps(src + i);
+    _mm_storeu_pd(dst + i, _mm_cvtps_pd(x));
+    _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+  }
+  for(; i < n; i++)
+    dst[i] = src[i];
+}
+#else
+IMPLEMENT_THTensor_COPY_CONTIGUOUS(Float, float)
+#endif
+
+#if defined(USE_SSE2) && defined(TH_REAL_IS_FLOAT)
+static void THTensor_(copyContiguousDouble)(real *dst, const void *src_, long n)
+{
+  const double *src = (const double*)src_;
+  long i;
+  for(i = 0; i + 4 <= n; i += 4)
+  {
+    __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+    __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+    _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+  }
+  for(; i < n; i++)
+    dst[i] = (float)src[i];
+}
+#else
+IMPLEMENT_THTensor_COPY_CONTIGUOUS(Double, double)
+#endif
+
+IMPLEMENT_THTensor_COPY_CONTIGUOUS(Byte, unsigned char)
+IMPLEMENT_THTensor_COPY_CONTIGUOUS(Char, char)
+IMPLEMENT_THTensor_COPY_CONTIGUOUS(Short, short)
+IMPLEMENT_THTensor_COPY_CONTIGUOUS(Int, int)
+IMPLEMENT_THTensor_COPY_CONTIGUOUS(Long, long)
+
 IMPLEMENT_THTensor_COPY(Byte, unsigned char)
 IMPLEMENT_THTensor_COPY(Char, char)
 IMPLEMENT_THTensor_COPY(Short, short)
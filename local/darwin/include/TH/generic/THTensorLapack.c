@@ -103,6 +103,7 @@ static THTensor *THTensor_(cloneColumnMajor)(THTensor *self, THTensor *src)
 
 void THTensor_(gesv)(THTensor *rb_, THTensor *ra_, THTensor *b, THTensor *a)
 {
+  TH_PROFILE_TENSOR_OP(rb_, ra_, b);
   if (a == NULL) a = ra_;
   if (b == NULL) b = rb_;
   THArgCheck(a->nDimension == 2, 2, "A should be 2 dimensional");
@@ -143,6 +144,7 @@ void THTensor_(gesv)(THTensor *rb_, THTensor *ra_, THTensor *b, THTensor *a)
 void THTensor_(trtrs)(THTensor *rb_, THTensor *ra_, THTensor *b, THTensor *a,
                       const char *uplo, const char *trans, const char *diag)
 {
+  TH_PROFILE_TENSOR_OP(rb_, ra_, b);
   if (a == NULL) a = ra_;
   if (b == NULL) b = rb_;
   THArgCheck(a->nDimension == 2, 2, "A should be 2 dimensional");
@@ -177,6 +179,7 @@ void THTensor_(trtrs)(THTensor *rb_, THTensor *ra_, THTensor *b, THTensor *a,
 
 void THTensor_(gels)(THTensor *rb_, THTensor *ra_, THTensor *b, THTensor *a)
 {
+  TH_PROFILE_TENSOR_OP(rb_, ra_, b);
   // Note that a = NULL is interpreted as a = ra_, and b = NULL as b = rb_.
   if (a == NULL) a = ra_;
   if (b == NULL) b = rb_;
@@ -232,6 +235,7 @@ void THTensor_(gels)(THTensor *rb_, THTensor *ra_, THTensor *b, THTensor *a)
 
 void THTensor_(geev)(THTensor *re_, THTensor *rv_, THTensor *a_, const char *jobvr)
 {
+  TH_PROFILE_TENSOR_OP(re_, rv_, a_);
   int n, lda, lwork, info, ldvr;
   THTensor *work, *wi, *wr, *a;
   real wkopt;
@@ -310,6 +314,7 @@ void THTensor_(geev)(THTensor *re_, THTensor *rv_, THTensor *a_, const char *job
 
 void THTensor_(syev)(THTensor *re_, THTensor *rv_, THTensor *a, const char *jobz, const char *uplo)
 {
+  TH_PROFILE_TENSOR_OP(re_, rv_, a);
   if (a == NULL) a = rv_;
   THArgCheck(a->nDimension == 2, 1, "A should be 2 dimensional");
 
@@ -349,6 +354,7 @@ void THTensor_(syev)(THTensor *re_, THTensor *rv_, THTensor *a, const char *jobz
 
 void THTensor_(gesvd)(THTensor *ru_, THTensor *rs_, THTensor *rv_, THTensor *a, const char* jobu)
 {
+  TH_PROFILE_TENSOR_OP(ru_, rs_, rv_);
   THTensor *ra_ = THTensor_(new)();
   THTensor_(gesvd2)(ru_, rs_, rv_,  ra_, a, jobu);
   THTensor_(free)(ra_);
@@ -356,6 +362,7 @@ void THTensor_(gesvd)(THTensor *ru_, THTensor *rs_, THTensor *rv_, THTensor *a,
 
 void THTensor_(gesvd2)(THTensor *ru_, THTensor *rs_, THTensor *rv_, THTensor *ra_, THTensor *a, const char* jobu)
 {
+  TH_PROFILE_TENSOR_OP(ru_, rs_, rv_);
   if (a == NULL) a = ra_;
   THArgCheck(a->nDimension == 2, 1, "A should be 2 dimensional");
 
@@ -438,6 +445,7 @@ void THTensor_(gesvd2)(THTensor *ru_, THTensor *rs_, THTensor *rv_, THTensor *ra
 
 void THTensor_(getri)(THTensor *ra_, THTensor *a)
 {
+  TH_PROFILE_TENSOR_OP(ra_, a, NULL);
   if (a == NULL) a = ra_;
   THArgCheck(a->nDimension == 2, 1, "A should be 2 dimensional");
   THArgCheck(a->size[0] == a->size[1], 1, "A should be square");
@@ -548,6 +556,7 @@ void THTensor_(copyUpLoTriangle)(THTensor *a, const char *uplo)
 
 void THTensor_(potrf)(THTensor *ra_, THTensor *a, const char *uplo)
 {
+  TH_PROFILE_TENSOR_OP(ra_, a, NULL);
   if (a == NULL) a = ra_;
   THArgCheck(a->nDimension == 2, 1, "A should be 2 dimensional");
   THArgCheck(a->size[0] == a->size[1], 1, "A should be square");
@@ -572,6 +581,7 @@ void THTensor_(potrf)(THTensor *ra_, THTensor *a, const char *uplo)
 
 void THTensor_(potrs)(THTensor *rb_, THTensor *b, THTensor *a, const char *uplo)
 {
+  TH_PROFILE_TENSOR_OP(rb_, b, a);
   if (b == NULL) b = rb_;
 
   THArgCheck(a->size[0] == a->size[1], 2, "A should be square");
@@ -604,6 +614,7 @@ void THTensor_(potrs)(THTensor *rb_, THTensor *b, THTensor *a, const char *uplo)
 
 void THTensor_(potri)(THTensor *ra_, THTensor *a, const char *uplo)
 {
+  TH_PROFILE_TENSOR_OP(ra_, a, NULL);
   if (a == NULL) a = ra_;
   THArgCheck(a->nDimension == 2, 1, "A should be 2 dimensional");
   THArgCheck(a->size[0] == a->size[1], 1, "A should be square");
@@ -643,6 +654,7 @@ void THTensor_(potri)(THTensor *ra_, THTensor *a, const char *uplo)
               The algorithm terminates when the pivot <= tol.
  */
 void THTensor_(pstrf)(THTensor *ra_, THIntTensor *rpiv_, THTensor *a, const char *uplo, real tol) {
+  TH_PROFILE_TENSOR_OP(ra_, a, NULL);
   THArgCheck(a->nDimension == 2, 1, "A should be 2 dimensional");
   THArgCheck(a->size[0] == a->size[1], 1, "A should be square");
 
@@ -691,9 +703,11 @@ void THTensor_(pstrf)(THTensor *ra_, THIntTensor *rpiv_, THTensor *a, const char
 */
 void THTensor_(qr)(THTensor *rq_, THTensor *rr_, THTensor *a)
 {
+  TH_PROFILE_TENSOR_OP(rq_, rr_, a);
   int m = a->size[0];
   int n = a->size[1];
   int k = (m < n ? m : n);
+
   THTensor *ra_ = THTensor_(new)();
   THTensor *rtau_ = THTensor_(new)();
   THTensor *rr__ = THTensor_(new)();
@@ -728,6 +742,7 @@ void THTensor_(qr)(THTensor *rq_, THTensor *rr_, THTensor *a)
 */
 void THTensor_(geqrf)(THTensor *ra_, THTensor *rtau_, THTensor *a)
 {
+  TH_PROFILE_TENSOR_OP(ra_, rtau_, a);
   if (a == NULL) ra_ = a;
   THArgCheck(a->nDimension == 2, 1, "A should be 2 dimensional");
 
@@ -784,6 +799,7 @@ void THTensor_(geqrf)(THTensor *ra_, THTensor *rtau_, THTensor *a)
 */
 void THTensor_(orgqr)(THTensor *ra_, THTensor *a, THTensor *tau)
 {
+  TH_PROFILE_TENSOR_OP(ra_, a, tau);
   if (a == NULL) a = ra_;
   THArgCheck(a->nDimension == 2, 1, "A should be 2 dimensional");
 
@@ -838,6 +854,7 @@ void THTensor_(orgqr)(THTensor *ra_, THTensor *a, THTensor *tau)
 */
 void THTensor_(ormqr)(THTensor *ra_, THTensor *a, THTensor *tau, THTensor *c, const char *side, const char *trans)
 {
+  TH_PROFILE_TENSOR_OP(ra_, a, tau);
   if (a == NULL) a = ra_;
   THArgCheck(a->nDimension == 2, 1, "A should be 2 dimensional");
 
@@ -881,4 +898,595 @@ void THTensor_(ormqr)(THTensor *ra_, THTensor *a, THTensor *tau, THTensor *c, co
   THTensor_(free)(work);
 }
 
+/*
+  Built-in dense kernels behind the batched functions below, which need
+  no LAPACK: row-major, in place, blocked by TH_LINALG_BLOCK columns with
+  the trailing updates done by gemm.
+  They target many small systems (up to a few hundred rows), where the
+  per-call LAPACK overhead and column-major copies dominate.
+*/
+#ifndef TH_LINALG_BLOCK
+#define TH_LINALG_BLOCK 32
+#endif
+
+/* y[i] -= alpha*x[i], i < n */
+static inline void THTensor_(linalgAxpy)(long n, real alpha, const real *x, real *y)
+{
+  long i;
+  for(i = 0; i < n; i++)
+    y[i] -= alpha*x[i];
+}
+
+static inline accreal THTensor_(linalgDot)(long n, const real *x, const real *y)
+{
+  accreal sum = 0;
+  long i;
+  for(i = 0; i < n; i++)
+    sum += x[i]*y[i];
+  return sum;
+}
+
+/*
+  Lower Cholesky of the n x n diagonal block at a, and the rows n..m-1 of
+  the panel below it (solved against the block). Columns left of a are
+  assumed already eliminated. Returns 0, or the 1-based failing column.
+*/
+static int THTensor_(cholPanel)(real *a, long n, long m, long lda)
+{
+  long i, j;
+  for(j = 0; j < n; j++)
+  {
+    real *aj = a + j*lda;
+    accreal d = aj[j] - THTensor_(linalgDot)(j, aj, aj);
+    if(!(d > 0))
+      return (int)j+1;
+    d = sqrt(d);
+    aj[j] = (real)d;
+    for(i = j+1; i < m; i++)
+    {
+      real *ai = a + i*lda;
+      ai[j] = (real)((ai[j] - THTensor_(linalgDot)(j, ai, aj)) / d);
+    }
+  }
+  return 0;
+}
+
+/* A = L L^T; L overwrites the lower triangle, the upper one is cleared */
+static int THTensor_(cholFactor)(real *a, long n, long lda)
+{
+  long i, k, kb;
+  for(k = 0; k < n; k += kb)
+  {
+    int info;
+    kb = THMin(TH_LINALG_BLOCK, n - k);
+    info = THTensor_(cholPanel)(a + k*lda + k, kb, n - k, lda);
+    if(info)
+      return (int)k + info;
+    if(k + kb < n)
+    {
+      /* A22 -= L21 L21^T, seen by the column-major gemm as A22^T -= (L21^T)^T L21^T */
+      long m = n - k - kb;
+      real *l21 = a + (k+kb)*lda + k;
+      THBlas_(gemm)('t', 'n', m, m, kb, -1, l21, lda, l21, lda, 1, l21 + kb, lda);
+    }
+  }
+  for(i = 0; i < n; i++)
+    memset(a + i*lda + i + 1, 0, (n - i - 1)*sizeof(real));
+  return 0;
+}
+
+/* solves L L^T X = B for the n x nrhs B */
+static void THTensor_(cholSolve)(const real *l, long n, long ldl, real *b, long nrhs, long ldb)
+{
+  long i, p;
+  for(i = 0; i < n; i++)
+  {
+    real *bi = b + i*ldb;
+    for(p = 0; p < i; p++)
+      THTensor_(linalgAxpy)(nrhs, l[i*ldl + p], b + p*ldb, bi);
+    for(p = 0; p < nrhs; p++)
+      bi[p] /= l[i*ldl + i];
+  }
+  for(i = n-1; i >= 0; i--)
+  {
+    real *bi = b + i*ldb;
+    for(p = i+1; p < n; p++)
+      THTensor_(linalgAxpy)(nrhs, l[p*ldl + i], b + p*ldb, bi);
+    for(p = 0; p < nrhs; p++)
+      bi[p] /= l[i*ldl + i];
+  }
+}
+
+/*
+  P A = L U with partial pivoting (unit L below the diagonal, U on and
+  above). piv is 1-based, as for LAPACK getrf. Returns 0, or the 1-based
+  index of the first zero pivot (the factorization is still completed).
+*/
+static int THTensor_(luFactor)(real *a, long n, long lda, int *piv)
+{
+  long i, j, k, kb, p;
+  int info = 0;
+  for(k = 0; k < n; k += kb)
+  {
+    kb = THMin(TH_LINALG_BLOCK, n - k);
+
+    /* panel; the row swaps are applied to whole rows */
+    for(j = k; j < k + kb; j++)
+    {
+      real *aj = a + j*lda;
+      long pivot = j;
+      real amax = fabs(aj[j]);
+      for(i = j+1; i < n; i++)
+      {
+        if(fabs(a[i*lda + j]) > amax)
+        {
+          amax = fabs(a[i*lda + j]);
+          pivot = i;
+        }
+      }
+      piv[j] = (int)pivot + 1;
+      if(pivot != j)
+      {
+        real *ap = a + pivot*lda;
+        for(p = 0; p < n; p++)
+        {
+          real z = aj[p];
+          aj[p] = ap[p];
+          ap[p] = z;
+        }
+      }
+      if(aj[j] == 0)
+      {
+        if(!info)
+          info = (int)j+1;
+        continue;
+      }
+      for(i = j+1; i < n; i++)
+      {
+        real *ai = a + i*lda;
+        ai[j] /= aj[j];
+        THTensor_(linalgAxpy)(k + kb - j - 1, ai[j], aj + j + 1, ai + j + 1);
+      }
+    }
+
+    if(k + kb < n)
+    {
+      /* U12 = L11^-1 A12, then A22 -= L21 U12 */
+      long m = n - k - kb;
+      for(i = k+1; i < k + kb; i++)
+        for(p = k; p < i; p++)
+          THTensor_(linalgAxpy)(m, a[i*lda + p], a + p*lda + k + kb, a + i*lda + k + kb);
+      THBlas_(gemm)('n', 'n', m, m, kb, -1, a + k*lda + k + kb, lda, a + (k+kb)*lda + k, lda,
+                    1, a + (k+kb)*lda + k + kb, lda);
+    }
+  }
+  return info;
+}
+
+/* solves A X = B for the n x nrhs B, given the luFactor output of A */
+static void THTensor_(luSolve)(const real *lu, long n, long ldlu, const int *piv, real *b, long nrhs, long ldb)
+{
+  long i, p;
+  for(i = 0; i < n; i++)
+  {
+    long pivot = piv[i] - 1;
+    if(pivot != i)
+    {
+      real *bi = b + i*ldb, *bp = b + pivot*ldb;
+      for(p = 0; p < nrhs; p++)
+      {
+        real z = bi[p];
+        bi[p] = bp[p];
+        bp[p] = z;
+      }
+    }
+  }
+  for(i = 1; i < n; i++)
+    for(p = 0; p < i; p++)
+      THTensor_(linalgAxpy)(nrhs, lu[i*ldlu + p], b + p*ldb, b + i*ldb);
+  for(i = n-1; i >= 0; i--)
+  {
+    real *bi = b + i*ldb;
+    for(p = i+1; p < n; p++)
+      THTensor_(linalgAxpy)(nrhs, lu[i*ldlu + p], b + p*ldb, bi);
+    for(p = 0; p < nrhs; p++)
+      bi[p] /= lu[i*ldlu + i];
+  }
+}
+
+/*
+  Householder QR of the m x n matrix A, given transposed in at (row j
+  holds column j, so reflectors are applied along contiguous rows).
+  Writes Q (m x k) and R (k x n), k = min(m,n). Same reflector
+  convention as LAPACK geqrf/orgqr. work holds k*m + k reals.
+*/
+static void THTensor_(qrHouseholder)(real *at, long m, long n, real *q, real *r, real *work)
+{
+  long k = THMin(m, n);
+  real *qt = work, *tau = work + k*m;
+  long i, j;
+
+  for(i = 0; i < k; i++)
+  {
+    real *x = at + i*m + i;
+    long len = m - i;
+    accreal sigma = THTensor_(linalgDot)(len - 1, x + 1, x + 1);
+    accreal alpha = x[0];
+
+    tau[i] = 0;
+    if(sigma != 0)
+    {
+      accreal norm = sqrt(alpha*alpha + sigma);
+      accreal beta = (alpha >= 0 ? -norm : norm);
+      accreal scale = 1/(alpha - beta);
+      tau[i] = (real)((beta - alpha)/beta);
+      for(j = 1; j < len; j++)
+        x[j] *= scale;
+      x[0] = (real)beta;
+    }
+    if(tau[i] == 0)
+      continue;
+    for(j = i+1; j < n; j++)
+    {
+      real *y = at + j*m + i;
+      real w = tau[i]*(y[0] + THTensor_(linalgDot)(len - 1, x + 1, y + 1));
+      y[0] -= w;
+      THTensor_(linalgAxpy)(len - 1, w, x + 1, y + 1);
+    }
+  }
+
+  for(i = 0; i < k; i++)
+    for(j = 0; j < n; j++)
+      r[i*n + j] = (j >= i ? at[j*m + i] : 0);
+
+  /* Q = H_0 ... H_{k-1} I, columns of Q held as rows of qt */
+  memset(qt, 0, k*m*sizeof(real));
+  for(i = 0; i < k; i++)
+    qt[i*m + i] = 1;
+  for(i = k-1; i >= 0; i--)
+  {
+    const real *v = at + i*m + i;
+    long len = m - i;
+    if(tau[i] == 0)
+      continue;
+    for(j = i; j < k; j++)
+    {
+      real *y = qt + j*m + i;
+      real w = tau[i]*(y[0] + THTensor_(linalgDot)(len - 1, v + 1, y + 1));
+      y[0] -= w;
+      THTensor_(linalgAxpy)(len - 1, w, v + 1, y + 1);
+    }
+  }
+  for(i = 0; i < m; i++)
+    for(j = 0; j < k; j++)
+      q[i*k + j] = qt[j*m + i];
+}
+
+/*
+  Contiguous working copy of src for a batched call writing into result.
+  The returned tensor must be released with freeCopyTo(work, result).
+*/
+static THTensor *THTensor_(batchClone)(THTensor *result, THTensor *src)
+{
+  if(result == src)
+    return THTensor_(newContiguous)(src);
+  THTensor_(resizeAs)(result, src);
+  if(THTensor_(isContiguous)(result))
+  {
+    THTensor_(copy)(result, src);
+    THTensor_(retain)(result);
+    return result;
+  }
+  return THTensor_(newClone)(src);
+}
+
+/* batch items per pool task, for items costing about n^3 flops */
+static long THTensor_(batchGrain)(long n)
+{
+  return THMax(1L, THThreadPool_getGrainSize()/(n*n*n + 1));
+}
+
+typedef struct THTensor_(BatchArgs)
+{
+  real *a;
+  real *b;
+  real *q;
+  real *r;
+  int *piv;
+  int *info;
+  real *work;
+  long m, n, nrhs;
+  int upper;
+  int nBuffers;
+} THTensor_(BatchArgs);
+
+static void THTensor_(btrifactKernel)(void *args_, long begin, long end)
+{
+  THTensor_(BatchArgs) *args = (THTensor_(BatchArgs)*)args_;
+  long n = args->n, i;
+  for(i = begin; i < end; i++)
+    args->info[i] = THTensor_(luFactor)(args->a + i*n*n, n, n, args->piv + i*n);
+}
+
+static void THTensor_(btrisolveKernel)(void *args_, long begin, long end)
+{
+  THTensor_(BatchArgs) *args = (THTensor_(BatchArgs)*)args_;
+  long n = args->n, nrhs = args->nrhs, i;
+  for(i = begin; i < end; i++)
+    THTensor_(luSolve)(args->a + i*n*n, n, n, args->piv + i*n, args->b + i*n*nrhs, nrhs, nrhs);
+}
+
+static void THTensor_(bpotrfKernel)(void *args_, long begin, long end)
+{
+  THTensor_(BatchArgs) *args = (THTensor_(BatchArgs)*)args_;
+  long n = args->n, i, j, k;
+  for(i = begin; i < end; i++)
+  {
+    real *a = args->a + i*n*n;
+    if(args->upper)
+    {
+      /* the upper triangle holds A */
+      for(j = 0; j < n; j++)
+        for(k = 0; k < j; k++)
+          a[j*n + k] = a[k*n + j];
+    }
+    args->info[i] = THTensor_(cholFactor)(a, n, n);
+    if(args->upper)
+    {
+      /* U = L^T */
+      for(j = 0; j < n; j++)
+        for(k = 0; k < j; k++)
+        {
+          a[k*n + j] = a[j*n + k];
+          a[j*n + k] = 0;
+        }
+    }
+  }
+}
+
+static void THTensor_(bpotrsKernel)(void *args_, long begin, long end)
+{
+  THTensor_(BatchArgs) *args = (THTensor_(BatchArgs)*)args_;
+  long n = args->n, nrhs = args->nrhs, i;
+  for(i = begin; i < end; i++)
+    THTensor_(cholSolve)(args->a + i*n*n, n, n, args->b + i*n*nrhs, nrhs, nrhs);
+}
+
+static void THTensor_(bqrKernel)(void *args_, long begin, long end)
+{
+  THTensor_(BatchArgs) *args = (THTensor_(BatchArgs)*)args_;
+  long m = args->m, n = args->n, k = THMin(m, n), i;
+  int buffer = (args->nBuffers > 1 ? THThreadPool_getThreadNum() : 0);
+  real *work = args->work + buffer*(k*m + k);
+  for(i = begin; i < end; i++)
+    THTensor_(qrHouseholder)(args->a + i*m*n, m, n, args->q + i*m*k, args->r + i*k*n, work);
+}
+
+/* first failed item of a batch, -1 if none */
+static long THTensor_(batchFailed)(const int *info, long batch)
+{
+  long i;
+  for(i = 0; i < batch; i++)
+    if(info[i])
+      return i;
+  return -1;
+}
+
+/*
+  Batched LU factorization with partial pivoting of a (batch x n x n).
+
+  Args:
+  * `ra_`      - result: L (unit, below the diagonal) and U of each matrix.
+  * `rpivots_` - result IntTensor (batch x n) of 1-based row pivots.
+  * `rinfo_`   - if not NULL, receives for each matrix 0 or the 1-based index
+                 of its first zero pivot; if NULL, a singular matrix is an error.
+  * `a`        - input; NULL means ra_.
+*/
+void THTensor_(btrifact)(THTensor *ra_, THIntTensor *rpivots_, THIntTensor *rinfo_, THTensor *a)
+{
+  TH_PROFILE_TENSOR_OP(ra_, a, NULL);
+  THTensor_(BatchArgs) args;
+  THTensor *ra__;
+  THIntTensor *piv, *info;
+  long batch, failed;
+
+  if (a == NULL) a = ra_;
+  THArgCheck(a->nDimension == 3, 4, "A should be 3 dimensional");
+  THArgCheck(a->size[1] == a->size[2], 4, "A should be a batch of square matrices");
+
+  batch = a->size[0];
+  args.n = a->size[1];
+  ra__ = THTensor_(batchClone)(ra_, a);
+  piv = THIntTensor_newWithSize2d(batch, args.n);
+  info = THIntTensor_newWithSize1d(batch);
+  args.a = THTensor_(data)(ra__);
+  args.piv = THIntTensor_data(piv);
+  args.info = THIntTensor_data(info);
+
+  THParallel_for(0, batch, THTensor_(batchGrain)(args.n), THTensor_(btrifactKernel), &args);
+
+  failed = THTensor_(batchFailed)(args.info, batch);
+  THTensor_(freeCopyTo)(ra__, ra_);
+  THIntTensor_resize2d(rpivots_, batch, args.n);
+  THIntTensor_freeCopyTo(piv, rpivots_);
+  if(rinfo_)
+  {
+    THIntTensor_resize1d(rinfo_, batch);
+    THIntTensor_copy(rinfo_, info);
+  }
+  else if(failed >= 0)
+  {
+    int i = args.info[failed];
+    THIntTensor_free(info);
+    THError("btrifact : U(%d,%d) is zero, singular U in matrix %ld", i, i, failed);
+  }
+  THIntTensor_free(info);
+}
+
+/*
+  Solves A_i X_i = B_i for each matrix of the batch, given the btrifact
+  output atf and pivots. b is batch x n x nrhs, or batch x n.
+*/
+void THTensor_(btrisolve)(THTensor *rb_, THTensor *b, THTensor *atf, THIntTensor *pivots)
+{
+  TH_PROFILE_TENSOR_OP(rb_, b, atf);
+  THTensor_(BatchArgs) args;
+  THTensor *rb__, *atf_;
+  THIntTensor *piv;
+
+  if (b == NULL) b = rb_;
+  THArgCheck(atf->nDimension == 3 && atf->size[1] == atf->size[2], 3, "A should be a batch of square matrices");
+  THArgCheck(b->nDimension == 2 || b->nDimension == 3, 2, "B should be 2 or 3 dimensional");
+  THArgCheck(b->size[0] == atf->size[0] && b->size[1] == atf->size[1], 2, "A,b size incompatible");
+  THArgCheck(pivots->nDimension == 2 && pivots->size[0] == atf->size[0] && pivots->size[1] == atf->size[1],
+             4, "pivots size incompatible");
+
+  args.n = atf->size[1];
+  args.nrhs = (b->nDimension == 3 ? b->size[2] : 1);
+  rb__ = THTensor_(batchClone)(rb_, b);
+  atf_ = THTensor_(newContiguous)(atf);
+  piv = THIntTensor_newContiguous(pivots);
+  args.a = THTensor_(data)(atf_);
+  args.b = THTensor_(data)(rb__);
+  args.piv = THIntTensor_data(piv);
+
+  THParallel_for(0, b->size[0], THTensor_(batchGrain)(args.n), THTensor_(btrisolveKernel), &args);
+
+  THTensor_(free)(atf_);
+  THIntTensor_free(piv);
+  THTensor_(freeCopyTo)(rb__, rb_);
+}
+
+/*
+  Batched gesv: solves A_i X_i = B_i. ra_ receives the LU factors, rb_ the
+  solutions; a and b are as for btrifact and btrisolve.
+*/
+void THTensor_(bgesv)(THTensor *rb_, THTensor *ra_, THTensor *b, THTensor *a)
+{
+  TH_PROFILE_TENSOR_OP(rb_, ra_, b);
+  THIntTensor *piv = THIntTensor_new();
+  if (a == NULL) a = ra_;
+  if (b == NULL) b = rb_;
+  THArgCheck(b->nDimension >= 2 && b->size[0] == a->size[0] && b->size[1] == a->size[1],
+             1, "A,b size incompatible");
+  THTensor_(btrifact)(ra_, piv, NULL, a);
+  THTensor_(btrisolve)(rb_, b, ra_, piv);
+  THIntTensor_free(piv);
+}
+
+/*
+  Batched Cholesky factorization of the symmetric positive definite
+  matrices of a (batch x n x n): A = L L^T (uplo "L") or A = U^T U ("U").
+  As for potrf, only the uplo triangle of each input matrix is read.
+*/
+void THTensor_(bpotrf)(THTensor *ra_, THTensor *a, const char *uplo)
+{
+  TH_PROFILE_TENSOR_OP(ra_, a, NULL);
+  THTensor_(BatchArgs) args;
+  THTensor *ra__;
+  long batch, failed;
+
+  if (a == NULL) a = ra_;
+  THArgCheck(a->nDimension == 3, 2, "A should be 3 dimensional");
+  THArgCheck(a->size[1] == a->size[2], 2, "A should be a batch of square matrices");
+
+  batch = a->size[0];
+  args.n = a->size[1];
+  args.upper = (uplo[0] == 'U');
+  ra__ = THTensor_(batchClone)(ra_, a);
+  args.a = THTensor_(data)(ra__);
+  args.info = THAlloc(sizeof(int)*batch);
+
+  THParallel_for(0, batch, THTensor_(batchGrain)(args.n), THTensor_(bpotrfKernel), &args);
+
+  failed = THTensor_(batchFailed)(args.info, batch);
+  THTensor_(freeCopyTo)(ra__, ra_);
+  if(failed >= 0)
+  {
+    int i = args.info[failed];
+    THFree(args.info);
+    THError("bpotrf : A(%d,%d) is not positive, matrix %ld cannot be factorized", i, i, failed);
+  }
+  THFree(args.info);
+}
+
+/* solves A_i X_i = B_i given the bpotrf factors of the A_i */
+void THTensor_(bpotrs)(THTensor *rb_, THTensor *b, THTensor *a, const char *uplo)
+{
+  TH_PROFILE_TENSOR_OP(rb_, b, a);
+  THTensor_(BatchArgs) args;
+  THTensor *rb__, *l;
+
+  if (b == NULL) b = rb_;
+  THArgCheck(a->nDimension == 3 && a->size[1] == a->size[2], 3, "A should be a batch of square matrices");
+  THArgCheck(b->nDimension == 2 || b->nDimension == 3, 2, "B should be 2 or 3 dimensional");
+  THArgCheck(b->size[0] == a->size[0] && b->size[1] == a->size[1], 2, "A,b size incompatible");
+
+  args.n = a->size[1];
+  args.nrhs = (b->nDimension == 3 ? b->size[2] : 1);
+  if(uplo[0] == 'U')
+  {
+    THTensor *u = THTensor_(newTranspose)(a, 1, 2);
+    l = THTensor_(newContiguous)(u);
+    THTensor_(free)(u);
+  }
+  else
+    l = THTensor_(newContiguous)(a);
+  rb__ = THTensor_(batchClone)(rb_, b);
+  args.a = THTensor_(data)(l);
+  args.b = THTensor_(data)(rb__);
+
+  THParallel_for(0, b->size[0], THTensor_(batchGrain)(args.n), THTensor_(bpotrsKernel), &args);
+
+  THTensor_(free)(l);
+  THTensor_(freeCopyTo)(rb__, rb_);
+}
+
+/*
+  Batched QR decomposition of a (batch x m x n): rq_ receives Q
+  (batch x m x k) and rr_ R (batch x k x n), k = min(m,n).
+*/
+void THTensor_(bqr)(THTensor *rq_, THTensor *rr_, THTensor *a)
+{
+  TH_PROFILE_TENSOR_OP(rq_, rr_, a);
+  THTensor_(BatchArgs) args;
+  THTensor *at, *at_, *q, *r;
+  long batch, k, grain;
+
+  THArgCheck(a->nDimension == 3, 3, "A should be 3 dimensional");
+
+  batch = a->size[0];
+  args.m = a->size[1];
+  args.n = a->size[2];
+  k = THMin(args.m, args.n);
+
+  /* working copy with the columns of each matrix contiguous */
+  at_ = THTensor_(newTranspose)(a, 1, 2);
+  at = THTensor_(newWithSize3d)(batch, args.n, args.m);
+  THTensor_(copy)(at, at_);
+  THTensor_(free)(at_);
+  q = THTensor_(newWithSize3d)(batch, args.m, k);
+  r = THTensor_(newWithSize3d)(batch, k, args.n);
+  args.a = THTensor_(data)(at);
+  args.q = THTensor_(data)(q);
+  args.r = THTensor_(data)(r);
+
+  /* one Householder work block per pool thread, the kernel must not allocate */
+  grain = THTensor_(batchGrain)(THMax(args.m, args.n));
+  args.nBuffers = (batch > grain && !THThreadPool_inParallelRegion() ? THThreadPool_getNumThreads() : 1);
+  args.work = THAlloc(sizeof(real)*(k*args.m + k)*args.nBuffers);
+  if(args.nBuffers > 1)
+    THParallel_for(0, batch, grain, THTensor_(bqrKernel), &args);
+  else
+    THTensor_(bqrKernel)(&args, 0, batch);
+  THFree(args.work);
+
+  THTensor_(free)(at);
+  THTensor_(resizeAs)(rq_, q);
+  THTensor_(resizeAs)(rr_, r);
+  THTensor_(freeCopyTo)(q, rq_);
+  THTensor_(freeCopyTo)(r, rr_);
+}
+
+
 #endif
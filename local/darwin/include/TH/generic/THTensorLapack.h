@@ -19,4 +19,11 @@ TH_API void THTensor_(orgqr)(THTensor *ra_, THTensor *a, THTensor *tau);
 TH_API void THTensor_(ormqr)(THTensor *ra_, THTensor *a, THTensor *tau, THTensor *c, const char *side, const char *trans);
 TH_API void THTensor_(pstrf)(THTensor *ra_, THIntTensor *rpiv_, THTensor*a, const char* uplo, real tol);
 
+TH_API void THTensor_(btrifact)(THTensor *ra_, THIntTensor *rpivots_, THIntTensor *rinfo_, THTensor *a);
+TH_API void THTensor_(btrisolve)(THTensor *rb_, THTensor *b, THTensor *atf, THIntTensor *pivots);
+TH_API void THTensor_(bgesv)(THTensor *rb_, THTensor *ra_, THTensor *b, THTensor *a);
+TH_API void THTensor_(bpotrf)(THTensor *ra_, THTensor *a, const char *uplo);
+TH_API void THTensor_(bpotrs)(THTensor *rb_, THTensor *b, THTensor *a, const char *uplo);
+TH_API void THTensor_(bqr)(THTensor *rq_, THTensor *rr_, THTensor *a);
+
 #endif
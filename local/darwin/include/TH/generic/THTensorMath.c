@@ -2,22 +2,90 @@
 #define TH_GENERIC_FILE "generic/THTensorMath.c"
 #else
 
-#define TH_OMP_OVERHEAD_THRESHOLD 100000
+/* operands of the contiguous element-wise kernels run through THParallel_for */
+typedef struct THTensor_(ContiguousArgs)
+{
+  real *rp;
+  real *tp;
+  real *sp;
+  real value;
+  real value2;
+} THTensor_(ContiguousArgs);
+
+#ifndef TH_TENSOR_CONTIGUOUS_KERNEL
+#define TH_TENSOR_CONTIGUOUS_KERNEL(NAME, CODE)                         \
+  static void THTensor_(NAME)(void *args_, long begin, long end)        \
+  {                                                                     \
+    THTensor_(ContiguousArgs) *args = (THTensor_(ContiguousArgs)*)args_; \
+    real *rp = args->rp;                                                \
+    real *tp = args->tp;                                                \
+    real *sp = args->sp;                                                \
+    real value = args->value;                                           \
+    real value2 = args->value2;                                         \
+    long i;                                                             \
+    (void)sp; (void)value; (void)value2;                                \
+    for (i=begin; i<end; i++)                                           \
+      CODE;                                                             \
+  }
+#endif
+
+TH_TENSOR_CONTIGUOUS_KERNEL(addKernel, rp[i] = tp[i] + value)
+TH_TENSOR_CONTIGUOUS_KERNEL(mulKernel, rp[i] = tp[i] * value)
+TH_TENSOR_CONTIGUOUS_KERNEL(divKernel, rp[i] = tp[i] / value)
+TH_TENSOR_CONTIGUOUS_KERNEL(fmodKernel, rp[i] = fmod(tp[i], value))
+TH_TENSOR_CONTIGUOUS_KERNEL(remainderKernel, rp[i] = (value == 0)? NAN : tp[i] - value * floor(tp[i] / value))
+TH_TENSOR_CONTIGUOUS_KERNEL(clampKernel, rp[i] = (tp[i] < value) ? value : (tp[i] > value2 ? value2 : tp[i]))
+TH_TENSOR_CONTIGUOUS_KERNEL(caddKernel, rp[i] = tp[i] + value * sp[i])
+TH_TENSOR_CONTIGUOUS_KERNEL(cmulKernel, rp[i] = tp[i] * sp[i])
+TH_TENSOR_CONTIGUOUS_KERNEL(cpowKernel, rp[i] = pow(tp[i], sp[i]))
+TH_TENSOR_CONTIGUOUS_KERNEL(cdivKernel, rp[i] = tp[i] / sp[i])
+TH_TENSOR_CONTIGUOUS_KERNEL(cfmodKernel, rp[i] = fmod(tp[i], sp[i]))
+TH_TENSOR_CONTIGUOUS_KERNEL(cremainderKernel, rp[i] = (sp[i] == 0)? NAN : tp[i] - sp[i] * floor(tp[i] / sp[i]))
+TH_TENSOR_CONTIGUOUS_KERNEL(tpowKernel, rp[i] = pow(value, tp[i]))
+
+static void THTensor_(contiguousApply)(THParallelFunction kernel, real *rp, real *tp, real *sp,
+                                       real value, real value2, long sz)
+{
+  THTensor_(ContiguousArgs) args;
+  args.rp = rp;
+  args.tp = tp;
+  args.sp = sp;
+  args.value = value;
+  args.value2 = value2;
+  THParallel_for(0, sz, 0, kernel, &args);
+}
+
+static void THTensor_(fillKernel)(void *args_, long begin, long end)
+{
+  THTensor_(ContiguousArgs) *args = (THTensor_(ContiguousArgs)*)args_;
+  real *rp = args->rp + begin;
+  THVector_(fill)(rp, args->value, end - begin);
+}
 
+/* contiguous tensors are split like in the other contiguous kernels, so that
+   freshly allocated pages are first touched by the thread that will later
+   work on them */
 void THTensor_(fill)(THTensor *r_, real value)
 {
-  TH_TENSOR_APPLY(real, r_,
-                  THVector_(fill)(r__data, value, r__size); break;);
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
+  if (THTensor_(isContiguous)(r_)) {
+    THTensor_(contiguousApply)(THTensor_(fillKernel), THTensor_(data)(r_), NULL, NULL,
+                               value, 0, THTensor_(nElement)(r_));
+  } else {
+    TH_TENSOR_APPLY(real, r_,
+                    THVector_(fill)(r__data, value, r__size); break;);
+  }
 }
 
 void THTensor_(zero)(THTensor *r_)
 {
-  TH_TENSOR_APPLY(real, r_,
-                  THVector_(fill)(r__data, 0, r__size); break;);
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
+  THTensor_(fill)(r_, 0);
 }
 
 void THTensor_(maskedFill)(THTensor *tensor, THByteTensor *mask, real value)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   TH_TENSOR_APPLY2(real, tensor, unsigned char, mask,
                    if (*mask_data > 1)
                    {
@@ -33,6 +101,7 @@ void THTensor_(maskedFill)(THTensor *tensor, THByteTensor *mask, real value)
 
 void THTensor_(maskedCopy)(THTensor *tensor, THByteTensor *mask, THTensor* src )
 {
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
   THTensor *srct = THTensor_(newContiguous)(src);
   real *src_data = THTensor_(data)(srct);
   long cntr = 0;
@@ -68,6 +137,7 @@ void THTensor_(maskedCopy)(THTensor *tensor, THByteTensor *mask, THTensor* src )
 
 void THTensor_(maskedSelect)(THTensor *tensor, THTensor *src, THByteTensor *mask)
 {
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
   long numel = THByteTensor_sumall(mask);
   real *tensor_data;
 
@@ -87,9 +157,95 @@ void THTensor_(maskedSelect)(THTensor *tensor, THTensor *src, THByteTensor *mask
                    });
 }
 
+typedef struct THTensor_(MaskedFillBitsArgs)
+{
+  real *data;
+  const uint64_t *bits;
+  real value;
+} THTensor_(MaskedFillBitsArgs);
+
+static void THTensor_(maskedFillBitsKernel)(void *args_, long begin, long end)
+{
+  THTensor_(MaskedFillBitsArgs) *args = (THTensor_(MaskedFillBitsArgs)*)args_;
+  long w, j;
+  for(w = begin; w < end; w++)
+  {
+    uint64_t word = args->bits[w];
+    real *data = args->data + w*TH_BIT_MASK_WORD_BITS;
+    if(word == ~(uint64_t)0)
+    {
+      for(j = 0; j < TH_BIT_MASK_WORD_BITS; j++)
+        data[j] = args->value;
+    }
+    else
+    {
+      for(; word; word &= word - 1)
+        data[THBitMask_ctz(word)] = args->value;
+    }
+  }
+}
+
+void THTensor_(maskedFillBits)(THTensor *tensor, THBitMask *mask, real value)
+{
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
+  const uint64_t *bits = THBitMask_data(mask);
+  THArgCheck(THTensor_(nElement)(tensor) == THBitMask_nElement(mask), 2,
+             "Number of elements of tensor != Number of elements in mask");
+  if(THTensor_(isContiguous)(tensor))
+  {
+    THTensor_(MaskedFillBitsArgs) args;
+    args.data = THTensor_(data)(tensor);
+    args.bits = bits;
+    args.value = value;
+    THParallel_for(0, THBitMask_nWords(THBitMask_nElement(mask)),
+                   THMax(1, THThreadPool_getGrainSize()/TH_BIT_MASK_WORD_BITS),
+                   THTensor_(maskedFillBitsKernel), &args);
+  }
+  else
+  {
+    long i = 0;
+    TH_TENSOR_APPLY(real, tensor,
+                    if((bits[i / TH_BIT_MASK_WORD_BITS] >> (i % TH_BIT_MASK_WORD_BITS)) & 1)
+                      *tensor_data = value;
+                    i++;);
+  }
+}
+
+void THTensor_(maskedSelectBits)(THTensor *tensor, THTensor *src, THBitMask *mask)
+{
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
+  const uint64_t *bits = THBitMask_data(mask);
+  real *tensor_data;
+
+  THArgCheck(THTensor_(nElement)(src) == THBitMask_nElement(mask), 3,
+             "Number of elements of src != Number of elements in mask");
+  THTensor_(resize1d)(tensor, THBitMask_count(mask));
+  tensor_data = THTensor_(data)(tensor);
+  if(THTensor_(isContiguous)(src))
+  {
+    real *src_data = THTensor_(data)(src);
+    long w, nWords = THBitMask_nWords(THBitMask_nElement(mask));
+    for(w = 0; w < nWords; w++)
+    {
+      uint64_t word = bits[w];
+      for(; word; word &= word - 1)
+        *tensor_data++ = src_data[w*TH_BIT_MASK_WORD_BITS + THBitMask_ctz(word)];
+    }
+  }
+  else
+  {
+    long i = 0;
+    TH_TENSOR_APPLY(real, src,
+                    if((bits[i / TH_BIT_MASK_WORD_BITS] >> (i % TH_BIT_MASK_WORD_BITS)) & 1)
+                      *tensor_data++ = *src_data;
+                    i++;);
+  }
+}
+
 // Finds non-zero elements of a tensor and returns their subscripts
 void THTensor_(nonzero)(THLongTensor *subscript, THTensor *tensor)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   long numel = 0;
   long *subscript_data;
   long i = 0;
@@ -119,8 +275,31 @@ void THTensor_(nonzero)(THLongTensor *subscript, THTensor *tensor)
                   ++i;);
 }
 
+typedef struct THTensor_(IndexSelectArgs)
+{
+  real *tensor_data;
+  real *src_data;
+  long *index_data;
+  long rowsize;
+} THTensor_(IndexSelectArgs);
+
+static void THTensor_(indexSelectKernel)(void *args_, long begin, long end)
+{
+  THTensor_(IndexSelectArgs) *args = (THTensor_(IndexSelectArgs)*)args_;
+  long rowsize = args->rowsize;
+  long i;
+  if (rowsize == 1) {
+    for (i=begin; i<end; i++)
+      args->tensor_data[i] = args->src_data[args->index_data[i]-1];
+  } else {
+    for (i=begin; i<end; i++)
+      memcpy(args->tensor_data + i*rowsize, args->src_data + (args->index_data[i]-1)*rowsize, rowsize*sizeof(real));
+  }
+}
+
 void THTensor_(indexSelect)(THTensor *tensor, THTensor *src, int dim, THLongTensor *index)
 {
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
   long i, numel;
   THLongStorage *newSize;
   THTensor *tSlice, *sSlice;
@@ -157,15 +336,14 @@ void THTensor_(indexSelect)(THTensor *tensor, THTensor *src, int dim, THLongTens
       }
     }
 
-    if (src->nDimension == 1) {
-      #pragma omp parallel for if(numel > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<numel; i++)
-        tensor_data[i] = src_data[index_data[i]-1];
-    } else {
-      #pragma omp parallel for if(numel*rowsize > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<numel; i++)
-        memcpy(tensor_data + i*rowsize, src_data + (index_data[i]-1)*rowsize, rowsize*sizeof(real));
-    }
+    THTensor_(IndexSelectArgs) args;
+    args.tensor_data = tensor_data;
+    args.src_data = src_data;
+    args.index_data = index_data;
+    args.rowsize = rowsize;
+    /* grain is counted in rows: keep the old element threshold */
+    THParallel_for(0, numel, (THThreadPool_getGrainSize() + rowsize - 1) / (rowsize > 0 ? rowsize : 1),
+                   THTensor_(indexSelectKernel), &args);
   }
   else if (src->nDimension == 1)
   {
@@ -174,15 +352,12 @@ void THTensor_(indexSelect)(THTensor *tensor, THTensor *src, int dim, THLongTens
   }
   else
   {
+    THTensorView tView, sView;
     for (i=0; i<numel; i++)
     {
-      tSlice = THTensor_(new)();
-      sSlice = THTensor_(new)();
-      THTensor_(select)(tSlice, tensor, dim, i);
-      THTensor_(select)(sSlice, src, dim, index_data[i]-1);
+      tSlice = THTensor_(viewSelect)(&tView, tensor, dim, i);
+      sSlice = THTensor_(viewSelect)(&sView, src, dim, index_data[i]-1);
       THTensor_(copy)(tSlice, sSlice);
-      THTensor_(free)(tSlice);
-      THTensor_(free)(sSlice);
     }
   }
 
@@ -191,6 +366,7 @@ void THTensor_(indexSelect)(THTensor *tensor, THTensor *src, int dim, THLongTens
 
 void THTensor_(indexCopy)(THTensor *tensor, int dim, THLongTensor *index, THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
   long i, numel;
   THTensor *tSlice, *sSlice;
   long *index_data;
@@ -205,18 +381,13 @@ void THTensor_(indexCopy)(THTensor *tensor, int dim, THLongTensor *index, THTens
 
   if (tensor->nDimension > 1 )
   {
-    tSlice = THTensor_(new)();
-    sSlice = THTensor_(new)();
-
+    THTensorView tView, sView;
     for (i=0; i<numel; i++)
     {
-      THTensor_(select)(tSlice, tensor, dim, index_data[i]-1);
-      THTensor_(select)(sSlice, src, dim, i);
+      tSlice = THTensor_(viewSelect)(&tView, tensor, dim, index_data[i]-1);
+      sSlice = THTensor_(viewSelect)(&sView, src, dim, i);
       THTensor_(copy)(tSlice, sSlice);
     }
-
-    THTensor_(free)(tSlice);
-    THTensor_(free)(sSlice);
   }
   else
   {
@@ -230,6 +401,7 @@ void THTensor_(indexCopy)(THTensor *tensor, int dim, THLongTensor *index, THTens
 
 void THTensor_(indexAdd)(THTensor *tensor, int dim, THLongTensor *index, THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
   long i, numel;
   THTensor *tSlice, *sSlice;
   long *index_data;
@@ -244,18 +416,13 @@ void THTensor_(indexAdd)(THTensor *tensor, int dim, THLongTensor *index, THTenso
 
   if (tensor->nDimension > 1 )
   {
-    tSlice = THTensor_(new)();
-    sSlice = THTensor_(new)();
-
+    THTensorView tView, sView;
     for (i=0; i<numel; i++)
     {
-      THTensor_(select)(tSlice, tensor, dim, index_data[i]-1);
-      THTensor_(select)(sSlice, src, dim, i);
+      tSlice = THTensor_(viewSelect)(&tView, tensor, dim, index_data[i]-1);
+      sSlice = THTensor_(viewSelect)(&sView, src, dim, i);
       THTensor_(cadd)(tSlice, tSlice, 1.0, sSlice);
     }
-
-    THTensor_(free)(tSlice);
-    THTensor_(free)(sSlice);
   }
   else
   {
@@ -269,6 +436,7 @@ void THTensor_(indexAdd)(THTensor *tensor, int dim, THLongTensor *index, THTenso
 
 void THTensor_(indexFill)(THTensor *tensor, int dim, THLongTensor *index, real val)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   long i, numel;
   THTensor *tSlice;
   long *index_data;
@@ -284,10 +452,9 @@ void THTensor_(indexFill)(THTensor *tensor, int dim, THLongTensor *index, real v
   {
     if (tensor->nDimension > 1 )
     {
-      tSlice = THTensor_(new)();
-      THTensor_(select)(tSlice, tensor,dim,index_data[i]-1);
+      THTensorView tView;
+      tSlice = THTensor_(viewSelect)(&tView, tensor, dim, index_data[i]-1);
       THTensor_(fill)(tSlice, val);
-      THTensor_(free)(tSlice);
     }
     else
     {
@@ -299,6 +466,7 @@ void THTensor_(indexFill)(THTensor *tensor, int dim, THLongTensor *index, real v
 
 void THTensor_(gather)(THTensor *tensor, THTensor *src, int dim, THLongTensor *index)
 {
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
   long elems_per_row, i, idx;
 
   THArgCheck(THTensor_(nDimension)(src) == THTensor_(nDimension)(tensor), 2,
@@ -324,6 +492,7 @@ void THTensor_(gather)(THTensor *tensor, THTensor *src, int dim, THLongTensor *i
 
 void THTensor_(scatter)(THTensor *tensor, int dim, THLongTensor *index, THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
   long elems_per_row, i, idx;
 
   THArgCheck(dim < THTensor_(nDimension)(tensor), 2, "Index dimension is out of bounds");
@@ -349,6 +518,7 @@ void THTensor_(scatter)(THTensor *tensor, int dim, THLongTensor *index, THTensor
 
 void THTensor_(scatterFill)(THTensor *tensor, int dim, THLongTensor *index, real val)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   long elems_per_row, i, idx;
 
   THArgCheck(dim < THTensor_(nDimension)(tensor), 2, "Index dimension is out of bounds");
@@ -370,13 +540,263 @@ void THTensor_(scatterFill)(THTensor *tensor, int dim, THLongTensor *index, real
                        })
 }
 
+/*
+  Accumulation policies of dot and sumall (see THTensorMath.h). In real,
+  ranges are reduced by TH_ACC_LANES independent accumulators folded at the
+  end, so that the additions keep the vector throughput of the type; the
+  compensated ones (KAHAN) carry a correction term per lane. Contiguous
+  tensors are split in fixed chunks (THParallel_reduce), whose results are
+  added with compensation in chunk order: the result does not depend on
+  the number of threads.
+*/
+#ifndef TH_ACC_LANES
+#define TH_ACC_LANES 8
+#endif
+/* pairwise leaves, summed by the lanes */
+#ifndef TH_ACC_BLOCK
+#define TH_ACC_BLOCK 256
+#endif
+
+static int THTensor_(accumulationPolicy) = TH_ACCUMULATE_ACCREAL;
+
+void THTensor_(setAccumulation)(int policy)
+{
+  THArgCheck(policy >= TH_ACCUMULATE_ACCREAL && policy <= TH_ACCUMULATE_KAHAN, 1, "unknown accumulation policy");
+  THTensor_(accumulationPolicy) = policy;
+}
+
+int THTensor_(getAccumulation)(void)
+{
+  return THTensor_(accumulationPolicy);
+}
+
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+
+/* compensated sum: the value is sum - comp */
+typedef struct THTensor_(Accumulator)
+{
+  real sum;
+  real comp;
+} THTensor_(Accumulator);
+
+static void THTensor_(accAdd)(THTensor_(Accumulator) *acc, real v)
+{
+  real y = v - acc->comp;
+  real t = acc->sum + y;
+  acc->comp = (t - acc->sum) - y;
+  acc->sum = t;
+}
+
+/* pairwise and compensated reductions of TERM(i) over [0, n): the sum of x
+   (y unused, ys = 0) or the dot product of x and y */
+#define TH_ACC_RANGE_KERNELS(PAIRWISE, KAHAN, TERM)                     \
+  static real THTensor_(PAIRWISE)(const real *x, long xs, const real *y, long ys, long n) \
+  {                                                                     \
+    real acc[TH_ACC_LANES];                                             \
+    real sum = 0;                                                       \
+    long i, l;                                                          \
+    if(n > TH_ACC_BLOCK)                                                \
+    {                                                                   \
+      long h = (n/2 + TH_ACC_BLOCK-1)/TH_ACC_BLOCK*TH_ACC_BLOCK;        \
+      return THTensor_(PAIRWISE)(x, xs, y, ys, h) +                     \
+        THTensor_(PAIRWISE)(x + h*xs, xs, y + h*ys, ys, n-h);           \
+    }                                                                   \
+    for(l = 0; l < TH_ACC_LANES; l++)                                   \
+      acc[l] = 0;                                                       \
+    for(i = 0; i + TH_ACC_LANES <= n; i += TH_ACC_LANES)                \
+      for(l = 0; l < TH_ACC_LANES; l++)                                 \
+        acc[l] += TERM(i+l);                                            \
+    for(l = 0; l < TH_ACC_LANES; l++)                                   \
+      sum += acc[l];                                                    \
+    for(; i < n; i++)                                                   \
+      sum += TERM(i);                                                   \
+    return sum;                                                         \
+  }                                                                     \
+                                                                        \
+  static void THTensor_(KAHAN)(THTensor_(Accumulator) *total, const real *x, long xs, \
+                               const real *y, long ys, long n)          \
+  {                                                                     \
+    real sum[TH_ACC_LANES], comp[TH_ACC_LANES];                         \
+    long i, l;                                                          \
+    (void)y; (void)ys;                                                  \
+    for(l = 0; l < TH_ACC_LANES; l++)                                   \
+      sum[l] = comp[l] = 0;                                             \
+    for(i = 0; i + TH_ACC_LANES <= n; i += TH_ACC_LANES)                \
+    {                                                                   \
+      for(l = 0; l < TH_ACC_LANES; l++)                                 \
+      {                                                                 \
+        real v = TERM(i+l) - comp[l];                                   \
+        real t = sum[l] + v;                                            \
+        comp[l] = (t - sum[l]) - v;                                     \
+        sum[l] = t;                                                     \
+      }                                                                 \
+    }                                                                   \
+    for(l = 0; l < TH_ACC_LANES; l++)                                   \
+    {                                                                   \
+      THTensor_(accAdd)(total, sum[l]);                                 \
+      THTensor_(accAdd)(total, -comp[l]);                               \
+    }                                                                   \
+    for(; i < n; i++)                                                   \
+      THTensor_(accAdd)(total, TERM(i));                                \
+  }
+
+#define TH_ACC_SUM_TERM(i) x[(i)*xs]
+#define TH_ACC_DOT_TERM(i) (x[(i)*xs]*y[(i)*ys])
+TH_ACC_RANGE_KERNELS(pairwiseSum, kahanSum, TH_ACC_SUM_TERM)
+TH_ACC_RANGE_KERNELS(pairwiseDot, kahanDot, TH_ACC_DOT_TERM)
+#undef TH_ACC_SUM_TERM
+#undef TH_ACC_DOT_TERM
+#undef TH_ACC_RANGE_KERNELS
+
+/* strided run of n terms into total (y == NULL: sum of x) */
+static void THTensor_(accRange)(THTensor_(Accumulator) *total, int policy,
+                                const real *x, long xs, const real *y, long ys, long n)
+{
+  if(policy == TH_ACCUMULATE_KAHAN)
+  {
+    if(y)
+      THTensor_(kahanDot)(total, x, xs, y, ys, n);
+    else
+      THTensor_(kahanSum)(total, x, xs, x, 0, n);
+  }
+  else
+    THTensor_(accAdd)(total, (y ? THTensor_(pairwiseDot)(x, xs, y, ys, n)
+                                : THTensor_(pairwiseSum)(x, xs, x, 0, n)));
+}
+
+typedef struct THTensor_(AccArgs)
+{
+  int policy;
+  real *x;
+  real *y;
+} THTensor_(AccArgs);
+
+static void THTensor_(accReduce)(void *args_, long begin, long end, void *partial)
+{
+  THTensor_(AccArgs) *args = (THTensor_(AccArgs)*)args_;
+  THTensor_(accRange)((THTensor_(Accumulator)*)partial, args->policy, args->x + begin, 1,
+                      (args->y ? args->y + begin : NULL), 1, end - begin);
+}
+
+static void THTensor_(accCombine)(void *ctx, void *result, const void *partial)
+{
+  const THTensor_(Accumulator) *p = (const THTensor_(Accumulator)*)partial;
+  (void)ctx;
+  THTensor_(accAdd)((THTensor_(Accumulator)*)result, p->sum);
+  THTensor_(accAdd)((THTensor_(Accumulator)*)result, -p->comp);
+}
+
+/* sum of tensor (src == NULL) or dot product of tensor and src, in real */
+static accreal THTensor_(accAll)(THTensor *tensor, THTensor *src, int policy)
+{
+  THTensor_(Accumulator) total = {0, 0};
+
+  if(THTensor_(isContiguous)(tensor) && (!src || THTensor_(isContiguous)(src)))
+  {
+    THTensor_(AccArgs) args;
+    args.policy = policy;
+    args.x = THTensor_(data)(tensor);
+    args.y = (src ? THTensor_(data)(src) : NULL);
+    THParallel_reduce(0, THTensor_(nElement)(tensor), 0, THTensor_(accReduce), THTensor_(accCombine),
+                      &args, &total, sizeof(total));
+  }
+  else if(!src)
+  {
+    /* innermost runs at once, as in dot */
+    TH_TENSOR_APPLY(real, tensor,
+                    long sz = tensor_size - tensor_i;
+                    THTensor_(accRange)(&total, policy, tensor_data, tensor_stride, NULL, 0, sz);
+                    tensor_i += sz;
+                    tensor_data += sz*tensor_stride;
+                    break;);
+  }
+  else
+  {
+    TH_TENSOR_APPLY2(real, tensor, real, src,
+                     long sz = (tensor_size-tensor_i < src_size-src_i ? tensor_size-tensor_i : src_size-src_i);
+                     THTensor_(accRange)(&total, policy, tensor_data, tensor_stride, src_data, src_stride, sz);
+                     tensor_i += sz;
+                     src_i += sz;
+                     tensor_data += sz*tensor_stride;
+                     src_data += sz*src_stride;
+                     break;);
+  }
+  return (accreal)total.sum - (accreal)total.comp;
+}
+
+#endif
+
+/* dot product of n strided elements, accumulated in accreal (THBlas_(dot)
+   would sum float in float) */
+static accreal THTensor_(accrealDot)(const real *x, long xs, const real *y, long ys, long n)
+{
+  accreal acc[TH_ACC_LANES];
+  accreal sum = 0;
+  long i, l;
+  for(l = 0; l < TH_ACC_LANES; l++)
+    acc[l] = 0;
+  for(i = 0; i + TH_ACC_LANES <= n; i += TH_ACC_LANES)
+    for(l = 0; l < TH_ACC_LANES; l++)
+      acc[l] += (accreal)x[(i+l)*xs]*y[(i+l)*ys];
+  for(l = 0; l < TH_ACC_LANES; l++)
+    sum += acc[l];
+  for(; i < n; i++)
+    sum += (accreal)x[i*xs]*y[i*ys];
+  return sum;
+}
+
+typedef struct THTensor_(DotArgs)
+{
+  real *tp;
+  real *sp;
+} THTensor_(DotArgs);
+
+static void THTensor_(dotKernel)(void *args_, long begin, long end, void *partial)
+{
+  THTensor_(DotArgs) *args = (THTensor_(DotArgs)*)args_;
+  *(accreal*)partial += THTensor_(accrealDot)(args->tp + begin, 1, args->sp + begin, 1, end - begin);
+}
+
+static void THTensor_(accrealSum)(void *ctx, void *result, const void *partial)
+{
+  (void)ctx;
+  *(accreal*)result += *(const accreal*)partial;
+}
+
 accreal THTensor_(dot)(THTensor *tensor, THTensor *src)
 {
+  return THTensor_(dotWith)(tensor, src, TH_ACCUMULATE_DEFAULT);
+}
+
+accreal THTensor_(dotWith)(THTensor *tensor, THTensor *src, int policy)
+{
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
   accreal sum = 0;
+  if(policy == TH_ACCUMULATE_DEFAULT)
+    policy = THTensor_(accumulationPolicy);
+  THArgCheck(policy >= TH_ACCUMULATE_ACCREAL && policy <= TH_ACCUMULATE_KAHAN, 3, "unknown accumulation policy");
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+  if(policy != TH_ACCUMULATE_ACCREAL)
+  {
+    THArgCheck(THTensor_(nElement)(tensor) == THTensor_(nElement)(src), 2, "inconsistent tensor size");
+    return THTensor_(accAll)(tensor, src, policy);
+  }
+#endif
+  /* contiguous operands: chunked dots summed in chunk order */
+  if(THTensor_(isContiguous)(tensor) && THTensor_(isContiguous)(src) &&
+     THTensor_(nElement)(tensor) == THTensor_(nElement)(src))
+  {
+    THTensor_(DotArgs) args;
+    args.tp = THTensor_(data)(tensor);
+    args.sp = THTensor_(data)(src);
+    THParallel_reduce(0, THTensor_(nElement)(tensor), 0, THTensor_(dotKernel), THTensor_(accrealSum),
+                      &args, &sum, sizeof(accreal));
+    return sum;
+  }
   /* we use a trick here. careful with that. */
   TH_TENSOR_APPLY2(real, tensor, real, src,
                    long sz = (tensor_size-tensor_i < src_size-src_i ? tensor_size-tensor_i : src_size-src_i);
-                   sum += THBlas_(dot)(sz, src_data, src_stride, tensor_data, tensor_stride);
+                   sum += THTensor_(accrealDot)(tensor_data, tensor_stride, src_data, src_stride, sz);
                    tensor_i += sz;
                    src_i += sz;
                    tensor_data += sz*tensor_stride;
@@ -387,6 +807,7 @@ accreal THTensor_(dot)(THTensor *tensor, THTensor *src)
 
 real THTensor_(minall)(THTensor *tensor)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   real theMin;
   real value;
 
@@ -408,6 +829,7 @@ real THTensor_(minall)(THTensor *tensor)
 
 real THTensor_(maxall)(THTensor *tensor)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   real theMax;
   real value;
 
@@ -429,122 +851,441 @@ real THTensor_(maxall)(THTensor *tensor)
 
 accreal THTensor_(sumall)(THTensor *tensor)
 {
+  return THTensor_(sumallWith)(tensor, TH_ACCUMULATE_DEFAULT);
+}
+
+accreal THTensor_(sumallWith)(THTensor *tensor, int policy)
+{
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   accreal sum = 0;
+  if(policy == TH_ACCUMULATE_DEFAULT)
+    policy = THTensor_(accumulationPolicy);
+  THArgCheck(policy >= TH_ACCUMULATE_ACCREAL && policy <= TH_ACCUMULATE_KAHAN, 2, "unknown accumulation policy");
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+  if(policy != TH_ACCUMULATE_ACCREAL)
+    return THTensor_(accAll)(tensor, NULL, policy);
+#endif
   TH_TENSOR_APPLY(real, tensor, sum += *tensor_data;);
   return sum;
 }
 
 accreal THTensor_(prodall)(THTensor *tensor)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   accreal prod = 1;
   TH_TENSOR_APPLY(real, tensor, prod *= *tensor_data;);
   return prod;
 }
 
+/* r = t (op) b over one row of n elements; a stride of 0 repeats the operand.
+   Each op gets its loops specialized at compile time by the macros below,
+   rowApply choosing the row shapes at run time. */
+typedef void (*THTensor_(RowFunction))(real *rp, long rStride, const real *tp, long tStride,
+                                       const real *sp, long sStride, real value, long n);
+
+/* r = CODE(a, value): unit stride and strided loops; sp is ignored */
+#ifndef TH_TENSOR_UNARY_ROW_KERNEL
+#define TH_TENSOR_UNARY_ROW_KERNEL(NAME, CODE)                          \
+  static void THTensor_(NAME)(real *rp, long rStride, const real *tp, long tStride, \
+                              const real *sp, long sStride, real value, long n) \
+  {                                                                     \
+    real a;                                                             \
+    long i;                                                             \
+    (void)sp; (void)sStride; (void)value;                               \
+    if(rStride == 1 && tStride == 1) {                                  \
+      for(i = 0; i < n; i++) {                                          \
+        a = tp[i]; rp[i] = CODE;                                        \
+      }                                                                 \
+    } else {                                                            \
+      for(i = 0; i < n; i++) {                                          \
+        a = tp[i*tStride]; rp[i*rStride] = CODE;                        \
+      }                                                                 \
+    }                                                                   \
+  }
+#endif
+
+TH_TENSOR_UNARY_ROW_KERNEL(addRow, a + value)
+TH_TENSOR_UNARY_ROW_KERNEL(mulRow, a * value)
+TH_TENSOR_UNARY_ROW_KERNEL(divRow, a / value)
+TH_TENSOR_UNARY_ROW_KERNEL(fmodRow, fmod(a, value))
+TH_TENSOR_UNARY_ROW_KERNEL(remainderRow, (value == 0)? NAN : a - value * floor(a / value))
+TH_TENSOR_UNARY_ROW_KERNEL(tpowRow, pow(value, a))
+TH_TENSOR_UNARY_ROW_KERNEL(cmaxValueRow, a > value ? a : value)
+TH_TENSOR_UNARY_ROW_KERNEL(cminValueRow, a < value ? a : value)
+
+/* specialized loops for the contiguous, column vector (one src value per row)
+   and scalar t cases; CODE computes the result from a, b and value */
+#ifndef TH_TENSOR_BINARY_ROW_KERNEL
+#define TH_TENSOR_BINARY_ROW_KERNEL(NAME, CODE)                          \
+  static void THTensor_(NAME)(real *rp, long rStride, const real *tp, long tStride, \
+                              const real *sp, long sStride, real value, long n) \
+  {                                                                     \
+    real a, b;                                                          \
+    long i;                                                             \
+    (void)value;                                                        \
+    if(rStride == 1 && tStride == 1 && sStride == 1) {                  \
+      for(i = 0; i < n; i++) {                                          \
+        a = tp[i]; b = sp[i]; rp[i] = CODE;                             \
+      }                                                                 \
+    } else if(rStride == 1 && tStride == 1 && sStride == 0) {           \
+      b = *sp;                                                          \
+      for(i = 0; i < n; i++) {                                          \
+        a = tp[i]; rp[i] = CODE;                                        \
+      }                                                                 \
+    } else if(rStride == 1 && tStride == 0 && sStride == 1) {           \
+      a = *tp;                                                          \
+      for(i = 0; i < n; i++) {                                          \
+        b = sp[i]; rp[i] = CODE;                                        \
+      }                                                                 \
+    } else {                                                            \
+      for(i = 0; i < n; i++) {                                          \
+        a = tp[i*tStride]; b = sp[i*sStride]; rp[i*rStride] = CODE;     \
+      }                                                                 \
+    }                                                                   \
+  }
+#endif
+
+TH_TENSOR_BINARY_ROW_KERNEL(caddRow, a + value * b)
+TH_TENSOR_BINARY_ROW_KERNEL(cmulRow, a * b)
+TH_TENSOR_BINARY_ROW_KERNEL(cpowRow, pow(a, b))
+TH_TENSOR_BINARY_ROW_KERNEL(cdivRow, a / b)
+TH_TENSOR_BINARY_ROW_KERNEL(cfmodRow, fmod(a, b))
+TH_TENSOR_BINARY_ROW_KERNEL(cremainderRow, (b == 0)? NAN : a - b * floor(a / b))
+TH_TENSOR_BINARY_ROW_KERNEL(cmaxRow, a > b ? a : b)
+TH_TENSOR_BINARY_ROW_KERNEL(cminRow, a < b ? a : b)
+
+typedef struct THTensor_(RowArgs)
+{
+  THTensor_(RowFunction) row;
+  real *rp;
+  real *tp;
+  real *sp;
+  real value;
+  int nOuter;     /* dimensions spanned by the rows */
+  long *size;     /* nOuter+1 sizes, the last one being the row length */
+  long *rStride;
+  long *tStride;
+  long *sStride;
+} THTensor_(RowArgs);
+
+/*
+  rows [begin, end), specialized on the number of outer dimensions left after
+  merging: none (one row), one (offsets are multiples of the strides), or
+  more, where the outer index is decomposed once and then advanced like a
+  counter rather than divided out again for every row
+*/
+#ifndef TH_ROW_KERNEL_MAX_COUNTER
+#define TH_ROW_KERNEL_MAX_COUNTER 8
+#endif
+
+static void THTensor_(rowKernel)(void *args_, long begin, long end)
+{
+  THTensor_(RowArgs) *args = (THTensor_(RowArgs)*)args_;
+  THTensor_(RowFunction) row = args->row;
+  int nOuter = args->nOuter;
+  long n = args->size[nOuter];
+  long rs = args->rStride[nOuter], ts = args->tStride[nOuter], ss = args->sStride[nOuter];
+  long r;
+
+  if(nOuter == 0)
+  {
+    row(args->rp, rs, args->tp, ts, args->sp, ss, args->value, n);
+  }
+  else if(nOuter == 1)
+  {
+    for(r = begin; r < end; r++)
+      row(args->rp + r*args->rStride[0], rs, args->tp + r*args->tStride[0], ts,
+          args->sp + r*args->sStride[0], ss, args->value, n);
+  }
+  else if(nOuter <= TH_ROW_KERNEL_MAX_COUNTER)
+  {
+    long counter[TH_ROW_KERNEL_MAX_COUNTER];
+    long index = begin, rOffset = 0, tOffset = 0, sOffset = 0;
+    int d;
+    for(d = nOuter-1; d >= 0; d--)
+    {
+      counter[d] = index % args->size[d];
+      index /= args->size[d];
+      rOffset += counter[d]*args->rStride[d];
+      tOffset += counter[d]*args->tStride[d];
+      sOffset += counter[d]*args->sStride[d];
+    }
+    for(r = begin; r < end; r++)
+    {
+      row(args->rp + rOffset, rs, args->tp + tOffset, ts, args->sp + sOffset, ss, args->value, n);
+      for(d = nOuter-1; d >= 0; d--)
+      {
+        rOffset += args->rStride[d];
+        tOffset += args->tStride[d];
+        sOffset += args->sStride[d];
+        if(++counter[d] < args->size[d])
+          break;
+        rOffset -= args->size[d]*args->rStride[d];
+        tOffset -= args->size[d]*args->tStride[d];
+        sOffset -= args->size[d]*args->sStride[d];
+        counter[d] = 0;
+      }
+    }
+  }
+  else
+  {
+    for(r = begin; r < end; r++)
+    {
+      long index = r, rOffset = 0, tOffset = 0, sOffset = 0;
+      int d;
+      for(d = nOuter-1; d >= 0; d--)
+      {
+        long i = index % args->size[d];
+        index /= args->size[d];
+        rOffset += i*args->rStride[d];
+        tOffset += i*args->tStride[d];
+        sOffset += i*args->sStride[d];
+      }
+      row(args->rp + rOffset, rs, args->tp + tOffset, ts, args->sp + sOffset, ss, args->value, n);
+    }
+  }
+}
+
+/* grains tried by the autotuner: the pool default, a quarter of it, four
+   times it, and no split at all (the row count is bucketed in the key) */
+#ifndef TH_ROW_APPLY_GRAINS
+#define TH_ROW_APPLY_GRAINS 4
+#endif
+
+/*
+  r_ = row(t, src) over all the elements of r_, t and src (NULL for unary
+  row functions) having the size of r_ or being broadcast to it (missing or
+  size 1 dimensions). Dimensions of size 1 are dropped and neighbouring
+  dimensions contiguous in all operands merged, so that contiguous operands
+  run as a single row and the row functions take their unit stride loops.
+  Rows are processed in parallel.
+*/
+static void THTensor_(rowApply)(THTensor *r_, THTensor *t, THTensor *src, real value,
+                                THTensor_(RowFunction) row)
+{
+  THTensor_(RowArgs) args;
+  long *dims;
+  long rows = 1, grain;
+  int nDim = r_->nDimension, n = 0, d;
+
+  if(THTensor_(nElement)(r_) == 0)
+    return;
+
+  dims = THAlloc(sizeof(long)*4*nDim);
+  args.size = dims;
+  args.rStride = dims + nDim;
+  args.tStride = dims + 2*nDim;
+  args.sStride = dims + 3*nDim;
+  for(d = 0; d < nDim; d++)
+  {
+    int dt = d - (nDim - t->nDimension), ds = (src ? d - (nDim - src->nDimension) : -1);
+    long sz = r_->size[d];
+    if(sz == 1)
+      continue;
+    args.size[n] = sz;
+    args.rStride[n] = r_->stride[d];
+    args.tStride[n] = (dt >= 0 && t->size[dt] != 1 ? t->stride[dt] : 0);
+    args.sStride[n] = (ds >= 0 && src->size[ds] != 1 ? src->stride[ds] : 0);
+    if(n > 0 && args.rStride[n-1] == args.rStride[n]*sz && args.tStride[n-1] == args.tStride[n]*sz &&
+       args.sStride[n-1] == args.sStride[n]*sz)
+    {
+      args.size[n-1] *= sz;
+      args.rStride[n-1] = args.rStride[n];
+      args.tStride[n-1] = args.tStride[n];
+      args.sStride[n-1] = args.sStride[n];
+    }
+    else
+      n++;
+  }
+  if(n == 0)
+  {
+    args.size[0] = 1;
+    args.rStride[0] = args.tStride[0] = args.sStride[0] = 0;
+    n = 1;
+  }
+  /* unary row functions ignore src: make its row look contiguous */
+  if(!src)
+    args.sStride[n-1] = 1;
+
+  args.row = row;
+  args.rp = THTensor_(data)(r_);
+  args.tp = THTensor_(data)(t);
+  args.sp = (src ? THTensor_(data)(src) : args.tp);
+  args.value = value;
+  args.nOuter = n-1;
+  for(d = 0; d < n-1; d++)
+    rows *= args.size[d];
+
+  grain = THMax(1, THThreadPool_getGrainSize()/args.size[n-1]);
+  if(rows > grain && THAutotune_getMode() != TH_AUTOTUNE_OFF &&
+     THThreadPool_getNumThreads() > 1 && !THThreadPool_inParallelRegion())
+  {
+    char key[TH_AUTOTUNE_KEY_SIZE];
+    THAutotuneTrial trial;
+    long shape[2];
+    int layout = (args.rStride[n-1] == 1) | ((args.tStride[n-1] == 1) << 1) | ((args.sStride[n-1] == 1) << 2);
+    shape[0] = rows;
+    shape[1] = args.size[n-1];
+    THAutotune_makeKey(key, "rowApply", TH_CONCAT_STRING_2(Real,Tensor), shape, 2, layout, 1);
+    switch(THAutotune_begin(&trial, key, TH_ROW_APPLY_GRAINS, 0))
+    {
+      case 1: grain = THMax(1, grain/4); break;
+      case 2: grain *= 4; break;
+      case 3: grain = rows; break;
+    }
+    THParallel_for(0, rows, grain, THTensor_(rowKernel), &args);
+    THAutotune_end(&trial);
+  }
+  else
+    THParallel_for(0, rows, grain, THTensor_(rowKernel), &args);
+  THFree(dims);
+}
+
 void THTensor_(add)(THTensor *r_, THTensor *t, real value)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
       real *tp = THTensor_(data)(t);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-          rp[i] = tp[i] + value;
+      THTensor_(contiguousApply)(THTensor_(addKernel), rp, tp, NULL, value, 0, sz);
   } else {
-      TH_TENSOR_APPLY2(real, r_, real, t, *r__data = *t_data + value;);
+      THTensor_(rowApply)(r_, t, NULL, value, THTensor_(addRow));
   }
 }
 
 void THTensor_(sub)(THTensor *r_, THTensor *t, real value)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THTensor_(add)(r_, t, -value);
 }
 
 void THTensor_(mul)(THTensor *r_, THTensor *t, real value)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
       real *tp = THTensor_(data)(t);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-          rp[i] = tp[i] * value;
+      THTensor_(contiguousApply)(THTensor_(mulKernel), rp, tp, NULL, value, 0, sz);
   } else {
-      TH_TENSOR_APPLY2(real, r_, real, t, *r__data = *t_data * value;);
+      THTensor_(rowApply)(r_, t, NULL, value, THTensor_(mulRow));
   }
 }
 
 void THTensor_(div)(THTensor *r_, THTensor *t, real value)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
       real *tp = THTensor_(data)(t);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-          rp[i] = tp[i] / value;
+      THTensor_(contiguousApply)(THTensor_(divKernel), rp, tp, NULL, value, 0, sz);
   } else {
-      TH_TENSOR_APPLY2(real, r_, real, t, *r__data = *t_data / value;);
+      THTensor_(rowApply)(r_, t, NULL, value, THTensor_(divRow));
   }
 }
 
 void THTensor_(fmod)(THTensor *r_, THTensor *t, real value)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
       real *tp = THTensor_(data)(t);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-          rp[i] = fmod(tp[i], value);
+      THTensor_(contiguousApply)(THTensor_(fmodKernel), rp, tp, NULL, value, 0, sz);
   } else {
-      TH_TENSOR_APPLY2(real, r_, real, t, *r__data = fmod(*t_data, value););
+      THTensor_(rowApply)(r_, t, NULL, value, THTensor_(fmodRow));
   }
 }
 
 void THTensor_(remainder)(THTensor *r_, THTensor *t, real value)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
       real *tp = THTensor_(data)(t);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-          rp[i] = (value == 0)? NAN : tp[i] - value * floor(tp[i] / value);
+      THTensor_(contiguousApply)(THTensor_(remainderKernel), rp, tp, NULL, value, 0, sz);
   } else {
-      TH_TENSOR_APPLY2(real, r_, real, t, *r__data = (value == 0)? NAN : *t_data - value * floor(*t_data / value););
+      THTensor_(rowApply)(r_, t, NULL, value, THTensor_(remainderRow));
   }
 }
 
 void THTensor_(clamp)(THTensor *r_, THTensor *t, real min_value, real max_value)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
       real *tp = THTensor_(data)(t);
       real *rp = THTensor_(data)(r_);
-      real t_val;
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-          rp[i] = (tp[i] < min_value) ? min_value : (tp[i] > max_value ? max_value : tp[i]);
+      THTensor_(contiguousApply)(THTensor_(clampKernel), rp, tp, NULL, min_value, max_value, sz);
   } else {
       TH_TENSOR_APPLY2(real, r_, real, t, *r__data = (*t_data < min_value) ? min_value : (*t_data > max_value ? max_value : *t_data););
   }
 }
 
+/*
+  r_ = t (op) src, with the sizes of t and src aligned on their last
+  dimension: a dimension of size 1 (or missing) in one operand is repeated
+  to the size of the other one through a zero stride, without materializing
+  the expansion. r_ is resized to the broadcast size, then filled row by
+  row by rowApply: e.g. a bias row added to a matrix runs as contiguous
+  rows, and a column vector as one src value per row.
+*/
+static void THTensor_(broadcastApply)(THTensor *r_, THTensor *t, THTensor *src, real value,
+                                      THTensor_(RowFunction) row)
+{
+  THLongStorage *size;
+  int nDim, d;
+
+  THArgCheck(t->nDimension > 0 && src->nDimension > 0, 2, "inconsistent tensor size");
+  nDim = THMax(t->nDimension, src->nDimension);
+
+  size = THLongStorage_newWithSize(nDim);
+  for(d = 0; d < nDim; d++)
+  {
+    int dt = d - (nDim - t->nDimension), ds = d - (nDim - src->nDimension);
+    long st = (dt >= 0 ? t->size[dt] : 1), ss = (ds >= 0 ? src->size[ds] : 1);
+    if(st != ss && st != 1 && ss != 1)
+    {
+      THLongStorage_free(size);
+      THError("inconsistent tensor size: size %ld and %ld at dimension %d can not be broadcast",
+              st, ss, d+1);
+    }
+    THLongStorage_data(size)[d] = THMax(st, ss);
+  }
+
+  /* an operand repeated into its own storage would be overwritten while read */
+  if((r_->storage && r_->storage == t->storage && !THTensor_(isSize)(t, size)) ||
+     (r_->storage && r_->storage == src->storage && !THTensor_(isSize)(src, size)))
+  {
+    THTensor *work = THTensor_(new)();
+    THTensor_(broadcastApply)(work, t, src, value, row);
+    THTensor_(resize)(r_, size, NULL);
+    THTensor_(freeCopyTo)(work, r_);
+    THLongStorage_free(size);
+    return;
+  }
+
+  THTensor_(resize)(r_, size, NULL);
+  THLongStorage_free(size);
+  THTensor_(rowApply)(r_, t, src, value, row);
+}
+
 void THTensor_(cadd)(THTensor *r_, THTensor *t, real value, THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, src);
+  if (THTensor_(nElement)(t) != THTensor_(nElement)(src)) {
+    THTensor_(broadcastApply)(r_, t, src, value, THTensor_(caddRow));
+    return;
+  }
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(isContiguous)(src) && THTensor_(nElement)(r_) == THTensor_(nElement)(src)) {
     if(r_ == t) {
@@ -554,11 +1295,10 @@ void THTensor_(cadd)(THTensor *r_, THTensor *t, real value, THTensor *src)
       real *sp = THTensor_(data)(src);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i< sz; i++)
-          rp[i] = tp[i] + value * sp[i];
+      THTensor_(contiguousApply)(THTensor_(caddKernel), rp, tp, sp, value, 0, sz);
     }
+  } else if (THTensor_(isSameSizeAs)(t, src)) {
+      THTensor_(rowApply)(r_, t, src, value, THTensor_(caddRow));
   } else {
       TH_TENSOR_APPLY3(real, r_, real, t, real, src, *r__data = *t_data + value * *src_data;);
   }
@@ -566,21 +1306,26 @@ void THTensor_(cadd)(THTensor *r_, THTensor *t, real value, THTensor *src)
 
 void THTensor_(csub)(THTensor *r_, THTensor *t, real value,THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, src);
   THTensor_(cadd)(r_, t, -value, src);
 }
 
 void THTensor_(cmul)(THTensor *r_, THTensor *t, THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, src);
+  if (THTensor_(nElement)(t) != THTensor_(nElement)(src)) {
+    THTensor_(broadcastApply)(r_, t, src, 0, THTensor_(cmulRow));
+    return;
+  }
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(isContiguous)(src) && THTensor_(nElement)(r_) == THTensor_(nElement)(src)) {
       real *tp = THTensor_(data)(t);
       real *sp = THTensor_(data)(src);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-        rp[i] = tp[i] * sp[i];
+      THTensor_(contiguousApply)(THTensor_(cmulKernel), rp, tp, sp, 0, 0, sz);
+  } else if (THTensor_(isSameSizeAs)(t, src)) {
+      THTensor_(rowApply)(r_, t, src, 0, THTensor_(cmulRow));
   } else {
       TH_TENSOR_APPLY3(real, r_, real, t, real, src, *r__data = *t_data * *src_data;);
   }
@@ -588,16 +1333,20 @@ void THTensor_(cmul)(THTensor *r_, THTensor *t, THTensor *src)
 
 void THTensor_(cpow)(THTensor *r_, THTensor *t, THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, src);
+  if (THTensor_(nElement)(t) != THTensor_(nElement)(src)) {
+    THTensor_(broadcastApply)(r_, t, src, 0, THTensor_(cpowRow));
+    return;
+  }
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(isContiguous)(src) && THTensor_(nElement)(r_) == THTensor_(nElement)(src)) {
       real *tp = THTensor_(data)(t);
       real *sp = THTensor_(data)(src);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-        rp[i] = pow(tp[i], sp[i]);
+      THTensor_(contiguousApply)(THTensor_(cpowKernel), rp, tp, sp, 0, 0, sz);
+  } else if (THTensor_(isSameSizeAs)(t, src)) {
+      THTensor_(rowApply)(r_, t, src, 0, THTensor_(cpowRow));
   } else {
       TH_TENSOR_APPLY3(real, r_, real, t, real, src, *r__data = pow(*t_data, *src_data););
   }
@@ -605,16 +1354,20 @@ void THTensor_(cpow)(THTensor *r_, THTensor *t, THTensor *src)
 
 void THTensor_(cdiv)(THTensor *r_, THTensor *t, THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, src);
+  if (THTensor_(nElement)(t) != THTensor_(nElement)(src)) {
+    THTensor_(broadcastApply)(r_, t, src, 0, THTensor_(cdivRow));
+    return;
+  }
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(isContiguous)(src) && THTensor_(nElement)(r_) == THTensor_(nElement)(src)) {
       real *tp = THTensor_(data)(t);
       real *sp = THTensor_(data)(src);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-        rp[i] = tp[i] / sp[i];
+      THTensor_(contiguousApply)(THTensor_(cdivKernel), rp, tp, sp, 0, 0, sz);
+  } else if (THTensor_(isSameSizeAs)(t, src)) {
+      THTensor_(rowApply)(r_, t, src, 0, THTensor_(cdivRow));
   } else {
       TH_TENSOR_APPLY3(real, r_, real, t, real, src, *r__data = *t_data / *src_data;);
   }
@@ -622,16 +1375,20 @@ void THTensor_(cdiv)(THTensor *r_, THTensor *t, THTensor *src)
 
 void THTensor_(cfmod)(THTensor *r_, THTensor *t, THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, src);
+  if (THTensor_(nElement)(t) != THTensor_(nElement)(src)) {
+    THTensor_(broadcastApply)(r_, t, src, 0, THTensor_(cfmodRow));
+    return;
+  }
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(isContiguous)(src) && THTensor_(nElement)(r_) == THTensor_(nElement)(src)) {
       real *tp = THTensor_(data)(t);
       real *sp = THTensor_(data)(src);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-        rp[i] = fmod(tp[i], sp[i]);
+      THTensor_(contiguousApply)(THTensor_(cfmodKernel), rp, tp, sp, 0, 0, sz);
+  } else if (THTensor_(isSameSizeAs)(t, src)) {
+      THTensor_(rowApply)(r_, t, src, 0, THTensor_(cfmodRow));
   } else {
       TH_TENSOR_APPLY3(real, r_, real, t, real, src, *r__data = fmod(*t_data, *src_data););
   }
@@ -639,16 +1396,20 @@ void THTensor_(cfmod)(THTensor *r_, THTensor *t, THTensor *src)
 
 void THTensor_(cremainder)(THTensor *r_, THTensor *t, THTensor *src)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, src);
+  if (THTensor_(nElement)(t) != THTensor_(nElement)(src)) {
+    THTensor_(broadcastApply)(r_, t, src, 0, THTensor_(cremainderRow));
+    return;
+  }
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(isContiguous)(src) && THTensor_(nElement)(r_) == THTensor_(nElement)(src)) {
       real *tp = THTensor_(data)(t);
       real *sp = THTensor_(data)(src);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-          rp[i] = (sp[i] == 0)? NAN : tp[i] - sp[i] * floor(tp[i] / sp[i]);
+      THTensor_(contiguousApply)(THTensor_(cremainderKernel), rp, tp, sp, 0, 0, sz);
+  } else if (THTensor_(isSameSizeAs)(t, src)) {
+      THTensor_(rowApply)(r_, t, src, 0, THTensor_(cremainderRow));
   } else {
       TH_TENSOR_APPLY3(real, r_, real, t, real, src, *r__data = (*src_data == 0)? NAN : *t_data - *src_data * floor(*t_data / *src_data););
   }
@@ -656,22 +1417,21 @@ void THTensor_(cremainder)(THTensor *r_, THTensor *t, THTensor *src)
 
 void THTensor_(tpow)(THTensor *r_, real value, THTensor *t)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
       real *tp = THTensor_(data)(t);
       real *rp = THTensor_(data)(r_);
       long sz = THTensor_(nElement)(t);
-      long i;
-      #pragma omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)
-      for (i=0; i<sz; i++)
-        rp[i] = pow(value, tp[i]);
+      THTensor_(contiguousApply)(THTensor_(tpowKernel), rp, tp, NULL, value, 0, sz);
   } else {
-      TH_TENSOR_APPLY2(real, r_, real, t, *r__data = pow(value, *t_data););
+      THTensor_(rowApply)(r_, t, NULL, value, THTensor_(tpowRow));
   }
 }
 
 void THTensor_(addcmul)(THTensor *r_, THTensor *t, real value, THTensor *src1, THTensor *src2)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, src1);
   if(r_ != t)
   {
     THTensor_(resizeAs)(r_, t);
@@ -684,6 +1444,7 @@ void THTensor_(addcmul)(THTensor *r_, THTensor *t, real value, THTensor *src1, T
 
 void THTensor_(addcdiv)(THTensor *r_, THTensor *t, real value, THTensor *src1, THTensor *src2)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, src1);
   if(r_ != t)
   {
     THTensor_(resizeAs)(r_, t);
@@ -695,6 +1456,7 @@ void THTensor_(addcdiv)(THTensor *r_, THTensor *t, real value, THTensor *src1, T
 
 void THTensor_(addmv)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *mat, THTensor *vec)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, mat);
   if( (mat->nDimension != 2) || (vec->nDimension != 1) )
     THError("matrix and vector expected, got %dD, %dD",
       mat->nDimension, vec->nDimension);
@@ -747,55 +1509,468 @@ void THTensor_(addmv)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor
   }
 }
 
-void THTensor_(match)(THTensor *r_, THTensor *m1, THTensor *m2, real gain)
-{
-  long N1 = m1->size[0];
-  long N2 = m2->size[0];
-  long dim;
-  real *m1_p;
-  real *m2_p;
-  real *r_p;
-  long i;
+/*
+  Pairwise distances between the rows of two matrices. The exact engine
+  computes every pair from the differences of the rows (summed in
+  TH_DIST_LANES independent lanes), going through m2 by tiles of
+  TH_DIST_TILE rows that stay in cache while a block of m1 rows is compared
+  to them. The GEMM engine gets all the dot products of a block at once from
+  THBlas_(gemm) and expands ||a-b||^2 = ||a||^2 + ||b||^2 - 2ab, which is
+  much faster but loses precision to cancellation when the distance is
+  small compared to the norms (clamped at 0).
+*/
+#define TH_DIST_LANES 8
+#define TH_DIST_TILE 256
+#define TH_DIST_BLOCK 64
+
+static int THTensor_(distEngineChoice) = TH_DIST_ENGINE_AUTO;
 
-  THTensor_(resize2d)(r_, N1, N2);
+void THTensor_(distSetEngine)(int engine)
+{
+  THArgCheck(engine >= TH_DIST_ENGINE_AUTO && engine <= TH_DIST_ENGINE_GEMM, 1, "unknown distance engine");
+  THTensor_(distEngineChoice) = engine;
+}
 
-  m1 = THTensor_(newContiguous)(m1);
-  m2 = THTensor_(newContiguous)(m2);
+int THTensor_(distGetEngine)(void)
+{
+  return THTensor_(distEngineChoice);
+}
 
-  THTensor_(resize2d)(m1, N1, THTensor_(nElement)(m1) / N1);
-  THTensor_(resize2d)(m2, N2, THTensor_(nElement)(m2) / N2);
+/* L1 has no product form; integer types always take the exact engine.
+   AUTO only picks GEMM if autoGemm (match keeps its exact results) */
+static int THTensor_(distSelectEngine)(int metric, long dim, int autoGemm)
+{
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+  if(metric == TH_DIST_L1)
+    return TH_DIST_ENGINE_EXACT;
+  if(THTensor_(distEngineChoice) != TH_DIST_ENGINE_AUTO)
+    return THTensor_(distEngineChoice);
+  return (autoGemm && dim >= 8 ? TH_DIST_ENGINE_GEMM : TH_DIST_ENGINE_EXACT);
+#else
+  (void)metric; (void)dim; (void)autoGemm;
+  return TH_DIST_ENGINE_EXACT;
+#endif
+}
 
-  dim = m1->size[1];
-  THArgCheck(m1->size[1] == m2->size[1], 3, "m1 and m2 must have the same inner vector dim");
+/* |x-y|, without wrapping for unsigned types */
+#define TH_DIST_ABSDIFF(x, y) ((x) > (y) ? (x) - (y) : (y) - (x))
 
-  m1_p = THTensor_(data)(m1);
-  m2_p = THTensor_(data)(m2);
-  r_p = THTensor_(data)(r_);
+/* sum of (a-b)^2, |a-b| or a*b over dim elements */
+static real THTensor_(distPair)(int metric, const real *a, const real *b, long dim)
+{
+  real acc[TH_DIST_LANES];
+  real sum = 0;
+  long k, l;
 
-#pragma omp parallel for private(i)
-  for (i=0; i<N1; i++) {
-    long j,k;
-    for (j=0; j<N2; j++) {
-      real sum = 0;
-      for (k=0; k<dim; k++) {
-        real term = m1_p[ i*dim + k ] - m2_p[ j*dim + k ];
-        sum += term*term;
+  for(l = 0; l < TH_DIST_LANES; l++)
+    acc[l] = 0;
+  k = 0;
+  if(metric == TH_DIST_L1)
+  {
+    for(; k + TH_DIST_LANES <= dim; k += TH_DIST_LANES)
+      for(l = 0; l < TH_DIST_LANES; l++)
+        acc[l] += TH_DIST_ABSDIFF(a[k+l], b[k+l]);
+    for(; k < dim; k++)
+      sum += TH_DIST_ABSDIFF(a[k], b[k]);
+  }
+  else if(metric == TH_DIST_COSINE)
+  {
+    for(; k + TH_DIST_LANES <= dim; k += TH_DIST_LANES)
+      for(l = 0; l < TH_DIST_LANES; l++)
+        acc[l] += a[k+l]*b[k+l];
+    for(; k < dim; k++)
+      sum += a[k]*b[k];
+  }
+  else
+  {
+    for(; k + TH_DIST_LANES <= dim; k += TH_DIST_LANES)
+      for(l = 0; l < TH_DIST_LANES; l++)
+      {
+        real d = TH_DIST_ABSDIFF(a[k+l], b[k+l]);
+        acc[l] += d*d;
       }
-      r_p[ i*N2 + j ] = gain * sum;
+    for(; k < dim; k++)
+    {
+      real d = TH_DIST_ABSDIFF(a[k], b[k]);
+      sum += d*d;
     }
   }
-
-  THTensor_(free)(m1);
-  THTensor_(free)(m2);
+  for(l = 0; l < TH_DIST_LANES; l++)
+    sum += acc[l];
+  return sum;
 }
 
-void THTensor_(addmm)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *m1, THTensor *m2)
+typedef struct THTensor_(DistArgs)
 {
-  char transpose_r, transpose_m1, transpose_m2;
-  THTensor *r__, *m1_, *m2_;
+  int metric;
+  int engine;
+  real gain;
+  real *m1;         /* N1 x dim, contiguous */
+  real *m2;         /* N2 x dim, contiguous */
+  long N1;
+  long N2;
+  long dim;
+  real *norm1;      /* squared norms (L2), norms (cosine), or NULL */
+  real *norm2;
+  real *r;          /* pairwiseDist: N1 x N2 result */
+  real *values;     /* knn: N1 x k */
+  long *indices;
+  long k;
+  int nBuffers;
+  real *scratch;    /* knn: TH_DIST_BLOCK x TH_DIST_TILE per buffer */
+} THTensor_(DistArgs);
+
+/* out[(i-i0)*ldo + j-j0] = gain * distance(m1 row i, m2 row j) */
+static void THTensor_(distBlock)(THTensor_(DistArgs) *args, long i0, long i1, long j0, long j1,
+                                 real *out, long ldo)
+{
+  int metric = args->metric;
+  long dim = args->dim;
+  long i, j;
 
-  if( (m1->nDimension != 2) || (m2->nDimension != 2))
-    THError("matrices expected, got %dD, %dD tensors", m1->nDimension, m2->nDimension);
+  if(args->engine == TH_DIST_ENGINE_GEMM)
+  {
+    /* the THBlas fallback reads c even with beta = 0, and knn's scratch is
+       not initialised */
+    for(i = i0; i < i1; i++)
+      memset(out + (i-i0)*ldo, 0, sizeof(real)*(j1-j0));
+    THBlas_(gemm)('t', 'n', j1-j0, i1-i0, dim, 1, args->m2 + j0*dim, dim, args->m1 + i0*dim, dim,
+                  0, out, ldo);
+  }
+
+  for(i = i0; i < i1; i++)
+  {
+    real *o = out + (i-i0)*ldo - j0;
+    const real *a = args->m1 + i*dim;
+    for(j = j0; j < j1; j++)
+    {
+      real s;
+      if(args->engine == TH_DIST_ENGINE_GEMM)
+      {
+        s = o[j];
+        if(metric != TH_DIST_COSINE)
+        {
+          accreal e = (accreal)args->norm1[i] + args->norm2[j] - 2*(accreal)s;
+          s = (real)(e > 0 ? e : 0);
+        }
+      }
+      else
+        s = THTensor_(distPair)(metric, a, args->m2 + j*dim, dim);
+
+      if(metric == TH_DIST_L2)
+        s = sqrt(s);
+      else if(metric == TH_DIST_COSINE)
+      {
+        real n = args->norm1[i]*args->norm2[j];
+        s = (n > 0 ? 1 - s/n : 1);
+      }
+      o[j] = args->gain*s;
+    }
+  }
+}
+
+/* squared norms of the rows for L2 through GEMM, norms for cosine */
+static real *THTensor_(distNorms)(int metric, int engine, const real *m, long n, long dim)
+{
+  real *norms;
+  long i;
+  if(metric == TH_DIST_COSINE || (engine == TH_DIST_ENGINE_GEMM && metric != TH_DIST_L1))
+  {
+    norms = THAlloc(sizeof(real)*THMax(n, 1));
+    for(i = 0; i < n; i++)
+    {
+      real s = THTensor_(distPair)(TH_DIST_COSINE, m + i*dim, m + i*dim, dim);
+      norms[i] = (metric == TH_DIST_COSINE ? sqrt(s) : s);
+    }
+    return norms;
+  }
+  return NULL;
+}
+
+/* m1 and m2 as contiguous N x dim matrices; fills the common part of args */
+static void THTensor_(distInit)(THTensor_(DistArgs) *args, THTensor **m1, THTensor **m2, int metric, real gain,
+                                int autoGemm)
+{
+  long N1, N2;
+
+  THArgCheck(metric >= TH_DIST_L2SQ && metric <= TH_DIST_COSINE, 4, "unknown distance metric");
+  THArgCheck((*m1)->nDimension > 0, 2, "empty tensor");
+  THArgCheck((*m2)->nDimension > 0, 3, "empty tensor");
+  N1 = (*m1)->size[0];
+  N2 = (*m2)->size[0];
+  THArgCheck(THTensor_(nElement)(*m1) / N1 == THTensor_(nElement)(*m2) / N2, 3,
+             "m1 and m2 must have the same inner vector dim");
+
+  *m1 = THTensor_(newContiguous)(*m1);
+  *m2 = THTensor_(newContiguous)(*m2);
+  THTensor_(resize2d)(*m1, N1, THTensor_(nElement)(*m1) / N1);
+  THTensor_(resize2d)(*m2, N2, THTensor_(nElement)(*m2) / N2);
+
+  memset(args, 0, sizeof(*args));
+  args->metric = metric;
+  args->gain = gain;
+  args->m1 = THTensor_(data)(*m1);
+  args->m2 = THTensor_(data)(*m2);
+  args->N1 = N1;
+  args->N2 = N2;
+  args->dim = (*m1)->size[1];
+  args->engine = THTensor_(distSelectEngine)(metric, args->dim, autoGemm);
+  args->norm1 = THTensor_(distNorms)(metric, args->engine, args->m1, N1, args->dim);
+  args->norm2 = THTensor_(distNorms)(metric, args->engine, args->m2, N2, args->dim);
+}
+
+static void THTensor_(distFree)(THTensor_(DistArgs) *args, THTensor *m1, THTensor *m2)
+{
+  THFree(args->norm1);
+  THFree(args->norm2);
+  THTensor_(free)(m1);
+  THTensor_(free)(m2);
+}
+
+/* blocks of TH_DIST_BLOCK rows of r; the exact engine walks m2 by tiles */
+static void THTensor_(pairwiseDistKernel)(void *args_, long begin, long end)
+{
+  THTensor_(DistArgs) *args = (THTensor_(DistArgs)*)args_;
+  long N2 = args->N2;
+  long b;
+
+  for(b = begin; b < end; b++)
+  {
+    long i0 = b*TH_DIST_BLOCK, i1 = THMin(i0 + TH_DIST_BLOCK, args->N1);
+    long tile = (args->engine == TH_DIST_ENGINE_GEMM ? N2 : TH_DIST_TILE);
+    long j0;
+    for(j0 = 0; j0 < N2; j0 += tile)
+      THTensor_(distBlock)(args, i0, i1, j0, THMin(j0 + tile, N2), args->r + i0*N2 + j0, N2);
+  }
+}
+
+static void THTensor_(distRun)(THTensor *r_, THTensor *m1, THTensor *m2, int metric, real gain, int autoGemm)
+{
+  THTensor_(DistArgs) args;
+  THTensor *r__;
+  long nBlocks;
+
+  THTensor_(distInit)(&args, &m1, &m2, metric, gain, autoGemm);
+  THTensor_(resize2d)(r_, args.N1, args.N2);
+  r__ = THTensor_(newContiguous)(r_);
+  args.r = THTensor_(data)(r__);
+
+  nBlocks = (args.N1 + TH_DIST_BLOCK - 1)/TH_DIST_BLOCK;
+  THParallel_for(0, nBlocks, THMax(1, THThreadPool_getGrainSize()/THMax(TH_DIST_BLOCK*args.N2*args.dim, 1)),
+                 THTensor_(pairwiseDistKernel), &args);
+
+  THTensor_(freeCopyTo)(r__, r_);
+  THTensor_(distFree)(&args, m1, m2);
+}
+
+void THTensor_(pairwiseDist)(THTensor *r_, THTensor *m1, THTensor *m2, int metric)
+{
+  TH_PROFILE_TENSOR_OP(r_, m1, m2);
+  THTensor_(distRun)(r_, m1, m2, metric, 1, 1);
+}
+
+void THTensor_(match)(THTensor *r_, THTensor *m1, THTensor *m2, real gain)
+{
+  TH_PROFILE_TENSOR_OP(r_, m1, m2);
+  THTensor_(distRun)(r_, m1, m2, TH_DIST_L2SQ, gain, 0);
+}
+
+/* max-heap on the distances of one row of the knn result */
+static void THTensor_(knnSiftDown)(real *values, long *indices, long root, long n)
+{
+  real value = values[root];
+  long index = indices[root];
+  long child;
+  while((child = 2*root + 1) < n)
+  {
+    if(child + 1 < n && values[child] < values[child + 1])
+      child++;
+    if(!(value < values[child]))
+      break;
+    values[root] = values[child];
+    indices[root] = indices[child];
+    root = child;
+  }
+  values[root] = value;
+  indices[root] = index;
+}
+
+/*
+  blocks of TH_DIST_BLOCK rows of m1: the distances to a tile of m2 go to
+  the thread's scratch buffer, then into the k-heaps of the rows, so that
+  only TH_DIST_BLOCK x TH_DIST_TILE distances exist at any time
+*/
+static void THTensor_(knnKernel)(void *args_, long begin, long end)
+{
+  THTensor_(DistArgs) *args = (THTensor_(DistArgs)*)args_;
+  long N2 = args->N2, k = args->k;
+  int buffer = (args->nBuffers > 1 ? THThreadPool_getThreadNum() : 0);
+  real *scratch = args->scratch + buffer*TH_DIST_BLOCK*TH_DIST_TILE;
+  long b;
+
+  for(b = begin; b < end; b++)
+  {
+    long i0 = b*TH_DIST_BLOCK, i1 = THMin(i0 + TH_DIST_BLOCK, args->N1);
+    long i, j, j0, n;
+
+    for(j0 = 0; j0 < N2; j0 += TH_DIST_TILE)
+    {
+      long j1 = THMin(j0 + TH_DIST_TILE, N2);
+      THTensor_(distBlock)(args, i0, i1, j0, j1, scratch, TH_DIST_TILE);
+      for(i = i0; i < i1; i++)
+      {
+        real *values = args->values + i*k;
+        long *indices = args->indices + i*k;
+        const real *d = scratch + (i-i0)*TH_DIST_TILE - j0;
+        for(j = j0; j < j1; j++)
+        {
+          if(j < k)
+          {
+            /* filling up: heapify once full */
+            values[j] = d[j];
+            indices[j] = j;
+            if(j == k-1)
+            {
+              for(n = k/2 - 1; n >= 0; n--)
+                THTensor_(knnSiftDown)(values, indices, n, k);
+            }
+          }
+          else if(d[j] < values[0])
+          {
+            values[0] = d[j];
+            indices[0] = j;
+            THTensor_(knnSiftDown)(values, indices, 0, k);
+          }
+        }
+      }
+    }
+
+    /* heap sort: nearest first */
+    for(i = i0; i < i1; i++)
+    {
+      real *values = args->values + i*k;
+      long *indices = args->indices + i*k;
+      for(n = k-1; n > 0; n--)
+      {
+        real v = values[0];
+        long x = indices[0];
+        values[0] = values[n];
+        indices[0] = indices[n];
+        values[n] = v;
+        indices[n] = x;
+        THTensor_(knnSiftDown)(values, indices, 0, n);
+      }
+    }
+  }
+}
+
+void THTensor_(knn)(THTensor *values_, THLongTensor *indices_, THTensor *m1, THTensor *m2, long k, int metric)
+{
+  TH_PROFILE_TENSOR_OP(values_, m1, m2);
+  THTensor_(DistArgs) args;
+  THTensor *values__;
+  THLongTensor *indices__;
+  long nBlocks, grain;
+
+  THArgCheck(m2->nDimension > 0 && k > 0 && k <= m2->size[0], 5, "k not in range");
+  THTensor_(distInit)(&args, &m1, &m2, metric, 1, 1);
+
+  THTensor_(resize2d)(values_, args.N1, k);
+  THLongTensor_resize2d(indices_, args.N1, k);
+  values__ = THTensor_(newContiguous)(values_);
+  indices__ = THLongTensor_newContiguous(indices_);
+  args.values = THTensor_(data)(values__);
+  args.indices = THLongTensor_data(indices__);
+  args.k = k;
+
+  nBlocks = (args.N1 + TH_DIST_BLOCK - 1)/TH_DIST_BLOCK;
+  grain = THMax(1, THThreadPool_getGrainSize()/THMax(TH_DIST_BLOCK*args.N2*args.dim, 1));
+  args.nBuffers = (nBlocks > grain && !THThreadPool_inParallelRegion() ? THThreadPool_getNumThreads() : 1);
+  args.scratch = THAlloc(sizeof(real)*TH_DIST_BLOCK*TH_DIST_TILE*args.nBuffers);
+  if(args.nBuffers > 1)
+    THParallel_for(0, nBlocks, grain, THTensor_(knnKernel), &args);
+  else
+    THTensor_(knnKernel)(&args, 0, nBlocks);
+  THFree(args.scratch);
+
+  THTensor_(freeCopyTo)(values__, values_);
+  THLongTensor_freeCopyTo(indices__, indices_);
+  THTensor_(distFree)(&args, m1, m2);
+}
+
+/*
+  operand of the gemm of addmm, d being the dimension of r__ seen as rows by
+  BLAS: m itself if one of its strides is 1 (transposed or not), a copy
+  otherwise. With repack a transposed operand is copied too, so that gemm
+  runs 'n': depending on the BLAS and on the shapes this may be faster,
+  which is left to the autotuner (THAutotune.h).
+*/
+static THTensor *THTensor_(addmmOperand)(THTensor *m, int d, int repack, char *transpose)
+{
+  THTensor *m_;
+
+  if(m->stride[d] == 1 &&
+     m->stride[1-d] != 0)
+  {
+    *transpose = 'n';
+    return m;
+  }
+  if(!repack &&
+     m->stride[1-d] == 1 &&
+     m->stride[d] != 0)
+  {
+    *transpose = 't';
+    return m;
+  }
+  if(!repack || d == 1)
+  {
+    *transpose = (d == 0 ? 't' : 'n');
+    return THTensor_(newContiguous)(m);
+  }
+  *transpose = 'n';
+  m_ = THTensor_(newWithSize2d)(m->size[1], m->size[0]);
+  THTensor_(transpose)(m_, NULL, 0, 1);
+  THTensor_(copy)(m_, m);
+  return m_;
+}
+
+static void THTensor_(addmmGemm)(THTensor *r__, char transpose_r, real beta, real alpha,
+                                 THTensor *m1, THTensor *m2, int repack)
+{
+  char transpose_m1, transpose_m2;
+  int d = (transpose_r == 'n' ? 0 : 1);
+  THTensor *m1_ = THTensor_(addmmOperand)(m1, d, repack, &transpose_m1);
+  THTensor *m2_ = THTensor_(addmmOperand)(m2, d, repack, &transpose_m2);
+
+  THBlas_(gemm)(transpose_m1,
+                transpose_m2,
+                r__->size[d],
+                r__->size[1-d],
+                m1_->size[1-d],
+                alpha,
+                THTensor_(data)(m1_),
+                (transpose_m1 == 'n' ? m1_->stride[1-d] : m1_->stride[d]),
+                THTensor_(data)(m2_),
+                (transpose_m2 == 'n' ? m2_->stride[1-d] : m2_->stride[d]),
+                beta,
+                THTensor_(data)(r__),
+                r__->stride[1-d]);
+
+  if(m1_ != m1)
+    THTensor_(free)(m1_);
+  if(m2_ != m2)
+    THTensor_(free)(m2_);
+}
+
+void THTensor_(addmm)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *m1, THTensor *m2)
+{
+  TH_PROFILE_TENSOR_OP(r_, t, m1);
+  char transpose_r;
+  THTensor *r__;
+  int d, layout;
+
+  if( (m1->nDimension != 2) || (m2->nDimension != 2))
+    THError("matrices expected, got %dD, %dD tensors", m1->nDimension, m2->nDimension);
 
   if(m1->size[1] != m2->size[0]) {
     THDescBuff bm1 = THTensor_(sizeDesc)(m1);
@@ -846,72 +2021,170 @@ void THTensor_(addmm)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor
     THTensor_(transpose)(r__, NULL, 0, 1);
   }
 
-  /* m1 */
-  if(m1->stride[(transpose_r == 'n' ? 0 : 1)] == 1 &&
-     m1->stride[(transpose_r == 'n' ? 1 : 0)] != 0)
+  /* repacking only matters when an operand would be passed transposed */
+  d = (transpose_r == 'n' ? 0 : 1);
+  layout = (m1->stride[d] != 1) | ((m2->stride[d] != 1) << 1) | ((transpose_r == 't') << 2);
+  if((layout & 3) && THAutotune_getMode() != TH_AUTOTUNE_OFF)
   {
-    transpose_m1 = 'n';
-    m1_ = m1;
+    char key[TH_AUTOTUNE_KEY_SIZE];
+    long dims[3];
+    THAutotuneTrial trial;
+    int repack;
+    dims[0] = r__->size[d];
+    dims[1] = r__->size[1-d];
+    dims[2] = m1->size[1-d];
+    THAutotune_makeKey(key, "addmm", TH_CONCAT_STRING_2(Real,Tensor), dims, 3, layout, 0);
+    repack = THAutotune_begin(&trial, key, 2, 0);
+    THTensor_(addmmGemm)(r__, transpose_r, beta, alpha, m1, m2, repack);
+    THAutotune_end(&trial);
   }
-  else if(m1->stride[(transpose_r == 'n' ? 1 : 0)] == 1 &&
-          m1->stride[(transpose_r == 'n' ? 0 : 1)] != 0)
-  {
-    transpose_m1 = 't';
-    m1_ = m1;
+  else
+    THTensor_(addmmGemm)(r__, transpose_r, beta, alpha, m1, m2, 0);
+
+  if(r__ != r_)
+    THTensor_(freeCopyTo)(r__, r_);
+}
+
+/*
+  Triangular and symmetric products. BLAS works column-major: a row-major
+  matrix with unit column stride is seen there as its transpose, which swaps
+  upper and lower and (for trmm) the side. Only the triangle that holds data
+  is ever read or written.
+*/
+void THTensor_(trmm)(THTensor *r_, real alpha, THTensor *a, THTensor *m, int upper, int left)
+{
+  TH_PROFILE_TENSOR_OP(r_, a, m);
+  THTensor *r__, *a_;
+  int transpose_r, transpose_a;
+  long n;
+
+  THArgCheck(a->nDimension == 2 && a->size[0] == a->size[1], 3, "square matrix expected");
+  THArgCheck(m->nDimension == 2, 4, "matrix expected");
+  n = a->size[0];
+  if(m->size[left ? 0 : 1] != n) {
+    THDescBuff ba = THTensor_(sizeDesc)(a);
+    THDescBuff bm = THTensor_(sizeDesc)(m);
+    THError("size mismatch, a: %s, m: %s", ba.str, bm.str);
   }
+
+  /* r_ is overwritten with m before a is read */
+  if(a->storage == r_->storage && a->storage != NULL)
+    a_ = THTensor_(newClone)(a);
+  else if(a->stride[0] == 1 || a->stride[1] == 1)
+    a_ = a;
   else
+    a_ = THTensor_(newContiguous)(a);
+
+  if(m != r_)
   {
-    transpose_m1 = (transpose_r == 'n' ? 't' : 'n');
-    m1_ = THTensor_(newContiguous)(m1);
+    THTensor_(resizeAs)(r_, m);
+    THTensor_(copy)(r_, m);
   }
+  if(r_->stride[0] == 1 || r_->stride[1] == 1)
+    r__ = r_;
+  else
+    r__ = THTensor_(newClone)(r_);
 
-  /* m2 */
-  if(m2->stride[(transpose_r == 'n' ? 0 : 1)] == 1 &&
-     m2->stride[(transpose_r == 'n' ? 1 : 0)] != 0)
-  {
-    transpose_m2 = 'n';
-    m2_ = m2;
+  transpose_r = (r__->stride[0] != 1);
+  transpose_a = (a_->stride[0] != 1);
+
+  THBlas_(trmm)((left != transpose_r) ? 'l' : 'r',
+                (upper != transpose_a) ? 'u' : 'l',
+                (transpose_r != transpose_a) ? 't' : 'n',
+                'n',
+                r__->size[transpose_r ? 1 : 0],
+                r__->size[transpose_r ? 0 : 1],
+                alpha,
+                THTensor_(data)(a_),
+                a_->stride[transpose_a ? 0 : 1],
+                THTensor_(data)(r__),
+                r__->stride[transpose_r ? 0 : 1]);
+
+  if(a_ != a)
+    THTensor_(free)(a_);
+  if(r__ != r_)
+    THTensor_(freeCopyTo)(r__, r_);
+}
+
+void THTensor_(addsyrk)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *m)
+{
+  TH_PROFILE_TENSOR_OP(r_, t, m);
+  THTensor *r__, *m_;
+  real *r__data;
+  long n, rs0, rs1, i, j;
+  int transpose_r, transpose_m;
+
+  THArgCheck(m->nDimension == 2, 5, "matrix expected");
+  n = m->size[0];
+  if(t->nDimension != 2 || t->size[0] != n || t->size[1] != n) {
+    THDescBuff bt = THTensor_(sizeDesc)(t);
+    THDescBuff bm = THTensor_(sizeDesc)(m);
+    THError("size mismatch, t: %s, m: %s", bt.str, bm.str);
   }
-  else if(m2->stride[(transpose_r == 'n' ? 1 : 0)] == 1 &&
-          m2->stride[(transpose_r == 'n' ? 0 : 1)] != 0)
+
+  if(m->storage == r_->storage && m->storage != NULL)
+    m_ = THTensor_(newClone)(m);
+  else if(m->stride[0] == 1 || m->stride[1] == 1)
+    m_ = m;
+  else
+    m_ = THTensor_(newContiguous)(m);
+
+  if(t != r_)
   {
-    transpose_m2 = 't';
-    m2_ = m2;
+    THTensor_(resizeAs)(r_, t);
+    THTensor_(copy)(r_, t);
   }
+  if(r_->stride[0] == 1 || r_->stride[1] == 1)
+    r__ = r_;
   else
+    r__ = THTensor_(newClone)(r_);
+
+  /* syrk fills the lower triangle (row-major); the upper one first keeps
+     beta*(t_ij - t_ji), so that adding the computed r_ji restores
+     beta*t_ij + alpha*(m*m')_ij even when t is not symmetric */
+  r__data = THTensor_(data)(r__);
+  rs0 = r__->stride[0];
+  rs1 = r__->stride[1];
+  for(i = 0; i < n; i++)
   {
-    transpose_m2 = (transpose_r == 'n' ? 't' : 'n');
-    m2_ = THTensor_(newContiguous)(m2);
+    for(j = i+1; j < n; j++)
+    {
+      if(beta == 0)
+        r__data[i*rs0+j*rs1] = 0;
+      else
+        r__data[i*rs0+j*rs1] = beta*(r__data[i*rs0+j*rs1] - r__data[j*rs0+i*rs1]);
+    }
   }
 
-  /* do the operation */
-  THBlas_(gemm)(transpose_m1,
-                transpose_m2,
-                r__->size[(transpose_r == 'n' ? 0 : 1)],
-                r__->size[(transpose_r == 'n' ? 1 : 0)],
-                m1_->size[(transpose_r == 'n' ? 1 : 0)],
+  transpose_r = (rs0 != 1);
+  transpose_m = (m_->stride[0] != 1);
+
+  THBlas_(syrk)(transpose_r ? 'u' : 'l',
+                transpose_m ? 't' : 'n',
+                n,
+                m_->size[1],
                 alpha,
-                THTensor_(data)(m1_),
-                (transpose_m1 == 'n' ? m1_->stride[(transpose_r == 'n' ? 1 : 0)] : m1_->stride[(transpose_r == 'n' ? 0 : 1)]),
-                THTensor_(data)(m2_),
-                (transpose_m2 == 'n' ? m2_->stride[(transpose_r == 'n' ? 1 : 0)] : m2_->stride[(transpose_r == 'n' ? 0 : 1)]),
+                THTensor_(data)(m_),
+                m_->stride[transpose_m ? 0 : 1],
                 beta,
-                THTensor_(data)(r__),
-                r__->stride[(transpose_r == 'n' ? 1 : 0)]);
+                r__data,
+                (transpose_r ? rs0 : rs1));
 
-  /* free intermediate variables */
-  if(m1_ != m1)
-    THTensor_(free)(m1_);
-
-  if(m2_ != m2)
-    THTensor_(free)(m2_);
+  for(i = 0; i < n; i++)
+  {
+    for(j = i+1; j < n; j++)
+      r__data[i*rs0+j*rs1] += r__data[j*rs0+i*rs1];
+  }
 
+  if(m_ != m)
+    THTensor_(free)(m_);
   if(r__ != r_)
     THTensor_(freeCopyTo)(r__, r_);
 }
 
 void THTensor_(addr)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *vec1, THTensor *vec2)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, vec1);
   if( (vec1->nDimension != 1) || (vec2->nDimension != 1) )
     THError("vector and vector expected, got %dD, %dD tensors",
         vec1->nDimension, vec2->nDimension);
@@ -964,6 +2237,7 @@ void THTensor_(addr)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor
 
 void THTensor_(addbmm)(THTensor *result, real beta, THTensor *t, real alpha, THTensor *batch1, THTensor *batch2)
 {
+  TH_PROFILE_TENSOR_OP(result, t, batch1);
   long batch;
 
   THArgCheck(THTensor_(nDimension)(batch1) == 3, 1, "expected 3D tensor");
@@ -986,23 +2260,20 @@ void THTensor_(addbmm)(THTensor *result, real beta, THTensor *t, real alpha, THT
     THTensor_(copy)(result, t);
   }
 
-  THTensor *matrix1 = THTensor_(new)();
-  THTensor *matrix2 = THTensor_(new)();
+  THTensorView view1, view2;
 
   for (batch = 0; batch < THTensor_(size)(batch1, 0); ++batch) {
-    THTensor_(select)(matrix1, batch1, 0, batch);
-    THTensor_(select)(matrix2, batch2, 0, batch);
+    THTensor *matrix1 = THTensor_(viewSelect)(&view1, batch1, 0, batch);
+    THTensor *matrix2 = THTensor_(viewSelect)(&view2, batch2, 0, batch);
 
     THTensor_(addmm)(result, beta, result, alpha, matrix1, matrix2);
     beta = 1; // accumulate output once
   }
-
-  THTensor_(free)(matrix1);
-  THTensor_(free)(matrix2);
 }
 
 void THTensor_(baddbmm)(THTensor *result, real beta, THTensor *t, real alpha, THTensor *batch1, THTensor *batch2)
 {
+  TH_PROFILE_TENSOR_OP(result, t, batch1);
   long batch;
 
   THArgCheck(THTensor_(nDimension)(batch1) == 3, 1, "expected 3D tensor, got %dD", THTensor_(nDimension)(batch1));
@@ -1027,30 +2298,26 @@ void THTensor_(baddbmm)(THTensor *result, real beta, THTensor *t, real alpha, TH
     THTensor_(copy)(result, t);
   }
 
-  THTensor *matrix1 = THTensor_(new)();
-  THTensor *matrix2 = THTensor_(new)();
-  THTensor *result_matrix = THTensor_(new)();
+  THTensorView view1, view2, resultView;
 
   for (batch = 0; batch < THTensor_(size)(batch1, 0); ++batch) {
-    THTensor_(select)(matrix1, batch1, 0, batch);
-    THTensor_(select)(matrix2, batch2, 0, batch);
-    THTensor_(select)(result_matrix, result, 0, batch);
+    THTensor *matrix1 = THTensor_(viewSelect)(&view1, batch1, 0, batch);
+    THTensor *matrix2 = THTensor_(viewSelect)(&view2, batch2, 0, batch);
+    THTensor *result_matrix = THTensor_(viewSelect)(&resultView, result, 0, batch);
 
     THTensor_(addmm)(result_matrix, beta, result_matrix, alpha, matrix1, matrix2);
   }
-
-  THTensor_(free)(matrix1);
-  THTensor_(free)(matrix2);
-  THTensor_(free)(result_matrix);
 }
 
 long THTensor_(numel)(THTensor *t)
 {
+  TH_PROFILE_TENSOR_OP(t, NULL, NULL);
   return THTensor_(nElement)(t);
 }
 
 void THTensor_(max)(THTensor *values_, THLongTensor *indices_, THTensor *t, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(values_, t, NULL);
   THLongStorage *dim;
   real theMax;
   real value;
@@ -1090,6 +2357,7 @@ void THTensor_(max)(THTensor *values_, THLongTensor *indices_, THTensor *t, int
 
 void THTensor_(min)(THTensor *values_, THLongTensor *indices_, THTensor *t, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(values_, t, NULL);
   THLongStorage *dim;
   real theMin;
   real value;
@@ -1130,6 +2398,7 @@ void THTensor_(min)(THTensor *values_, THLongTensor *indices_, THTensor *t, int
 
 void THTensor_(sum)(THTensor *r_, THTensor *t, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THLongStorage *dim;
 
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 2, "dimension %d out of range",
@@ -1150,6 +2419,7 @@ void THTensor_(sum)(THTensor *r_, THTensor *t, int dimension)
 
 void THTensor_(prod)(THTensor *r_, THTensor *t, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THLongStorage *dim;
 
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 2, "dimension %d out of range",
@@ -1171,6 +2441,7 @@ void THTensor_(prod)(THTensor *r_, THTensor *t, int dimension)
 
 void THTensor_(cumsum)(THTensor *r_, THTensor *t, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 2, "dimension %d out of range",
       dimension+1);
 
@@ -1188,6 +2459,7 @@ void THTensor_(cumsum)(THTensor *r_, THTensor *t, int dimension)
 
 void THTensor_(cumprod)(THTensor *r_, THTensor *t, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 2, "dimension %d out of range",
       dimension+1);
 
@@ -1206,6 +2478,7 @@ void THTensor_(cumprod)(THTensor *r_, THTensor *t, int dimension)
 
 void THTensor_(sign)(THTensor *r_, THTensor *t)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THTensor_(resizeAs)(r_, t);
 
 #if defined (TH_REAL_IS_BYTE)
@@ -1223,6 +2496,7 @@ void THTensor_(sign)(THTensor *r_, THTensor *t)
 
 accreal THTensor_(trace)(THTensor *t)
 {
+  TH_PROFILE_TENSOR_OP(t, NULL, NULL);
   real *t_data = THTensor_(data)(t);
   accreal sum = 0;
   long i = 0;
@@ -1244,6 +2518,7 @@ accreal THTensor_(trace)(THTensor *t)
 
 void THTensor_(cross)(THTensor *r_, THTensor *a, THTensor *b, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(r_, a, b);
   int i;
 
   if(THTensor_(nDimension)(a) != THTensor_(nDimension)(b))
@@ -1289,43 +2564,64 @@ void THTensor_(cross)(THTensor *r_, THTensor *a, THTensor *b, int dimension)
 }
 
 void THTensor_(cmax)(THTensor *r, THTensor *t, THTensor *src) {
+  TH_PROFILE_TENSOR_OP(r, t, src);
+  if (THTensor_(nElement)(t) != THTensor_(nElement)(src)) {
+    THTensor_(broadcastApply)(r, t, src, 0, THTensor_(cmaxRow));
+    return;
+  }
   THTensor_(resizeAs)(r, t);
+  if (THTensor_(isSameSizeAs)(t, src)) {
+    THTensor_(rowApply)(r, t, src, 0, THTensor_(cmaxRow));
+    return;
+  }
   TH_TENSOR_APPLY3(real, r, real, t, real, src,
                    *r_data = *t_data > *src_data ? *t_data : *src_data;);
 }
 
 void THTensor_(cmin)(THTensor *r, THTensor *t, THTensor *src) {
+  TH_PROFILE_TENSOR_OP(r, t, src);
+  if (THTensor_(nElement)(t) != THTensor_(nElement)(src)) {
+    THTensor_(broadcastApply)(r, t, src, 0, THTensor_(cminRow));
+    return;
+  }
   THTensor_(resizeAs)(r, t);
+  if (THTensor_(isSameSizeAs)(t, src)) {
+    THTensor_(rowApply)(r, t, src, 0, THTensor_(cminRow));
+    return;
+  }
   TH_TENSOR_APPLY3(real, r, real, t, real, src,
                    *r_data = *t_data < *src_data ? *t_data : *src_data;);
 }
 
 void THTensor_(cmaxValue)(THTensor *r, THTensor *t, real value) {
+  TH_PROFILE_TENSOR_OP(r, t, NULL);
   THTensor_(resizeAs)(r, t);
-  TH_TENSOR_APPLY2(real, r, real, t,
-                   *r_data = *t_data > value ? *t_data : value;);
+  THTensor_(rowApply)(r, t, NULL, value, THTensor_(cmaxValueRow));
 }
 
 void THTensor_(cminValue)(THTensor *r, THTensor *t, real value) {
+  TH_PROFILE_TENSOR_OP(r, t, NULL);
   THTensor_(resizeAs)(r, t);
-  TH_TENSOR_APPLY2(real, r, real, t,
-                   *r_data = *t_data < value ? *t_data : value;);
+  THTensor_(rowApply)(r, t, NULL, value, THTensor_(cminValueRow));
 }
 
 void THTensor_(zeros)(THTensor *r_, THLongStorage *size)
 {
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
   THTensor_(resize)(r_, size, NULL);
   THTensor_(zero)(r_);
 }
 
 void THTensor_(ones)(THTensor *r_, THLongStorage *size)
 {
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
   THTensor_(resize)(r_, size, NULL);
   THTensor_(fill)(r_, 1);
 }
 
 void THTensor_(diag)(THTensor *r_, THTensor *t, int k)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THArgCheck(THTensor_(nDimension)(t) == 1 || THTensor_(nDimension)(t) == 2, 1, "matrix or a vector expected");
 
   if(THTensor_(nDimension)(t) == 1)
@@ -1375,6 +2671,7 @@ void THTensor_(diag)(THTensor *r_, THTensor *t, int k)
 
 void THTensor_(eye)(THTensor *r_, long n, long m)
 {
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
   real *r__data;
   long i, sz;
 
@@ -1396,6 +2693,7 @@ void THTensor_(eye)(THTensor *r_, long n, long m)
 
 void THTensor_(range)(THTensor *r_, accreal xmin, accreal xmax, accreal step)
 {
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
   long size;
   real i = 0;
 
@@ -1412,8 +2710,162 @@ void THTensor_(range)(THTensor *r_, accreal xmin, accreal xmax, accreal step)
   TH_TENSOR_APPLY(real, r_, *r__data = xmin + (i++)*step;);
 }
 
+/*
+  Random permutations. Up to TH_RANDPERM_BLOCK elements: a Fisher-Yates
+  shuffle driven by the generator, as before. Beyond, MergeShuffle: the
+  array is cut in a power of two number of blocks (depending on n only),
+  shuffled in parallel, then adjacent runs are merged pairwise level after
+  level, each merge interleaving its two runs with random bits and putting
+  the leftovers of the longer one at random positions. Every block and merge
+  draws from its own splitmix64 stream, seeded from the generator and its
+  position, so that the result depends on the generator state only, not on
+  the number of threads.
+*/
+#define TH_RANDPERM_BLOCK 65536
+
+static unsigned long long THTensor_(permNext)(unsigned long long *state)
+{
+  unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* uniform in [0, k), without modulo bias */
+static long THTensor_(permBelow)(unsigned long long *state, long k)
+{
+  if(k <= 0xFFFFFFFFL)
+  {
+    unsigned long long m = (THTensor_(permNext)(state) >> 32) * (unsigned long long)k;
+    if((unsigned int)m < (unsigned long long)k)
+    {
+      /* 2^32 mod k: low products below it are rejected */
+      unsigned int t = (unsigned int)(-(unsigned int)k) % (unsigned int)k;
+      while((unsigned int)m < t)
+        m = (THTensor_(permNext)(state) >> 32) * (unsigned long long)k;
+    }
+    return (long)(m >> 32);
+  }
+  return (long)(THTensor_(permNext)(state) % (unsigned long long)k);
+}
+
+typedef struct THTensor_(PermArgs)
+{
+  real *data;
+  long n;
+  long nBlocks;
+  int level;            /* 0: blocks shuffled, l > 0: runs of 2^(l-1) blocks merged */
+  unsigned long long seed;
+} THTensor_(PermArgs);
+
+/* start of block b */
+static long THTensor_(permBound)(THTensor_(PermArgs) *args, long b)
+{
+  return (long)((double)b / args->nBlocks * args->n + 0.5);
+}
+
+static unsigned long long THTensor_(permStream)(THTensor_(PermArgs) *args, long index)
+{
+  unsigned long long state = args->seed ^ ((unsigned long long)(args->level + 1) << 56) ^ (unsigned long long)index;
+  return THTensor_(permNext)(&state);
+}
+
+static void THTensor_(permBlockKernel)(void *args_, long begin, long end)
+{
+  THTensor_(PermArgs) *args = (THTensor_(PermArgs)*)args_;
+  long b, i;
+  for(b = begin; b < end; b++)
+  {
+    unsigned long long state = THTensor_(permStream)(args, b);
+    long lo = THTensor_(permBound)(args, b), hi = THTensor_(permBound)(args, b+1);
+    real *t = args->data + lo;
+    for(i = hi - lo - 1; i > 0; i--)
+    {
+      long z = THTensor_(permBelow)(&state, i+1);
+      real sav = t[i];
+      t[i] = t[z];
+      t[z] = sav;
+    }
+  }
+}
+
+/* merges j: blocks [2j w, (2j+1) w) and [(2j+1) w, (2j+2) w), w = 2^(level-1) */
+static void THTensor_(permMergeKernel)(void *args_, long begin, long end)
+{
+  THTensor_(PermArgs) *args = (THTensor_(PermArgs)*)args_;
+  long w = 1L << (args->level - 1);
+  long j;
+  for(j = begin; j < end; j++)
+  {
+    unsigned long long state = THTensor_(permStream)(args, j);
+    long start = THTensor_(permBound)(args, 2*j*w);
+    real *t = args->data + start;
+    long u = 0;
+    long v = THTensor_(permBound)(args, (2*j+1)*w) - start;
+    long n = THTensor_(permBound)(args, (2*j+2)*w) - start;
+    unsigned long long bits = 0;
+    int nBits = 0;
+
+    for(;;)
+    {
+      if(nBits == 0)
+      {
+        bits = THTensor_(permNext)(&state);
+        nBits = 64;
+      }
+      nBits--;
+      if(bits & 1)
+      {
+        real sav;
+        if(v == n)
+          break;
+        sav = t[u];
+        t[u] = t[v];
+        t[v++] = sav;
+      }
+      else if(u == v)
+        break;
+      bits >>= 1;
+      u++;
+    }
+    for(; u < n; u++)
+    {
+      long z = THTensor_(permBelow)(&state, u+1);
+      real sav = t[u];
+      t[u] = t[z];
+      t[z] = sav;
+    }
+  }
+}
+
+/* shuffles data[0..n) in place with MergeShuffle */
+static void THTensor_(permShuffle)(real *data, long n, THGenerator *_generator)
+{
+  THTensor_(PermArgs) args;
+  args.data = data;
+  args.n = n;
+  args.nBlocks = 1;
+  while(args.nBlocks*TH_RANDPERM_BLOCK < n)
+    args.nBlocks *= 2;
+  args.seed = ((unsigned long long)THRandom_random(_generator) << 32) ^ THRandom_random(_generator);
+
+  args.level = 0;
+  THParallel_for(0, args.nBlocks, 1, THTensor_(permBlockKernel), &args);
+  for(args.level = 1; (1L << args.level) <= args.nBlocks; args.level++)
+    THParallel_for(0, args.nBlocks >> args.level, 1, THTensor_(permMergeKernel), &args);
+}
+
+static void THTensor_(permIotaKernel)(void *args_, long begin, long end)
+{
+  real *data = ((THTensor_(PermArgs)*)args_)->data;
+  long i;
+  for(i = begin; i < end; i++)
+    data[i] = (real)i;
+}
+
 void THTensor_(randperm)(THTensor *r_, THGenerator *_generator, long n)
 {
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
   real *r__data;
   long r__stride_0;
   long i;
@@ -1421,6 +2873,18 @@ void THTensor_(randperm)(THTensor *r_, THGenerator *_generator, long n)
   THArgCheck(n > 0, 1, "must be strictly positive");
 
   THTensor_(resize1d)(r_, n);
+
+  if(n > TH_RANDPERM_BLOCK)
+  {
+    THTensor *r__ = THTensor_(newContiguous)(r_);
+    THTensor_(PermArgs) args;
+    args.data = THTensor_(data)(r__);
+    THParallel_for(0, n, 0, THTensor_(permIotaKernel), &args);
+    THTensor_(permShuffle)(args.data, n, _generator);
+    THTensor_(freeCopyTo)(r__, r_);
+    return;
+  }
+
   r__data = THTensor_(data)(r_);
   r__stride_0 = THTensor_(stride)(r_,0);
 
@@ -1436,31 +2900,141 @@ void THTensor_(randperm)(THTensor *r_, THGenerator *_generator, long n)
   }
 }
 
-void THTensor_(reshape)(THTensor *r_, THTensor *t, THLongStorage *size)
+void THTensor_(shuffle)(THTensor *r_, THTensor *t, THGenerator *_generator, int dimension)
 {
-  THTensor_(resize)(r_, size, NULL);
-  THTensor_(copy)(r_, t);
-}
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
+  THLongTensor *perm;
+  long *p;
+  long n, i;
+  THTensorView view1, view2;
 
-/* I cut and pasted (slightly adapted) the quicksort code from
-   Sedgewick's 1978 "Implementing Quicksort Programs" article
-   http://www.csie.ntu.edu.tw/~b93076/p847-sedgewick.pdf
+  THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 4, "dimension %d out of range",
+      dimension+1);
 
-   It is the state of the art existing implementation. The macros
-   are here to make as close a match as possible to the pseudocode of
-   Program 2 p.851
+  n = t->size[dimension];
+  perm = THLongTensor_new();
+  THLongTensor_randperm(perm, _generator, n);
+  p = THLongTensor_data(perm);
 
-   Note that other partition schemes exist, and are typically presented
-   in textbook, but those are less efficient. See e.g.
-   http://cs.stackexchange.com/questions/11458/quicksort-partitioning-hoare-vs-lomuto
+  if(r_ != t)
+  {
+    /* slice i of r_ <- slice p[i] of t; slices are narrowed, not selected,
+       so that vectors are shuffled too */
+    THTensor_(resizeAs)(r_, t);
+    for(i = 0; i < n; i++)
+      THTensor_(copy)(THTensor_(viewNarrow)(&view1, r_, dimension, i, 1),
+                      THTensor_(viewNarrow)(&view2, t, dimension, p[i], 1));
+  }
+  else
+  {
+    /* in place: each cycle of the permutation is rotated through one saved
+       slice, every slice being moved once; p[i] = i marks moved slices */
+    THTensor *saved = THTensor_(new)();
+    for(i = 0; i < n; i++)
+    {
+      long j = i;
+      if(p[i] == i)
+        continue;
+      THTensor_(resizeAs)(saved, THTensor_(viewNarrow)(&view1, t, dimension, i, 1));
+      THTensor_(copy)(saved, &view1.tensor);
+      while(p[j] != i)
+      {
+        long next = p[j];
+        THTensor_(copy)(THTensor_(viewNarrow)(&view1, t, dimension, j, 1),
+                        THTensor_(viewNarrow)(&view2, t, dimension, next, 1));
+        p[j] = j;
+        j = next;
+      }
+      THTensor_(copy)(THTensor_(viewNarrow)(&view1, t, dimension, j, 1), saved);
+      p[j] = j;
+    }
+    THTensor_(free)(saved);
+  }
+  THLongTensor_free(perm);
+}
 
-   Julien, November 12th 2013
-*/
-#define MAX_LEVELS  300
-#define M_SMALL 10 /* Limit for small subfiles */
+void THTensor_(randsample)(THTensor *r_, THGenerator *_generator, long n, long k)
+{
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
+  THTensor *r__;
+  real *r;
+  double w;
+  long i;
 
-#define ARR(III) arr[(III)*stride]
-#define IDX(III) idx[(III)*stride]
+  THArgCheck(n > 0, 2, "must be strictly positive");
+  THArgCheck(k > 0 && k <= n, 3, "k not in range (1..n)");
+
+  THTensor_(resize1d)(r_, k);
+  r__ = THTensor_(newContiguous)(r_);
+  r = THTensor_(data)(r__);
+
+  /* reservoir sampling, algorithm L: skips over the indices never kept,
+     O(k (1 + log(n/k))) draws */
+  for(i = 0; i < k; i++)
+    r[i] = (real)i;
+#define TH_RANDSAMPLE_LOG_U(LOG_U)                                      \
+  {                                                                     \
+    double u_;                                                          \
+    do { u_ = THRandom_uniform(_generator, 0, 1); } while(u_ <= 0);     \
+    LOG_U = log(u_);                                                    \
+  }
+  {
+    double logU;
+    TH_RANDSAMPLE_LOG_U(logU);
+    w = exp(logU/k);
+    i = k - 1;
+    while(w < 1)
+    {
+      double skip;
+      TH_RANDSAMPLE_LOG_U(logU);
+      skip = floor(logU/log1p(-w));
+      if(skip >= (double)(n - 1 - i))
+        break;
+      i += (long)skip + 1;
+      r[THRandom_random(_generator) % k] = (real)i;
+      TH_RANDSAMPLE_LOG_U(logU);
+      w *= exp(logU/k);
+    }
+  }
+#undef TH_RANDSAMPLE_LOG_U
+
+  /* the reservoir order is not uniform */
+  for(i = 0; i < k-1; i++)
+  {
+    long z = THRandom_random(_generator) % (k-i);
+    real sav = r[i];
+    r[i] = r[z+i];
+    r[z+i] = sav;
+  }
+  THTensor_(freeCopyTo)(r__, r_);
+}
+
+void THTensor_(reshape)(THTensor *r_, THTensor *t, THLongStorage *size)
+{
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
+  THTensor_(resize)(r_, size, NULL);
+  THTensor_(copy)(r_, t);
+}
+
+/* I cut and pasted (slightly adapted) the quicksort code from
+   Sedgewick's 1978 "Implementing Quicksort Programs" article
+   http://www.csie.ntu.edu.tw/~b93076/p847-sedgewick.pdf
+
+   It is the state of the art existing implementation. The macros
+   are here to make as close a match as possible to the pseudocode of
+   Program 2 p.851
+
+   Note that other partition schemes exist, and are typically presented
+   in textbook, but those are less efficient. See e.g.
+   http://cs.stackexchange.com/questions/11458/quicksort-partitioning-hoare-vs-lomuto
+
+   Julien, November 12th 2013
+*/
+#define MAX_LEVELS  300
+#define M_SMALL 10 /* Limit for small subfiles */
+
+#define ARR(III) arr[(III)*stride]
+#define IDX(III) idx[(III)*stride]
 
 #define LONG_SWAP(AAA, BBB) swap = AAA; AAA = BBB; BBB = swap
 #define REAL_SWAP(AAA, BBB) rswap = AAA; AAA = BBB; BBB = rswap
@@ -1650,8 +3224,54 @@ static void THTensor_(quicksortdescend)(real *arr, long *idx, long elements, lon
 #undef MAX_LEVELS
 #undef M_SMALL
 
+/*
+  one slice of sort. Slices with a non unit stride can be sorted in place
+  or gathered into the contiguous buffers vbuf and ibuf (when not NULL),
+  sorted there and scattered back: which is faster depends on the slice
+  length and on the stride, so sort leaves the choice to the autotuner
+  (THAutotune.h). The quicksorts step through data and idx with the same
+  stride: slices whose strides differ must be gathered.
+*/
+static void THTensor_(sortSlice)(real *data, long stride, long *idx, long idxStride, long n,
+                                 int descendingOrder, real *vbuf, long *ibuf)
+{
+  long i;
+
+  if(!vbuf)
+  {
+    for(i = 0; i < n; i++)
+      idx[i*stride] = i;
+    if(descendingOrder)
+      THTensor_(quicksortdescend)(data, idx, n, stride);
+    else
+      THTensor_(quicksortascend)(data, idx, n, stride);
+    return;
+  }
+
+  for(i = 0; i < n; i++)
+  {
+    vbuf[i] = data[i*stride];
+    ibuf[i] = i;
+  }
+  if(descendingOrder)
+    THTensor_(quicksortdescend)(vbuf, ibuf, n, 1);
+  else
+    THTensor_(quicksortascend)(vbuf, ibuf, n, 1);
+  for(i = 0; i < n; i++)
+  {
+    data[i*stride] = vbuf[i];
+    idx[i*idxStride] = ibuf[i];
+  }
+}
+
 void THTensor_(sort)(THTensor *rt_, THLongTensor *ri_, THTensor *t, int dimension, int descendingOrder)
 {
+  TH_PROFILE_TENSOR_OP(rt_, t, NULL);
+  THAutotuneTrial trial;
+  real *vbuf = NULL;
+  long *ibuf = NULL;
+  long size, stride;
+
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 2, "invalid dimension %d",
       dimension+1);
 
@@ -1664,22 +3284,36 @@ void THTensor_(sort)(THTensor *rt_, THLongTensor *ri_, THTensor *t, int dimensio
     THLongStorage_free(size);
   }
 
-  if(descendingOrder)
+  trial.candidate = -1;
+  size = rt_->size[dimension];
+  stride = rt_->stride[dimension];
+  if(ri_->stride[dimension] != stride && size > 1)
   {
-    TH_TENSOR_DIM_APPLY2(real, rt_, long, ri_, dimension,
-                         long i;
-                         for(i = 0; i < ri__size; i++)
-                           ri__data[i*ri__stride] = i;
-                         THTensor_(quicksortdescend)(rt__data, ri__data, rt__size, rt__stride);)
-      }
-  else
+    vbuf = THAlloc(size*sizeof(real));
+    ibuf = THAlloc(size*sizeof(long));
+  }
+  else if(stride != 1 && size > 1 && THAutotune_getMode() != TH_AUTOTUNE_OFF)
   {
-    TH_TENSOR_DIM_APPLY2(real, rt_, long, ri_, dimension,
-                         long i;
-                         for(i = 0; i < ri__size; i++)
-                           ri__data[i*ri__stride] = i;
-                         THTensor_(quicksortascend)(rt__data, ri__data, rt__size, rt__stride);)
-      }
+    char key[TH_AUTOTUNE_KEY_SIZE];
+    long shape[2];
+    shape[0] = size;
+    shape[1] = THTensor_(nElement)(rt_)/size;
+    THAutotune_makeKey(key, "sort", TH_CONCAT_STRING_2(Real,Tensor), shape, 2, descendingOrder, 1);
+    if(THAutotune_begin(&trial, key, 2, 0))
+    {
+      vbuf = THAlloc(size*sizeof(real));
+      ibuf = THAlloc(size*sizeof(long));
+    }
+  }
+
+  TH_TENSOR_DIM_APPLY2(real, rt_, long, ri_, dimension,
+                       (void)ri__size;
+                       THTensor_(sortSlice)(rt__data, rt__stride, ri__data, ri__stride, rt__size,
+                                            descendingOrder, vbuf, ibuf););
+
+  THAutotune_end(&trial);
+  THFree(vbuf);
+  THFree(ibuf);
 }
 
 /* Implementation of the Quickselect algorithm, based on Nicolas Devillard's
@@ -1735,110 +3369,385 @@ static void THTensor_(quickselect)(real *arr, long *idx, long k, long elements,
 #undef REAL_SWAP
 #undef BOTH_SWAP
 
-void THTensor_(mode)(THTensor *values_, THLongTensor *indices_, THTensor *t, int dimension)
+/* offset in tensor of slice s along dimension, the slices being numbered in
+   the order of the other dimensions (the numbering is the same for every
+   tensor of the same sizes outside dimension) */
+static long THTensor_(sliceOffset)(const long *size, const long *stride, int nDimension, int dimension, long s)
 {
-  THLongStorage *dim;
-  THTensor *temp_;
-  THLongTensor *tempi_;
-  real *temp__data;
-  long *tempi__data;
-  long t_size_dim;
+  long offset = 0;
+  int d;
+  for(d = nDimension-1; d >= 0; d--)
+  {
+    if(d == dimension)
+      continue;
+    offset += (s % size[d])*stride[d];
+    s /= size[d];
+  }
+  return offset;
+}
 
-  THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 3, "dimension out of range");
+static void THTensor_(heapSiftDown)(real *arr, long root, long n)
+{
+  real value = arr[root];
+  long child;
+  while((child = 2*root + 1) < n)
+  {
+    if(child + 1 < n && arr[child] < arr[child + 1])
+      child++;
+    if(!(value < arr[child]))
+      break;
+    arr[root] = arr[child];
+    root = child;
+  }
+  arr[root] = value;
+}
 
-  dim = THTensor_(newSizeOf)(t);
+static void THTensor_(heapSortValues)(real *arr, long n)
+{
+  long i;
+  for(i = n/2 - 1; i >= 0; i--)
+    THTensor_(heapSiftDown)(arr, i, n);
+  for(i = n - 1; i > 0; i--)
+  {
+    real swap = arr[0];
+    arr[0] = arr[i];
+    arr[i] = swap;
+    THTensor_(heapSiftDown)(arr, 0, i);
+  }
+}
+
+#define TH_SELECT_SWAP(AAA, BBB) do { real swap_ = AAA; AAA = BBB; BBB = swap_; } while(0)
+
+/*
+  Floyd-Rivest selection on values only: arr[k] ends up being the element of
+  rank k of arr[left..right], with no larger element before it and no
+  smaller one after. Large ranges first select k within a sample around its
+  expected position, which leaves a pivot very close to the k-th element
+  (about n + min(k, n-k) comparisons on average). Past depth rounds the
+  range is heap sorted instead, bounding the worst case as in introselect.
+*/
+static void THTensor_(floydRivestSelect)(real *arr, long left, long right, long k, int depth)
+{
+  while(right > left)
+  {
+    real t;
+    long i, j;
+
+    if(depth-- <= 0)
+    {
+      THTensor_(heapSortValues)(arr + left, right - left + 1);
+      return;
+    }
+    if(right - left > 600)
+    {
+      double n = right - left + 1;
+      double rank = k - left + 1;
+      double z = log(n);
+      double s = 0.5*exp(2*z/3);
+      double sd = 0.5*sqrt(z*s*(n - s)/n)*(rank < n/2 ? -1 : 1);
+      long newLeft = THMax(left, (long)(k - rank*s/n + sd));
+      long newRight = THMin(right, (long)(k + (n - rank)*s/n + sd));
+      THTensor_(floydRivestSelect)(arr, newLeft, newRight, k, depth);
+    }
+
+    t = arr[k];
+    i = left;
+    j = right;
+    TH_SELECT_SWAP(arr[left], arr[k]);
+    if(arr[right] > t)
+      TH_SELECT_SWAP(arr[right], arr[left]);
+    while(i < j)
+    {
+      TH_SELECT_SWAP(arr[i], arr[j]);
+      i++;
+      j--;
+      while(arr[i] < t)
+        i++;
+      while(arr[j] > t)
+        j--;
+    }
+    if(arr[left] == t)
+      TH_SELECT_SWAP(arr[left], arr[j]);
+    else
+    {
+      j++;
+      TH_SELECT_SWAP(arr[j], arr[right]);
+    }
+    if(j <= k)
+      left = j + 1;
+    if(k <= j)
+      right = j - 1;
+  }
+}
+
+#undef TH_SELECT_SWAP
+
+/* state of the per-slice kernels of mode and kthvalue */
+typedef struct THTensor_(SliceSelectArgs)
+{
+  THTensor *t;
+  THTensor *values;
+  THLongTensor *indices;
+  int dimension;
+  long k;
+  int nBuffers;
+  real *scratch;        /* scratchSize reals per buffer */
+  long scratchSize;
+  long *counts;         /* countsSize longs per buffer */
+  long countsSize;
+} THTensor_(SliceSelectArgs);
+
+/* slices [begin, end): pointers to the input slice and its outputs */
+#define TH_SLICE_SELECT_BEGIN(ARGS, S)                                  \
+  long sliceSize_ = ARGS->t->size[ARGS->dimension];                     \
+  long sliceStride_ = ARGS->t->stride[ARGS->dimension];                 \
+  int buffer_ = (ARGS->nBuffers > 1 ? THThreadPool_getThreadNum() : 0); \
+  real *scratch_ = ARGS->scratch + buffer_*ARGS->scratchSize;           \
+  for(S = begin; S < end; S++)                                          \
+  {                                                                     \
+    real *slice_ = THTensor_(data)(ARGS->t) +                           \
+      THTensor_(sliceOffset)(ARGS->t->size, ARGS->t->stride, ARGS->t->nDimension, ARGS->dimension, S); \
+    real *value_ = THTensor_(data)(ARGS->values) +                      \
+      THTensor_(sliceOffset)(ARGS->values->size, ARGS->values->stride, ARGS->values->nDimension, ARGS->dimension, S); \
+    long *index_ = THLongTensor_data(ARGS->indices) +                   \
+      THTensor_(sliceOffset)(ARGS->indices->size, ARGS->indices->stride, ARGS->indices->nDimension, ARGS->dimension, S);
+
+#define TH_SLICE_SELECT_END }
+
+/* the count buffer of the thread, for the kernels of mode */
+#define TH_SLICE_SELECT_COUNTS(ARGS) (ARGS->counts + buffer_*ARGS->countsSize)
+
+/*
+  runs kernel over the nSlices slices, in parallel (unless already inside a
+  parallel region), each thread with its own scratch buffers
+*/
+static void THTensor_(sliceSelectRun)(THParallelFunction kernel, THTensor_(SliceSelectArgs) *args,
+                                      long nSlices, long sliceSize)
+{
+  long grain = THMax(1, THThreadPool_getGrainSize()/THMax(sliceSize, 1));
+  args->nBuffers = (nSlices > grain && !THThreadPool_inParallelRegion() ? THThreadPool_getNumThreads() : 1);
+  args->scratch = THAlloc(sizeof(real)*args->scratchSize*args->nBuffers);
+  args->counts = (args->countsSize > 0 ? THAlloc(sizeof(long)*args->countsSize*args->nBuffers) : NULL);
+  if(args->nBuffers > 1)
+    THParallel_for(0, nSlices, grain, kernel, args);
+  else
+    kernel(args, 0, nSlices);
+  THFree(args->scratch);
+  THFree(args->counts);
+}
+
+/* outputs of size 1 along dimension; returns the number of slices */
+static long THTensor_(sliceSelectInit)(THTensor_(SliceSelectArgs) *args, THTensor *values_, THLongTensor *indices_,
+                                       THTensor *t, int dimension)
+{
+  THLongStorage *dim = THTensor_(newSizeOf)(t);
   THLongStorage_set(dim, dimension, 1);
   THTensor_(resize)(values_, dim, NULL);
   THLongTensor_resize(indices_, dim, NULL);
   THLongStorage_free(dim);
 
-  t_size_dim = THTensor_(size)(t, dimension);
+  memset(args, 0, sizeof(*args));
+  args->t = t;
+  args->values = values_;
+  args->indices = indices_;
+  args->dimension = dimension;
+  return THTensor_(nElement)(t)/t->size[dimension];
+}
+
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+
+/* sort, then longest run (the smallest value on ties), as before */
+static void THTensor_(modeKernel)(void *args_, long begin, long end)
+{
+  THTensor_(SliceSelectArgs) *args = (THTensor_(SliceSelectArgs)*)args_;
+  long s;
+  TH_SLICE_SELECT_BEGIN(args, s)
+    long *counts_ = TH_SLICE_SELECT_COUNTS(args);
+    long i;
+    real mode = 0;
+    long modei = 0;
+    long temp_freq = 0;
+    long max_freq = 0;
+    for(i = 0; i < sliceSize_; i++)
+    {
+      scratch_[i] = slice_[i*sliceStride_];
+      counts_[i] = i;
+    }
+    THTensor_(quicksortascend)(scratch_, counts_, sliceSize_, 1);
+    for(i = 0; i < sliceSize_; i++)
+    {
+      temp_freq++;
+      if((i == sliceSize_ - 1) || (scratch_[i] != scratch_[i+1]))
+      {
+        if(temp_freq > max_freq)
+        {
+          mode = scratch_[i];
+          modei = counts_[i];
+          max_freq = temp_freq;
+        }
+        temp_freq = 0;
+      }
+    }
+    *value_ = mode;
+    *index_ = modei;
+  TH_SLICE_SELECT_END
+}
 
-  temp_ = THTensor_(new)();
-  THTensor_(resize1d)(temp_, t_size_dim);
-  temp__data = THTensor_(data)(temp_);
+#else
 
-  tempi_ = THLongTensor_new();
-  THLongTensor_resize1d(tempi_, t_size_dim);
-  tempi__data = THLongTensor_data(tempi_);
+/*
+  integer types, O(n): counts in a table of countsSize entries, indexed by
+  value - min when the range of the slice fits (counting), by an open
+  addressing hash of the value otherwise. The mode is the most frequent
+  value (the smallest one on ties), its index the last occurrence.
+*/
+static void THTensor_(modeKernel)(void *args_, long begin, long end)
+{
+  THTensor_(SliceSelectArgs) *args = (THTensor_(SliceSelectArgs)*)args_;
+  long tableSize = args->countsSize;
+  long s;
+  TH_SLICE_SELECT_BEGIN(args, s)
+    long *counts_ = TH_SLICE_SELECT_COUNTS(args);
+    long i, maxCount = 0;
+    real minValue = slice_[0], maxValue = slice_[0], mode = 0;
+
+    for(i = 1; i < sliceSize_; i++)
+    {
+      real v = slice_[i*sliceStride_];
+      if(v < minValue)
+        minValue = v;
+      if(v > maxValue)
+        maxValue = v;
+    }
 
-  TH_TENSOR_DIM_APPLY3(real, t, real, values_, long, indices_, dimension,
-                       long i;
-                       long mode = 0;
-                       long modei = 0;
-                       long temp_freq = 0;
-                       long max_freq = 0;
-                       for(i = 0; i < t_size_dim; i++)
-                          temp__data[i] = t_data[i*t_stride];
-                       for(i = 0; i < t_size_dim; i++)
-                          tempi__data[i] = i;
-                       THTensor_(quicksortascend)(temp__data, tempi__data, t_size_dim, 1);
-
-                       for(i = 0; i < t_size_dim; i++)
-                       {
-                          temp_freq++;
-                          if ((i == t_size_dim - 1) || (temp__data[i] != temp__data[i+1]))
-                          {
-                              if (temp_freq > max_freq)
-                              {
-                                 mode = temp__data[i];
-                                 modei = tempi__data[i];
-                                 max_freq = temp_freq;
-                              }
-                              temp_freq = 0;
-                          }
-                       }
-                       *values__data = mode;
-                       *indices__data = modei;);
+    memset(counts_, 0, sizeof(long)*tableSize);
+    /* differences in unsigned long: max - min overflows long for Long */
+    if((unsigned long)(long)maxValue - (unsigned long)(long)minValue < (unsigned long)tableSize)
+    {
+      for(i = 0; i < sliceSize_; i++)
+        counts_[(unsigned long)(long)slice_[i*sliceStride_] - (unsigned long)(long)minValue]++;
+      for(i = 0; i < tableSize; i++)
+      {
+        if(counts_[i] > maxCount)
+        {
+          maxCount = counts_[i];
+          mode = (real)((long)minValue + i);
+        }
+      }
+    }
+    else
+    {
+      unsigned long mask = (unsigned long)tableSize - 1;
+      for(i = 0; i < sliceSize_; i++)
+      {
+        real v = slice_[i*sliceStride_];
+        unsigned long h = (((unsigned long)(long)v*0x9E3779B97F4A7C15UL) >> 17) & mask;
+        while(counts_[h] && scratch_[h] != v)
+          h = (h + 1) & mask;
+        scratch_[h] = v;
+        counts_[h]++;
+      }
+      for(i = 0; i < tableSize; i++)
+      {
+        if(counts_[i] > maxCount || (counts_[i] && counts_[i] == maxCount && scratch_[i] < mode))
+        {
+          maxCount = counts_[i];
+          mode = scratch_[i];
+        }
+      }
+    }
 
-  THTensor_(free)(temp_);
-  THLongTensor_free(tempi_);
+    for(i = sliceSize_-1; i >= 0; i--)
+    {
+      if(slice_[i*sliceStride_] == mode)
+        break;
+    }
+    *value_ = mode;
+    *index_ = i;
+  TH_SLICE_SELECT_END
 }
 
-void THTensor_(kthvalue)(THTensor *values_, THLongTensor *indices_, THTensor *t, long k, int dimension)
+#endif
+
+void THTensor_(mode)(THTensor *values_, THLongTensor *indices_, THTensor *t, int dimension)
 {
-  THLongStorage *dim;
-  THTensor *temp_;
-  THLongTensor *tempi_;
-  real *temp__data;
-  long *tempi__data;
-  long t_size_dim;
+  TH_PROFILE_TENSOR_OP(values_, t, NULL);
+  THTensor_(SliceSelectArgs) args;
+  long nSlices, sliceSize;
 
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 3, "dimension out of range");
-  THArgCheck(k >= 0 && k < t->size[dimension], 2, "selected index out of range");
 
-  dim = THTensor_(newSizeOf)(t);
-  THLongStorage_set(dim, dimension, 1);
-  THTensor_(resize)(values_, dim, NULL);
-  THLongTensor_resize(indices_, dim, NULL);
-  THLongStorage_free(dim);
-
-  t_size_dim = THTensor_(size)(t, dimension);
+  nSlices = THTensor_(sliceSelectInit)(&args, values_, indices_, t, dimension);
+  sliceSize = t->size[dimension];
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+  args.scratchSize = sliceSize;
+  args.countsSize = sliceSize;
+#else
+  /* a power of 2, at least twice the slice (hash load <= 1/2), and enough
+     for the counting path to always be taken on bytes */
+  args.countsSize = 256;
+  while(args.countsSize < 2*sliceSize)
+    args.countsSize *= 2;
+  args.scratchSize = args.countsSize;
+#endif
+  THTensor_(sliceSelectRun)(THTensor_(modeKernel), &args, nSlices, sliceSize);
+}
 
-  temp_ = THTensor_(new)();
-  THTensor_(resize1d)(temp_, t_size_dim);
-  temp__data = THTensor_(data)(temp_);
+/* selection on a contiguous copy of the values; the index is the first
+   occurrence of the selected value in the slice */
+static void THTensor_(kthvalueKernel)(void *args_, long begin, long end)
+{
+  THTensor_(SliceSelectArgs) *args = (THTensor_(SliceSelectArgs)*)args_;
+  long k = args->k;
+  long s;
+  TH_SLICE_SELECT_BEGIN(args, s)
+    long i, n;
+    int depth = 8;
+    real value;
+    for(i = 0; i < sliceSize_; i++)
+      scratch_[i] = slice_[i*sliceStride_];
+    for(n = sliceSize_; n > 1; n >>= 1)
+      depth += 2;
+    THTensor_(floydRivestSelect)(scratch_, 0, sliceSize_-1, k, depth);
+    value = scratch_[k];
+    for(i = 0; i < sliceSize_; i++)
+    {
+      real v = slice_[i*sliceStride_];
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+      if(v == value || (isnan(v) && isnan(value)))
+        break;
+#else
+      if(v == value)
+        break;
+#endif
+    }
+    *value_ = value;
+    *index_ = i;
+  TH_SLICE_SELECT_END
+}
 
-  tempi_ = THLongTensor_new();
-  THLongTensor_resize1d(tempi_, t_size_dim);
-  tempi__data = THLongTensor_data(tempi_);
+void THTensor_(kthvalue)(THTensor *values_, THLongTensor *indices_, THTensor *t, long k, int dimension)
+{
+  TH_PROFILE_TENSOR_OP(values_, t, NULL);
+  THTensor_(SliceSelectArgs) args;
+  long nSlices;
 
-  TH_TENSOR_DIM_APPLY3(real, t, real, values_, long, indices_, dimension,
-                       long i;
-                       for(i = 0; i < t_size_dim; i++)
-                          temp__data[i] = t_data[i*t_stride];
-                       for(i = 0; i < t_size_dim; i++)
-                          tempi__data[i] = i;
-                       THTensor_(quickselect)(temp__data, tempi__data, k, t_size_dim, 1);
-                       *values__data = temp__data[k];
-                       *indices__data = tempi__data[k];);
+  THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 3, "dimension out of range");
+  THArgCheck(k >= 0 && k < t->size[dimension], 2, "selected index out of range");
 
-  THTensor_(free)(temp_);
-  THLongTensor_free(tempi_);
+  nSlices = THTensor_(sliceSelectInit)(&args, values_, indices_, t, dimension);
+  args.k = k;
+  args.scratchSize = t->size[dimension];
+  THTensor_(sliceSelectRun)(THTensor_(kthvalueKernel), &args, nSlices, t->size[dimension]);
 }
 
+#undef TH_SLICE_SELECT_BEGIN
+#undef TH_SLICE_SELECT_END
+#undef TH_SLICE_SELECT_COUNTS
+
 void THTensor_(median)(THTensor *values_, THLongTensor *indices_, THTensor *t, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(values_, t, NULL);
   long t_size_dim, k;
 
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 3, "dimension out of range");
@@ -1851,6 +3760,7 @@ void THTensor_(median)(THTensor *values_, THLongTensor *indices_, THTensor *t, i
 
 void THTensor_(topk)(THTensor *rt_, THLongTensor *ri_, THTensor *t, long k, int dim, int dir, int sorted)
 {
+  TH_PROFILE_TENSOR_OP(rt_, t, NULL);
   int numDims = THTensor_(nDimension)(t);
   THArgCheck(dim >= 0 && dim < numDims, 3, "dim not in range");
 
@@ -1914,78 +3824,187 @@ void THTensor_(topk)(THTensor *rt_, THLongTensor *ri_, THTensor *t, long k, int
   THLongTensor_free(tmpIndices);
 }
 
-void THTensor_(tril)(THTensor *r_, THTensor *t, long k)
+/*
+  tril/triu: each row keeps one column range [c0, c1) of t and zeroes the
+  rest. Rows are independent, so they are split over the pool; with unit
+  column strides both ranges are a single memcpy/memset, and in place the
+  kept range is not touched at all.
+*/
+typedef struct THTensor_(TriangleArgs)
 {
-  long t_size_0, t_size_1;
-  long t_stride_0, t_stride_1;
-  long r__stride_0, r__stride_1;
-  real *t_data, *r__data;
-  long r, c;
-
-  THArgCheck(THTensor_(nDimension)(t) == 2, 1, "expected a matrix");
-
-  THTensor_(resizeAs)(r_, t);
+  real *t_data;
+  long t_stride_0;
+  long t_stride_1;
+  real *r_data;
+  long r_stride_0;
+  long r_stride_1;
+  long ncols;
+  long k;
+  int lower;
+} THTensor_(TriangleArgs);
+
+static void THTensor_(triangleZero)(real *r, long stride, long n)
+{
+  long c;
+  if(n <= 0)
+    return;
+  if(stride == 1)
+    memset(r, 0, n*sizeof(real));
+  else
+  {
+    for(c = 0; c < n; c++)
+      r[c*stride] = 0;
+  }
+}
 
-  t_size_0 = THTensor_(size)(t, 0);
-  t_size_1 = THTensor_(size)(t, 1);
-  t_stride_0 = THTensor_(stride)(t, 0);
-  t_stride_1 = THTensor_(stride)(t, 1);
-  r__stride_0 = THTensor_(stride)(r_, 0);
-  r__stride_1 = THTensor_(stride)(r_, 1);
-  r__data = THTensor_(data)(r_);
-  t_data = THTensor_(data)(t);
+static void THTensor_(triangleKernel)(void *args_, long begin, long end)
+{
+  THTensor_(TriangleArgs) *args = (THTensor_(TriangleArgs)*)args_;
+  long ncols = args->ncols;
+  long rs1 = args->r_stride_1, ts1 = args->t_stride_1;
+  int inplace = (args->t_data == args->r_data && args->t_stride_0 == args->r_stride_0 && ts1 == rs1);
+  long r, c;
 
-  for(r = 0; r < t_size_0; r++)
+  for(r = begin; r < end; r++)
   {
-    long sz = THMin(r+k+1, t_size_1);
-    for(c = THMax(0, r+k); c < t_size_1; c++)
-      r__data[r*r__stride_0+c*r__stride_1] = 0;
-    for(c = 0; c < sz; c++)
-      r__data[r*r__stride_0+c*r__stride_1] = t_data[r*t_stride_0+c*t_stride_1];
+    real *r_row = args->r_data + r*args->r_stride_0;
+    real *t_row = args->t_data + r*args->t_stride_0;
+    long c0 = (args->lower ? 0 : THMin(THMax(r+args->k, 0), ncols));
+    long c1 = (args->lower ? THMin(THMax(r+args->k+1, 0), ncols) : ncols);
+
+    THTensor_(triangleZero)(r_row, rs1, c0);
+    THTensor_(triangleZero)(r_row + c1*rs1, rs1, ncols-c1);
+    if(inplace || c1 <= c0)
+      continue;
+    if(rs1 == 1 && ts1 == 1)
+      memcpy(r_row + c0, t_row + c0, (c1-c0)*sizeof(real));
+    else
+    {
+      for(c = c0; c < c1; c++)
+        r_row[c*rs1] = t_row[c*ts1];
+    }
   }
 }
 
-void THTensor_(triu)(THTensor *r_, THTensor *t, long k)
+static void THTensor_(triangle)(THTensor *r_, THTensor *t, long k, int lower)
 {
-  long t_size_0, t_size_1;
-  long t_stride_0, t_stride_1;
-  long r__stride_0, r__stride_1;
-  real *t_data, *r__data;
-  long r, c;
+  THTensor_(TriangleArgs) args;
 
   THArgCheck(THTensor_(nDimension)(t) == 2, 1, "expected a matrix");
 
   THTensor_(resizeAs)(r_, t);
 
-  t_size_0 = THTensor_(size)(t, 0);
-  t_size_1 = THTensor_(size)(t, 1);
-  t_stride_0 = THTensor_(stride)(t, 0);
-  t_stride_1 = THTensor_(stride)(t, 1);
-  r__stride_0 = THTensor_(stride)(r_, 0);
-  r__stride_1 = THTensor_(stride)(r_, 1);
-  r__data = THTensor_(data)(r_);
-  t_data = THTensor_(data)(t);
+  args.t_data = THTensor_(data)(t);
+  args.t_stride_0 = THTensor_(stride)(t, 0);
+  args.t_stride_1 = THTensor_(stride)(t, 1);
+  args.r_data = THTensor_(data)(r_);
+  args.r_stride_0 = THTensor_(stride)(r_, 0);
+  args.r_stride_1 = THTensor_(stride)(r_, 1);
+  args.ncols = THTensor_(size)(t, 1);
+  args.k = k;
+  args.lower = lower;
+
+  THParallel_for(0, THTensor_(size)(t, 0),
+                 THMax(1, THThreadPool_getGrainSize()/THMax(args.ncols, 1)),
+                 THTensor_(triangleKernel), &args);
+}
 
-  for(r = 0; r < t_size_0; r++)
-  {
-    long sz = THMin(r+k, t_size_1);
-    for(c = THMax(0, r+k); c < t_size_1; c++)
-      r__data[r*r__stride_0+c*r__stride_1] = t_data[r*t_stride_0+c*t_stride_1];
-    for(c = 0; c < sz; c++)
-      r__data[r*r__stride_0+c*r__stride_1] = 0;
-  }
+void THTensor_(tril)(THTensor *r_, THTensor *t, long k)
+{
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
+  THTensor_(triangle)(r_, t, k, 1);
+}
+
+void THTensor_(triu)(THTensor *r_, THTensor *t, long k)
+{
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
+  THTensor_(triangle)(r_, t, k, 0);
 }
 
 void THTensor_(cat)(THTensor *r_, THTensor *ta, THTensor *tb, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(r_, ta, tb);
   THTensor* inputs[2];
   inputs[0] = ta;
   inputs[1] = tb;
   THTensor_(catArray)(r_, inputs, 2, dimension);
 }
 
+typedef struct THTensor_(CatArgs)
+{
+  real *result;
+  real **inputs;
+  long *offsets;  /* in each row of result */
+  long *lengths;  /* input elements per row */
+  long rowLength;
+  int numInputs;
+} THTensor_(CatArgs);
+
+/* tasks are (row, input) blocks, in the order of the result */
+static void THTensor_(catKernel)(void *args_, long begin, long end)
+{
+  THTensor_(CatArgs) *args = (THTensor_(CatArgs)*)args_;
+  long t;
+  for(t = begin; t < end; t++)
+  {
+    long row = t / args->numInputs;
+    int j = (int)(t % args->numInputs);
+    memcpy(args->result + row*args->rowLength + args->offsets[j],
+           args->inputs[j] + row*args->lengths[j], args->lengths[j]*sizeof(real));
+  }
+}
+
+/*
+  One pass concatenation when result and inputs are contiguous: seen as
+  rows (the dimensions before dimension), each row of the result is made
+  of one contiguous run per input, copied in parallel.
+  Returns 0 (nothing done) when the layouts do not allow it.
+*/
+static int THTensor_(catContiguous)(THTensor *result, THTensor **inputs, int numInputs, int dimension)
+{
+  THTensor_(CatArgs) args;
+  long rows = 1, nTasks;
+  int i, j;
+
+  if(!THTensor_(isContiguous)(result) || THTensor_(nElement)(result) == 0)
+    return 0;
+  for(j = 0; j < numInputs; j++)
+  {
+    if(inputs[j]->nDimension == 0 || !THTensor_(isContiguous)(inputs[j]) ||
+       inputs[j]->storage == result->storage)
+      return 0;
+  }
+
+  for(i = 0; i < dimension; i++)
+    rows *= result->size[i];
+
+  args.result = THTensor_(data)(result);
+  args.inputs = THAlloc(sizeof(real*)*numInputs);
+  args.offsets = THAlloc(sizeof(long)*numInputs);
+  args.lengths = THAlloc(sizeof(long)*numInputs);
+  args.rowLength = 0;
+  args.numInputs = numInputs;
+  for(j = 0; j < numInputs; j++)
+  {
+    args.inputs[j] = THTensor_(data)(inputs[j]);
+    args.offsets[j] = args.rowLength;
+    args.lengths[j] = THTensor_(nElement)(inputs[j]) / rows;
+    args.rowLength += args.lengths[j];
+  }
+
+  nTasks = rows*numInputs;
+  THParallel_for(0, nTasks, THMax(1, THThreadPool_getGrainSize()*numInputs/THMax(args.rowLength, 1)),
+                 THTensor_(catKernel), &args);
+
+  THFree(args.inputs);
+  THFree(args.offsets);
+  THFree(args.lengths);
+  return 1;
+}
+
 void THTensor_(catArray)(THTensor *result, THTensor **inputs, int numInputs, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(result, NULL, NULL);
   THLongStorage *size;
   int i, j;
   long offset;
@@ -2026,6 +4045,9 @@ void THTensor_(catArray)(THTensor *result, THTensor **inputs, int numInputs, int
   THTensor_(resize)(result, size, NULL);
   THLongStorage_free(size);
 
+  if(THTensor_(catContiguous)(result, inputs, numInputs, dimension))
+    return;
+
   offset = 0;
   for (j = 0; j < numInputs; j++)
   {
@@ -2038,81 +4060,370 @@ void THTensor_(catArray)(THTensor *result, THTensor **inputs, int numInputs, int
   }
 }
 
-int THTensor_(equal)(THTensor *ta, THTensor* tb)
+/*
+  Equality engine of equal and allclose: operands are compared by blocks of
+  TH_EQUAL_BLOCK elements, a block folding its differences into one flag
+  (a branch-free loop the compiler can vectorize) or going through memcmp
+  for the integer types, and the comparison stops at the first block that
+  differs. Large contiguous operands are split over the pool, the threads
+  giving up as soon as one of them finds a difference.
+*/
+#define TH_EQUAL_BLOCK 4096
+
+static int THTensor_(equalRange)(const real *a, long aStride, const real *b, long bStride, long n)
 {
-  int equal = 1;
-  if(!THTensor_(isSameSizeAs)(ta, tb))
+  long i, j;
+  for(i = 0; i < n; i += TH_EQUAL_BLOCK)
+  {
+    long m = THMin(TH_EQUAL_BLOCK, n - i);
+    int diff = 0;
+    if(aStride == 1 && bStride == 1)
+    {
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+      for(j = 0; j < m; j++)
+        diff |= (a[i+j] != b[i+j]);
+#else
+      diff = (memcmp(a + i, b + i, sizeof(real)*m) != 0);
+#endif
+    }
+    else
+    {
+      for(j = 0; j < m; j++)
+        diff |= (a[(i+j)*aStride] != b[(i+j)*bStride]);
+    }
+    if(diff)
+      return 0;
+  }
+  return 1;
+}
+
+/* |a - b| <= atol + rtol*|b|, NaNs never being close */
+static int THTensor_(closeRange)(const real *a, long aStride, const real *b, long bStride, long n,
+                                 double rtol, double atol)
+{
+  long i, j;
+  for(i = 0; i < n; i += TH_EQUAL_BLOCK)
+  {
+    long m = THMin(TH_EQUAL_BLOCK, n - i);
+    int far = 0;
+    for(j = 0; j < m; j++)
+    {
+      double x = a[(i+j)*aStride], y = b[(i+j)*bStride];
+      /* infinities are only close to themselves */
+      far |= !(x == y || (isfinite(x) && isfinite(y) && fabs(x - y) <= atol + rtol*fabs(y)));
+    }
+    if(far)
+      return 0;
+  }
+  return 1;
+}
+
+typedef struct THTensor_(EqualArgs)
+{
+  const real *a;
+  const real *b;
+  int close;
+  double rtol;
+  double atol;
+  int volatile differ;
+} THTensor_(EqualArgs);
+
+static void THTensor_(equalKernel)(void *args_, long begin, long end)
+{
+  THTensor_(EqualArgs) *args = (THTensor_(EqualArgs)*)args_;
+  long i;
+  for(i = begin; i < end && !args->differ; i += TH_EQUAL_BLOCK)
+  {
+    long n = THMin(TH_EQUAL_BLOCK, end - i);
+    int same = (args->close ?
+                THTensor_(closeRange)(args->a + i, 1, args->b + i, 1, n, args->rtol, args->atol) :
+                THTensor_(equalRange)(args->a + i, 1, args->b + i, 1, n));
+    if(!same)
+      args->differ = 1;
+  }
+}
+
+static int THTensor_(equalApply)(THTensor *ta, THTensor *tb, int close, double rtol, double atol)
+{
+  int equal = 1;
+  if(!THTensor_(isSameSizeAs)(ta, tb))
     return 0;
 
   if (THTensor_(isContiguous)(ta) && THTensor_(isContiguous)(tb)) {
-    real *tap = THTensor_(data)(ta);
-    real *tbp = THTensor_(data)(tb);
-    long sz = THTensor_(nElement)(ta);
-    long i;
-    for (i=0; i<sz; ++i){
-      if(tap[i] != tbp[i]) return 0;
-    }
+    THTensor_(EqualArgs) args;
+    args.a = THTensor_(data)(ta);
+    args.b = THTensor_(data)(tb);
+    args.close = close;
+    args.rtol = rtol;
+    args.atol = atol;
+    args.differ = 0;
+    THParallel_for(0, THTensor_(nElement)(ta), 0, THTensor_(equalKernel), &args);
+    equal = !args.differ;
   } else {
-    // Short-circuit the apply function on inequality
+    /* contiguous runs at a time; short-circuit the apply function on inequality */
     TH_TENSOR_APPLY2(real, ta, real, tb,
-                     if (equal && *ta_data != *tb_data) {
-                        equal = 0;
-                        TH_TENSOR_APPLY_hasFinished = 1; break;
-                     })
+                     long sz = (ta_size-ta_i < tb_size-tb_i ? ta_size-ta_i : tb_size-tb_i);
+                     equal = (close ?
+                              THTensor_(closeRange)(ta_data, ta_stride, tb_data, tb_stride, sz, rtol, atol) :
+                              THTensor_(equalRange)(ta_data, ta_stride, tb_data, tb_stride, sz));
+                     if (!equal) {
+                       TH_TENSOR_APPLY_hasFinished = 1; break;
+                     }
+                     ta_i += sz;
+                     tb_i += sz;
+                     ta_data += sz*ta_stride;
+                     tb_data += sz*tb_stride;
+                     break;)
   }
   return equal;
 }
 
-#define TENSOR_IMPLEMENT_LOGICAL(NAME,OP)				\
+int THTensor_(equal)(THTensor *ta, THTensor* tb)
+{
+  TH_PROFILE_TENSOR_OP(ta, tb, NULL);
+  return THTensor_(equalApply)(ta, tb, 0, 0, 0);
+}
+
+int THTensor_(allclose)(THTensor *ta, THTensor *tb, double rtol, double atol)
+{
+  TH_PROFILE_TENSOR_OP(ta, tb, NULL);
+  return THTensor_(equalApply)(ta, tb, 1, rtol, atol);
+}
+
+/*
+  Comparisons. Each op has a word kernel giving the 0/1 results of up to
+  64 elements as the bits of a word (SSE compares and movemask for float
+  and double). Contiguous operands are run through it in parallel, the
+  words being stored as is (THBitMask results) or expanded to bytes or
+  reals; other layouts use TH_TENSOR_APPLY.
+*/
+typedef uint64_t (*THTensor_(CompareFunction))(const real *a, const real *b, real value, long n);
+
+typedef struct THTensor_(CompareArgs)
+{
+  THTensor_(CompareFunction) compare;
+  const real *a;
+  const real *b;    /* NULL: compare against value */
+  real value;
+  long n;
+  unsigned char *bytes;
+  real *reals;
+  uint64_t *bits;
+} THTensor_(CompareArgs);
+
+static void THTensor_(compareKernel)(void *args_, long begin, long end)
+{
+  THTensor_(CompareArgs) *args = (THTensor_(CompareArgs)*)args_;
+  long w, j;
+  for(w = begin; w < end; w++)
+  {
+    long i = w*TH_BIT_MASK_WORD_BITS;
+    long n = THMin(TH_BIT_MASK_WORD_BITS, args->n - i);
+    uint64_t word = args->compare(args->a + i, (args->b ? args->b + i : NULL), args->value, n);
+    if(args->bits)
+      args->bits[w] = word;
+    else if(args->bytes)
+      THBitMask_expandWord(args->bytes + i, word, n);
+    else
+    {
+      for(j = 0; j < n; j++)
+        args->reals[i+j] = (real)((word >> j) & 1);
+    }
+  }
+}
+
+/* exactly one of bytes, reals and bits is not NULL */
+static void THTensor_(compareContiguous)(THTensor_(CompareFunction) compare, const real *a, const real *b, real value,
+                                         long n, unsigned char *bytes, real *reals, uint64_t *bits)
+{
+  THTensor_(CompareArgs) args;
+  args.compare = compare;
+  args.a = a;
+  args.b = b;
+  args.value = value;
+  args.n = n;
+  args.bytes = bytes;
+  args.reals = reals;
+  args.bits = bits;
+  THParallel_for(0, THBitMask_nWords(n), THMax(1, THThreadPool_getGrainSize()/TH_BIT_MASK_WORD_BITS),
+                 THTensor_(compareKernel), &args);
+}
+
+#if defined(USE_SSE2) && defined(TH_REAL_IS_FLOAT)
+#define TENSOR_IMPLEMENT_COMPARE_WORD(NAME, OP, SSEOP)                  \
+  static uint64_t THTensor_(NAME##Word)(const real *a, const real *b, real value, long n) \
+  {                                                                     \
+    uint64_t word = 0;                                                  \
+    long i = 0;                                                         \
+    if(b)                                                               \
+    {                                                                   \
+      for(; i + 4 <= n; i += 4)                                         \
+        word |= (uint64_t)_mm_movemask_ps(_mm_cmp##SSEOP##_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i))) << i; \
+      for(; i < n; i++)                                                 \
+        word |= (uint64_t)(a[i] OP b[i]) << i;                          \
+    }                                                                   \
+    else                                                                \
+    {                                                                   \
+      __m128 v = _mm_set1_ps(value);                                    \
+      for(; i + 4 <= n; i += 4)                                         \
+        word |= (uint64_t)_mm_movemask_ps(_mm_cmp##SSEOP##_ps(_mm_loadu_ps(a + i), v)) << i; \
+      for(; i < n; i++)                                                 \
+        word |= (uint64_t)(a[i] OP value) << i;                         \
+    }                                                                   \
+    return word;                                                        \
+  }
+#elif defined(USE_SSE2) && defined(TH_REAL_IS_DOUBLE)
+#define TENSOR_IMPLEMENT_COMPARE_WORD(NAME, OP, SSEOP)                  \
+  static uint64_t THTensor_(NAME##Word)(const real *a, const real *b, real value, long n) \
+  {                                                                     \
+    uint64_t word = 0;                                                  \
+    long i = 0;                                                         \
+    if(b)                                                               \
+    {                                                                   \
+      for(; i + 2 <= n; i += 2)                                         \
+        word |= (uint64_t)_mm_movemask_pd(_mm_cmp##SSEOP##_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i))) << i; \
+      for(; i < n; i++)                                                 \
+        word |= (uint64_t)(a[i] OP b[i]) << i;                          \
+    }                                                                   \
+    else                                                                \
+    {                                                                   \
+      __m128d v = _mm_set1_pd(value);                                   \
+      for(; i + 2 <= n; i += 2)                                         \
+        word |= (uint64_t)_mm_movemask_pd(_mm_cmp##SSEOP##_pd(_mm_loadu_pd(a + i), v)) << i; \
+      for(; i < n; i++)                                                 \
+        word |= (uint64_t)(a[i] OP value) << i;                         \
+    }                                                                   \
+    return word;                                                        \
+  }
+#else
+#define TENSOR_IMPLEMENT_COMPARE_WORD(NAME, OP, SSEOP)                  \
+  static uint64_t THTensor_(NAME##Word)(const real *a, const real *b, real value, long n) \
+  {                                                                     \
+    uint64_t word = 0;                                                  \
+    long i;                                                             \
+    if(b)                                                               \
+    {                                                                   \
+      for(i = 0; i < n; i++)                                            \
+        word |= (uint64_t)(a[i] OP b[i]) << i;                          \
+    }                                                                   \
+    else                                                                \
+    {                                                                   \
+      for(i = 0; i < n; i++)                                            \
+        word |= (uint64_t)(a[i] OP value) << i;                         \
+    }                                                                   \
+    return word;                                                        \
+  }
+#endif
+
+#define TENSOR_IMPLEMENT_LOGICAL(NAME,OP,SSEOP)				\
+  TENSOR_IMPLEMENT_COMPARE_WORD(NAME, OP, SSEOP)			\
   void THTensor_(NAME##Value)(THByteTensor *r_, THTensor* t, real value)	\
   {									\
+    TH_PROFILE_TENSOR_OP(t, NULL, NULL);				\
     THByteTensor_rawResize(r_, t->nDimension, t->size, NULL);		\
+    if(THTensor_(isContiguous)(t) && THByteTensor_isContiguous(r_))	\
+    {									\
+      THTensor_(compareContiguous)(THTensor_(NAME##Word), THTensor_(data)(t), NULL, value, \
+                                   THTensor_(nElement)(t), THByteTensor_data(r_), NULL, NULL); \
+      return;								\
+    }									\
     THByteTensor_zero(r_);						\
     TH_TENSOR_APPLY2(unsigned char, r_, real, t,			\
 		     if (*t_data OP value) *r__data = 1;);		\
   }									\
   void THTensor_(NAME##ValueT)(THTensor* r_, THTensor* t, real value)	\
   {									\
+    TH_PROFILE_TENSOR_OP(r_, t, NULL);					\
     THTensor_(rawResize)(r_, t->nDimension, t->size, NULL);		\
+    if(THTensor_(isContiguous)(t) && THTensor_(isContiguous)(r_))	\
+    {									\
+      THTensor_(compareContiguous)(THTensor_(NAME##Word), THTensor_(data)(t), NULL, value, \
+                                   THTensor_(nElement)(t), NULL, THTensor_(data)(r_), NULL); \
+      return;								\
+    }									\
     THTensor_(zero)(r_);						\
     TH_TENSOR_APPLY2(real, r_, real, t,					\
 		     if (*t_data OP value) *r__data = 1;);		\
   }									\
   void THTensor_(NAME##Tensor)(THByteTensor *r_, THTensor *ta, THTensor *tb) \
   {									\
+    TH_PROFILE_TENSOR_OP(ta, tb, NULL);					\
     THByteTensor_rawResize(r_, ta->nDimension, ta->size, NULL);		\
+    if(THTensor_(isContiguous)(ta) && THTensor_(isContiguous)(tb) &&	\
+       THByteTensor_isContiguous(r_) && THTensor_(nElement)(ta) == THTensor_(nElement)(tb)) \
+    {									\
+      THTensor_(compareContiguous)(THTensor_(NAME##Word), THTensor_(data)(ta), THTensor_(data)(tb), 0, \
+                                   THTensor_(nElement)(ta), THByteTensor_data(r_), NULL, NULL); \
+      return;								\
+    }									\
     THByteTensor_zero(r_);						\
     TH_TENSOR_APPLY3(unsigned char, r_, real, ta, real, tb,		\
 		     if(*ta_data OP *tb_data) *r__data = 1;);		\
   }									\
   void THTensor_(NAME##TensorT)(THTensor *r_, THTensor *ta, THTensor *tb) \
   {									\
+    TH_PROFILE_TENSOR_OP(r_, ta, tb);					\
     THTensor_(rawResize)(r_, ta->nDimension, ta->size, NULL);		\
+    if(THTensor_(isContiguous)(ta) && THTensor_(isContiguous)(tb) &&	\
+       THTensor_(isContiguous)(r_) && THTensor_(nElement)(ta) == THTensor_(nElement)(tb)) \
+    {									\
+      THTensor_(compareContiguous)(THTensor_(NAME##Word), THTensor_(data)(ta), THTensor_(data)(tb), 0, \
+                                   THTensor_(nElement)(ta), NULL, THTensor_(data)(r_), NULL); \
+      return;								\
+    }									\
     THTensor_(zero)(r_);						\
     TH_TENSOR_APPLY3(real, r_, real, ta, real, tb,			\
 		     if(*ta_data OP *tb_data) *r__data = 1;);		\
   }									\
+  void THTensor_(NAME##ValueMask)(THBitMask *r_, THTensor* t, real value) \
+  {									\
+    TH_PROFILE_TENSOR_OP(t, NULL, NULL);				\
+    THTensor *tc = THTensor_(newContiguous)(t);				\
+    THBitMask_resize(r_, t->nDimension, t->size);			\
+    THTensor_(compareContiguous)(THTensor_(NAME##Word), THTensor_(data)(tc), NULL, value, \
+                                 THTensor_(nElement)(tc), NULL, NULL, THBitMask_data(r_)); \
+    THTensor_(free)(tc);						\
+  }									\
+  void THTensor_(NAME##TensorMask)(THBitMask *r_, THTensor *ta, THTensor *tb) \
+  {									\
+    TH_PROFILE_TENSOR_OP(ta, tb, NULL);					\
+    THTensor *tac, *tbc;						\
+    THArgCheck(THTensor_(nElement)(ta) == THTensor_(nElement)(tb), 3, "inconsistent tensor size"); \
+    tac = THTensor_(newContiguous)(ta);					\
+    tbc = THTensor_(newContiguous)(tb);					\
+    THBitMask_resize(r_, ta->nDimension, ta->size);			\
+    THTensor_(compareContiguous)(THTensor_(NAME##Word), THTensor_(data)(tac), THTensor_(data)(tbc), 0, \
+                                 THTensor_(nElement)(tac), NULL, NULL, THBitMask_data(r_)); \
+    THTensor_(free)(tac);						\
+    THTensor_(free)(tbc);						\
+  }									\
+
 
+TENSOR_IMPLEMENT_LOGICAL(lt,<,lt)
+TENSOR_IMPLEMENT_LOGICAL(gt,>,gt)
+TENSOR_IMPLEMENT_LOGICAL(le,<=,le)
+TENSOR_IMPLEMENT_LOGICAL(ge,>=,ge)
+TENSOR_IMPLEMENT_LOGICAL(eq,==,eq)
+TENSOR_IMPLEMENT_LOGICAL(ne,!=,neq)
 
-TENSOR_IMPLEMENT_LOGICAL(lt,<)
-TENSOR_IMPLEMENT_LOGICAL(gt,>)
-TENSOR_IMPLEMENT_LOGICAL(le,<=)
-TENSOR_IMPLEMENT_LOGICAL(ge,>=)
-TENSOR_IMPLEMENT_LOGICAL(eq,==)
-TENSOR_IMPLEMENT_LOGICAL(ne,!=)
+#undef TENSOR_IMPLEMENT_COMPARE_WORD
 
 #define LAB_IMPLEMENT_BASIC_FUNCTION(NAME, CFUNC)             \
+  TH_TENSOR_UNARY_ROW_KERNEL(NAME##Row, CFUNC(a))             \
   void THTensor_(NAME)(THTensor *r_, THTensor *t)                \
   {                                                           \
+    TH_PROFILE_TENSOR_OP(r_, t, NULL);                        \
     THTensor_(resizeAs)(r_, t);                               \
-    TH_TENSOR_APPLY2(real, t, real, r_, *r__data = CFUNC(*t_data);); \
+    THTensor_(rowApply)(r_, t, NULL, 0, THTensor_(NAME##Row)); \
   }                                                           \
 
 #define LAB_IMPLEMENT_BASIC_FUNCTION_VALUE(NAME, CFUNC)                 \
+  TH_TENSOR_UNARY_ROW_KERNEL(NAME##Row, CFUNC(a, value))                \
   void THTensor_(NAME)(THTensor *r_, THTensor *t, real value)              \
   {                                                                     \
+    TH_PROFILE_TENSOR_OP(r_, t, NULL);                                  \
     THTensor_(resizeAs)(r_, t);                                         \
-    TH_TENSOR_APPLY2(real, t, real, r_, *r__data = CFUNC(*t_data, value);); \
+    THTensor_(rowApply)(r_, t, NULL, value, THTensor_(NAME##Row));      \
   }                                                                     \
 
 #if defined(TH_REAL_IS_LONG)
@@ -2128,7 +4439,18 @@ LAB_IMPLEMENT_BASIC_FUNCTION(abs,abs)
 #define TENSOR_IMPLEMENT_LOGICAL_SUM(NAME, OP, INIT_VALUE) \
   int THTensor_(NAME)(THTensor *tensor) \
   { \
+    TH_PROFILE_TENSOR_OP(tensor, NULL, NULL); \
     THArgCheck(tensor->nDimension > 0, 1, "empty Tensor"); \
+    if(THTensor_(isContiguous)(tensor))                 \
+    {                                                   \
+      /* stops at the first element deciding the result */ \
+      real *data = THTensor_(data)(tensor);             \
+      long i, n = THTensor_(nElement)(tensor);          \
+      for(i = 0; i < n; i++)                            \
+        if((data[i] != 0) != INIT_VALUE)                \
+          return !INIT_VALUE;                           \
+      return INIT_VALUE;                                \
+    }                                                   \
     int sum = INIT_VALUE;                               \
     TH_TENSOR_APPLY(real, tensor, sum = sum OP *tensor_data;); \
     return sum; \
@@ -2169,19 +4491,277 @@ LAB_IMPLEMENT_BASIC_FUNCTION(cinv, 1.0 / )
 
 void THTensor_(atan2)(THTensor *r_, THTensor *tx, THTensor *ty)
 {
+  TH_PROFILE_TENSOR_OP(r_, tx, ty);
   THTensor_(resizeAs)(r_, tx);
   TH_TENSOR_APPLY3(real, r_, real, tx, real, ty, *r__data = atan2(*tx_data,*ty_data););
 }
 
 void THTensor_(lerp)(THTensor *r_, THTensor *a, THTensor *b, real weight)
 {
+  TH_PROFILE_TENSOR_OP(r_, a, b);
   THArgCheck(THTensor_(nElement)(a) == THTensor_(nElement)(b), 2, "sizes do not match");
   THTensor_(resizeAs)(r_, a);
   TH_TENSOR_APPLY3(real, r_, real, a, real, b, *r__data = TH_lerp(*a_data, *b_data, weight););
 }
 
+/*
+  Log-space arithmetic. Sums of exponentials are accumulated as (max, sum of
+  exp(x - max)) pairs: a range is scanned once for its max, then once for
+  the sum, and pairs are merged by rescaling to the larger max, so that no
+  exp overflows. NaNs propagate; a range of -inf gives -inf, one holding
+  +inf gives +inf.
+*/
+typedef struct THTensor_(LogSumExp)
+{
+  accreal max;
+  accreal sum;
+} THTensor_(LogSumExp);
+
+static void THTensor_(logSumExpMerge)(THTensor_(LogSumExp) *acc, accreal max, accreal sum)
+{
+  if(max > acc->max)
+  {
+    accreal t = max; max = acc->max; acc->max = t;
+    t = sum; sum = acc->sum; acc->sum = t;
+  }
+  if(max != max)
+  {
+    acc->max = max;
+    acc->sum = sum;
+  }
+  else if(max > -INFINITY && acc->max < INFINITY)
+    acc->sum += sum*exp(max - acc->max);
+}
+
+/* acc <- acc (+) log(sum of exp(x[i] + y[i])) over n elements */
+static void THTensor_(logSumExpRange)(THTensor_(LogSumExp) *acc, const real *x, long xStride,
+                                      const real *y, long yStride, long n)
+{
+  static const real zero = 0;
+  accreal max = -INFINITY, sum = 0;
+  long i;
+
+  if(!y)
+  {
+    y = &zero;
+    yStride = 0;
+  }
+  for(i = 0; i < n; i++)
+  {
+    real v = x[i*xStride] + y[i*yStride];
+    if(v > max || v != v)
+      max = v;
+  }
+  if(max != max)
+    sum = max;
+  else if(max == INFINITY)
+    sum = 1;
+  else if(max > -INFINITY)
+  {
+    for(i = 0; i < n; i++)
+      sum += exp(x[i*xStride] + y[i*yStride] - max);
+  }
+  THTensor_(logSumExpMerge)(acc, max, sum);
+}
+
+static void THTensor_(logSumExpInit)(THTensor_(LogSumExp) *acc)
+{
+  acc->max = -INFINITY;
+  acc->sum = 0;
+}
+
+static accreal THTensor_(logSumExpValue)(THTensor_(LogSumExp) *acc)
+{
+  return acc->max + log(acc->sum);
+}
+
+typedef struct THTensor_(LogSumExpArgs)
+{
+  THTensor *r;
+  THTensor *t;
+  int dimension;
+  const real *x;        /* one range reduced by THParallel_reduce */
+  long xStride;
+  const real *y;
+  long yStride;
+} THTensor_(LogSumExpArgs);
+
+static void THTensor_(logSumExpReduce)(void *args_, long begin, long end, void *partial)
+{
+  THTensor_(LogSumExpArgs) *args = (THTensor_(LogSumExpArgs)*)args_;
+  THTensor_(logSumExpRange)((THTensor_(LogSumExp)*)partial, args->x + begin*args->xStride, args->xStride,
+                            (args->y ? args->y + begin*args->yStride : NULL), args->yStride, end - begin);
+}
+
+static void THTensor_(logSumExpCombine)(void *args_, void *result, const void *partial_)
+{
+  const THTensor_(LogSumExp) *partial = (const THTensor_(LogSumExp)*)partial_;
+  (void)args_;
+  THTensor_(logSumExpMerge)((THTensor_(LogSumExp)*)result, partial->max, partial->sum);
+}
+
+/* log(sum of exp(x[i] + y[i])), split over the pool when n is large */
+static accreal THTensor_(logSumExpVector)(const real *x, long xStride, const real *y, long yStride, long n)
+{
+  THTensor_(LogSumExpArgs) args;
+  THTensor_(LogSumExp) acc;
+  args.x = x;
+  args.xStride = xStride;
+  args.y = y;
+  args.yStride = yStride;
+  THTensor_(logSumExpInit)(&acc);
+  THParallel_reduce(0, n, 0, THTensor_(logSumExpReduce), THTensor_(logSumExpCombine),
+                    &args, &acc, sizeof(acc));
+  return THTensor_(logSumExpValue)(&acc);
+}
+
+static void THTensor_(logSumExpSlices)(void *args_, long begin, long end)
+{
+  THTensor_(LogSumExpArgs) *args = (THTensor_(LogSumExpArgs)*)args_;
+  THTensor *t = args->t, *r = args->r;
+  int dimension = args->dimension;
+  long s;
+  for(s = begin; s < end; s++)
+  {
+    THTensor_(LogSumExp) acc;
+    THTensor_(logSumExpInit)(&acc);
+    THTensor_(logSumExpRange)(&acc,
+                              THTensor_(data)(t) + THTensor_(sliceOffset)(t->size, t->stride, t->nDimension, dimension, s),
+                              t->stride[dimension], NULL, 0, t->size[dimension]);
+    THTensor_(data)(r)[THTensor_(sliceOffset)(r->size, r->stride, r->nDimension, dimension, s)] =
+      (real)THTensor_(logSumExpValue)(&acc);
+  }
+}
+
+void THTensor_(logsumexp)(THTensor *r_, THTensor *t, int dimension)
+{
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
+  THTensor_(LogSumExpArgs) args;
+  THLongStorage *dim;
+  long nSlices, sliceSize;
+
+  THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 2, "dimension %d out of range",
+      dimension+1);
+
+  dim = THTensor_(newSizeOf)(t);
+  THLongStorage_set(dim, dimension, 1);
+  THTensor_(resize)(r_, dim, NULL);
+  THLongStorage_free(dim);
+
+  sliceSize = t->size[dimension];
+  nSlices = THTensor_(nElement)(t)/sliceSize;
+
+  /* few long slices: each one is split over the pool instead */
+  if(nSlices < THThreadPool_getNumThreads() && sliceSize > THThreadPool_getGrainSize())
+  {
+    long s;
+    for(s = 0; s < nSlices; s++)
+      THTensor_(data)(r_)[THTensor_(sliceOffset)(r_->size, r_->stride, r_->nDimension, dimension, s)] =
+        (real)THTensor_(logSumExpVector)(THTensor_(data)(t) +
+                                         THTensor_(sliceOffset)(t->size, t->stride, t->nDimension, dimension, s),
+                                         t->stride[dimension], NULL, 0, sliceSize);
+    return;
+  }
+
+  args.r = r_;
+  args.t = t;
+  args.dimension = dimension;
+  THParallel_for(0, nSlices, THMax(1, THThreadPool_getGrainSize()/sliceSize), THTensor_(logSumExpSlices), &args);
+}
+
+accreal THTensor_(logsumexpall)(THTensor *tensor)
+{
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
+  THTensor *t = THTensor_(newContiguous)(tensor);
+  accreal result = THTensor_(logSumExpVector)(THTensor_(data)(t), 1, NULL, 0, THTensor_(nElement)(t));
+  THTensor_(free)(t);
+  return result;
+}
+
+static void THTensor_(logmvKernel)(void *args_, long begin, long end)
+{
+  THTensor_(LogSumExpArgs) *args = (THTensor_(LogSumExpArgs)*)args_;
+  THTensor *mat = args->t, *r = args->r;
+  long i;
+  for(i = begin; i < end; i++)
+  {
+    THTensor_(LogSumExp) acc;
+    THTensor_(logSumExpInit)(&acc);
+    THTensor_(logSumExpRange)(&acc, THTensor_(data)(mat) + i*mat->stride[0], mat->stride[1],
+                              args->y, args->yStride, mat->size[1]);
+    THTensor_(data)(r)[i*r->stride[0]] = (real)THTensor_(logSumExpValue)(&acc);
+  }
+}
+
+void THTensor_(logmv)(THTensor *r_, THTensor *mat, THTensor *vec)
+{
+  TH_PROFILE_TENSOR_OP(r_, mat, vec);
+  THTensor_(LogSumExpArgs) args;
+  THTensor *r__;
+
+  if( (mat->nDimension != 2) || (vec->nDimension != 1) )
+    THError("matrix and vector expected, got %dD, %dD", mat->nDimension, vec->nDimension);
+  if( mat->size[1] != vec->size[0] )
+    THError("size mismatch, %ld, %ld", mat->size[1], vec->size[0]);
+
+  /* the result must not overwrite an operand while it is read */
+  if(r_->storage && (r_->storage == mat->storage || r_->storage == vec->storage))
+    r__ = THTensor_(newWithSize1d)(mat->size[0]);
+  else
+  {
+    THTensor_(resize1d)(r_, mat->size[0]);
+    r__ = r_;
+  }
+
+  args.r = r__;
+  args.t = mat;
+  args.y = THTensor_(data)(vec);
+  args.yStride = vec->stride[0];
+  if(mat->size[0] < THThreadPool_getNumThreads() && mat->size[1] > THThreadPool_getGrainSize())
+  {
+    long i;
+    for(i = 0; i < mat->size[0]; i++)
+      THTensor_(data)(r__)[i*r__->stride[0]] =
+        (real)THTensor_(logSumExpVector)(THTensor_(data)(mat) + i*mat->stride[0], mat->stride[1],
+                                         args.y, args.yStride, mat->size[1]);
+  }
+  else
+    THParallel_for(0, mat->size[0], THMax(1, THThreadPool_getGrainSize()/THMax(mat->size[1], 1)),
+                   THTensor_(logmvKernel), &args);
+
+  if(r__ != r_)
+  {
+    THTensor_(resize1d)(r_, mat->size[0]);
+    THTensor_(freeCopyTo)(r__, r_);
+  }
+}
+
+/* log(exp(a) + exp(b)); equal infinities are returned as is */
+TH_TENSOR_BINARY_ROW_KERNEL(logaddexpRow,
+                            a == b ? a + (real)log(2.0) :
+                            (a > b ? a : b) + log1p(exp(-fabs(a - b))))
+
+void THTensor_(logaddexp)(THTensor *r_, THTensor *a, THTensor *b)
+{
+  TH_PROFILE_TENSOR_OP(r_, a, b);
+  if (THTensor_(nElement)(a) != THTensor_(nElement)(b)) {
+    THTensor_(broadcastApply)(r_, a, b, 0, THTensor_(logaddexpRow));
+    return;
+  }
+  THTensor_(resizeAs)(r_, a);
+  if (THTensor_(isSameSizeAs)(a, b)) {
+    THTensor_(rowApply)(r_, a, b, 0, THTensor_(logaddexpRow));
+  } else {
+    TH_TENSOR_APPLY3(real, r_, real, a, real, b,
+                     real x = *a_data;
+                     real y = *b_data;
+                     *r__data = (x == y ? x + (real)log(2.0) : (x > y ? x : y) + log1p(exp(-fabs(x - y)))););
+  }
+}
+
 void THTensor_(mean)(THTensor *r_, THTensor *t, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THLongStorage *dim;
 
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 2, "invalid dimension %d",
@@ -2202,6 +4782,7 @@ void THTensor_(mean)(THTensor *r_, THTensor *t, int dimension)
 
 void THTensor_(std)(THTensor *r_, THTensor *t, int dimension, int flag)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THLongStorage *dim;
 
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 3, "invalid dimension %d",
@@ -2243,6 +4824,7 @@ void THTensor_(std)(THTensor *r_, THTensor *t, int dimension, int flag)
 
 void THTensor_(var)(THTensor *r_, THTensor *t, int dimension, int flag)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
   THLongStorage *dim;
 
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 3, "invalid dimension %d",
@@ -2282,9 +4864,180 @@ void THTensor_(var)(THTensor *r_, THTensor *t, int dimension, int flag)
                        });
 }
 
+/*
+  p-norms of x - y (y may be NULL): sum of |d|^p, max |d| for p = inf, or
+  the number of non-zeros for p = 0, before the root taken by normRoot.
+  p = 1, 2 and inf have their own loops, small integer p multiplies instead
+  of calling pow; unit stride operands are summed in TH_NORM_LANES
+  independent lanes.
+*/
+#define TH_NORM_LANES 8
+
+#ifndef TH_NORM_ADD
+#define TH_NORM_ADD(A, B) ((A) + (B))
+#define TH_NORM_MAX(A, B) ((B) > (A) || (B) != (B) ? (B) : (A))
+#endif
+
+#define TH_NORM_LOOP(TERM, OP)                                          \
+  if(!y)                                                                \
+  {                                                                     \
+    if(xStride == 1)                                                    \
+      for(; i + TH_NORM_LANES <= n; i += TH_NORM_LANES)                 \
+        for(l = 0; l < TH_NORM_LANES; l++)                              \
+        {                                                               \
+          accreal d = x[i+l];                                           \
+          acc[l] = OP(acc[l], TERM);                                    \
+        }                                                               \
+    for(; i < n; i++)                                                   \
+    {                                                                   \
+      accreal d = x[i*xStride];                                         \
+      sum = OP(sum, TERM);                                              \
+    }                                                                   \
+  }                                                                     \
+  else                                                                  \
+  {                                                                     \
+    if(xStride == 1 && yStride == 1)                                    \
+      for(; i + TH_NORM_LANES <= n; i += TH_NORM_LANES)                 \
+        for(l = 0; l < TH_NORM_LANES; l++)                              \
+        {                                                               \
+          accreal d = (accreal)x[i+l] - y[i+l];                         \
+          acc[l] = OP(acc[l], TERM);                                    \
+        }                                                               \
+    for(; i < n; i++)                                                   \
+    {                                                                   \
+      accreal d = (accreal)x[i*xStride] - y[i*yStride];                 \
+      sum = OP(sum, TERM);                                              \
+    }                                                                   \
+  }                                                                     \
+  for(l = 0; l < TH_NORM_LANES; l++)                                    \
+    sum = OP(sum, acc[l]);
+
+static accreal THTensor_(normIntPow)(accreal a, int p)
+{
+  accreal r = a;
+  while(--p > 0)
+    r *= a;
+  return r;
+}
+
+static accreal THTensor_(normRange)(const real *x, long xStride, const real *y, long yStride, long n, real p)
+{
+  accreal acc[TH_NORM_LANES];
+  accreal sum = 0;
+  long i = 0;
+  int l;
+
+  for(l = 0; l < TH_NORM_LANES; l++)
+    acc[l] = 0;
+
+  if(p == 1)
+  {
+    TH_NORM_LOOP(fabs(d), TH_NORM_ADD)
+  }
+  else if(p == 2)
+  {
+    TH_NORM_LOOP(d*d, TH_NORM_ADD)
+  }
+  else if(p == INFINITY)
+  {
+    TH_NORM_LOOP(fabs(d), TH_NORM_MAX)
+  }
+  else if(p == 0)
+  {
+    TH_NORM_LOOP((d != 0), TH_NORM_ADD)
+  }
+  else if(p > 2 && p <= 16 && p == (int)p)
+  {
+    int ip = (int)p;
+    TH_NORM_LOOP(THTensor_(normIntPow)(fabs(d), ip), TH_NORM_ADD)
+  }
+  else
+  {
+    TH_NORM_LOOP(pow(fabs(d), p), TH_NORM_ADD)
+  }
+  return sum;
+}
+
+#undef TH_NORM_LOOP
+
+static accreal THTensor_(normRoot)(accreal sum, real p)
+{
+  if(p == 0 || p == 1 || p == INFINITY)
+    return sum;
+  if(p == 2)
+    return sqrt(sum);
+  return pow(sum, 1.0/p);
+}
+
+typedef struct THTensor_(NormArgs)
+{
+  real p;
+  const real *x;
+  long xStride;
+  const real *y;
+  long yStride;
+  THTensor *r;          /* norm: slices of t along dimension */
+  THTensor *t;
+  int dimension;
+  real *rp;             /* renorm: contiguous rows */
+  long outer;
+  long inner;
+  long n;
+  real maxnorm;
+} THTensor_(NormArgs);
+
+static void THTensor_(normReduce)(void *args_, long begin, long end, void *partial)
+{
+  THTensor_(NormArgs) *args = (THTensor_(NormArgs)*)args_;
+  accreal sum = THTensor_(normRange)(args->x + begin*args->xStride, args->xStride,
+                                     (args->y ? args->y + begin*args->yStride : NULL), args->yStride,
+                                     end - begin, args->p);
+  *(accreal*)partial = (args->p == INFINITY ? TH_NORM_MAX(*(accreal*)partial, sum) : *(accreal*)partial + sum);
+}
+
+static void THTensor_(normCombine)(void *args_, void *result, const void *partial)
+{
+  THTensor_(NormArgs) *args = (THTensor_(NormArgs)*)args_;
+  accreal sum = *(const accreal*)partial;
+  *(accreal*)result = (args->p == INFINITY ? TH_NORM_MAX(*(accreal*)result, sum) : *(accreal*)result + sum);
+}
+
+/* norm of x - y before the root, split over the pool when n is large */
+static accreal THTensor_(normVector)(const real *x, long xStride, const real *y, long yStride, long n, real p)
+{
+  THTensor_(NormArgs) args;
+  accreal sum = 0;
+  args.p = p;
+  args.x = x;
+  args.xStride = xStride;
+  args.y = y;
+  args.yStride = yStride;
+  THParallel_reduce(0, n, 0, THTensor_(normReduce), THTensor_(normCombine), &args, &sum, sizeof(accreal));
+  return sum;
+}
+
+static void THTensor_(normSlices)(void *args_, long begin, long end)
+{
+  THTensor_(NormArgs) *args = (THTensor_(NormArgs)*)args_;
+  THTensor *t = args->t, *r = args->r;
+  int dimension = args->dimension;
+  long s;
+  for(s = begin; s < end; s++)
+  {
+    accreal sum = THTensor_(normRange)(THTensor_(data)(t) +
+                                       THTensor_(sliceOffset)(t->size, t->stride, t->nDimension, dimension, s),
+                                       t->stride[dimension], NULL, 0, t->size[dimension], args->p);
+    THTensor_(data)(r)[THTensor_(sliceOffset)(r->size, r->stride, r->nDimension, dimension, s)] =
+      (real)THTensor_(normRoot)(sum, args->p);
+  }
+}
+
 void THTensor_(norm)(THTensor *r_, THTensor *t, real value, int dimension)
 {
+  TH_PROFILE_TENSOR_OP(r_, t, NULL);
+  THTensor_(NormArgs) args;
   THLongStorage *dim;
+  long nSlices, sliceSize;
 
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(t), 3, "invalid dimension %d",
       dimension+1);
@@ -2294,45 +5047,94 @@ void THTensor_(norm)(THTensor *r_, THTensor *t, real value, int dimension)
   THTensor_(resize)(r_, dim, NULL);
   THLongStorage_free(dim);
 
-  if(value == 0) {
-    TH_TENSOR_DIM_APPLY2(real, t, real, r_, dimension,
-                         accreal sum = 0;
-                         long i;
-                         for(i = 0; i < t_size; i++)
-                           sum += t_data[i*t_stride] != 0.0;
-                         *r__data = sum;)
-  } else {
-    TH_TENSOR_DIM_APPLY2(real, t, real, r_, dimension,
-                         accreal sum = 0;
-                         long i;
-                         for(i = 0; i < t_size; i++)
-                           sum += pow(fabs(t_data[i*t_stride]), value);
-                         *r__data = pow(sum, 1.0/value);)
+  sliceSize = t->size[dimension];
+  nSlices = THTensor_(nElement)(t)/sliceSize;
+
+  /* few long slices: each one is split over the pool instead */
+  if(nSlices < THThreadPool_getNumThreads() && sliceSize > THThreadPool_getGrainSize())
+  {
+    long s;
+    for(s = 0; s < nSlices; s++)
+    {
+      accreal sum = THTensor_(normVector)(THTensor_(data)(t) +
+                                          THTensor_(sliceOffset)(t->size, t->stride, t->nDimension, dimension, s),
+                                          t->stride[dimension], NULL, 0, sliceSize, value);
+      THTensor_(data)(r_)[THTensor_(sliceOffset)(r_->size, r_->stride, r_->nDimension, dimension, s)] =
+        (real)THTensor_(normRoot)(sum, value);
+    }
+    return;
   }
+
+  args.p = value;
+  args.r = r_;
+  args.t = t;
+  args.dimension = dimension;
+  THParallel_for(0, nSlices, THMax(1, THThreadPool_getGrainSize()/sliceSize), THTensor_(normSlices), &args);
 }
 
 accreal THTensor_(normall)(THTensor *tensor, real value)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   accreal sum = 0;
-  if(value == 0) {
-    TH_TENSOR_APPLY(real, tensor, sum += *tensor_data != 0.0;);
-    return sum;
-  } else if(value == 1) {
-    TH_TENSOR_APPLY(real, tensor, sum += fabs(*tensor_data););
-    return sum;
-  } else if(value == 2) {
-    TH_TENSOR_APPLY(real, tensor, accreal z = *tensor_data; sum += z*z;);
-    return sqrt(sum);
-  } else {
-    TH_TENSOR_APPLY(real, tensor, sum += pow(fabs(*tensor_data), value););
-    return pow(sum, 1.0/value);
+  if(THTensor_(isContiguous)(tensor))
+    sum = THTensor_(normVector)(THTensor_(data)(tensor), 1, NULL, 0, THTensor_(nElement)(tensor), value);
+  else
+    TH_TENSOR_APPLY(real, tensor,
+                    long sz = tensor_size - tensor_i;
+                    accreal part = THTensor_(normRange)(tensor_data, tensor_stride, NULL, 0, sz, value);
+                    sum = (value == INFINITY ? TH_NORM_MAX(sum, part) : sum + part);
+                    tensor_i += sz;
+                    tensor_data += sz*tensor_stride;
+                    break;);
+  return THTensor_(normRoot)(sum, value);
+}
+
+/* rows [begin, end) along dimension of a contiguous tensor: outer blocks of
+   inner elements; each row is rescaled in place of the copy while still in
+   cache */
+static void THTensor_(renormKernel)(void *args_, long begin, long end)
+{
+  THTensor_(NormArgs) *args = (THTensor_(NormArgs)*)args_;
+  long outer = args->outer, inner = args->inner, step = args->n*inner;
+  real p = args->p;
+  long i, o, k;
+
+  for(i = begin; i < end; i++)
+  {
+    const real *sp = args->x + i*inner;
+    real *rp = args->rp + i*inner;
+    accreal norm = 0;
+    real scale = 1;
+
+    for(o = 0; o < outer; o++)
+    {
+      accreal part = THTensor_(normRange)(sp + o*step, 1, NULL, 0, inner, p);
+      norm = (p == INFINITY ? TH_NORM_MAX(norm, part) : norm + part);
+    }
+    norm = THTensor_(normRoot)(norm, p);
+
+    if(norm > args->maxnorm)
+      scale = args->maxnorm / (norm + 1e-7);
+    if(scale != 1)
+    {
+      for(o = 0; o < outer; o++)
+        for(k = 0; k < inner; k++)
+          rp[o*step + k] = sp[o*step + k] * scale;
+    }
+    else if(rp != sp)
+    {
+      for(o = 0; o < outer; o++)
+        memcpy(rp + o*step, sp + o*step, sizeof(real)*inner);
+    }
   }
 }
 
 void THTensor_(renorm)(THTensor *res, THTensor *src, real value, int dimension, real maxnorm)
 {
-  int i;
-  THTensor *rowR, *rowS;
+  TH_PROFILE_TENSOR_OP(res, src, NULL);
+  THTensor_(NormArgs) args;
+  THTensor *src_, *res_;
+  int d;
 
   THArgCheck(dimension >= 0 && dimension < THTensor_(nDimension)(src), 3, "invalid dimension %d",
       dimension+1);
@@ -2340,61 +5142,60 @@ void THTensor_(renorm)(THTensor *res, THTensor *src, real value, int dimension,
   THArgCheck(THTensor_(nDimension)(src) > 1, 1, "need at least 2 dimensions, got %d dimensions",
       THTensor_(nDimension)(src));
 
-  rowR = THTensor_(new)();
-  rowS = THTensor_(new)();
-
   THTensor_(resizeAs)(res, src);
-
-  for (i=0; i<src->size[dimension]; i++)
-  {
-    real norm = 0;
-    real new_norm;
-
-    THTensor_(select)(rowS, src, dimension, i);
-    THTensor_(select)(rowR, res, dimension, i);
-    if (value == 1) {
-      TH_TENSOR_APPLY(real, rowS, norm += fabs(*rowS_data););
-    } else if (value == 2) {
-      TH_TENSOR_APPLY(real, rowS, accreal z = *rowS_data; norm += z*z;);
-    } else {
-      TH_TENSOR_APPLY(real, rowS, norm += pow(fabs(*rowS_data), value););
-    }
-
-    norm = pow(norm, 1/value);
-
-    if (norm > maxnorm)
-    {
-      new_norm = maxnorm / (norm + 1e-7);
-
-      TH_TENSOR_APPLY2(
-        real, rowR, real, rowS,
-        *rowR_data = (*rowS_data) * new_norm;
-      )
-    }
-    else
-      THTensor_(copy)(rowR, rowS);
-  }
-
-  THTensor_(free)(rowR);
-  THTensor_(free)(rowS);
+  src_ = THTensor_(newContiguous)(src);
+  res_ = THTensor_(newContiguous)(res);
+
+  args.p = value;
+  args.maxnorm = maxnorm;
+  args.x = THTensor_(data)(src_);
+  args.rp = THTensor_(data)(res_);
+  args.n = src_->size[dimension];
+  args.outer = 1;
+  args.inner = 1;
+  for(d = 0; d < dimension; d++)
+    args.outer *= src_->size[d];
+  for(d = dimension+1; d < src_->nDimension; d++)
+    args.inner *= src_->size[d];
+
+  THParallel_for(0, args.n, THMax(1, THThreadPool_getGrainSize()/THMax(args.outer*args.inner, 1)),
+                 THTensor_(renormKernel), &args);
+
+  THTensor_(free)(src_);
+  THTensor_(freeCopyTo)(res_, res);
 }
 
 accreal THTensor_(dist)(THTensor *tensor, THTensor *src, real value)
 {
-  real sum = 0;
-  TH_TENSOR_APPLY2(real, tensor, real, src,
-	sum += pow(fabs(*tensor_data - *src_data), value);)
-  return pow(sum, 1.0/value);
+  TH_PROFILE_TENSOR_OP(tensor, src, NULL);
+  accreal sum = 0;
+  if(THTensor_(isContiguous)(tensor) && THTensor_(isContiguous)(src) &&
+     THTensor_(nElement)(tensor) == THTensor_(nElement)(src))
+    sum = THTensor_(normVector)(THTensor_(data)(tensor), 1, THTensor_(data)(src), 1,
+                                THTensor_(nElement)(tensor), value);
+  else
+    TH_TENSOR_APPLY2(real, tensor, real, src,
+                     long sz = (tensor_size-tensor_i < src_size-src_i ? tensor_size-tensor_i : src_size-src_i);
+                     accreal part = THTensor_(normRange)(tensor_data, tensor_stride, src_data, src_stride, sz, value);
+                     sum = (value == INFINITY ? TH_NORM_MAX(sum, part) : sum + part);
+                     tensor_i += sz;
+                     src_i += sz;
+                     tensor_data += sz*tensor_stride;
+                     src_data += sz*src_stride;
+                     break;);
+  return THTensor_(normRoot)(sum, value);
 }
 
 accreal THTensor_(meanall)(THTensor *tensor)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   THArgCheck(tensor->nDimension > 0, 1, "empty Tensor");
   return THTensor_(sumall)(tensor)/THTensor_(nElement)(tensor);
 }
 
 accreal THTensor_(varall)(THTensor *tensor)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   accreal mean = THTensor_(meanall)(tensor);
   accreal sum = 0;
   TH_TENSOR_APPLY(real, tensor, sum += (*tensor_data - mean)*(*tensor_data - mean););
@@ -2404,11 +5205,13 @@ accreal THTensor_(varall)(THTensor *tensor)
 
 accreal THTensor_(stdall)(THTensor *tensor)
 {
+  TH_PROFILE_TENSOR_OP(tensor, NULL, NULL);
   return sqrt(THTensor_(varall)(tensor));
 }
 
 void THTensor_(linspace)(THTensor *r_, real a, real b, long n)
 {
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
   real i = 0;
 
   THArgCheck(n > 1 || (n == 1 && (a == b)), 3, "invalid number of points");
@@ -2432,6 +5235,7 @@ void THTensor_(linspace)(THTensor *r_, real a, real b, long n)
 
 void THTensor_(logspace)(THTensor *r_, real a, real b, long n)
 {
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
   real i = 0;
 
   THArgCheck(n > 1 || (n == 1 && (a == b)), 3, "invalid number of points");
@@ -2455,18 +5259,21 @@ void THTensor_(logspace)(THTensor *r_, real a, real b, long n)
 
 void THTensor_(rand)(THTensor *r_, THGenerator *_generator, THLongStorage *size)
 {
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
   THTensor_(resize)(r_, size, NULL);
   THTensor_(uniform)(r_, _generator, 0, 1);
 }
 
 void THTensor_(randn)(THTensor *r_, THGenerator *_generator, THLongStorage *size)
 {
+  TH_PROFILE_TENSOR_OP(r_, NULL, NULL);
   THTensor_(resize)(r_, size, NULL);
   THTensor_(normal)(r_, _generator, 0, 1);
 }
 
 void THTensor_(histc)(THTensor *hist, THTensor *tensor, long nbins, real minvalue, real maxvalue)
 {
+  TH_PROFILE_TENSOR_OP(hist, tensor, NULL);
   THTensor *clone;
   real minval;
   real maxval;
@@ -10,6 +10,8 @@ TH_API void THTensor_(zero)(THTensor *r_);
 TH_API void THTensor_(maskedFill)(THTensor *tensor, THByteTensor *mask, real value);
 TH_API void THTensor_(maskedCopy)(THTensor *tensor, THByteTensor *mask, THTensor* src);
 TH_API void THTensor_(maskedSelect)(THTensor *tensor, THTensor* src, THByteTensor *mask);
+TH_API void THTensor_(maskedFillBits)(THTensor *tensor, THBitMask *mask, real value);
+TH_API void THTensor_(maskedSelectBits)(THTensor *tensor, THTensor* src, THBitMask *mask);
 
 TH_API void THTensor_(nonzero)(THLongTensor *subscript, THTensor *tensor);
 
@@ -29,6 +31,26 @@ TH_API real THTensor_(maxall)(THTensor *t);
 TH_API accreal THTensor_(sumall)(THTensor *t);
 TH_API accreal THTensor_(prodall)(THTensor *t);
 
+/* how dot, sumall and meanall accumulate float and double tensors (integer
+   types always sum in accreal):
+   ACCREAL   in accreal, i.e. double for float tensors (the default)
+   PAIRWISE  in real, blocks of lane sums added pairwise: error growing
+             with log(n) rather than n, at the speed of a plain real sum
+   KAHAN     in real, compensated per lane: error independent of n, about
+             four times the additions of a plain sum
+   DEFAULT (per call only) takes the policy set by setAccumulation */
+#ifndef TH_ACCUMULATE_DEFAULT
+#define TH_ACCUMULATE_DEFAULT  -1
+#define TH_ACCUMULATE_ACCREAL   0
+#define TH_ACCUMULATE_PAIRWISE  1
+#define TH_ACCUMULATE_KAHAN     2
+#endif
+
+TH_API void THTensor_(setAccumulation)(int policy);
+TH_API int THTensor_(getAccumulation)(void);
+TH_API accreal THTensor_(dotWith)(THTensor *t, THTensor *src, int policy);
+TH_API accreal THTensor_(sumallWith)(THTensor *t, int policy);
+
 TH_API void THTensor_(neg)(THTensor *self, THTensor *src);
 TH_API void THTensor_(cinv)(THTensor *self, THTensor *src);
 
@@ -40,6 +62,10 @@ TH_API void THTensor_(fmod)(THTensor *r_, THTensor *t, real value);
 TH_API void THTensor_(remainder)(THTensor *r_, THTensor *t, real value);
 TH_API void THTensor_(clamp)(THTensor *r_, THTensor *t, real min_value, real max_value);
 
+/* when t and src hold different numbers of elements, they are broadcast:
+   sizes aligned on the last dimension, dimensions of size 1 or missing
+   repeated (no copy made), r_ resized to the broadcast size. This applies to
+   cadd, csub, cmul, cpow, cdiv, cfmod, cremainder, cmax and cmin. */
 TH_API void THTensor_(cadd)(THTensor *r_, THTensor *t, real value, THTensor *src);
 TH_API void THTensor_(csub)(THTensor *self, THTensor *src1, real value, THTensor *src2);
 TH_API void THTensor_(cmul)(THTensor *r_, THTensor *t, THTensor *src);
@@ -54,12 +80,42 @@ TH_API void THTensor_(addcdiv)(THTensor *r_, THTensor *t, real value, THTensor *
 TH_API void THTensor_(addmv)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *mat,  THTensor *vec);
 TH_API void THTensor_(addmm)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *mat1, THTensor *mat2);
 TH_API void THTensor_(addr)(THTensor *r_,  real beta, THTensor *t, real alpha, THTensor *vec1, THTensor *vec2);
+/* r_ = alpha*T*m (left) or alpha*m*T (!left), T the upper or lower triangle
+   (with the diagonal) of the square matrix a; the other half is not read */
+TH_API void THTensor_(trmm)(THTensor *r_, real alpha, THTensor *a, THTensor *m, int upper, int left);
+/* r_ = beta*t + alpha*m*m', computing only one half of the symmetric product */
+TH_API void THTensor_(addsyrk)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *m);
 
 TH_API void THTensor_(addbmm)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *batch1, THTensor *batch2);
 TH_API void THTensor_(baddbmm)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *batch1, THTensor *batch2);
 
 TH_API void THTensor_(match)(THTensor *r_, THTensor *m1, THTensor *m2, real gain);
 
+/* distances between the rows of m1 and m2 (flattened to N x dim): squared
+   euclidean, euclidean, L1 or cosine (1 - cos, 1 against a zero row). The
+   GEMM engine expands ||a-b||^2 = ||a||^2 + ||b||^2 - 2ab, which is fast but
+   inaccurate for close points; EXACT sums the differences. AUTO (default)
+   picks GEMM for float and double unless the rows are very short. L1 and
+   integer types always run EXACT. match is gain * L2SQ, and only takes the
+   GEMM engine if it was set explicitly. */
+#ifndef TH_DIST_L2SQ
+#define TH_DIST_L2SQ   0
+#define TH_DIST_L2     1
+#define TH_DIST_L1     2
+#define TH_DIST_COSINE 3
+
+#define TH_DIST_ENGINE_AUTO  0
+#define TH_DIST_ENGINE_EXACT 1
+#define TH_DIST_ENGINE_GEMM  2
+#endif
+
+TH_API void THTensor_(distSetEngine)(int engine);
+TH_API int THTensor_(distGetEngine)(void);
+TH_API void THTensor_(pairwiseDist)(THTensor *r_, THTensor *m1, THTensor *m2, int metric);
+/* the k nearest rows of m2 for each row of m1, nearest first, without
+   building the N1 x N2 distance matrix; 0-based indices */
+TH_API void THTensor_(knn)(THTensor *values_, THLongTensor *indices_, THTensor *m1, THTensor *m2, long k, int metric);
+
 TH_API long THTensor_(numel)(THTensor *t);
 TH_API void THTensor_(max)(THTensor *values_, THLongTensor *indices_, THTensor *t, int dimension);
 TH_API void THTensor_(min)(THTensor *values_, THLongTensor *indices_, THTensor *t, int dimension);
@@ -85,6 +141,10 @@ TH_API void THTensor_(diag)(THTensor *r_, THTensor *t, int k);
 TH_API void THTensor_(eye)(THTensor *r_, long n, long m);
 TH_API void THTensor_(range)(THTensor *r_, accreal xmin, accreal xmax, accreal step);
 TH_API void THTensor_(randperm)(THTensor *r_, THGenerator *_generator, long n);
+/* r_ = t with its slices along dimension in random order; in place if r_ == t */
+TH_API void THTensor_(shuffle)(THTensor *r_, THTensor *t, THGenerator *_generator, int dimension);
+/* k distinct indices of [0, n) in random order (reservoir sampling) */
+TH_API void THTensor_(randsample)(THTensor *r_, THGenerator *_generator, long n, long k);
 
 TH_API void THTensor_(reshape)(THTensor *r_, THTensor *t, THLongStorage *size);
 TH_API void THTensor_(sort)(THTensor *rt_, THLongTensor *ri_, THTensor *t, int dimension, int descendingOrder);
@@ -95,6 +155,8 @@ TH_API void THTensor_(cat)(THTensor *r_, THTensor *ta, THTensor *tb, int dimensi
 TH_API void THTensor_(catArray)(THTensor *result, THTensor **inputs, int numInputs, int dimension);
 
 TH_API int THTensor_(equal)(THTensor *ta, THTensor *tb);
+/* same sizes and |a - b| <= atol + rtol*|b| everywhere (NaNs are never close) */
+TH_API int THTensor_(allclose)(THTensor *ta, THTensor *tb, double rtol, double atol);
 
 TH_API void THTensor_(ltValue)(THByteTensor *r_, THTensor* t, real value);
 TH_API void THTensor_(leValue)(THByteTensor *r_, THTensor* t, real value);
@@ -124,6 +186,20 @@ TH_API void THTensor_(geTensorT)(THTensor *r_, THTensor *ta, THTensor *tb);
 TH_API void THTensor_(neTensorT)(THTensor *r_, THTensor *ta, THTensor *tb);
 TH_API void THTensor_(eqTensorT)(THTensor *r_, THTensor *ta, THTensor *tb);
 
+TH_API void THTensor_(ltValueMask)(THBitMask *r_, THTensor* t, real value);
+TH_API void THTensor_(leValueMask)(THBitMask *r_, THTensor* t, real value);
+TH_API void THTensor_(gtValueMask)(THBitMask *r_, THTensor* t, real value);
+TH_API void THTensor_(geValueMask)(THBitMask *r_, THTensor* t, real value);
+TH_API void THTensor_(neValueMask)(THBitMask *r_, THTensor* t, real value);
+TH_API void THTensor_(eqValueMask)(THBitMask *r_, THTensor* t, real value);
+
+TH_API void THTensor_(ltTensorMask)(THBitMask *r_, THTensor *ta, THTensor *tb);
+TH_API void THTensor_(leTensorMask)(THBitMask *r_, THTensor *ta, THTensor *tb);
+TH_API void THTensor_(gtTensorMask)(THBitMask *r_, THTensor *ta, THTensor *tb);
+TH_API void THTensor_(geTensorMask)(THBitMask *r_, THTensor *ta, THTensor *tb);
+TH_API void THTensor_(neTensorMask)(THBitMask *r_, THTensor *ta, THTensor *tb);
+TH_API void THTensor_(eqTensorMask)(THBitMask *r_, THTensor *ta, THTensor *tb);
+
 #if defined(TH_REAL_IS_INT) || defined(TH_REAL_IS_LONG)
 TH_API void THTensor_(abs)(THTensor *r_, THTensor *t);
 #endif
@@ -155,6 +231,14 @@ TH_API void THTensor_(abs)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(trunc)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(frac)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(lerp)(THTensor *r_, THTensor *a, THTensor *b, real weight);
+TH_API void THTensor_(logaddexp)(THTensor *r_, THTensor *a, THTensor *b);
+
+/* log(sum of exp) along dimension, over all elements, and of the rows of
+   mat + vec (log-space matrix-vector product), shifted by the max so that
+   nothing overflows */
+TH_API void THTensor_(logsumexp)(THTensor *r_, THTensor *t, int dimension);
+TH_API accreal THTensor_(logsumexpall)(THTensor *t);
+TH_API void THTensor_(logmv)(THTensor *r_, THTensor *mat, THTensor *vec);
 
 TH_API void THTensor_(mean)(THTensor *r_, THTensor *t, int dimension);
 TH_API void THTensor_(std)(THTensor *r_, THTensor *t, int dimension, int flag);
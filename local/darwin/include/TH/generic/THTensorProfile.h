@@ -0,0 +1,57 @@
+#ifndef TH_GENERIC_FILE
+#define TH_GENERIC_FILE "generic/THTensorProfile.h"
+#else
+
+/* state of an instrumented call, see TH_PROFILE_TENSOR_OP */
+typedef struct THTensor_(ProfileScope)
+{
+  const char *name; /* NULL when profiling is disabled */
+  double start;
+  THTensor *tensor[3];
+} THTensor_(ProfileScope);
+
+static TH_INLINE THTensor_(ProfileScope) THTensor_(profileBegin)(const char *name, THTensor *t1, THTensor *t2, THTensor *t3)
+{
+  THTensor_(ProfileScope) scope;
+  scope.name = NULL;
+  if(THProfile_isEnabled())
+  {
+    scope.name = name;
+    scope.tensor[0] = t1;
+    scope.tensor[1] = t2;
+    scope.tensor[2] = t3;
+    scope.start = THProfile_now();
+  }
+  return scope;
+}
+
+/* shapes and sizes are read on exit, once outputs have been resized */
+static TH_INLINE void THTensor_(profileEnd)(THTensor_(ProfileScope) *scope)
+{
+  THTensor *main = NULL;
+  long bytes = 0;
+  int i, j;
+
+  if(!scope->name)
+    return;
+
+  for(i = 0; i < 3; i++)
+  {
+    THTensor *t = scope->tensor[i];
+    int seen = 0;
+    if(!t)
+      continue;
+    for(j = 0; j < i; j++)
+      seen |= (scope->tensor[j] == t);
+    if(seen)
+      continue;
+    bytes += THTensor_(nElement)(t)*(long)sizeof(real);
+    if(!main)
+      main = t;
+  }
+
+  THProfile_record(scope->name, scope->start, THProfile_now(), bytes,
+                   (main ? main->nDimension : 0), (main ? main->size : NULL));
+}
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef TH_GENERIC_FILE
+#define TH_GENERIC_FILE "generic/THTensorStream.c"
+#else
+
+#define TH_STREAM_SUM 0
+#define TH_STREAM_MINMAX 1
+#define TH_STREAM_VAR 2
+#define TH_STREAM_HISTC 3
+
+typedef struct THTensor_(StreamArgs)
+{
+  THTensor *chunk[2];  /* views on the two read buffers */
+  int op;
+  long count;          /* elements reduced so far */
+  accreal sum;
+  real min;
+  real max;
+  accreal mean;
+  accreal m2;          /* sum of squared deviations from mean */
+  long *counts;        /* bins of histc, converted to real at the end */
+  long nbins;
+  real minvalue;
+  real maxvalue;
+} THTensor_(StreamArgs);
+
+static size_t THTensor_(streamRead)(THFile *file, void *data, size_t n)
+{
+  return TH_CONCAT_3(THFile_read,Real,Raw)(file, (real*)data, n);
+}
+
+/* must not raise (see THFile_stream): nothing is allocated here, the
+   histogram is binned into the counts streamHistc allocated beforehand */
+static int THTensor_(streamChunk)(void *args_, int buffer, long n)
+{
+  THTensor_(StreamArgs) *args = (THTensor_(StreamArgs)*)args_;
+  THTensor *chunk = args->chunk[buffer];
+
+  THTensor_(resize1d)(chunk, n);
+  switch(args->op)
+  {
+    case TH_STREAM_SUM:
+      args->sum += THTensor_(sumall)(chunk);
+      break;
+    case TH_STREAM_MINMAX:
+    {
+      real min = THTensor_(minall)(chunk);
+      real max = THTensor_(maxall)(chunk);
+      if(args->count == 0 || min < args->min)
+        args->min = min;
+      if(args->count == 0 || max > args->max)
+        args->max = max;
+      break;
+    }
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+    case TH_STREAM_VAR:
+    {
+      accreal mean = THTensor_(meanall)(chunk);
+      accreal m2 = (n > 1 ? THTensor_(varall)(chunk)*(n-1) : 0);
+      accreal delta = mean - args->mean;
+      long total = args->count + n;
+      args->mean += delta*n/total;
+      args->m2 += m2 + delta*delta*((accreal)args->count*n/total);
+      break;
+    }
+    case TH_STREAM_HISTC:
+    {
+      /* the bins of histc, same operations in the same order */
+      long *h = args->counts;
+      real *x = THTensor_(data)(chunk);
+      real range = args->maxvalue - args->minvalue;
+      real bins = (real)(args->nbins)-1e-6;
+      long i;
+      for(i = 0; i < n; i++)
+      {
+        real v = x[i] - args->minvalue;
+        v = v / range;
+        v = v * bins;
+        v = floor(v) + 1;
+        if(v <= args->nbins && v >= 1)
+          h[(int)v - 1] += 1;
+      }
+      break;
+    }
+#endif
+  }
+  args->count += n;
+  return 0;
+}
+
+/* streams the next n elements of file through op; returns their count */
+static long THTensor_(stream)(THTensor_(StreamArgs) *args, int op, THFile *file, long n, long chunkSize)
+{
+  THStorage *storage[2];
+  void *buffers[2];
+  long count;
+  int b;
+
+  if(chunkSize <= 0)
+    chunkSize = TH_STREAM_DEFAULT_CHUNK;
+  if(n >= 0)
+    chunkSize = THMax(1, THMin(chunkSize, n));
+
+  for(b = 0; b < 2; b++)
+  {
+    storage[b] = THStorage_(newWithSize)(chunkSize);
+    args->chunk[b] = THTensor_(newWithStorage1d)(storage[b], 0, chunkSize, 1);
+    buffers[b] = storage[b]->data;
+    THStorage_(free)(storage[b]);
+  }
+  args->op = op;
+  args->count = 0;
+  args->sum = 0;
+  args->mean = 0;
+  args->m2 = 0;
+
+  count = THFile_stream(file, n, chunkSize, buffers, THTensor_(streamRead), THTensor_(streamChunk), args);
+
+  THTensor_(free)(args->chunk[0]);
+  THTensor_(free)(args->chunk[1]);
+  return count;
+}
+
+accreal THTensor_(streamSumall)(THFile *file, long n, long chunkSize)
+{
+  THTensor_(StreamArgs) args;
+  THTensor_(stream)(&args, TH_STREAM_SUM, file, n, chunkSize);
+  return args.sum;
+}
+
+real THTensor_(streamMinall)(THFile *file, long n, long chunkSize)
+{
+  THTensor_(StreamArgs) args;
+  THArgCheck(THTensor_(stream)(&args, TH_STREAM_MINMAX, file, n, chunkSize) > 0, 1, "no element to reduce");
+  return args.min;
+}
+
+real THTensor_(streamMaxall)(THFile *file, long n, long chunkSize)
+{
+  THTensor_(StreamArgs) args;
+  THArgCheck(THTensor_(stream)(&args, TH_STREAM_MINMAX, file, n, chunkSize) > 0, 1, "no element to reduce");
+  return args.max;
+}
+
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+
+accreal THTensor_(streamMeanall)(THFile *file, long n, long chunkSize)
+{
+  THTensor_(StreamArgs) args;
+  long count = THTensor_(stream)(&args, TH_STREAM_SUM, file, n, chunkSize);
+  THArgCheck(count > 0, 1, "no element to reduce");
+  return args.sum/count;
+}
+
+accreal THTensor_(streamVarall)(THFile *file, long n, long chunkSize)
+{
+  THTensor_(StreamArgs) args;
+  long count = THTensor_(stream)(&args, TH_STREAM_VAR, file, n, chunkSize);
+  THArgCheck(count > 0, 1, "no element to reduce");
+  return args.m2/(count-1);
+}
+
+accreal THTensor_(streamStdall)(THFile *file, long n, long chunkSize)
+{
+  return sqrt(THTensor_(streamVarall)(file, n, chunkSize));
+}
+
+void THTensor_(streamHistc)(THTensor *hist, THFile *file, long n, long nbins,
+                            real minvalue, real maxvalue, long chunkSize)
+{
+  THTensor_(StreamArgs) args;
+  THTensor *h;
+  real *hdata;
+  long i;
+
+  if(minvalue == maxvalue)
+  {
+    size_t position = THFile_position(file);
+    long count = THTensor_(stream)(&args, TH_STREAM_MINMAX, file, n, chunkSize);
+    THFile_seek(file, position);
+    n = count;
+    minvalue = (count > 0 ? args.min : 0);
+    maxvalue = (count > 0 ? args.max : 0);
+  }
+  if(minvalue == maxvalue)
+  {
+    minvalue = minvalue - 1;
+    maxvalue = maxvalue + 1;
+  }
+
+  /* counted in long, a float bin would stop at 2^24 */
+  args.counts = THAlloc(sizeof(long)*nbins);
+  for(i = 0; i < nbins; i++)
+    args.counts[i] = 0;
+  args.nbins = nbins;
+  args.minvalue = minvalue;
+  args.maxvalue = maxvalue;
+  THTensor_(stream)(&args, TH_STREAM_HISTC, file, n, chunkSize);
+
+  THTensor_(resize1d)(hist, nbins);
+  h = THTensor_(newContiguous)(hist);
+  hdata = THTensor_(data)(h);
+  for(i = 0; i < nbins; i++)
+    hdata[i] = (real)args.counts[i];
+  THFree(args.counts);
+  THTensor_(freeCopyTo)(h, hist);
+}
+
+#endif
+
+#undef TH_STREAM_SUM
+#undef TH_STREAM_MINMAX
+#undef TH_STREAM_VAR
+#undef TH_STREAM_HISTC
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef TH_GENERIC_FILE
+#define TH_GENERIC_FILE "generic/THTensorStream.h"
+#else
+
+TH_API accreal THTensor_(streamSumall)(THFile *file, long n, long chunkSize);
+TH_API real THTensor_(streamMinall)(THFile *file, long n, long chunkSize);
+TH_API real THTensor_(streamMaxall)(THFile *file, long n, long chunkSize);
+
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+
+TH_API accreal THTensor_(streamMeanall)(THFile *file, long n, long chunkSize);
+/* unbiased; chunks are combined with the pairwise update of Chan et al. */
+TH_API accreal THTensor_(streamVarall)(THFile *file, long n, long chunkSize);
+TH_API accreal THTensor_(streamStdall)(THFile *file, long n, long chunkSize);
+/* as histc; minvalue == maxvalue takes the range from the data, which reads
+   the elements twice (the file must then support seek) */
+TH_API void THTensor_(streamHistc)(THTensor *hist, THFile *file, long n, long nbins,
+                                   real minvalue, real maxvalue, long chunkSize);
+
+#endif
+
+#endif